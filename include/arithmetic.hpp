@@ -0,0 +1,25 @@
+#pragma once
+
+#include "opcodes.hpp"
+#include "value.hpp"
+
+namespace kestrel {
+
+// Generic arithmetic and comparison, dispatching on the operand tags. The
+// interpreter executes Add..GreaterThan through this and the compiler folds
+// constants with it, so both agree on every result. Operands the operator
+// does not accept produce nil.
+Value arithmetic(Opcode opcode, const Value& left, const Value& right);
+
+// LessThan, GreaterThan and Equals as arithmetic() computes them, without
+// making a Value of the result; for the fused compare-and-branch opcodes.
+bool compare(Opcode opcode, const Value& left, const Value& right);
+
+// Negate and Not on a single operand.
+Value unary(Opcode opcode, const Value& value);
+
+// True if `arithmetic` would overflow int on these operands; compile-time
+// evaluation leaves such operations to the runtime.
+bool overflows(Opcode opcode, const Value& left, const Value& right);
+
+} // namespace kestrel
@@ -4,6 +4,8 @@
 #include <functional>
 #include <unordered_map>
 #include <map>
+#include <vector>
+#include <string>
 
 namespace kestrel {
 
@@ -33,9 +35,21 @@ public:
         constructor_ = m;
     }
 
+    // Plain instances are attribute bags: construction has no side effects
+    // beyond allocating the object, which lets the optimizer replace
+    // instances that never escape with locals.
+    void setPlain(bool plain) {
+        plain_ = plain;
+    }
+
+    bool isPlain() const {
+        return plain_;
+    }
+
 protected:
     std::map<std::string, Method> methods;
     Constructor constructor_; // TODO 
+    bool plain_ = false;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "function.hpp"
+#include "value.hpp"
+
+namespace kestrel {
+
+class Module;
+
+// The compiled code of a module, apart from any state of running it: the
+// bytecode and headers of its functions, its constants and its names.
+// Built once and never written afterwards, so any number of Runtimes on
+// any threads can instantiate the same unit at once.
+//
+// An instance is a Module that refers to the unit for all of these and
+// holds only its own globals and its own Function objects, each made on
+// first use with code that runs from the unit. A tenant that calls three
+// functions of a large script pays for three functions and its globals.
+class CodeUnit : public std::enable_shared_from_this<CodeUnit> {
+public:
+  // Takes over the code and tables of a compiled or loaded module, after
+  // compiling its lazy functions. Throws std::runtime_error if the module
+  // has globals other than functions, which are state, not code.
+  static std::shared_ptr<const CodeUnit> build(Module &&module);
+
+  // A module running this code, with no globals bound yet.
+  Module instantiate() const;
+
+  const std::vector<std::string> &names() const { return names_; }
+
+  // Constants as compiled, with nil where a constant is a function; see
+  // functionAt().
+  const std::vector<Value> &constants() const { return constants_; }
+
+  // Index of the function constant `index` is, -1 for any other constant.
+  int functionAt(int index) const { return constantFunctions_[index]; }
+
+  // Index of `name` in names(), of a constant equal to `value`, or of
+  // global `name` in globals(); -1 if there is none.
+  int nameIndex(const std::string &name) const;
+  int constantIndex(const Value &value) const;
+  int globalIndex(const std::string &name) const;
+
+  // Globals bound to functions, and the functions by index; 0 is the
+  // initializer.
+  const std::vector<std::pair<std::string, int>> &globals() const {
+    return globals_;
+  }
+  size_t functionCount() const { return functions_.size(); }
+
+  // A function of its own for an instance, running the code of function
+  // `index` in place; it runs against `home` unless that is nullptr.
+  std::shared_ptr<Function> makeFunction(int index, Module *home) const;
+
+  // Bytes of bytecode and of the tables, shared by every instance.
+  size_t codeSize() const;
+
+private:
+  CodeUnit() = default;
+
+  std::vector<std::shared_ptr<Function>> functions_;
+  std::vector<std::string> names_;
+  std::vector<Value> constants_;
+  std::vector<int> constantFunctions_;
+  std::vector<std::pair<std::string, int>> globals_;
+  std::unordered_map<std::string, int> nameIndex_;
+  std::unordered_multimap<size_t, int> constantIndex_;
+  std::unordered_map<std::string, int> globalIndex_;
+};
+
+} // namespace kestrel
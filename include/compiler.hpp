@@ -13,27 +13,56 @@ namespace kestrel {
 
 using namespace kestrel;
 
+struct Expression;
+struct FunctionStatement;
+class Arena;
+
 class Compiler {
 public:
 
   Compiler();
   ~Compiler();
 
-  Module compile(std::vector<std::shared_ptr<Statement>> &statemetns);
+  // `arena` holds the tree; nodes the compiler rewrites are allocated there
+  // too, so the whole tree can be dropped at once when this returns.
+  //
+  // The code is moved into the result, so a compiler compiles once. So are
+  // the tables of its own module. Compiled into one passed to setModule(),
+  // the result holds only the initializer, to run against that module.
+  Module compile(std::vector<Statement *> &statemetns, Arena &arena);
+
+  // Compiles a function body, which returns nil when it falls off the end.
+  // Names and constants go to module(), the code to the result.
+  Function compileFunction(std::vector<Statement *> &body, Arena &arena);
+
+  // Arena of the tree being compiled.
+  Arena &arena();
 
   InstructionArray &instructions();
 
-  std::shared_ptr<Module> module();
+  Module &module();
 
-  void setModule(std::shared_ptr<Module> module);
+  // Compiles into `module` instead of a module of the compiler's own: names,
+  // constants and globals are added to it in place. It must outlive the
+  // compiler.
+  void setModule(Module &module);
 
   // TODO move to codegen?
   void emitCode(Opcode code);
 
-  int emitIndex(int16_t index);
+  // Appends an operand of the instruction emitCode() began and returns its
+  // offset, for patchBranch().
+  int emitIndex(int index);
+
+  // Points the branch whose operand is at `operand` to offset `target`.
+  void patchBranch(int operand, int target);
 
   int putConstant(Value& v);
 
+  // Pushes a literal: integers inline, nil as LoadNil, anything else through
+  // the constant pool.
+  void emitConstant(const Value &value);
+
   int lookup(const std::string &name);
 
   // int defineVaraible(const std::string& name);
@@ -44,6 +73,15 @@ public:
 
   int maxSlots() const;
 
+  // First slot above the declared locals; code between statements may use
+  // the slots from here on as scratch.
+  int firstFreeSlot() const;
+
+  // Emits a call of `arity` arguments to the function bound to the global
+  // `name`, inlined when it is small enough (see Inliner). The inlined
+  // locals start at `firstSlot`.
+  void emitCall(int arity, const std::string &name, int firstSlot);
+
   void enterBlock();
 
   void exitBlock();
@@ -51,7 +89,35 @@ public:
 
   int nameIndex(const std::string& name);
 
+  // Static type of an expression in the body being compiled, Unknown if
+  // inference could not prove one.
+  ValueType typeOf(const Expression *expression) const;
+
+  // Stores the top of the stack into a local, unboxed if `type` allows.
+  void emitStore(int index, ValueType type);
+
+  // 0 compiles the tree as written, 1 (the default) folds constants and
+  // runs the peephole pass, 2 also optimizes function bodies in SSA form.
+  void setOptimizationLevel(int level);
+  int optimizationLevel() const;
+
+  // Number of threads compiling top-level function bodies, 1 (the default)
+  // compiles them in order as they are reached. See ParallelCompiler.
+  void setJobs(int jobs);
+  int jobs() const;
+
+  // Code compiled ahead for a top-level function, nullptr if there is none.
+  std::shared_ptr<Function> precompiled(const FunctionStatement *statement);
+
 private:
+  void emitStatements(std::vector<Statement *> &statemetns);
+
+  // Runs the peephole pass and moves the code out into a function.
+  Function finishCode();
+
+  // The code of finishCode() as the initializer of a module.
+  Module finish();
+
   struct Detail;
   std::unique_ptr<Detail> detail;
 };
@@ -13,6 +13,7 @@ namespace core {
 class Object {
 public:
     Value& getAttribute(const std::string& name);
+    void setAttribute(const std::string& name, const Value& value);
 
     void setClass(Class* cls) {
         this->cls = cls;
@@ -22,9 +23,13 @@ public:
         return this->cls;
     }
 
+    const std::map<std::string, Value>& attributes() const {
+        return attrs;
+    }
+
 private:
     // uint64_t id;
-    Class* cls;
+    Class* cls = nullptr;
     std::map<std::string, Value> attrs; // TODO
 };
 
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "value.hpp"
+
+namespace kestrel {
+
+class Class;
+class Function;
+class InstructionArray;
+
+enum class FeedbackKind : uint8_t {
+  Arithmetic = 0,
+  Compare,
+  Dispatch,
+  Call,
+  LoadGlobal,
+};
+
+enum class FeedbackState : uint8_t {
+  Uninitialized = 0,
+  Monomorphic,
+  Polymorphic,
+  Megamorphic,
+};
+
+// Bit set of observed ValueTypes, one bit per ValueType.
+using TypeSet = uint16_t;
+
+inline TypeSet typeBit(ValueType type) {
+  return static_cast<TypeSet>(1u << static_cast<unsigned>(type));
+}
+
+std::string toString(FeedbackKind kind);
+std::string toString(FeedbackState state);
+std::string typeSetToString(TypeSet types);
+
+// What the interpreter has seen at a single instruction.
+//
+// `left`/`right` hold operand types for arithmetic and compare sites, the
+// receiver type for Dispatch, the callee type for Call and the loaded value
+// type for LoadGlobal. Receiver classes and call targets are kept as plain
+// pointers; they are identity hints only and never dereferenced.
+struct FeedbackSlot {
+  static const int kMaxTargets = 4;
+
+  FeedbackKind kind = FeedbackKind::Arithmetic;
+  int pc = 0;
+  uint32_t count = 0;
+  TypeSet left = 0;
+  TypeSet right = 0;
+  int targetCount = 0;
+  bool megamorphic = false;
+  const void *targets[kMaxTargets] = {};
+
+  void recordOperands(const Value &lhs, const Value &rhs) {
+    count++;
+    left |= typeBit(lhs.type());
+    right |= typeBit(rhs.type());
+  }
+
+  void recordValue(const Value &value) {
+    count++;
+    left |= typeBit(value.type());
+  }
+
+  void recordTarget(const void *target) {
+    if (megamorphic || target == nullptr) {
+      return;
+    }
+    for (int i = 0; i < targetCount; i++) {
+      if (targets[i] == target) {
+        return;
+      }
+    }
+    if (targetCount == kMaxTargets) {
+      megamorphic = true;
+      return;
+    }
+    targets[targetCount++] = target;
+  }
+
+  FeedbackState state() const;
+  std::string toString() const;
+};
+
+// One slot per arithmetic, compare, Dispatch, Call and LoadGlobal site of a
+// function. Slots are laid out from the final bytecode the first time the
+// function runs, so the encoding carries no feedback operands.
+class FeedbackVector {
+public:
+  void build(InstructionArray &instructions);
+  bool built() const { return built_; }
+  void reset();
+
+  // Slot of the instruction starting at `pc`, or nullptr if it is not a site.
+  FeedbackSlot *slotAt(int pc) {
+    if (pc < 0 || pc >= (int)index_.size() || index_[pc] < 0) {
+      return nullptr;
+    }
+    return &slots_[index_[pc]];
+  }
+
+  int size() const { return (int)slots_.size(); }
+  FeedbackSlot &operator[](int i) { return slots_[i]; }
+  std::vector<FeedbackSlot> &slots() { return slots_; }
+
+  // Sites that have seen more than one operand type, class or target.
+  std::vector<FeedbackSlot *> polymorphicSites();
+
+private:
+  bool built_ = false;
+  std::vector<FeedbackSlot> slots_;
+  std::vector<int> index_; // pc -> slot, -1 for non sites;
+};
+
+} // namespace kestrel
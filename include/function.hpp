@@ -4,20 +4,29 @@
 #include <memory>
 
 #include "core/object.hpp"
+#include "feedback.hpp"
 #include "instruction_array.hpp"
+#include "specialization.hpp"
 #include "value.hpp"
 
 namespace kestrel {
 
+class Module;
+
 using ForeignFunction = std::function<Value(std::vector<Value> &args)>;
 
+// Fills in the code of a lazily compiled function, against the module the
+// function is called in.
+using LazyBody = std::function<void(Function &function, Module &module)>;
+
 enum FunctionType { Native = 0, Foreign = 1 };
 
 class Function : core::Object {
 public:
   Function();
   Function(ForeignFunction f);
-  Function(InstructionArray &instructions);
+  // Takes the code over; pass an rvalue unless a copy is wanted.
+  Function(InstructionArray instructions);
   ~Function();
 
   Function(const Function &other);
@@ -35,12 +44,53 @@ public:
 
   InstructionArray &instructions();
 
+  // Makes this a stub whose code `body` supplies on the first call.
+  void setLazyBody(LazyBody body);
+
+  // False for a stub whose body was not compiled yet.
+  bool isCompiled() const;
+
+  // Compiles the body of a stub; nothing to do for any other function.
+  void compile(Module &module);
+
+  // Module whose names and constants the code indexes into, nullptr for
+  // code run with the module it was compiled in. Functions of imported
+  // modules run against their own module, see ModuleLoader.
+  Module *module() const;
+  void setModule(Module *module);
+
   void setArity(size_t arity);
   int arity() const;
 
   int maxSlots() const;
   void setMaxSlots(int size);
 
+  // Bytecode size as emitted by the compiler, before the peephole pass.
+  size_t compiledSize() const;
+  void setCompiledSize(size_t size);
+
+  // Type feedback collected by the interpreter, laid out on first use.
+  FeedbackVector &feedback();
+
+  // Clones of this function specialized by argument types.
+  SpecializationTable &specializations();
+
+  // Optimized version of this script function, nullptr if there is none.
+  const std::shared_ptr<Function> &optimized() const;
+  void setOptimized(std::shared_ptr<Function> code, int eliminatedAllocations);
+  bool optimizationAttempted() const;
+  int eliminatedAllocations() const;
+
+  // A frozen function is shared with processes forked after it was frozen:
+  // it collects no feedback and is neither specialized nor optimized, as
+  // all of these write to it. See Heap::freeze.
+  void freeze();
+  bool frozen() const;
+
+  // Drops optimized and specialized code after one of its assumptions broke.
+  // Frames still running the old code keep it alive until they return.
+  void deoptimize();
+
 private:
   class Detail;
   std::unique_ptr<Detail> detail;
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "core/object.hpp"
+#include "function.hpp"
+
+namespace kestrel {
+
+class Module;
+
+// Allocator and collector for script objects, laid out for a prefork
+// server: a parent initializes the heap, freezes it and forks workers that
+// share its pages copy-on-write.
+//
+// Objects live in fixed-size cells of aligned blocks. Which cells are in use
+// and which were reached by a collection is kept in bitmaps beside the
+// blocks, so marking and sweeping write no object page. freeze() seals the
+// blocks allocated so far; nothing the runtime does by itself writes to them
+// afterwards:
+//
+//   - frozen blocks are never swept and their free cells never reused;
+//   - functions reachable from the module collect no feedback and are
+//     neither specialized nor optimized (see Function::freeze);
+//   - values stored in the module and in frozen objects hold their
+//     functions without a reference count, the heap owns them instead.
+//
+// Objects allocated after the freeze go to new blocks, which collect()
+// sweeps as usual. Pages of frozen objects the script itself assigns to are
+// copied, as with any write.
+class Heap {
+public:
+  static const size_t kBlockSize = 64 * 1024;
+
+  // The heap objects of this process are allocated from.
+  static Heap &current();
+
+  Heap();
+  Heap(const Heap &) = delete;
+  Heap &operator=(const Heap &) = delete;
+  ~Heap();
+
+  Object *allocate();
+
+  // Seals every block allocated so far and freezes the functions reachable
+  // from `module` and the modules it imports, compiling lazy ones first;
+  // throws what compiling one of them throws. A module imported but not
+  // used yet has nothing to freeze, it is loaded after the fork.
+  void freeze(Module &module);
+
+  bool isFrozen(const Object *object) const;
+
+  // Destroys the objects not reachable from the globals and constants of
+  // `module` and of the modules it imports and returns how many. Frozen objects are traced but never
+  // freed. Only call it between runs: values on an interpreter's stack are
+  // not roots.
+  size_t collect(Module &module);
+
+  size_t liveObjects() const { return live_; }
+  size_t blockCount() const { return blocks_.size(); }
+
+private:
+  struct Block;
+
+  Block *blockOf(const Object *object) const;
+
+  std::vector<std::unique_ptr<Block>> blocks_;
+  std::unordered_map<uintptr_t, Block *> blockIndex_; // by block address;
+  std::vector<Object *> free_;                        // in unfrozen blocks;
+  std::vector<std::shared_ptr<Function>> pinned_;     // frozen functions;
+  size_t live_ = 0;
+};
+
+} // namespace kestrel
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "module.hpp"
+
+namespace kestrel {
+
+// Binary image of a compiled Module, written once and mapped read-only by
+// every process that runs it. The bytecode of the initializer and of every
+// function is executed in place from the mapping, so processes running the
+// same image share its physical pages; only the constant pool, the name
+// table and the function headers are rebuilt on load.
+//
+// Layout, integers little-endian, every section 8-byte aligned:
+//
+//     header                 ; magic, version, source hash, offsets
+//     function records       ; the first one is the initializer
+//     constant records       ; functions refer to function records
+//     name records           ; the name table
+//     global records         ; globals bound to functions
+//     string bytes
+//     bytecode
+//
+// The header carries a hash of the source the image was compiled from and
+// the optimization level, so a stale image is recompiled, not run.
+class Image {
+public:
+  // 2: variable-width operands, 3: fused compare-and-branch opcodes;
+  static const uint32_t kVersion = 3;
+
+  // FNV-1a of `text`; images are keyed by the hash of their source.
+  static uint64_t contentHash(const std::string &text);
+
+  // Writes `module` to `path`, compiling any lazy function first. The file
+  // is replaced in one rename, processes still running the old image keep
+  // their mapping. Throws std::runtime_error if a value can't be stored.
+  static void write(Module &module, uint64_t sourceHash,
+                    int optimizationLevel, const std::string &path);
+
+  // Replaces the file at `path` with `bytes` in one rename, from a
+  // temporary file of a unique name in the same directory, so concurrent
+  // writers of one path never write into each other's file. Throws
+  // std::runtime_error if it can't.
+  static void replaceFile(const std::string &path, const std::string &bytes);
+
+  // Maps the image at `path`. Throws std::runtime_error if it can't be
+  // read or is not a well formed image of this version.
+  static Image map(const std::string &path);
+
+  // The image write() would store, kept in memory; for code shared within
+  // one process rather than across processes.
+  static Image build(Module &module, uint64_t sourceHash,
+                     int optimizationLevel);
+
+  Image(Image &&other) noexcept;
+  Image &operator=(Image &&other) noexcept;
+  ~Image();
+
+  uint64_t sourceHash() const;
+  int optimizationLevel() const;
+  size_t size() const;
+
+  // A module whose code runs from the mapping, which it keeps alive.
+  Module load() const;
+
+private:
+  Image();
+
+  struct Detail;
+  std::unique_ptr<Detail> detail;
+};
+
+} // namespace kestrel
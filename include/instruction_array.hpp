@@ -1,16 +1,60 @@
 #pragma once
 
 #include <cstdint>
+#include <cstring>
 #include <vector>
 #include <memory>
 
 namespace kestrel {
 
+// Read-only cursor over encoded bytecode. Operands are stored little endian
+// and read with memcpy, which compiles to a single unaligned load on the
+// little-endian targets we build for. A view does not own its bytes and is
+// invalidated by any write to the InstructionArray it came from.
+class BytecodeView {
+public:
+  BytecodeView() = default;
+  BytecodeView(const uint8_t* code, size_t size) : code_(code), size_(size) {}
+
+  uint8_t readByte(size_t index) const { return code_[index]; }
+  bool readBoolean(size_t index) const { return code_[index] != 0; }
+  int16_t readShort(size_t index) const { return read<int16_t>(index); }
+  int32_t readInt(size_t index) const { return read<int32_t>(index); }
+  int64_t readLong(size_t index) const { return read<int64_t>(index); }
+
+  // A signed operand of `width` bytes: 1, 2 or 4.
+  int readOperand(size_t index, int width) const {
+    if (width == 1) {
+      return (int8_t)code_[index];
+    }
+    return width == 2 ? readShort(index) : readInt(index);
+  }
+
+  const uint8_t* data() const { return code_; }
+  size_t size() const { return size_; }
+
+private:
+  template <typename T>
+  T read(size_t index) const {
+    T value;
+    std::memcpy(&value, code_ + index, sizeof(T));
+    return value;
+  }
+
+  const uint8_t* code_ = nullptr;
+  size_t size_ = 0;
+};
+
 class InstructionArrayDetail;
 
 class InstructionArray {
 public:
   InstructionArray();
+  // Refers to `size` bytes at `code` without copying them, as for code in a
+  // mapped image; `owner` keeps them alive. The first write or append copies
+  // the bytes over, so they are never written.
+  InstructionArray(const uint8_t* code, size_t size,
+                   std::shared_ptr<const void> owner);
   InstructionArray(const InstructionArray& other);
   InstructionArray(InstructionArray&& other) noexcept;
   InstructionArray& operator=(const InstructionArray& other);
@@ -29,6 +73,9 @@ public:
   size_t appendInt(int32_t value);
   size_t appendLong(int64_t value);
 
+  // A signed operand of `width` bytes: 1, 2 or 4; see readOperand().
+  size_t appendOperand(int value, int width);
+
   uint8_t readByte(size_t index) const;
   bool readBoolean(size_t index) const;
   int16_t readShort(size_t index) const;
@@ -37,6 +84,16 @@ public:
 
   size_t size() const;
 
+  // True while the bytes are the ones passed to the borrowing constructor.
+  bool borrowed() const;
+
+  BytecodeView view() const;
+
+  // Bytes copied from one array into another so far, by copies and by the
+  // first write to borrowed bytes, in every thread. Compiling and loading a
+  // module copy none.
+  static size_t copiedBytes();
+
 private:
   std::unique_ptr<InstructionArrayDetail> detail;
 };
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "instruction_array.hpp"
+#include "opcodes.hpp"
+
+namespace kestrel {
+
+struct Instruction {
+  Opcode opcode = Opcode::NoOP;
+  int operands[2] = {0, 0};
+  int id = -1;      // stable identity, survives inserts and removals;
+  int target = -1;  // id of the branch target, -1 for non branches;
+  int pc = -1;      // offset in the decoded array, -1 for new instructions;
+  bool removed = false;
+
+  bool isBranch() const {
+    bool when;
+    return opcode == Opcode::Branch || opcode == Opcode::BranchTrue ||
+           opcode == Opcode::BranchFalse ||
+           fusedCompare(opcode, when) != Opcode::NoOP;
+  }
+
+  // Values popped from and pushed onto the operand stack.
+  int pops() const;
+  int pushes() const;
+};
+
+// Decoded, editable form of an InstructionArray. Branches refer to their
+// target by instruction id, so instructions can be inserted, rewritten or
+// removed freely; encode() lays the code out again and recomputes every
+// branch offset. A removed instruction that is a branch target forwards the
+// branch to the next instruction that is kept.
+class InstructionList {
+public:
+  static InstructionList decode(const InstructionArray &instructions);
+
+  InstructionArray encode() const;
+
+  // Inserts a new instruction before position `index` and returns its id.
+  int insert(int index, Opcode opcode, int operand = 0);
+
+  // Position of the instruction with the given id, -1 if unknown.
+  int indexOf(int id) const;
+
+  // True if any kept branch targets the instruction with this id.
+  bool isTarget(int id) const;
+
+  // indexOf and isTarget walk the list; passes asking for every instruction
+  // take these once instead. Both go stale with the next insert or branch
+  // rewrite.
+  std::unordered_map<int, int> indices() const;
+  std::unordered_set<int> targets() const;
+
+  std::vector<Instruction> code;
+
+private:
+  int nextId_ = 0;
+};
+
+} // namespace kestrel
@@ -1,12 +1,14 @@
 #pragma once
 
 #include <unordered_map>
+#include <unordered_set>
 #include <memory>
 #include <string>
 #include <vector>
 
 #include "value.hpp"
 #include "function.hpp"
+#include "code_unit.hpp"
 
 #include "instruction_array.hpp"
 
@@ -14,40 +16,158 @@ namespace kestrel {
 
 class Module {
 public:
-  Value &getGlobal(const std::string &name) { return globals_[name]; }
+  Value &getGlobal(const std::string &name) {
+    if (pendingGlobals_ > 0) {
+      bindGlobal(name, true);
+    }
+    return globals_[name];
+  }
+
+  void setGlobal(const std::string &name, Value& v) {
+    if (pendingGlobals_ > 0) {
+      bindGlobal(name, false);
+    }
+    globals_[name] = v;
+    invalidate(name);
+  }
+
+  void setGlobal(const std::string &name, Value&& v) {
+    if (pendingGlobals_ > 0) {
+      bindGlobal(name, false);
+    }
+    globals_[name] = v;
+    invalidate(name);
+  }
+
+  // Unbinds `name`, which then does not fall back to the unit's binding.
+  void removeGlobal(const std::string &name) {
+    if (pendingGlobals_ > 0) {
+      bindGlobal(name, false);
+    }
+    globals_.erase(name);
+    invalidate(name);
+  }
 
-  void setGlobal(const std::string &name, Value& v) { globals_[name] = v; }
+  // Registers optimized code of `function` that assumes the binding of the
+  // global `name` does not change; rebinding it deoptimizes the function.
+  void addDependent(const std::string &name, std::weak_ptr<Function> function) {
+    dependents_[name].push_back(std::move(function));
+  }
 
-  void setGlobal(const std::string &name, Value&& v) { globals_[name] = v; }
+  void invalidate(const std::string &name) {
+    if (dependents_.empty()) {
+      return;
+    }
+    auto it = dependents_.find(name);
+    if (it == dependents_.end()) {
+      return;
+    }
+    std::vector<std::weak_ptr<Function>> functions = std::move(it->second);
+    dependents_.erase(it);
+    for (auto &function : functions) {
+      if (auto f = function.lock()) {
+        f->deoptimize();
+      }
+    }
+  }
 
+  // Constants and names are deduplicated through hash indexes keyed by type
+  // and value. The vectors stay public for appending: entries pushed behind
+  // the module's back are indexed on the next lookup, and a vector that
+  // shrank is indexed anew. Entries must not be replaced in place, the index
+  // would still find them under their old value; code that rebuilds the
+  // tables resets the indexes itself, as materialize() does.
   int putConstant(Value& value) { // TODO rename;
-    for (int i = 0; i < constants.size(); i++) {
-      if (constants[i] == value) {
-        return i;
+    if (unit_ != nullptr) {
+      int found = unit_->constantIndex(value);
+      if (found >= 0) {
+        return found;
       }
     }
-    int index = (int) constants.size();
+    syncConstants();
+    size_t hash = value.hash();
+    int found = -1;
+    auto range = constantIndex_.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+      // lowest index wins, as with the linear scan this replaced;
+      if ((found < 0 || it->second < found) &&
+          constants[it->second - unitConstants_] == value) {
+        found = it->second;
+      }
+    }
+    if (found >= 0) {
+      return found;
+    }
+    int index = (int) (unitConstants_ + constants.size());
     constants.push_back(value);
+    constantIndex_.emplace(hash, index);
+    indexedConstants_ = constants.size();
     return index;
   }
 
-  Value &getConstant(int index) { return constants[index]; }
+  const Value &getConstant(int index) {
+    if ((size_t) index >= unitConstants_) {
+      return constants[index - unitConstants_];
+    }
+    return unit_->functionAt(index) < 0 ? unit_->constants()[index]
+                                        : functionConstant(index);
+  }
+
+  const std::string &getName(int index) const {
+    return (size_t) index >= unitNames_ ? names[index - unitNames_]
+                                        : unit_->names()[index];
+  }
+
+  size_t constantCount() const { return unitConstants_ + constants.size(); }
+  size_t nameCount() const { return unitNames_ + names.size(); }
 
   bool hasGlobal(const std::string& name) {
+    if (pendingGlobals_ > 0) {
+      bindGlobal(name, true);
+    }
     return globals_.find(name) != globals_.end();
   }
 
   int nameIndex(const std::string& name) {
-    for (int i = 0; i < names.size(); i++) {
-      if (name == names[i]) {
-        return i;
+    if (unit_ != nullptr) {
+      int found = unit_->nameIndex(name);
+      if (found >= 0) {
+        return found;
       }
     }
+    syncNames();
+    auto it = nameIndex_.find(name);
+    if (it != nameIndex_.end()) {
+      return it->second;
+    }
+    int index = (int) (unitNames_ + names.size());
     names.push_back(name);
-    return names.size() - 1;
+    nameIndex_.emplace(name, index);
+    indexedNames_ = names.size();
+    return index;
   }
 
-  InstructionArray instructions;
+  // Code this module is an instance of, null for a module compiled in
+  // place. `constants` and `names` then hold only what was added to the
+  // instance, numbered on from the unit's; read them with getConstant()
+  // and getName().
+  const std::shared_ptr<const CodeUnit> &unit() const { return unit_; }
+
+  // Module the functions made from the unit run against; see
+  // Function::module().
+  void setHome(Module *home) { home_ = home; }
+
+  // Copies the unit's tables in and binds every global it leaves pending,
+  // for code that walks the tables whole. The functions still run their
+  // code from the unit.
+  void materialize();
+
+  // Takes in code compiled against `from`, a private module: appends its
+  // names and constants here, renumbers the operands of `functions` and of
+  // the functions among its constants and globals to match, and binds its
+  // globals here. `from` must not be used afterwards.
+  void merge(Module &from,
+             const std::vector<std::shared_ptr<Function>> &functions);
 
 public:
   // Value initializer;
@@ -55,6 +175,60 @@ public:
   std::vector<Value> constants;
   std::vector<std::string> names;
   std::unordered_map<std::string, Value> globals_;
+  std::unordered_map<std::string, std::vector<std::weak_ptr<Function>>>
+      dependents_;
+  // Names the module imports, so `name.f(x)` compiles to a call of the
+  // imported function rather than a method dispatch;
+  std::unordered_set<std::string> imports_;
+
+private:
+  void syncConstants() {
+    if (indexedConstants_ > constants.size()) {
+      constantIndex_.clear();
+      indexedConstants_ = 0;
+    }
+    for (; indexedConstants_ < constants.size(); indexedConstants_++) {
+      constantIndex_.emplace(constants[indexedConstants_].hash(),
+                             (int) (unitConstants_ + indexedConstants_));
+    }
+  }
+
+  void syncNames() {
+    if (indexedNames_ > names.size()) {
+      nameIndex_.clear();
+      indexedNames_ = 0;
+    }
+    for (; indexedNames_ < names.size(); indexedNames_++) {
+      // emplace keeps the first index of a name pushed twice;
+      nameIndex_.emplace(names[indexedNames_],
+                         (int) (unitNames_ + indexedNames_));
+    }
+  }
+
+  // Binds global `name` to its function in the unit, if it has one and it
+  // was not bound yet; `make` false only marks it bound, for a caller
+  // about to rebind it.
+  void bindGlobal(const std::string &name, bool make);
+  std::shared_ptr<Function> function(int index);
+  const Value &functionConstant(int index);
+
+  friend class CodeUnit;
+
+  std::shared_ptr<const CodeUnit> unit_;
+  Module *home_ = nullptr;
+  size_t unitConstants_ = 0;
+  size_t unitNames_ = 0;
+  // globals of the unit bound in this instance, the others are bound on
+  // first use; so are its functions;
+  std::vector<bool> boundGlobals_;
+  size_t pendingGlobals_ = 0;
+  std::unordered_map<int, std::shared_ptr<Function>> functions_;
+  std::unordered_map<int, Value> functionConstants_;
+
+  std::unordered_multimap<size_t, int> constantIndex_;
+  std::unordered_map<std::string, int> nameIndex_;
+  size_t indexedConstants_ = 0;
+  size_t indexedNames_ = 0;
 };
 
 } // namespace kestrel
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <cstdint>
 #include <map>
 #include <string>
 
+#include "instruction_array.hpp"
+
 namespace kestrel {
 
 enum class Opcode : uint8_t {
@@ -41,6 +44,65 @@ enum class Opcode : uint8_t {
   Return, // Exit from the current function and return the value on the top of
           // the stack.
 
+  Pop, // Discard the value on the top of the stack.
+
+  // Type-specialized forms, both operands are known to have the given type so
+  // no tag checks are needed.
+  AddInt,
+  SubtractInt,
+  MultiplyInt,
+  EqualsInt,
+  LessThanInt,
+  GreaterThanInt,
+
+  AddDouble,
+  SubtractDouble,
+  MultiplyDouble,
+  DivideDouble,
+  EqualsDouble,
+  LessThanDouble,
+  GreaterThanDouble,
+
+  AddString,
+
+  StoreGlobal, // Pop the top of the stack into a module global.
+  Negate,
+  Not,
+
+  // Locals the compiler proved to hold one type; stores write the payload
+  // into the slot in place instead of copying a boxed value.
+  LoadLocalInt,
+  LoadLocalDouble,
+  StoreInt,
+  StoreDouble,
+  StoreBoolean,
+
+  SetItem, // Set an attribute of an object, leaving the value on the stack.
+
+  // Guard in front of an inlined call: pushes whether the callee below the
+  // arguments is still the function the compiler inlined (a constant).
+  CheckCallee,
+
+  // Prefixes: the operands of the next instruction are 16 or 32 bits wide
+  // rather than 8.
+  Wide,
+  ExtraWide,
+
+  // LoadLocal of slots 0 to 3, without an operand.
+  LoadLocal0,
+  LoadLocal1,
+  LoadLocal2,
+  LoadLocal3,
+
+  // Compare and branch in one: pop both operands and branch when the
+  // comparison holds, or for the Not forms when it does not. No boolean is
+  // pushed.
+  BranchIfLess,
+  BranchIfNotLess,
+  BranchIfGreater,
+  BranchIfNotGreater,
+  BranchIfEqual,
+  BranchIfNotEqual,
 };
 
 inline std::string toString(Opcode code) {
@@ -58,18 +120,72 @@ inline std::string toString(Opcode code) {
       REGISTER_CODE(BranchTrue),
       REGISTER_CODE(BranchFalse),
 
+      REGISTER_CODE(Equals),
       REGISTER_CODE(LessThan),
       REGISTER_CODE(GreaterThan),
 
+      REGISTER_CODE(Duplicate),
       REGISTER_CODE(LoadBoolean),
       REGISTER_CODE(LoadInteger),
       REGISTER_CODE(LoadConstant),
+      REGISTER_CODE(LoadName),
+      REGISTER_CODE(LoadLocal),
       REGISTER_CODE(LoadGlobal),
       REGISTER_CODE(LoadGlobalFromPool), // TODO
       REGISTER_CODE(LoadNil),
+      REGISTER_CODE(Import),
+
+      REGISTER_CODE(GetItem),
+      REGISTER_CODE(Store),
 
       REGISTER_CODE(Call),
+      REGISTER_CODE(Dispatch),
       REGISTER_CODE(Return),
+      REGISTER_CODE(Pop),
+
+      REGISTER_CODE(AddInt),
+      REGISTER_CODE(SubtractInt),
+      REGISTER_CODE(MultiplyInt),
+      REGISTER_CODE(EqualsInt),
+      REGISTER_CODE(LessThanInt),
+      REGISTER_CODE(GreaterThanInt),
+
+      REGISTER_CODE(AddDouble),
+      REGISTER_CODE(SubtractDouble),
+      REGISTER_CODE(MultiplyDouble),
+      REGISTER_CODE(DivideDouble),
+      REGISTER_CODE(EqualsDouble),
+      REGISTER_CODE(LessThanDouble),
+      REGISTER_CODE(GreaterThanDouble),
+
+      REGISTER_CODE(AddString),
+
+      REGISTER_CODE(StoreGlobal),
+      REGISTER_CODE(Negate),
+      REGISTER_CODE(Not),
+
+      REGISTER_CODE(LoadLocalInt),
+      REGISTER_CODE(LoadLocalDouble),
+      REGISTER_CODE(StoreInt),
+      REGISTER_CODE(StoreDouble),
+      REGISTER_CODE(StoreBoolean),
+
+      REGISTER_CODE(SetItem),
+      REGISTER_CODE(CheckCallee),
+
+      REGISTER_CODE(Wide),
+      REGISTER_CODE(ExtraWide),
+      REGISTER_CODE(LoadLocal0),
+      REGISTER_CODE(LoadLocal1),
+      REGISTER_CODE(LoadLocal2),
+      REGISTER_CODE(LoadLocal3),
+
+      REGISTER_CODE(BranchIfLess),
+      REGISTER_CODE(BranchIfNotLess),
+      REGISTER_CODE(BranchIfGreater),
+      REGISTER_CODE(BranchIfNotGreater),
+      REGISTER_CODE(BranchIfEqual),
+      REGISTER_CODE(BranchIfNotEqual),
   };
 
 #undef REGISTER_CODE
@@ -79,4 +195,161 @@ inline std::string toString(Opcode code) {
   return "unknown";
 }
 
+// Number of operands following the opcode. Each is a signed byte, or 16 or
+// 32 bits after a Wide or ExtraWide prefix; branch offsets count from the
+// next instruction.
+inline int operandCount(Opcode code) {
+  switch (code) {
+  case Opcode::Branch:
+  case Opcode::BranchTrue:
+  case Opcode::BranchFalse:
+  case Opcode::BranchIfLess:
+  case Opcode::BranchIfNotLess:
+  case Opcode::BranchIfGreater:
+  case Opcode::BranchIfNotGreater:
+  case Opcode::BranchIfEqual:
+  case Opcode::BranchIfNotEqual:
+  case Opcode::LoadBoolean:
+  case Opcode::LoadInteger:
+  case Opcode::LoadConstant:
+  case Opcode::LoadName:
+  case Opcode::LoadLocal:
+  case Opcode::LoadGlobal:
+  case Opcode::LoadGlobalFromPool:
+  case Opcode::Import:
+  case Opcode::GetItem:
+  case Opcode::SetItem:
+  case Opcode::Store:
+  case Opcode::StoreGlobal:
+  case Opcode::LoadLocalInt:
+  case Opcode::LoadLocalDouble:
+  case Opcode::StoreInt:
+  case Opcode::StoreDouble:
+  case Opcode::StoreBoolean:
+  case Opcode::Call:
+    return 1;
+  case Opcode::Dispatch:
+    return 2; // name index, arity;
+  case Opcode::CheckCallee:
+    return 2; // arity, constant index;
+  default:
+    return 0;
+  }
+}
+
+// The fused branch taken when `compare` (LessThan, GreaterThan or Equals)
+// comes out `when`; NoOP for any other opcode.
+inline Opcode fusedBranch(Opcode compare, bool when) {
+  switch (compare) {
+  case Opcode::LessThan:
+    return when ? Opcode::BranchIfLess : Opcode::BranchIfNotLess;
+  case Opcode::GreaterThan:
+    return when ? Opcode::BranchIfGreater : Opcode::BranchIfNotGreater;
+  case Opcode::Equals:
+    return when ? Opcode::BranchIfEqual : Opcode::BranchIfNotEqual;
+  default:
+    return Opcode::NoOP;
+  }
+}
+
+// The comparison a fused branch makes, and in `when` the result it branches
+// on; NoOP for any other opcode.
+inline Opcode fusedCompare(Opcode branch, bool &when) {
+  when = branch == Opcode::BranchIfLess || branch == Opcode::BranchIfGreater ||
+         branch == Opcode::BranchIfEqual;
+  switch (branch) {
+  case Opcode::BranchIfLess:
+  case Opcode::BranchIfNotLess:
+    return Opcode::LessThan;
+  case Opcode::BranchIfGreater:
+  case Opcode::BranchIfNotGreater:
+    return Opcode::GreaterThan;
+  case Opcode::BranchIfEqual:
+  case Opcode::BranchIfNotEqual:
+    return Opcode::Equals;
+  default:
+    return Opcode::NoOP;
+  }
+}
+
+// The conditional branch taken exactly when `branch` is not; NoOP for any
+// other opcode.
+inline Opcode invertedBranch(Opcode branch) {
+  if (branch == Opcode::BranchTrue || branch == Opcode::BranchFalse) {
+    return branch == Opcode::BranchTrue ? Opcode::BranchFalse
+                                        : Opcode::BranchTrue;
+  }
+  bool when;
+  Opcode compare = fusedCompare(branch, when);
+  return fusedBranch(compare, !when);
+}
+
+// Bytes an operand of `value` needs: 1, 2 or 4.
+inline int operandWidth(int value) {
+  if (value >= INT8_MIN && value <= INT8_MAX) {
+    return 1;
+  }
+  return value >= INT16_MIN && value <= INT16_MAX ? 2 : 4;
+}
+
+// An instruction as decodeAt() reads it, short forms spelled out: a
+// LoadLocal0 is a LoadLocal of slot 0.
+struct DecodedInstruction {
+  Opcode opcode = Opcode::NoOP;
+  int operands[2] = {0, 0};
+  int width = 1;  // of each operand;
+  int length = 1; // of the whole instruction, prefix included;
+};
+
+inline DecodedInstruction decodeAt(const BytecodeView &code, size_t pc) {
+  DecodedInstruction decoded;
+  size_t at = pc;
+  decoded.opcode = static_cast<Opcode>(code.readByte(at++));
+  if (decoded.opcode == Opcode::Wide || decoded.opcode == Opcode::ExtraWide) {
+    decoded.width = decoded.opcode == Opcode::Wide ? 2 : 4;
+    decoded.opcode = static_cast<Opcode>(code.readByte(at++));
+  }
+  if (decoded.opcode >= Opcode::LoadLocal0 &&
+      decoded.opcode <= Opcode::LoadLocal3) {
+    decoded.operands[0] = (int)decoded.opcode - (int)Opcode::LoadLocal0;
+    decoded.opcode = Opcode::LoadLocal;
+    return decoded;
+  }
+  int count = operandCount(decoded.opcode);
+  for (int i = 0; i < count; i++) {
+    decoded.operands[i] = code.readOperand(at, decoded.width);
+    at += decoded.width;
+  }
+  decoded.length = (int)(at - pc);
+  return decoded;
+}
+
+// Operand holding an index into the module's name table, -1 if none.
+inline int nameOperand(Opcode code) {
+  switch (code) {
+  case Opcode::LoadName:
+  case Opcode::LoadGlobal:
+  case Opcode::StoreGlobal:
+  case Opcode::Import:
+  case Opcode::GetItem:
+  case Opcode::SetItem:
+  case Opcode::Dispatch:
+    return 0;
+  default:
+    return -1;
+  }
+}
+
+// Operand holding an index into the module's constant pool, -1 if none.
+inline int constantOperand(Opcode code) {
+  switch (code) {
+  case Opcode::LoadConstant:
+    return 0;
+  case Opcode::CheckCallee:
+    return 1;
+  default:
+    return -1;
+  }
+}
+
 } // namespace kestrel
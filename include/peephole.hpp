@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <unordered_map>
+
+#include "instruction_array.hpp"
+#include "instruction_list.hpp"
+
+namespace kestrel {
+
+// Local cleanups over a finished function's bytecode, repeated until none
+// applies:
+//
+//   - NoOPs and branches to the next instruction are dropped;
+//   - branches to a Branch go straight to its target (jump threading);
+//   - a conditional branch over a Branch takes the opposite condition to
+//     the Branch's target instead;
+//   - `Duplicate; Store s; Pop` becomes `Store s`, and `Store s; LoadLocal s`
+//     becomes `Duplicate; Store s` (load/store forwarding);
+//   - a side-effect free load followed by Pop is dropped;
+//   - instructions no path reaches are removed, such as the `LoadNil;
+//     Return` appended after an explicit return.
+//
+// Branch offsets are recomputed when the code is encoded again.
+class Peephole {
+public:
+  struct Report {
+    size_t before = 0;
+    size_t after = 0;
+  };
+
+  Report run(InstructionArray &instructions);
+
+private:
+  bool removeNoOPs();
+  bool threadJumps();
+  bool invertBranches();
+  bool forward();
+  bool removeDeadCode();
+
+  int next(int index) const;
+  int resolve(int id) const;
+
+  InstructionList list_;
+  // position of each id: the passes remove instructions but never insert
+  // any, so the positions hold for the whole run;
+  std::unordered_map<int, int> indices_;
+};
+
+} // namespace kestrel
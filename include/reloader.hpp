@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "module.hpp"
+#include "runtime/runtime.hpp"
+
+namespace kestrel {
+
+// Diffs a new version of a script against the one a running module was
+// compiled from, one top-level function at a time, and compiles only the
+// functions whose text changed into a Patch for Runtime::reload. Function
+// bodies of the new source are skipped, not parsed, unless they changed;
+// top-level statements are not run again.
+class Reloader {
+public:
+  explicit Reloader(int optimizationLevel = 1);
+  ~Reloader();
+
+  // Remembers `source` as the one the module was compiled from.
+  void track(const std::string &source);
+
+  // The functions of `source` that are new or differ from the tracked
+  // source, and the ones it dropped. `source` is tracked from then on.
+  // The functions are compiled against a module of the patch's own, which
+  // Runtime::reload merges into `module` when it applies the patch; `module`
+  // itself is only read for its imports, so the diff can be taken while it
+  // runs.
+  Patch diff(Module &module, const std::string &source);
+
+  // Functions the last diff() found changed and unchanged.
+  size_t changed() const;
+  size_t unchanged() const;
+
+private:
+  struct Detail;
+  std::unique_ptr<Detail> detail;
+};
+
+} // namespace kestrel
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "module.hpp"
+#include "runtime/snapshot.hpp"
+
+namespace kestrel {
+
+// Compiles the source of an imported module; the runtime does not depend
+// on the compiler, the embedder supplies one.
+using SourceCompiler = std::function<Module(const std::string &source)>;
+
+// Resolves `import name;` to a module of one Runtime.
+//
+// Importing only finds the file, `name.ks` in the first directory of the
+// search path that has one, and binds the name to an empty module. The
+// first access to one of its globals compiles it and runs its initializer,
+// so a module imported but never used costs a lookup.
+//
+// Compiled code is cached by the content hash of the source and the
+// optimization level: in memory for every Runtime of the process, as a
+// CodeUnit, and in the cache directory, if one is set, as an Image for
+// later processes. Each Runtime instantiates the unit with its own
+// globals, feedback and optimized code; code, constants and names are
+// shared.
+//
+// preload() trades the laziness for start-up time when most imports are
+// used: it walks the whole import graph up front and compiles it on a
+// pool of threads.
+class ModuleLoader {
+public:
+  explicit ModuleLoader(const HostRegistry &hosts);
+  ~ModuleLoader();
+
+  void addSearchPath(const std::string &directory);
+  void setCacheDirectory(const std::string &directory);
+  void setCompiler(SourceCompiler compile, int optimizationLevel);
+
+  // Path of the source of module `name`. Throws std::runtime_error if no
+  // directory of the search path has it.
+  std::string resolve(const std::string &name) const;
+
+  // Module `name`, the same one for every import of it. It is not loaded
+  // yet unless it was defined; see prepare().
+  Module *import(const std::string &name);
+
+  // Name `module` was imported or defined under, nullptr if it was not.
+  const std::string *nameOf(const Module *module) const;
+
+  // A module the embedder fills in, imported like any other.
+  Module &define(const std::string &name);
+
+  // Loads `module` on its first access and returns true, the caller then
+  // runs its initializer; false once it was loaded. Throws
+  // std::runtime_error if the source can't be read or compiled.
+  bool prepare(Module &module);
+
+  // Finds every module `source` imports, directly or not, by scanning
+  // only their import declarations, and reads and compiles them on `jobs`
+  // threads. Returns them dependencies first, the order to run their
+  // initializers in; prepare() then loads them without compiling. Throws
+  // std::runtime_error if one can't be found, read or compiled.
+  std::vector<Module *> preload(const std::string &source, int jobs);
+
+  // Names `source` imports, in order, without parsing the rest of it.
+  static std::vector<std::string> importsOf(const std::string &source);
+
+  size_t importedModules() const;
+  size_t loadedModules() const;
+
+  // Compiled modules shared by the loaders of this process.
+  static size_t cachedModules();
+
+private:
+  struct Detail;
+  std::unique_ptr<Detail> detail;
+};
+
+} // namespace kestrel
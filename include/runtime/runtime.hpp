@@ -2,20 +2,68 @@
 
 #include <string>
 #include <memory>
+#include <utility>
+#include <vector>
 #include "module.hpp"
 #include "value.hpp"
+#include "runtime/module_loader.hpp"
+#include "runtime/snapshot.hpp"
 
 namespace kestrel {
 
+// Changed functions to swap into a running module, see Runtime::reload.
+struct Patch {
+    // New and changed functions, by the global they are bound to;
+    std::vector<std::pair<std::string, std::shared_ptr<Function>>> functions;
+    // Functions the new source no longer has;
+    std::vector<std::string> removed;
+    // Module the functions were compiled against instead of the running
+    // one, merged into it when the patch is applied; null if they index
+    // into the running module already.
+    std::shared_ptr<Module> module;
+};
+
 class Runtime {
 public:
     Runtime();
     ~Runtime();
 
+    // A module scripts can import by `name`, filled in by the embedder.
     Module& defineModule(const std::string& name);
 
+    // Resolves the imports of the scripts this runtime runs.
+    ModuleLoader& modules();
+
+    // Compiles every module `source` imports on `jobs` threads and runs
+    // their initializers, dependencies first, instead of on first use.
+    void preload(const std::string& source, int jobs);
+
     Value run(Module& module, Function& function);
 
+    // Rebinds the functions of `patch` in `module`, all at once, at the
+    // next safepoint: now if nothing runs, else once the outermost run()
+    // returns, so no frame sees a mix of old and new functions. Code that
+    // depended on the old bindings is deoptimized and inlined copies of
+    // them are bypassed by their guards. Other globals keep their values.
+    // May be called from another thread than the one running the module.
+    //
+    // The only safepoint is the return of the outermost run(): a script
+    // that never returns, a request loop written in script say, never sees
+    // a patch. Serve each request with its own run() to reload between
+    // them.
+    void reload(Module& module, Patch patch);
+
+    // Host functions and classes, which snapshots refer to by name.
+    HostRegistry& hosts();
+
+    // Saves `module` once its initializer ran, see Snapshot.
+    void snapshot(Module& module, uint64_t sourceHash, const std::string& path);
+
+    // A module as saved by snapshot(), to use instead of running the
+    // initializer again; the same hosts must be registered. Throws
+    // std::runtime_error if there is no usable snapshot at `path`.
+    Module restore(const std::string& path, uint64_t sourceHash);
+
 private:
     struct Detail;
     std::unique_ptr<Detail> detail;
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+#include "module.hpp"
+#include "value.hpp"
+
+namespace kestrel {
+
+class ModuleLoader;
+
+// Foreign functions and classes the embedder defines. A snapshot can't hold
+// host code, so it refers to these by the name they are registered under;
+// the process restoring it registers the same names, possibly bound to
+// other instances.
+class HostRegistry {
+public:
+  // `value` is a foreign function or a class.
+  void add(const std::string &name, const Value &value);
+
+  // Name `value` is registered under, nullptr if it is not.
+  const std::string *nameOf(const Value &value) const;
+
+  // Value registered under `name`, nullptr if there is none.
+  const Value *find(const std::string &name) const;
+
+  const std::unordered_map<std::string, Value> &values() const {
+    return values_;
+  }
+
+private:
+  std::unordered_map<std::string, Value> values_;
+  std::unordered_map<const void *, std::string> names_; // by Function/Class;
+};
+
+// Heap snapshot of a module whose initializer has run: its globals, every
+// object reachable from them, its constants and names, and the code of its
+// script functions. Objects and functions keep their identity, shared and
+// cyclic references included; feedback and optimized code are left out and
+// collected again after the restore. Imported modules are stored by name
+// and imported again on restore, their initializers run on first use.
+class Snapshot {
+public:
+  // 2: variable-width operands, 3: fused compare-and-branch opcodes;
+  static const uint32_t kVersion = 3;
+
+  // Compiles any lazy function still reachable first. Throws
+  // std::runtime_error for a host value that is not registered.
+  static void write(Module &module, const HostRegistry &hosts,
+                    uint64_t sourceHash, const std::string &path,
+                    const ModuleLoader *modules = nullptr);
+
+  // Throws std::runtime_error if the snapshot is missing, was taken from
+  // another source than `sourceHash`, is malformed or names a host value
+  // that is not registered.
+  static Module restore(const std::string &path, const HostRegistry &hosts,
+                        uint64_t sourceHash, ModuleLoader *modules = nullptr);
+};
+
+} // namespace kestrel
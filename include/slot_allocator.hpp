@@ -0,0 +1,32 @@
+#pragma once
+
+#include "instruction_array.hpp"
+#include "instruction_list.hpp"
+
+namespace kestrel {
+
+// Renumbers the local slots of a finished function so that slots whose
+// values are never live at the same time share one frame entry. Liveness
+// is computed backwards over the decoded code; two slots interfere when
+// one is stored while the other is live, and slots are then colored
+// greedily in order of first appearance.
+//
+// The first `pinned` slots (the parameters the caller fills in) and any
+// slot read before it is written keep their number, since their initial
+// contents come from outside the code.
+class SlotAllocator {
+public:
+  // Functions with more instructions times slots than this keep their
+  // numbering.
+  static const long long kMaxCells = 1 << 24;
+
+  explicit SlotAllocator(int pinned) : pinned_(pinned) {}
+
+  // Rewrites `instructions` in place and returns the frame size needed.
+  int run(InstructionArray &instructions);
+
+private:
+  int pinned_;
+};
+
+} // namespace kestrel
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "value.hpp"
+
+namespace kestrel {
+
+class Function;
+
+// Argument types of a call packed into one word: the arity in the top four
+// bits and one ValueType per nibble below it, so a call without arguments
+// has signature 0. Calls with more than kMaxSignatureArity arguments get
+// kNoSignature, which no arity reaches and which is never specialized.
+using TypeSignature = uint32_t;
+
+static const int kMaxSignatureArity = 7;
+static const TypeSignature kNoSignature = 0xffffffff;
+
+template <typename Args>
+inline TypeSignature signatureOf(Args &args, int first, int arity) {
+  if (arity > kMaxSignatureArity) {
+    return kNoSignature;
+  }
+  TypeSignature signature = static_cast<TypeSignature>(arity) << 28;
+  for (int i = 0; i < arity; i++) {
+    signature |= static_cast<TypeSignature>(args[first + i].type()) << (4 * i);
+  }
+  return signature;
+}
+
+std::vector<ValueType> signatureTypes(TypeSignature signature);
+std::string signatureToString(const std::string &name,
+                              TypeSignature signature);
+
+struct Specialization {
+  TypeSignature signature = 0;
+  std::shared_ptr<Function> function;
+  uint64_t hits = 0;
+};
+
+// Clones of a script function specialized for the argument types it was
+// called with. A signature becomes a candidate once it has been seen
+// kHotCalls times; at most kMaxClones clones are kept per function.
+class SpecializationTable {
+public:
+  static const int kMaxClones = 4;
+  static const int kHotCalls = 8;
+
+  std::shared_ptr<Function> lookup(TypeSignature signature) {
+    // most functions see one signature: the answer for the last one, clone
+    // or none, costs a single compare;
+    if (signature != lastSignature_) {
+      lastSignature_ = signature;
+      last_ = -1;
+      for (size_t i = 0; i < clones_.size(); i++) {
+        if (clones_[i].signature == signature) {
+          last_ = (int)i;
+          break;
+        }
+      }
+    }
+    if (last_ < 0) {
+      generic_++;
+      return nullptr;
+    }
+    clones_[last_].hits++;
+    return clones_[last_].function;
+  }
+
+  // Counts a generic call and returns true exactly once, when `signature`
+  // turns hot while there is still room for another clone.
+  bool shouldSpecialize(TypeSignature signature);
+
+  void add(TypeSignature signature, std::shared_ptr<Function> function);
+
+  // Drops every clone and starts over.
+  void clear();
+
+  std::vector<Specialization> &clones() { return clones_; }
+  uint64_t genericCalls() const { return generic_; }
+  uint64_t specializedCalls() const;
+  double hitRate() const;
+
+  std::string report(const std::string &name) const;
+
+private:
+  std::vector<Specialization> clones_;
+  std::vector<std::pair<TypeSignature, int>> counts_;
+  uint64_t generic_ = 0;
+  // signature of the last lookup and the clone it found, -1 for none;
+  TypeSignature lastSignature_ = kNoSignature;
+  int last_ = -1;
+};
+
+} // namespace kestrel
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "opcodes.hpp"
+#include "value.hpp"
+
+namespace kestrel {
+
+// Typing rules shared by the compiler's type inference and the runtime
+// specializer. Unknown means "any type" and never yields a typed opcode.
+
+inline bool isNumberType(ValueType type) {
+  return type == ValueType::Integer || type == ValueType::Double;
+}
+
+// Result type of Add, Subtract or Multiply on two numbers.
+inline ValueType numberResult(ValueType left, ValueType right) {
+  if (left == ValueType::Integer && right == ValueType::Integer) {
+    return ValueType::Integer;
+  }
+  if (isNumberType(left) && isNumberType(right)) {
+    return ValueType::Double;
+  }
+  return ValueType::Unknown;
+}
+
+// Result type of a generic arithmetic or compare instruction.
+inline ValueType resultType(Opcode code, ValueType left, ValueType right) {
+  switch (code) {
+  case Opcode::Equals:
+  case Opcode::LessThan:
+  case Opcode::GreaterThan:
+    return ValueType::Boolean;
+  case Opcode::Add:
+    if (left == ValueType::String && right == ValueType::String) {
+      return ValueType::String;
+    }
+    return numberResult(left, right);
+  case Opcode::Subtract:
+  case Opcode::Multiply:
+    return numberResult(left, right);
+  case Opcode::Divide:
+    // int / int falls back to double on a zero divisor;
+    if (isNumberType(left) && isNumberType(right) &&
+        (left == ValueType::Double || right == ValueType::Double)) {
+      return ValueType::Double;
+    }
+    return ValueType::Unknown;
+  default:
+    return ValueType::Unknown;
+  }
+}
+
+// Typed replacement of a generic instruction, NoOP if there is none.
+inline Opcode typedForm(Opcode code, ValueType left, ValueType right) {
+  if (left != right) {
+    return Opcode::NoOP;
+  }
+  if (left == ValueType::Integer) {
+    switch (code) {
+    case Opcode::Add: return Opcode::AddInt;
+    case Opcode::Subtract: return Opcode::SubtractInt;
+    case Opcode::Multiply: return Opcode::MultiplyInt;
+    case Opcode::Equals: return Opcode::EqualsInt;
+    case Opcode::LessThan: return Opcode::LessThanInt;
+    case Opcode::GreaterThan: return Opcode::GreaterThanInt;
+    default: return Opcode::NoOP;
+    }
+  }
+  if (left == ValueType::Double) {
+    switch (code) {
+    case Opcode::Add: return Opcode::AddDouble;
+    case Opcode::Subtract: return Opcode::SubtractDouble;
+    case Opcode::Multiply: return Opcode::MultiplyDouble;
+    case Opcode::Divide: return Opcode::DivideDouble;
+    case Opcode::Equals: return Opcode::EqualsDouble;
+    case Opcode::LessThan: return Opcode::LessThanDouble;
+    case Opcode::GreaterThan: return Opcode::GreaterThanDouble;
+    default: return Opcode::NoOP;
+    }
+  }
+  if (left == ValueType::String && code == Opcode::Add) {
+    return Opcode::AddString;
+  }
+  return Opcode::NoOP;
+}
+
+// Result type of a typed instruction.
+inline ValueType typedResult(Opcode code) {
+  switch (code) {
+  case Opcode::AddInt:
+  case Opcode::SubtractInt:
+  case Opcode::MultiplyInt:
+    return ValueType::Integer;
+  case Opcode::AddDouble:
+  case Opcode::SubtractDouble:
+  case Opcode::MultiplyDouble:
+  case Opcode::DivideDouble:
+    return ValueType::Double;
+  case Opcode::AddString:
+    return ValueType::String;
+  default:
+    return ValueType::Boolean;
+  }
+}
+
+} // namespace kestrel
@@ -14,6 +14,7 @@ namespace kestrel {
 using Object = core::Object;
 
 class Function;
+class Module;
 
 enum class ValueType : unsigned char {
     Nil = 0,
@@ -42,6 +43,7 @@ public:
     Value(const std::shared_ptr<Function>& f);
     Value(Class* cls);
     Value(Object*);
+    Value(Module* module); // an imported module, see ModuleLoader;
     ~Value();
 
     bool isNumber() const;
@@ -58,6 +60,8 @@ public:
     double doubleValue() const;
     std::string& stringValue() const;
     std::shared_ptr<Function>& functionValue() const;
+    Object* objectValue() const;
+    Module* moduleValue() const;
 
     void set(bool value);
     void set(int value);
@@ -78,6 +82,17 @@ public:
     bool operator==(const Value& rhs) const;
     bool operator!=(const Value& other) const;
 
+    // Hash by type and value; values that compare equal hash alike.
+    size_t hash() const;
+
+    // Refers to the function without owning it, so copying this value never
+    // touches the function's reference count. Someone else must keep the
+    // function alive, see Heap::freeze.
+    void borrowFunction();
+
+    // True once borrowFunction() was called on this value or a copy of it.
+    bool borrowsFunction() const;
+
     Value& operator[](const std::string& name);
 
     Class* metaClass() const;
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace kestrel {
+
+// Bump allocator for the syntax tree of one compilation. Nodes are carved
+// out of large chunks and never freed one by one: destroying (or clearing)
+// the arena runs their destructors, newest first, and releases every chunk
+// at once. Nodes refer to each other with plain pointers into the arena.
+class Arena {
+public:
+  static const size_t kChunkSize = 64 * 1024;
+
+  Arena() = default;
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  ~Arena() { clear(); }
+
+  template <typename T, typename... Args> T *make(Args &&...args) {
+    void *memory = allocate(sizeof(T), alignof(T));
+    T *object = new (memory) T(std::forward<Args>(args)...);
+    if (!std::is_trivially_destructible<T>::value) {
+      destructors_.emplace_back(object,
+                                [](void *p) { static_cast<T *>(p)->~T(); });
+    }
+    return object;
+  }
+
+  void clear() {
+    for (auto it = destructors_.rbegin(); it != destructors_.rend(); ++it) {
+      it->second(it->first);
+    }
+    destructors_.clear();
+    chunks_.clear();
+    next_ = end_ = nullptr;
+    used_ = reserved_ = 0;
+  }
+
+  // Takes over every node and chunk of `other`, which is left empty; used to
+  // gather nodes built on other threads into the tree's own arena.
+  void absorb(Arena &other) {
+    for (auto &chunk : other.chunks_) {
+      chunks_.push_back(std::move(chunk));
+    }
+    destructors_.insert(destructors_.end(), other.destructors_.begin(),
+                        other.destructors_.end());
+    used_ += other.used_;
+    reserved_ += other.reserved_;
+    other.destructors_.clear();
+    other.chunks_.clear();
+    other.next_ = other.end_ = nullptr;
+    other.used_ = other.reserved_ = 0;
+  }
+
+  // Bytes handed out to nodes, and bytes held in chunks.
+  size_t used() const { return used_; }
+  size_t reserved() const { return reserved_; }
+
+private:
+  void *allocate(size_t size, size_t alignment) {
+    char *start = align(next_, alignment);
+    if (next_ == nullptr || start + size > end_) {
+      size_t chunk = size + alignment > kChunkSize ? size + alignment
+                                                   : kChunkSize;
+      chunks_.emplace_back(new char[chunk]);
+      next_ = chunks_.back().get();
+      end_ = next_ + chunk;
+      reserved_ += chunk;
+      start = align(next_, alignment);
+    }
+    next_ = start + size;
+    used_ += size;
+    return start;
+  }
+
+  static char *align(char *p, size_t alignment) {
+    uintptr_t address = reinterpret_cast<uintptr_t>(p);
+    address = (address + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    return reinterpret_cast<char *>(address);
+  }
+
+  std::vector<std::unique_ptr<char[]>> chunks_;
+  std::vector<std::pair<void *, void (*)(void *)>> destructors_;
+  char *next_ = nullptr;
+  char *end_ = nullptr;
+  size_t used_ = 0;
+  size_t reserved_ = 0;
+};
+
+} // namespace kestrel
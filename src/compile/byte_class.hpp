@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace kestrel {
+
+// Length of the longest run of identifier, digit or blank bytes starting at
+// `p`, never reading past `end`. With SSE2 sixteen bytes are classified per
+// step; the tail and other targets fall back to one byte at a time.
+namespace byte_class {
+
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+inline bool isAlpha(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+inline bool isAlphaNumeric(char c) { return isAlpha(c) || isDigit(c); }
+
+// Blank bytes the scanner skips; newlines are counted separately.
+inline bool isBlank(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+#if defined(__SSE2__)
+// Bytes of `v` in [lo, hi], as 0xff lanes. Shifting by 128 - lo maps the
+// range onto the bottom of the signed range, so one signed compare does.
+inline __m128i inRange(__m128i v, char lo, char hi) {
+  __m128i shifted = _mm_add_epi8(v, _mm_set1_epi8((char)(128 - lo)));
+  return _mm_cmplt_epi8(shifted, _mm_set1_epi8((char)(-128 + hi - lo + 1)));
+}
+
+inline __m128i digits(__m128i v) { return inRange(v, '0', '9'); }
+
+inline __m128i alphaNumerics(__m128i v) {
+  // setting 0x20 folds upper case onto lower case and nothing else onto it;
+  __m128i letters = inRange(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+  __m128i underscores = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+  return _mm_or_si128(_mm_or_si128(letters, underscores), digits(v));
+}
+
+inline __m128i blanks(__m128i v) {
+  __m128i spaces = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+  __m128i tabs = _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'));
+  __m128i returns = _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'));
+  __m128i newlines = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+  return _mm_or_si128(_mm_or_si128(spaces, tabs),
+                      _mm_or_si128(returns, newlines));
+}
+
+template <typename Classify>
+inline size_t run(const char *p, const char *end, Classify classify) {
+  const char *start = p;
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    unsigned mask = (unsigned)_mm_movemask_epi8(classify(v)) ^ 0xffffu;
+    if (mask != 0) {
+      return (size_t)(p - start) + __builtin_ctz(mask);
+    }
+    p += 16;
+  }
+  return (size_t)(p - start);
+}
+#endif
+
+inline size_t digitRun(const char *p, const char *end) {
+  size_t n = 0;
+#if defined(__SSE2__)
+  n = run(p, end, [](__m128i v) { return digits(v); });
+#endif
+  while (p + n < end && isDigit(p[n])) {
+    n++;
+  }
+  return n;
+}
+
+inline size_t identifierRun(const char *p, const char *end) {
+  size_t n = 0;
+#if defined(__SSE2__)
+  n = run(p, end, [](__m128i v) { return alphaNumerics(v); });
+#endif
+  while (p + n < end && isAlphaNumeric(p[n])) {
+    n++;
+  }
+  return n;
+}
+
+inline size_t blankRun(const char *p, const char *end) {
+  size_t n = 0;
+#if defined(__SSE2__)
+  n = run(p, end, [](__m128i v) { return blanks(v); });
+#endif
+  while (p + n < end && isBlank(p[n])) {
+    n++;
+  }
+  return n;
+}
+
+} // namespace byte_class
+} // namespace kestrel
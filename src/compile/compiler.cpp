@@ -1,26 +1,47 @@
 #include "compiler.hpp"
 
+#include <algorithm>
 #include <unordered_map>
 
+#include "arena.hpp"
+#include "constant_folder.hpp"
+#include "inliner.hpp"
+#include "parallel_compiler.hpp"
+#include "ssa/builder.hpp"
+#include "ssa/lower.hpp"
+
 #include "log.hpp"
 #include "module.hpp"
 #include "statement.hpp"
 
 #include "instruction_array.hpp"
+#include "instruction_list.hpp"
 #include "opcodes.hpp"
+#include "peephole.hpp"
+#include "slot_allocator.hpp"
 #include "statements.hpp"
 #include "symbol_table.hpp"
+#include "type_inference.hpp"
 
 namespace kestrel {
 
 struct Compiler::Detail {
 
-  std::shared_ptr<Module> module_ = std::make_shared<Module>();
+  Module own;               // compiled into unless setModule() names another;
+  Module *module_ = &own;
   InstructionArray instructions;
   // std::vector<Value> constants;
   std::vector<std::string> names; // global name table;
   // std::unordered_map<std::string, Value> globals;
   SymbolTable table;
+  TypeInference types;
+  int optimizationLevel = 1;
+  int reservedSlots = 0; // used by SSA values and inlined calls;
+  int parameters = 0;
+  int frameSlots = -1; // frame size once finish() allocated the slots;
+  Arena *arena = nullptr;
+  int jobs = 1;
+  ParallelCompiler::Results precompiled;
 
 };
 
@@ -32,7 +53,59 @@ InstructionArray& Compiler::instructions() {
   return detail->instructions;
 }
 
-Module Compiler::compile(std::vector<std::shared_ptr<Statement>> &statemetns) {
+Module Compiler::compile(std::vector<Statement *> &statemetns, Arena &arena) {
+  detail->arena = &arena;
+  // functions may call into a module imported further down;
+  for (Statement *statement : statemetns) {
+    if (auto *import = dynamic_cast<Import *>(statement)) {
+      detail->module_->imports_.insert(import->name.lexeme());
+    }
+  }
+  if (detail->jobs > 1) {
+    detail->precompiled =
+        ParallelCompiler(*detail->module_, detail->optimizationLevel,
+                         detail->jobs)
+            .run(statemetns, arena);
+  }
+  emitStatements(statemetns);
+  return finish();
+}
+
+Function Compiler::compileFunction(std::vector<Statement *> &body,
+                                 Arena &arena) {
+  detail->arena = &arena;
+  emitStatements(body);
+  // falling off the end returns nil;
+  emitCode(Opcode::LoadNil);
+  emitCode(Opcode::Return);
+  return finishCode();
+}
+
+void Compiler::emitStatements(std::vector<Statement *> &statemetns) {
+  detail->parameters = detail->table.size();
+  detail->types = TypeInference(detail->table);
+  detail->types.run(statemetns);
+  // simplify with the inferred types, then type the simplified tree;
+  if (detail->optimizationLevel >= 1 &&
+      ConstantFolder(detail->types, *detail->arena).run(statemetns)) {
+    detail->types = TypeInference(detail->table);
+    detail->types.run(statemetns);
+  }
+
+  if (detail->optimizationLevel >= 2) {
+    ssa::Graph graph;
+    if (ssa::Builder(graph, detail->table).build(statemetns)) {
+      ssa::propagateConstants(graph);
+      ssa::eliminateCommonSubexpressions(graph);
+      ssa::hoistLoopInvariants(graph);
+      ssa::eliminateDeadCode(graph);
+      ssa::inferTypes(graph);
+      int slots = ssa::lower(graph, *this, detail->table.size());
+      detail->reservedSlots = std::max(detail->reservedSlots, slots);
+      return;
+    }
+    Log(level, tag) << "ssa: unsupported construct, compiling the tree";
+  }
 
   for (auto &statemnt : statemetns) {
     Log(level, tag) << statemnt;
@@ -42,31 +115,66 @@ Module Compiler::compile(std::vector<std::shared_ptr<Statement>> &statemetns) {
     statemnt->evaluate(*this);
     // TODO pop the last result?
   }
-  Module m; // TODO
-  m.instructions = detail->instructions;
-  m.constants = detail->module_->constants;
-  m.names = detail->module_->names;
-  m.globals_ = detail->module_->globals_; //TODO
-  m.initializer_ = Function(detail->instructions);
+}
+
+Function Compiler::finishCode() {
+  Peephole::Report report;
+  report.before = report.after = detail->instructions.size();
+  if (detail->optimizationLevel >= 1) {
+    report = Peephole().run(detail->instructions);
+    Log(level, tag) << "peephole: " << report.before << " -> " << report.after
+                    << " bytes";
+    detail->frameSlots =
+        SlotAllocator(detail->parameters).run(detail->instructions);
+  } else {
+    // the peephole pass lays the code out narrow, without it just re-encode;
+    detail->instructions = InstructionList::decode(detail->instructions).encode();
+  }
+
+  Function code(std::move(detail->instructions));
+  code.setMaxSlots(maxSlots());
+  code.setCompiledSize(report.before);
+  return code;
+}
+
+Module Compiler::finish() {
+  Module m;
+  // nobody else sees the tables of the compiler's own module, hand them
+  // over; those of another one stay with it, the code indexes into them;
+  if (detail->module_ == &detail->own) {
+    m = std::move(detail->own);
+  }
+  m.initializer_ = finishCode();
   return m;
-  // TODO
 }
 
-std::shared_ptr<Module> Compiler::module() {
-  return detail->module_;
+Arena &Compiler::arena() {
+  return *detail->arena;
 }
 
-void Compiler::setModule(std::shared_ptr<Module> module_) {
-  detail->module_ = module_;
+Module &Compiler::module() {
+  return *detail->module_;
+}
+
+void Compiler::setModule(Module &module_) {
+  detail->module_ = &module_;
 }
 
 void Compiler::emitCode(Opcode code) {
+  // every operand is emitted 32 bits wide, finishCode() narrows them;
+  if (operandCount(code) > 0) {
+    detail->instructions.appendByte(static_cast<uint8_t>(Opcode::ExtraWide));
+  }
   detail->instructions.appendByte(static_cast<uint8_t>(code));
 }
 
-int Compiler::emitIndex(int16_t index) {
-  detail->instructions.appendShort(index);
-  return (int) detail->instructions.size() - 2;
+int Compiler::emitIndex(int index) {
+  return (int) detail->instructions.appendInt(index);
+}
+
+void Compiler::patchBranch(int operand, int target) {
+  // offsets are relative to the next opcode;
+  detail->instructions.writeInt(target - (operand + 4), operand);
 }
 
 int Compiler::putConstant(Value& v) {
@@ -86,7 +194,31 @@ int Compiler::addLocal(const std::string& value) {
 }
 
 int Compiler::maxSlots() const {
-  return detail->table.maxSlots();
+  if (detail->frameSlots >= 0) {
+    return detail->frameSlots;
+  }
+  return std::max(detail->table.maxSlots(), detail->reservedSlots);
+}
+
+int Compiler::firstFreeSlot() const {
+  return detail->table.size();
+}
+
+void Compiler::emitCall(int arity, const std::string &name, int firstSlot) {
+  InstructionArray code;
+  int slots = 0;
+  if (detail->optimizationLevel >= 1 &&
+      Inliner(*detail->module_).inlineCall(name, arity, firstSlot, code,
+                                            slots)) {
+    BytecodeView view = code.view();
+    for (size_t i = 0; i < view.size(); i++) {
+      detail->instructions.appendByte(view.readByte(i));
+    }
+    detail->reservedSlots = std::max(detail->reservedSlots, slots);
+    return;
+  }
+  emitCode(Opcode::Call);
+  emitIndex(arity);
 }
 
 void Compiler::enterBlock() {
@@ -101,6 +233,80 @@ int Compiler::nameIndex(const std::string& name) {
   return detail->module_->nameIndex(name);
 }
 
+ValueType Compiler::typeOf(const Expression *expression) const {
+  return detail->types.typeOf(expression);
+}
+
+void Compiler::emitConstant(const Value &value) {
+  switch (value.type()) {
+    case ValueType::Integer: {
+      emitCode(Opcode::LoadInteger);
+      emitIndex(value.intValue());
+      break;
+    }
+    case ValueType::Double:
+    case ValueType::Boolean: //TODO
+    case ValueType::String: {
+      Value constant = value;
+      int index = putConstant(constant);
+      emitCode(Opcode::LoadConstant);
+      emitIndex(index);
+      break;
+    }
+    case ValueType::Nil: {
+      emitCode(Opcode::LoadNil);
+      break;
+    }
+    case ValueType::Function: {
+      // TODO
+      break;
+    }
+    default: {
+      throw -1;
+    }
+  }
+}
+
+void Compiler::setOptimizationLevel(int level) {
+  detail->optimizationLevel = level;
+}
+
+int Compiler::optimizationLevel() const {
+  return detail->optimizationLevel;
+}
+
+void Compiler::setJobs(int jobs) {
+  detail->jobs = jobs;
+}
+
+int Compiler::jobs() const {
+  return detail->jobs;
+}
+
+std::shared_ptr<Function>
+Compiler::precompiled(const FunctionStatement *statement) {
+  auto it = detail->precompiled.find(statement);
+  return it != detail->precompiled.end() ? it->second : nullptr;
+}
+
+void Compiler::emitStore(int index, ValueType type) {
+  switch (type) {
+    case ValueType::Integer:
+      emitCode(Opcode::StoreInt);
+      break;
+    case ValueType::Double:
+      emitCode(Opcode::StoreDouble);
+      break;
+    case ValueType::Boolean:
+      emitCode(Opcode::StoreBoolean);
+      break;
+    default:
+      emitCode(Opcode::Store);
+      break;
+  }
+  emitIndex(index);
+}
+
 // void Compiler::emitLoadVariable() {
 
 // }
@@ -0,0 +1,343 @@
+#include "constant_folder.hpp"
+
+#include <cmath>
+
+#include "arithmetic.hpp"
+#include "statements.hpp"
+#include "type_rules.hpp"
+
+namespace kestrel {
+
+static LiteralExpression *literalOf(Expression *e) {
+  if (e && e->type() == ExpressionType::Literal) {
+    return static_cast<LiteralExpression *>(e);
+  }
+  return nullptr;
+}
+
+Expression *ConstantFolder::makeLiteral(const Value &value) {
+  return arena_.make<LiteralExpression>(value);
+}
+
+// True for an integer (or, with `doubles`, a double) literal equal to `n`.
+static bool isNumber(Expression *e, double n, bool doubles) {
+  LiteralExpression *literal = literalOf(e);
+  if (literal == nullptr) {
+    return false;
+  }
+  const Value &value = literal->value;
+  if (value.type() == ValueType::Integer) {
+    return value.intValue() == n;
+  }
+  return doubles && value.type() == ValueType::Double &&
+         value.doubleValue() == n;
+}
+
+// Evaluating the expression twice, or not at all, is unobservable.
+static bool isPure(Expression *e) {
+  return e->type() == ExpressionType::Variable ||
+         e->type() == ExpressionType::Literal;
+}
+
+bool ConstantFolder::run(std::vector<Statement *> &statements) {
+  changed_ = false;
+  for (auto &stmt : statements) {
+    stmt = statement(stmt);
+  }
+  return changed_;
+}
+
+ConstantFolder::StatementPtr
+ConstantFolder::statement(StatementPtr stmt) {
+  if (stmt == nullptr) {
+    return stmt;
+  }
+  if (auto *s = dynamic_cast<ExpressionStatement *>(stmt)) {
+    ExpressionPtr e = expression(s->expression);
+    if (e != s->expression) {
+      return arena_.make<ExpressionStatement>(e);
+    }
+  } else if (auto *s = dynamic_cast<VariableStatement *>(stmt)) {
+    ExpressionPtr e = expression(s->initializer);
+    if (e != s->initializer) {
+      return arena_.make<VariableStatement>(s->name, e);
+    }
+  } else if (auto *s = dynamic_cast<ReturnStatement *>(stmt)) {
+    ExpressionPtr e = expression(s->value);
+    if (e != s->value) {
+      return arena_.make<ReturnStatement>(e);
+    }
+  } else if (auto *s = dynamic_cast<BlockStatement *>(stmt)) {
+    std::vector<StatementPtr> statements = s->statements;
+    bool changed = false;
+    for (auto &inner : statements) {
+      StatementPtr folded = statement(inner);
+      changed |= folded != inner;
+      inner = folded;
+    }
+    if (changed) {
+      return arena_.make<BlockStatement>(statements);
+    }
+  } else if (auto *s = dynamic_cast<IfStatement *>(stmt)) {
+    ExpressionPtr condition = expression(s->condition);
+    if (LiteralExpression *literal = literalOf(condition)) {
+      changed_ = true;
+      StatementPtr taken =
+          literal->value.boolValue() ? s->thenBranch : s->elseBranch;
+      if (taken == nullptr) {
+        return arena_.make<BlockStatement>(std::vector<Statement *>{});
+      }
+      return statement(taken);
+    }
+    StatementPtr thenBranch = statement(s->thenBranch);
+    StatementPtr elseBranch = statement(s->elseBranch);
+    if (condition != s->condition || thenBranch != s->thenBranch ||
+        elseBranch != s->elseBranch) {
+      return arena_.make<IfStatement>(condition, thenBranch, elseBranch);
+    }
+  } else if (auto *s = dynamic_cast<While *>(stmt)) {
+    ExpressionPtr condition = expression(s->condition);
+    LiteralExpression *literal = literalOf(condition);
+    if (literal && !literal->value.boolValue()) {
+      changed_ = true;
+      return arena_.make<BlockStatement>(std::vector<Statement *>{});
+    }
+    StatementPtr body = statement(s->body);
+    if (condition != s->condition || body != s->body) {
+      return arena_.make<While>(condition, body);
+    }
+  }
+  return stmt;
+}
+
+ConstantFolder::ExpressionPtr
+ConstantFolder::expression(ExpressionPtr expr) {
+  if (expr == nullptr) {
+    return expr;
+  }
+  switch (expr->type()) {
+  case ExpressionType::Binary: {
+    auto *b = static_cast<Binary *>(expr);
+    ExpressionPtr result = binary(b, expression(b->left), expression(b->right));
+    return result ? result : expr;
+  }
+  case ExpressionType::Unary: {
+    auto *u = static_cast<Unary *>(expr);
+    ExpressionPtr result = unary(u, expression(u->right));
+    return result ? result : expr;
+  }
+  case ExpressionType::Logical: {
+    auto *l = static_cast<Logical *>(expr);
+    ExpressionPtr result =
+        logical(l, expression(l->left), expression(l->right));
+    return result ? result : expr;
+  }
+  case ExpressionType::Grouping: {
+    changed_ = true; // parentheses only matter to the parser;
+    return expression(static_cast<Grouping *>(expr)->expression);
+  }
+  case ExpressionType::Assign: {
+    auto *a = static_cast<Assign *>(expr);
+    ExpressionPtr value = expression(a->value);
+    if (value != a->value) {
+      return arena_.make<Assign>(a->name, value);
+    }
+    return expr;
+  }
+  case ExpressionType::Call: {
+    auto *c = static_cast<Call *>(expr);
+    ExpressionPtr callee = expression(c->callee);
+    std::vector<ExpressionPtr> arguments = c->arguments;
+    bool changed = callee != c->callee;
+    for (auto &argument : arguments) {
+      ExpressionPtr folded = expression(argument);
+      changed |= folded != argument;
+      argument = folded;
+    }
+    if (changed) {
+      return arena_.make<Call>(callee, arguments);
+    }
+    return expr;
+  }
+  case ExpressionType::Dispatch: {
+    auto *d = static_cast<Dispatch *>(expr);
+    ExpressionPtr object = expression(d->object);
+    std::vector<ExpressionPtr> arguments = d->arguments;
+    bool changed = object != d->object;
+    for (auto &argument : arguments) {
+      ExpressionPtr folded = expression(argument);
+      changed |= folded != argument;
+      argument = folded;
+    }
+    if (changed) {
+      return arena_.make<Dispatch>(object, d->name, arguments);
+    }
+    return expr;
+  }
+  case ExpressionType::Get: {
+    auto *g = static_cast<Get *>(expr);
+    ExpressionPtr object = expression(g->object);
+    if (object != g->object) {
+      return arena_.make<Get>(object, g->name);
+    }
+    return expr;
+  }
+  case ExpressionType::Set: {
+    auto *s = static_cast<Set *>(expr);
+    ExpressionPtr object = expression(s->object);
+    ExpressionPtr value = expression(s->value);
+    if (object != s->object || value != s->value) {
+      return arena_.make<Set>(object, s->name, value);
+    }
+    return expr;
+  }
+  default:
+    return expr;
+  }
+}
+
+// Returns the simplified expression, or nullptr if `b` stays as it is.
+ConstantFolder::ExpressionPtr ConstantFolder::binary(Binary *b,
+                                                     ExpressionPtr left,
+                                                     ExpressionPtr right) {
+  bool negated = false;
+  Opcode code = b->opcode(negated);
+  LiteralExpression *l = literalOf(left);
+  LiteralExpression *r = literalOf(right);
+
+  if (l && r && code != Opcode::NoOP &&
+      !overflows(code, l->value, r->value)) {
+    Value result = arithmetic(code, l->value, r->value);
+    if (result.type() != ValueType::Nil) {
+      changed_ = true;
+      return makeLiteral(negated ? kestrel::unary(Opcode::Not, result)
+                                 : result);
+    }
+  }
+
+  // identities, valid only for the operand types inference proved; folded
+  // operands have the type of the expression they replace;
+  ValueType lt = l ? l->value.type() : types_.typeOf(b->left);
+  ValueType rt = r ? r->value.type() : types_.typeOf(b->right);
+  bool lInt = lt == ValueType::Integer;
+  bool rInt = rt == ValueType::Integer;
+  bool lDouble = lt == ValueType::Double;
+  bool rDouble = rt == ValueType::Double;
+  Token plus(TokenType::Plus, "+", b->op.line);
+  Token star(TokenType::Star, "*", b->op.line);
+
+  ExpressionPtr result = nullptr;
+  switch (negated ? Opcode::NoOP : code) {
+  case Opcode::Add:
+    // not for doubles: -0.0 + 0 is 0.0;
+    if (lInt && isNumber(right, 0, false)) {
+      result = left;
+    } else if (rInt && isNumber(left, 0, false)) {
+      result = right;
+    }
+    break;
+  case Opcode::Subtract:
+    if ((lInt && isNumber(right, 0, false)) ||
+        (lDouble && isNumber(right, 0, true))) {
+      result = left;
+    }
+    break;
+  case Opcode::Multiply:
+    if ((lInt && isNumber(right, 1, false)) ||
+        (lDouble && isNumber(right, 1, true))) {
+      result = left;
+    } else if ((rInt && isNumber(left, 1, false)) ||
+               (rDouble && isNumber(left, 1, true))) {
+      result = right;
+    } else if (lInt && isPure(left) && isNumber(right, 0, false)) {
+      result = makeLiteral(Value(0)); // not for doubles: NaN * 0;
+    } else if (rInt && isPure(right) && isNumber(left, 0, false)) {
+      result = makeLiteral(Value(0));
+    } else if (isPure(left) && ((lInt && isNumber(right, 2, false)) ||
+                                (lDouble && isNumber(right, 2, true)))) {
+      result = arena_.make<Binary>(left, plus, left);
+    } else if (isPure(right) && ((rInt && isNumber(left, 2, false)) ||
+                                 (rDouble && isNumber(left, 2, true)))) {
+      result = arena_.make<Binary>(right, plus, right);
+    }
+    break;
+  case Opcode::Divide:
+    if ((lInt && isNumber(right, 1, false)) ||
+        (lDouble && isNumber(right, 1, true))) {
+      result = left;
+    } else if (isNumberType(lt) && r && r->value.type() == ValueType::Double) {
+      // dividing by a power of two is exact as a multiplication;
+      int exponent = 0;
+      double divisor = r->value.doubleValue();
+      if (divisor != 0 && std::isfinite(divisor) &&
+          std::frexp(divisor, &exponent) == 0.5 && std::abs(exponent) < 1000) {
+        result = arena_.make<Binary>(left, star,
+                                          makeLiteral(Value(1.0 / divisor)));
+      }
+    }
+    break;
+  default:
+    break;
+  }
+  if (result) {
+    changed_ = true;
+    return result;
+  }
+
+  if (left != b->left || right != b->right) {
+    return arena_.make<Binary>(left, b->op, right);
+  }
+  return nullptr;
+}
+
+ConstantFolder::ExpressionPtr ConstantFolder::unary(Unary *u,
+                                                    ExpressionPtr right) {
+  bool isNot = u->op.type == TokenType::Bang;
+  Opcode code = isNot ? Opcode::Not : Opcode::Negate;
+
+  if (LiteralExpression *literal = literalOf(right)) {
+    Value result = kestrel::unary(code, literal->value);
+    if (result.type() != ValueType::Nil) {
+      changed_ = true;
+      return makeLiteral(result);
+    }
+  }
+
+  // !!b and --n give back their operand;
+  if (right->type() == ExpressionType::Unary) {
+    auto *inner = static_cast<Unary *>(right);
+    ValueType type = types_.typeOf(u->right);
+    if (inner->op.type == u->op.type &&
+        ((isNot && type == ValueType::Boolean) ||
+         (!isNot && isNumberType(type)))) {
+      changed_ = true;
+      return inner->right;
+    }
+  }
+
+  if (right != u->right) {
+    return arena_.make<Unary>(u->op, right);
+  }
+  return nullptr;
+}
+
+// `and` and `or` yield the operand that decided the result, so a constant
+// left side selects one operand outright.
+ConstantFolder::ExpressionPtr ConstantFolder::logical(Logical *l,
+                                                      ExpressionPtr left,
+                                                      ExpressionPtr right) {
+  if (LiteralExpression *literal = literalOf(left)) {
+    bool truthy = literal->value.boolValue();
+    changed_ = true;
+    if (l->op.type == TokenType::And) {
+      return truthy ? right : left;
+    }
+    return truthy ? left : right;
+  }
+  if (left != l->left || right != l->right) {
+    return arena_.make<Logical>(left, l->op, right);
+  }
+  return nullptr;
+}
+
+} // namespace kestrel
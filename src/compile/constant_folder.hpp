@@ -0,0 +1,53 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "arena.hpp"
+#include "expression.hpp"
+#include "statement.hpp"
+#include "type_inference.hpp"
+
+namespace kestrel {
+
+// AST simplification run on one function body (or the module initializer)
+// before code generation:
+//
+//   - operators, Unary, Logical and Grouping over literals are evaluated
+//     with the runtime's own arithmetic, so `60 * 60 * 24` becomes 86400;
+//   - identities such as `x + 0`, `x * 1` and `x / 1` are dropped, and
+//     `x * 2` and `x / 4.0` are strength-reduced, but only when TypeInference
+//     proved an operand type for which the rewrite gives the same result;
+//   - `if` and `while` with a constant condition lose their dead branch.
+//
+// Nested functions are folded when their own body is compiled.
+class ConstantFolder {
+public:
+  // Replacement nodes are allocated in `arena`, next to the tree's own.
+  ConstantFolder(const TypeInference &types, Arena &arena)
+      : types_(types), arena_(arena) {}
+
+  // Rewrites `statements` in place and returns true if anything changed.
+  bool run(std::vector<Statement *> &statements);
+
+private:
+  using ExpressionPtr = Expression *;
+  using StatementPtr = Statement *;
+
+  Expression *makeLiteral(const Value &value);
+
+  StatementPtr statement(StatementPtr statement);
+  ExpressionPtr expression(ExpressionPtr expression);
+
+  ExpressionPtr binary(Binary *binary, ExpressionPtr left,
+                       ExpressionPtr right);
+  ExpressionPtr unary(Unary *unary, ExpressionPtr right);
+  ExpressionPtr logical(Logical *logical, ExpressionPtr left,
+                        ExpressionPtr right);
+
+  const TypeInference &types_;
+  Arena &arena_;
+  bool changed_ = false;
+};
+
+} // namespace kestrel
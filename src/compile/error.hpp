@@ -26,7 +26,7 @@ inline void error(const Token& token, String message) {
   if (token.type == TokenType::EndOfFile) {
     report(token.line, " at end", message);
   } else {
-    report(token.line, " at '" + token.lexeme + "'", message);
+    report(token.line, " at '" + token.lexeme() + "'", message);
   }
 }
 
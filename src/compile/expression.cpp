@@ -1,6 +1,7 @@
 #include "expression.hpp"
 #include "compiler.hpp"
 #include "opcodes.hpp"
+#include "type_rules.hpp"
 #include "log.hpp"
 
 namespace kestrel {
@@ -8,16 +9,30 @@ namespace kestrel {
 static LogLevel level = LogLevel::Debug;
 static std::string tag = "expr";
 
+void Expression::branch(Compiler &compiler, bool when,
+                        std::vector<int> &jumps) {
+  eval(compiler);
+  compiler.emitCode(when ? Opcode::BranchTrue : Opcode::BranchFalse);
+  jumps.push_back(compiler.emitIndex(0));
+}
+
 void Assign::eval(Compiler &compiler) {
-  Log(level, tag) << "Assign : " << name.lexeme;
+  Log(level, tag) << "Assign : " << name.lexeme();
 
   value->eval(compiler);
-}
+  compiler.emitCode(Opcode::Duplicate); // the assignment's own value;
 
-void Binary::eval(Compiler &compiler) {
-  Log(level, tag) << "Binary:";
+  int index = compiler.lookup(name.lexeme());
+  if (index >= 0) {
+    compiler.emitStore(index, compiler.typeOf(value));
+  } else {
+    compiler.emitCode(Opcode::StoreGlobal);
+    compiler.emitIndex(compiler.nameIndex(name.lexeme()));
+  }
+}
 
-  static std::map<std::string, Opcode> opcodeMap = {
+Opcode Binary::opcode(bool &negated) const {
+  static const std::map<std::string, Opcode> opcodeMap = {
       {"+", Opcode::Add},
       {"-", Opcode::Subtract},
       {"*", Opcode::Multiply},
@@ -28,12 +43,49 @@ void Binary::eval(Compiler &compiler) {
 
       {"==", Opcode::Equals},
   };
+  static const std::map<std::string, Opcode> negatedMap = {
+      {"<=", Opcode::GreaterThan},
+      {">=", Opcode::LessThan},
+      {"!=", Opcode::Equals},
+  };
+
+  auto it = negatedMap.find(op.lexeme());
+  negated = it != negatedMap.end();
+  if (negated) {
+    return it->second;
+  }
+  auto found = opcodeMap.find(op.lexeme());
+  return found != opcodeMap.end() ? found->second : Opcode::NoOP;
+}
 
+void Binary::eval(Compiler &compiler) {
+  Log(level, tag) << "Binary:";
+
+  left->eval(compiler);
+  right->eval(compiler);
+  Log(level, tag) << "operator : " << op.lexeme();
+  bool negated = false;
+  Opcode code = opcode(negated);
+  Opcode typed = typedForm(code, compiler.typeOf(left),
+                           compiler.typeOf(right));
+  compiler.emitCode(typed != Opcode::NoOP ? typed : code);
+  if (negated) {
+    compiler.emitCode(Opcode::Not);
+  }
+}
+
+void Binary::branch(Compiler &compiler, bool when, std::vector<int> &jumps) {
+  bool negated = false;
+  Opcode code = opcode(negated);
+  Opcode fused = fusedBranch(code, when != negated);
+  if (fused == Opcode::NoOP) {
+    Expression::branch(compiler, when, jumps);
+    return;
+  }
   left->eval(compiler);
   right->eval(compiler);
-  Log(level, tag) << "operator : " << op.lexeme;
-  Opcode opcode = opcodeMap[op.lexeme];
-  compiler.emitCode(opcode);
+  compiler.emitCode(fused);
+  jumps.push_back(compiler.emitIndex(0));
 }
 
 void Call::eval(Compiler &compiler) {
@@ -41,19 +93,41 @@ void Call::eval(Compiler &compiler) {
   for (int i = 0; i < arguments.size(); i++) {
     arguments[i]->eval(compiler);
   }
-  
+
+  // a global function may be inlined;
+  auto *variable = dynamic_cast<Variable *>(callee);
+  if (variable && compiler.lookup(variable->name.lexeme()) < 0) {
+    compiler.emitCall(arguments.size(), variable->name.lexeme(),
+                      compiler.firstFreeSlot());
+    return;
+  }
   compiler.emitCode(Opcode::Call);
   compiler.emitIndex(arguments.size());
 }
 
 void Dispatch::eval(Compiler &compiler) {
-  std::cout << "Calling method:" << name.lexeme << std::endl;
+  std::cout << "Calling method:" << name.lexeme() << std::endl;
   object->eval(compiler); 
+
+  // a function of an imported module is called like any other;
+  auto *variable = dynamic_cast<Variable *>(object);
+  if (variable && compiler.lookup(variable->name.lexeme()) < 0 &&
+      compiler.module().imports_.count(variable->name.lexeme()) > 0) {
+    compiler.emitCode(Opcode::GetItem);
+    compiler.emitIndex(compiler.nameIndex(name.lexeme()));
+    for (int i = 0; i < arguments.size(); i++) {
+      arguments[i]->eval(compiler);
+    }
+    compiler.emitCode(Opcode::Call);
+    compiler.emitIndex(arguments.size());
+    return;
+  }
+
   for (int i = 0; i < arguments.size(); i++) {
     arguments[i]->eval(compiler);
   }
   
-  int index = compiler.nameIndex(name.lexeme);
+  int index = compiler.nameIndex(name.lexeme());
   // compiler.emitCode(Opcode::LoadConstant);
   // compiler.emitIndex(index);
   // TODO encode into bytecode? Dispatch, name, argCount;
@@ -64,13 +138,12 @@ void Dispatch::eval(Compiler &compiler) {
 }
 
 void Get::eval(Compiler &compiler) {
-  std::cout << "Get:" << name.lexeme << std::endl;
+  std::cout << "Get:" << name.lexeme() << std::endl;
   object->eval(compiler);
-  int index = compiler.nameIndex(name.lexeme);
+  int index = compiler.nameIndex(name.lexeme());
 
-  compiler.emitCode(Opcode::LoadName);
-  compiler.emitIndex(index);
   compiler.emitCode(Opcode::GetItem);
+  compiler.emitIndex(index);
 
   // compiler.emitCode(Opcode::Load)
   Log(level, tag) << "Get";
@@ -79,21 +152,33 @@ void Get::eval(Compiler &compiler) {
 
 void Set::eval(Compiler &compiler) {
   Log(level, tag) << "Set";
+  object->eval(compiler);
+  value->eval(compiler);
+
+  compiler.emitCode(Opcode::SetItem);
+  compiler.emitIndex(compiler.nameIndex(name.lexeme()));
 }
 
 void Variable::eval(Compiler &compiler) {
-  Log(level, tag) << "Variable: " << name.lexeme;
-  int index = compiler.lookup(name.lexeme);
-  // std::cout << name.lexeme << " at index " << index << std::endl;
+  Log(level, tag) << "Variable: " << name.lexeme();
+  int index = compiler.lookup(name.lexeme());
+  // std::cout << name.lexeme() << " at index " << index << std::endl;
   if (index >= 0) {
     // local variable
-    compiler.emitCode(Opcode::LoadLocal);
+    ValueType type = compiler.typeOf(this);
+    if (type == ValueType::Integer) {
+      compiler.emitCode(Opcode::LoadLocalInt);
+    } else if (type == ValueType::Double) {
+      compiler.emitCode(Opcode::LoadLocalDouble);
+    } else {
+      compiler.emitCode(Opcode::LoadLocal);
+    }
     compiler.emitIndex(index);
   } else {
     // global variable;
-    // Value val(name.lexeme);
+    // Value val(name.lexeme());
     // int index = compiler.putConstant(val);
-    int index = compiler.nameIndex(name.lexeme);
+    int index = compiler.nameIndex(name.lexeme());
     // std::cout << "constant:" << index << std::endl;
     compiler.emitCode(Opcode::LoadGlobal); // TODO LoadName?
     compiler.emitIndex(index);
@@ -111,49 +196,61 @@ void This::eval(Compiler &compiler) {
 
 void Unary::eval(Compiler &compiler) {
   Log(level, tag) << "Unary";
-  // return 0;
+  right->eval(compiler);
+  compiler.emitCode(op.type == TokenType::Bang ? Opcode::Not : Opcode::Negate);
+}
+
+void Unary::branch(Compiler &compiler, bool when, std::vector<int> &jumps) {
+  if (op.type != TokenType::Bang) {
+    Expression::branch(compiler, when, jumps);
+    return;
+  }
+  right->branch(compiler, !when, jumps);
 }
 
 void Logical::eval(Compiler &compiler) {
   Log(level, tag) << "Logical";
-  // return 0;
+  left->eval(compiler);
+  // keep the left value as the result if it decides;
+  compiler.emitCode(Opcode::Duplicate);
+  compiler.emitCode(op.type == TokenType::And ? Opcode::BranchFalse
+                                              : Opcode::BranchTrue);
+  int end = compiler.emitIndex(0);
+  compiler.emitCode(Opcode::Pop);
+  right->eval(compiler);
+  compiler.patchBranch(end, (int)compiler.instructions().size());
+}
+
+void Logical::branch(Compiler &compiler, bool when, std::vector<int> &jumps) {
+  // `a and b` is false as soon as `a` is, `a or b` true as soon as `a` is;
+  bool decides = op.type == TokenType::Or;
+  if (when == decides) {
+    left->branch(compiler, when, jumps);
+    right->branch(compiler, when, jumps);
+    return;
+  }
+  // otherwise the left side deciding skips the right one;
+  std::vector<int> skip;
+  left->branch(compiler, decides, skip);
+  right->branch(compiler, when, jumps);
+  for (int jump : skip) {
+    compiler.patchBranch(jump, (int)compiler.instructions().size());
+  }
 }
 
 void Grouping::eval(Compiler &compiler) {
   Log(level, tag) << "Grouping";
-  // return 0;
+  expression->eval(compiler);
+}
+
+void Grouping::branch(Compiler &compiler, bool when, std::vector<int> &jumps) {
+  expression->branch(compiler, when, jumps);
 }
 
 void LiteralExpression::eval(Compiler &compiler) {
-  Log(level, tag) << "literal exprssion :" << value->toString() << " type:" << (int)value->type();
-
-  switch (value->type()) {
-      // TODO
-      case ValueType::Integer:
-      case ValueType::Double: {
-        compiler.emitCode(Opcode::LoadInteger);
-        compiler.emitIndex(value->intValue());
-        break;
-      }
-
-      case ValueType::Boolean: //TODO
-      case ValueType::String: 
-      case ValueType::Nil : {
-        int index = compiler.putConstant(*value);
-        compiler.emitCode(Opcode::LoadConstant);
-        compiler.emitIndex(index);
-        break;
-      }
-      case ValueType::Function: {
-          // TODO
-          break;
-      }
-      default: {
-        // std::cout << "type:" << (int)value->type() << std::endl;
-        throw -1;
-      }
-  }
+  Log(level, tag) << "literal exprssion :" << value.toString() << " type:" << (int)value.type();
 
+  compiler.emitConstant(value);
 }
 
 } // namespace kestrel
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "opcodes.hpp"
 #include "token.hpp"
 #include "value.hpp"
 
@@ -30,6 +31,7 @@ enum class ExpressionType {
   Assign,
   Binary,
   Call,
+  Dispatch,
   Get,
   Grouping,
   Literal,
@@ -46,47 +48,57 @@ struct Expression {
     throw std::runtime_error("Expression::eval not implemented");
   }
 
+  // Compiles the expression as a condition: branches when its truth is
+  // `when` and falls through otherwise, appending the operand offset of
+  // every such branch to `jumps` for Compiler::patchBranch. By default the
+  // value is computed and tested; see the overrides.
+  virtual void branch(Compiler &compiler, bool when, std::vector<int> &jumps);
+
   virtual ExpressionType type() = 0; 
 };
 
 struct Assign : Expression {
-  Assign(Token name, std::shared_ptr<Expression> value)
+  Assign(Token name, Expression *value)
       : name{std::move(name)}, value{std::move(value)} {}
 
   ExpressionType type() override { return ExpressionType::Assign;}
   void eval(Compiler &compiler) override;
 
   const Token name;
-  const std::shared_ptr<Expression> value;
+  Expression *const value;
 };
 
 struct Binary : Expression {
-  Binary(std::shared_ptr<Expression> left, Token op,
-         std::shared_ptr<Expression> right)
+  Binary(Expression *left, Token op, Expression *right)
       : left{std::move(left)}, op{std::move(op)}, right{std::move(right)} {}
 
   ExpressionType type() override { return ExpressionType::Binary;}
   void eval(Compiler &compiler) override;
+  // Comparisons branch on their operands, without a boolean;
+  void branch(Compiler &compiler, bool when, std::vector<int> &jumps) override;
+
+  // Instruction implementing the operator; `negated` is set for the
+  // operators compiled as the opposite comparison followed by Not.
+  Opcode opcode(bool &negated) const;
 
   const Token op;
-  const std::shared_ptr<Expression> left;
-  const std::shared_ptr<Expression> right;
+  Expression *const left;
+  Expression *const right;
 };
 
 struct Call : Expression {
-  Call(std::shared_ptr<Expression> callee,
-       std::vector<std::shared_ptr<Expression>> arguments)
+  Call(Expression *callee, std::vector<Expression *> arguments)
       : callee{std::move(callee)}, arguments{std::move(arguments)} {}
 
   ExpressionType type() override { return ExpressionType::Call;}
   void eval(Compiler &compiler) override;
 
-  const std::shared_ptr<Expression> callee;
-  const std::vector<std::shared_ptr<Expression>> arguments;
+  Expression *const callee;
+  const std::vector<Expression *> arguments;
 };
 
 struct Get : Expression {
-  Get(std::shared_ptr<Expression> object, Token name)
+  Get(Expression *object, Token name)
       : object{std::move(object)}, name{std::move(name)} {
         std::cout << "Get Expression" << std::endl;
       }
@@ -95,50 +107,53 @@ struct Get : Expression {
   void eval(Compiler &compiler) override;
 
   const Token name;
-  const std::shared_ptr<Expression> object;
+  Expression *const object;
 };
 
 struct Dispatch: Expression {
-  Dispatch(std::shared_ptr<Expression> object, Token name,
-       std::vector<std::shared_ptr<Expression>> arguments)
+  Dispatch(Expression *object, Token name,
+       std::vector<Expression *> arguments)
       : object{std::move(object)}, name(std::move(name)), 
       arguments{std::move(arguments)} {}
 
-  ExpressionType type() override { return ExpressionType::Call;}
+  ExpressionType type() override { return ExpressionType::Dispatch;}
   void eval(Compiler &compiler) override;
 
   const Token name;
-  const std::shared_ptr<Expression> object;
-  const std::vector<std::shared_ptr<Expression>> arguments;
+  Expression *const object;
+  const std::vector<Expression *> arguments;
 };
 
 struct Grouping : Expression {
-  Grouping(std::shared_ptr<Expression> expression)
+  Grouping(Expression *expression)
       : expression{std::move(expression)} {}
 
   ExpressionType type() override { return ExpressionType::Grouping;}
   void eval(Compiler &compiler) override;
+  void branch(Compiler &compiler, bool when, std::vector<int> &jumps) override;
 
-  const std::shared_ptr<Expression> expression;
+  Expression *const expression;
 };
 
 struct LiteralExpression : Expression {
-  LiteralExpression(std::shared_ptr<Value> value) : value{std::move(value)} {}
+  LiteralExpression(Value value) : value{std::move(value)} {}
+
+  LiteralExpression(double d) : value{d} {}
 
-  LiteralExpression(double d) { value = std::make_shared<Value>(d); }
+  LiteralExpression(bool b) : value{b} {}
 
   LiteralExpression(Literal lit) {
     switch (lit.type) {
       case LiteralType::Double: {
-        value = std::make_shared<Value>(lit.value.doubleValue); // TODO
+        value = Value(lit.value.doubleValue); // TODO
         break;
       }
       case LiteralType::Integer: {
-        value = std::make_shared<Value>(lit.value.intValue); // TODO
+        value = Value(lit.value.intValue); // TODO
         break;
       }
       case LiteralType::kString: {
-        value = std::make_shared<Value>(lit.string); // TODO
+        value = Value(lit.string); // TODO
         break;
       }
     }
@@ -150,34 +165,35 @@ struct LiteralExpression : Expression {
   ExpressionType type() override { return ExpressionType::Literal;}
   void eval(Compiler &compiler) override;
 
-  std::shared_ptr<Value> value;
+  Value value;
 };
 
 struct Logical : Expression {
-  Logical(std::shared_ptr<Expression> left, Token op,
-          std::shared_ptr<Expression> right)
+  Logical(Expression *left, Token op, Expression *right)
       : left{std::move(left)}, op{std::move(op)}, right{std::move(right)} {}
 
   ExpressionType type() override { return ExpressionType::Logical;}
+  // The value is the operand that decided, the right one is evaluated only
+  // when the left one did not;
   void eval(Compiler &compiler) override;
+  // A chain of jumps, no value is computed;
+  void branch(Compiler &compiler, bool when, std::vector<int> &jumps) override;
 
   const Token op;
-  const std::shared_ptr<Expression> left;
-  const std::shared_ptr<Expression> right;
+  Expression *const left;
+  Expression *const right;
 };
 
 struct Set : Expression {
-  Set(std::shared_ptr<Expression> object, Token name,
-      std::shared_ptr<Expression> value)
-      : object{std::move(object)}, name{std::move(name)}, value{std::move(
-                                                              value)} {}
+  Set(Expression *object, Token name, Expression *value)
+      : object{object}, name{std::move(name)}, value{value} {}
 
   ExpressionType type() override { return ExpressionType::Set;}
   void eval(Compiler &compiler) override;
 
-  const std::shared_ptr<Expression> object;
+  Expression *const object;
   const Token name;
-  const std::shared_ptr<Expression> value;
+  Expression *const value;
 };
 
 struct Super : Expression {
@@ -201,14 +217,16 @@ struct This : Expression {
 };
 
 struct Unary : Expression {
-  Unary(Token op, std::shared_ptr<Expression> right)
+  Unary(Token op, Expression *right)
       : op{std::move(op)}, right{std::move(right)} {}
 
   ExpressionType type() override { return ExpressionType::Unary;}
   void eval(Compiler &compiler) override;
+  // `!` branches on its operand with the sense flipped;
+  void branch(Compiler &compiler, bool when, std::vector<int> &jumps) override;
 
   const Token op;
-  const std::shared_ptr<Expression> right;
+  Expression *const right;
 };
 
 struct Variable : Expression {
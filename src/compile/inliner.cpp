@@ -0,0 +1,79 @@
+#include "inliner.hpp"
+
+#include <algorithm>
+
+#include "function.hpp"
+#include "instruction_list.hpp"
+
+namespace kestrel {
+
+bool Inliner::inlineCall(const std::string &name, int arity, int firstSlot,
+                         InstructionArray &out, int &slots) {
+  if (!module_.hasGlobal(name)) {
+    return false;
+  }
+  Value &value = module_.getGlobal(name);
+  if (value.type() != ValueType::Function) {
+    return false;
+  }
+  std::shared_ptr<Function> callee = value.functionValue();
+  if (callee->type() != FunctionType::Native || callee->arity() != arity ||
+      !callee->isCompiled() ||
+      callee->instructions().size() > kMaxCalleeSize) {
+    return false;
+  }
+
+  InstructionList list = InstructionList::decode(callee->instructions());
+  int end = list.code.back().id;
+  for (Instruction &instruction : list.code) {
+    if (instruction.removed) {
+      continue;
+    }
+    switch (instruction.opcode) {
+    case Opcode::LoadLocal:
+    case Opcode::LoadLocalInt:
+    case Opcode::LoadLocalDouble:
+    case Opcode::Store:
+    case Opcode::StoreInt:
+    case Opcode::StoreDouble:
+    case Opcode::StoreBoolean:
+      instruction.operands[0] += firstSlot;
+      break;
+    case Opcode::Return:
+      instruction.opcode = Opcode::Branch;
+      instruction.target = end;
+      break;
+    case Opcode::LoadGlobal:
+      if (module_.getName(instruction.operands[0]) == name) {
+        return false; // recursive;
+      }
+      break;
+    case Opcode::LoadName:
+    case Opcode::Import:
+    case Opcode::Move:
+      return false;
+    default:
+      break;
+    }
+  }
+
+  // the original call, taken when the guard fails;
+  int call = list.insert((int)list.code.size() - 1, Opcode::Call, arity);
+
+  // inserted at the front, so each lands at the position it was given;
+  int at = 0;
+  list.insert(at, Opcode::CheckCallee, arity);
+  list.code[at++].operands[1] = module_.putConstant(value);
+  list.insert(at, Opcode::BranchFalse);
+  list.code[at++].target = call;
+  for (int i = arity - 1; i >= 0; i--) {
+    list.insert(at++, Opcode::Store, firstSlot + i);
+  }
+  list.insert(at++, Opcode::Pop); // the callee;
+
+  out = list.encode();
+  slots = firstSlot + std::max(callee->maxSlots(), arity);
+  return true;
+}
+
+} // namespace kestrel
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+
+#include "instruction_array.hpp"
+#include "module.hpp"
+
+namespace kestrel {
+
+// Inlines calls to small script functions bound to module globals. The
+// callee's finished bytecode is copied into the caller with its locals
+// renamed to caller slots and every Return turned into a branch past the
+// call. A guard keeps the original call for when the global has been
+// rebound since compile time:
+//
+//     LoadGlobal f; <args>          ; as for any call
+//     CheckCallee n k               ; is the callee still constants[k]?
+//     BranchFalse slow
+//     Store base+n-1 .. Store base  ; arguments into the renamed locals
+//     Pop                           ; the callee
+//     <callee body>                 ; Return -> Branch end
+//   slow:
+//     Call n
+//   end:
+//
+// Only functions already compiled when the call is reached qualify, so a
+// function is never inlined into itself.
+class Inliner {
+public:
+  // Bytecode budget of a callee, larger functions keep the call.
+  static const size_t kMaxCalleeSize = 64;
+
+  explicit Inliner(Module &module) : module_(module) {}
+
+  // Writes the sequence replacing `Call arity` to the global `name` into
+  // `out`, using slots from `firstSlot` up to `slots`. Returns false if the
+  // call should stay a call.
+  bool inlineCall(const std::string &name, int arity, int firstSlot,
+                  InstructionArray &out, int &slots);
+
+private:
+  Module &module_;
+};
+
+} // namespace kestrel
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+
+#include "token.hpp"
+
+namespace kestrel {
+
+// Reserved words, recognized with a perfect hash over the first byte, the
+// last byte and the length of an identifier. The multiplier is searched at
+// compile time, so adding a keyword that collides either picks another
+// multiplier or fails the static_assert below.
+namespace keywords {
+
+struct Keyword {
+  const char *text;
+  size_t length;
+  TokenType type;
+};
+
+constexpr Keyword kKeywords[] = {
+    {"and", 3, TokenType::And},         {"class", 5, TokenType::Class},
+    {"else", 4, TokenType::Else},       {"false", 5, TokenType::False},
+    {"final", 5, TokenType::While},     {"for", 3, TokenType::For},
+    {"get", 3, TokenType::Get},         {"def", 3, TokenType::Def},
+    {"if", 2, TokenType::If},           {"import", 6, TokenType::Import},
+    {"is", 2, TokenType::Is},           {"nil", 3, TokenType::Nil},
+    {"nothing", 7, TokenType::Nothing}, {"or", 2, TokenType::Or},
+    {"return", 6, TokenType::Return},   {"set", 3, TokenType::Set},
+    {"super", 5, TokenType::Super},     {"this", 4, TokenType::This},
+    {"true", 4, TokenType::True},       {"let", 3, TokenType::Var},
+    {"while", 5, TokenType::While},     {"module", 6, TokenType::While},
+};
+
+constexpr int kCount = sizeof(kKeywords) / sizeof(kKeywords[0]);
+constexpr int kTableSize = 64;
+constexpr size_t kMaxLength = 7;
+
+constexpr unsigned hash(unsigned multiplier, unsigned char first,
+                        unsigned char last, size_t length) {
+  return (first * multiplier + last + (unsigned)length * 7) % kTableSize;
+}
+
+constexpr bool isPerfect(unsigned multiplier) {
+  bool used[kTableSize] = {};
+  for (int i = 0; i < kCount; i++) {
+    const Keyword &k = kKeywords[i];
+    unsigned h = hash(multiplier, k.text[0], k.text[k.length - 1], k.length);
+    if (used[h]) {
+      return false;
+    }
+    used[h] = true;
+  }
+  return true;
+}
+
+constexpr unsigned findMultiplier() {
+  for (unsigned multiplier = 1; multiplier < 1024; multiplier++) {
+    if (isPerfect(multiplier)) {
+      return multiplier;
+    }
+  }
+  return 0;
+}
+
+constexpr unsigned kMultiplier = findMultiplier();
+static_assert(kMultiplier != 0, "no perfect hash for the keyword set");
+
+// Keyword index per hash bucket, -1 for empty buckets.
+struct Table {
+  signed char slots[kTableSize];
+};
+
+constexpr Table buildTable() {
+  Table table = {};
+  for (int i = 0; i < kTableSize; i++) {
+    table.slots[i] = -1;
+  }
+  for (int i = 0; i < kCount; i++) {
+    const Keyword &k = kKeywords[i];
+    table.slots[hash(kMultiplier, k.text[0], k.text[k.length - 1],
+                     k.length)] = (signed char)i;
+  }
+  return table;
+}
+
+constexpr Table kTable = buildTable();
+
+} // namespace keywords
+
+// Type of the identifier spelled by [text, text + length): the keyword's
+// token type, or Identifier.
+inline TokenType keywordType(const char *text, size_t length) {
+  using namespace keywords;
+  if (length < 2 || length > kMaxLength) {
+    return TokenType::Identifier;
+  }
+  int slot = kTable.slots[hash(kMultiplier, text[0], text[length - 1],
+                               length)];
+  if (slot < 0) {
+    return TokenType::Identifier;
+  }
+  const Keyword &k = kKeywords[slot];
+  if (k.length != length || std::memcmp(k.text, text, length) != 0) {
+    return TokenType::Identifier;
+  }
+  return k.type;
+}
+
+} // namespace kestrel
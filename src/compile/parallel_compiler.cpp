@@ -0,0 +1,76 @@
+#include "parallel_compiler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <thread>
+
+#include "statements.hpp"
+
+namespace kestrel {
+
+namespace {
+
+struct Job {
+  FunctionStatement *statement = nullptr;
+  Module module;
+  Arena arena;
+  std::shared_ptr<Function> function;
+  std::exception_ptr error;
+};
+
+} // namespace
+
+ParallelCompiler::Results
+ParallelCompiler::run(const std::vector<Statement *> &statements,
+                      Arena &arena) {
+  std::vector<FunctionStatement *> functions;
+  for (Statement *statement : statements) {
+    if (auto *function = dynamic_cast<FunctionStatement *>(statement)) {
+      functions.push_back(function);
+    }
+  }
+
+  // constructed in place and never moved, an Arena is not movable;
+  std::vector<Job> jobs(functions.size());
+  for (size_t i = 0; i < functions.size(); i++) {
+    jobs[i].statement = functions[i];
+    jobs[i].module.imports_ = module_.imports_;
+  }
+
+  std::atomic<size_t> next{0};
+  auto work = [&]() {
+    for (size_t i = next++; i < jobs.size(); i = next++) {
+      Job &job = jobs[i];
+      try {
+        job.function = job.statement->compile(job.module, optimizationLevel_,
+                                              job.arena);
+      } catch (...) {
+        job.error = std::current_exception();
+      }
+    }
+  };
+  size_t threads = std::min(jobs.size(), (size_t)std::max(jobs_, 1));
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < threads; i++) {
+    workers.emplace_back(work);
+  }
+  work(); // the calling thread is a worker too;
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  // merge in source order, so indices come out the same on every run;
+  Results results;
+  for (Job &job : jobs) {
+    arena.absorb(job.arena);
+    if (job.error) {
+      std::rethrow_exception(job.error);
+    }
+    module_.merge(job.module, {job.function});
+    results[job.statement] = job.function;
+  }
+  return results;
+}
+
+} // namespace kestrel
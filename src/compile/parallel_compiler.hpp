@@ -0,0 +1,44 @@
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "arena.hpp"
+#include "function.hpp"
+#include "module.hpp"
+#include "statement.hpp"
+
+namespace kestrel {
+
+struct FunctionStatement;
+
+// Compiles the bodies of a module's top-level functions on a pool of worker
+// threads before the module itself is compiled. Each body is compiled
+// against a private module, so workers share nothing but the read-only
+// tree; the private constant and name tables are then merged into the
+// shared module one function at a time, in source order, and the operands
+// of the merged code renumbered. The result does not depend on how the
+// work was scheduled.
+//
+// A body cannot inline calls to other top-level functions, which are not
+// compiled yet when it is; code outside of functions still can.
+class ParallelCompiler {
+public:
+  using Results = std::unordered_map<const FunctionStatement *,
+                                     std::shared_ptr<Function>>;
+
+  ParallelCompiler(Module &module, int optimizationLevel, int jobs)
+      : module_(module), optimizationLevel_(optimizationLevel), jobs_(jobs) {}
+
+  // Compiles every FunctionStatement directly in `statements`. Nodes the
+  // workers allocate end up in `arena`.
+  Results run(const std::vector<Statement *> &statements, Arena &arena);
+
+private:
+  Module &module_;
+  int optimizationLevel_;
+  int jobs_;
+};
+
+} // namespace kestrel
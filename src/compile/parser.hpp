@@ -5,6 +5,7 @@
 #include <stdexcept>
 #include <string>
 #include <vector>
+#include "arena.hpp"
 #include "statements.hpp"
 #include "token.hpp"
 
@@ -16,29 +17,45 @@ class Parser {
   };
 
   const std::vector<Token> &tokens;
+  Arena &arena;
   int current = 0;
+  bool lazyFunctions = false;
+  std::vector<std::string> errors_;
 
 public:
-  Parser(const std::vector<Token> &tokens) : tokens{tokens} {}
+  // Nodes are allocated in `arena` and live exactly as long as it does.
+  Parser(const std::vector<Token> &tokens, Arena &arena)
+      : tokens{tokens}, arena{arena} {}
 
-  std::vector<std::shared_ptr<Statement>> parse() {
-    std::vector<std::shared_ptr<Statement>> statements;
+  std::vector<Statement *> parse() {
+    std::vector<Statement *> statements;
     while (!isAtEnd()) {
-      statements.push_back(declaration());
+      if (Statement *statement = declaration()) {
+        statements.push_back(statement);
+      }
     }
 
     return statements;
   }
 
+  // Syntax errors met by parse(), one per statement left out; the tree of a
+  // source with any is incomplete and must not be compiled.
+  const std::vector<std::string> &errors() const { return errors_; }
+
+  // Pre-parses function declarations: their bodies are only skipped over,
+  // to be parsed and compiled on the first call (see LazyFunctionStatement).
+  // Class methods are parsed as usual.
+  void setLazyFunctions(bool lazy) { lazyFunctions = lazy; }
+
 private:
-  std::shared_ptr<Expression> expression() { return assignment(); }
+  Expression *expression() { return assignment(); }
 
-  std::shared_ptr<Statement> declaration() {
+  Statement *declaration() {
     try {
       if (match(TokenType::Class))
         return classDeclaration();
       if (match(TokenType::Def))
-        return function("function");
+        return lazyFunctions ? lazyFunction() : function("function");
       if (match(TokenType::Var))
         return varDeclaration();
       if (match(TokenType::Import))
@@ -50,26 +67,27 @@ private:
       return statement();
     } catch (ParseError error) {
       Log(level, tag) << "parse error:" << error.what() ;
+      errors_.push_back(error.what());
       synchronize();
       return nullptr;
     }
   }
 
-  std::shared_ptr<Statement> classDeclaration() {
+  Statement *classDeclaration() {
     Token name = consume(TokenType::Identifier, "Expect class name.");
 
-    std::shared_ptr<Variable> superclass = nullptr;
+    Variable *superclass = nullptr;
     if (match(TokenType::Colon)) {
       consume(TokenType::Identifier, "Expect superclass name.");
-      superclass = std::make_shared<Variable>(previous());
+      superclass = arena.make<Variable>(previous());
     }
 
     consume(TokenType::LeftBrace, "Expect '{' before class body.");
 
-    std::vector<std::shared_ptr<FunctionStatement>> methods;
-    std::vector<std::shared_ptr<FunctionStatement>> constructors;
-    std::vector<std::shared_ptr<FunctionStatement>> getters;
-    std::vector<std::shared_ptr<FunctionStatement>> setters;
+    std::vector<FunctionStatement *> methods;
+    std::vector<FunctionStatement *> constructors;
+    std::vector<FunctionStatement *> getters;
+    std::vector<FunctionStatement *> setters;
 
     while (!check(TokenType::RightBrace) && !isAtEnd()) {
       // TODO check duplicate?
@@ -97,13 +115,13 @@ private:
         // TODO generate default constructor;
     }
 
-    return std::make_shared<ClassStatement>(std::move(name), superclass,
+    return arena.make<ClassStatement>(std::move(name), superclass,
                                    std::move(constructors),
                                    std::move(methods), std::move(getters),
                                    std::move(setters));
   }
 
-  std::shared_ptr<Statement> statement() {
+  Statement *statement() {
     if (match(TokenType::For)) {
       return forStatement();
     }
@@ -120,17 +138,17 @@ private:
     }
       
     if (match(TokenType::LeftBrace)) {
-      return std::make_shared<BlockStatement>(block());
+      return arena.make<BlockStatement>(block());
     }
       
 
     return expressionStatement();
   }
 
-  std::shared_ptr<Statement> forStatement() {
+  Statement *forStatement() {
     consume(TokenType::LeftParenthesis, "Expect '(' after 'for'.");
 
-    std::shared_ptr<Statement> initializer;
+    Statement *initializer = nullptr;
     if (match(TokenType::Semicolon)) {
       initializer = nullptr;
     } else if (match(TokenType::Var)) {
@@ -139,100 +157,159 @@ private:
       initializer = expressionStatement();
     }
 
-    std::shared_ptr<Expression> condition = nullptr;
+    Expression *condition = nullptr;
     if (!check(TokenType::Semicolon)) {
       condition = expression();
     }
     consume(TokenType::Semicolon, "Expect ';' after loop condition.");
 
-    std::shared_ptr<Expression> increment = nullptr;
+    Expression *increment = nullptr;
     if (!check(TokenType::RightParenthesis)) {
       increment = expression();
     }
     consume(TokenType::RightParenthesis, "Expect ')' after for clauses.");
-    std::shared_ptr<Statement> body = statement();
+    Statement *body = statement();
 
     if (increment != nullptr) {
-      body = std::make_shared<BlockStatement>(std::vector<std::shared_ptr<Statement>>{
-          body, std::make_shared<ExpressionStatement>(increment)});
+      body = arena.make<BlockStatement>(std::vector<Statement *>{
+          body, arena.make<ExpressionStatement>(increment)});
         //TODO 
     }
 
     if (condition == nullptr) {
-      condition = std::make_shared<LiteralExpression>(true);
+      condition = arena.make<LiteralExpression>(true);
     }
-    body = std::make_shared<While>(condition, body);
+    body = arena.make<While>(condition, body);
 
     if (initializer != nullptr) {
-      body = std::make_shared<BlockStatement>(
-          std::vector<std::shared_ptr<Statement>>{initializer, body});
+      body = arena.make<BlockStatement>(
+          std::vector<Statement *>{initializer, body});
     }
 
     return body;
   }
 
-  std::shared_ptr<Statement> ifStatement() {
+  Statement *ifStatement() {
     consume(TokenType::LeftParenthesis, "Expect '(' after 'if'.");
-    std::shared_ptr<Expression> condition = expression();
+    Expression *condition = expression();
     consume(TokenType::RightParenthesis, "Expect ')' after if condition.");
 
-    std::shared_ptr<Statement> thenBranch = statement();
-    std::shared_ptr<Statement> elseBranch = nullptr;
+    Statement *thenBranch = statement();
+    Statement *elseBranch = nullptr;
     if (match(TokenType::Else)) {
       elseBranch = statement();
     }
 
-    return std::make_shared<IfStatement>(condition, thenBranch, elseBranch);
+    return arena.make<IfStatement>(condition, thenBranch, elseBranch);
   }
 
-  std::shared_ptr<Statement> returnStatement() {
+  Statement *returnStatement() {
     // Log(level, tag) << "returnStatement" ;
     Token keyword = previous();
-    std::shared_ptr<Expression> value = nullptr;
+    Expression *value = nullptr;
     if (!check(TokenType::Semicolon)) {
       Log(level, tag) << "return !Semicolon" ;
       value = expression();
     }
 
     consume(TokenType::Semicolon, "Expect ';' after return value.");
-    return std::make_shared<ReturnStatement>(value);
+    return arena.make<ReturnStatement>(value);
   }
 
-  std::shared_ptr<Statement> importDeclaration() {
+  Statement *importDeclaration() {
     Token name = consume(TokenType::Identifier, "Expect module name.");
     consume(TokenType::Semicolon, "Expect ';' after import declaration.");
-    return std::make_shared<Import>(std::move(name));
+    return arena.make<Import>(std::move(name));
   }
 
-  std::shared_ptr<Statement> varDeclaration() {
+  Statement *varDeclaration() {
     Token name = consume(TokenType::Identifier, "Expect variable name.");
 
-    std::shared_ptr<Expression> initializer = nullptr;
+    Expression *initializer = nullptr;
     if (match(TokenType::Equal)) {
       initializer = expression();
     }
 
     consume(TokenType::Semicolon, "Expect ';' after variable declaration.");
-    return std::make_shared<VariableStatement>(std::move(name), initializer);
+    return arena.make<VariableStatement>(std::move(name), initializer);
   }
 
-  std::shared_ptr<Statement> whileStatement() {
+  Statement *whileStatement() {
     consume(TokenType::LeftParenthesis, "Expect '(' after 'while'.");
-    std::shared_ptr<Expression> condition = expression();
+    Expression *condition = expression();
     consume(TokenType::RightParenthesis, "Expect ')' after condition.");
-    std::shared_ptr<Statement> body = statement();
+    Statement *body = statement();
 
-    return std::make_shared<While>(condition, body);
+    return arena.make<While>(condition, body);
   }
 
-  std::shared_ptr<Statement> expressionStatement() {
-    std::shared_ptr<Expression> expr = expression();
+  Statement *expressionStatement() {
+    Expression *expr = expression();
     consume(TokenType::Semicolon, "Expect ';' after expression.");
-    return std::make_shared<ExpressionStatement>(expr);
+    return arena.make<ExpressionStatement>(expr);
   }
 
-  std::shared_ptr<FunctionStatement> function(String kind) {
+  FunctionStatement *function(String kind) {
     Token name = consume(TokenType::Identifier, "Expect " + kind + " name.");
+    std::vector<Token> parameters = parameterList(kind);
+
+    consume(TokenType::LeftBrace, "Expect '{' before " + kind + " body.");
+    if (check(TokenType::RightBrace)) {
+      throw error(peek(), "Expect statement in " + kind + " body.");
+    }
+    std::vector<Statement *> body = block();
+
+    // Log(level, tag) << "body.size():" << body.size() ;
+    return arena.make<FunctionStatement>(std::move(name), std::move(parameters), body);
+  }
+
+  // Finds where a function body ends without building it, checking only
+  // that its brackets pair up; the rest of the syntax is checked when the
+  // body is parsed for real.
+  Statement *lazyFunction() {
+    Token name = consume(TokenType::Identifier, "Expect function name.");
+    std::vector<Token> parameters = parameterList("function");
+
+    Token open = consume(TokenType::LeftBrace, "Expect '{' before function body.");
+    if (check(TokenType::RightBrace)) {
+      throw error(peek(), "Expect statement in function body.");
+    }
+    std::vector<TokenType> closers;
+    while (!closers.empty() || !check(TokenType::RightBrace)) {
+      if (isAtEnd()) {
+        throw error(peek(), "Expect '}' after block.");
+      }
+      const Token &token = advance();
+      switch (token.type) {
+      case TokenType::LeftParenthesis:
+        closers.push_back(TokenType::RightParenthesis);
+        break;
+      case TokenType::LeftBracket:
+        closers.push_back(TokenType::RightBracket);
+        break;
+      case TokenType::LeftBrace:
+        closers.push_back(TokenType::RightBrace);
+        break;
+      case TokenType::RightParenthesis:
+      case TokenType::RightBracket:
+      case TokenType::RightBrace:
+        if (closers.empty() || closers.back() != token.type) {
+          throw error(token, "Unbalanced '" + token.lexeme() + "'.");
+        }
+        closers.pop_back();
+        break;
+      default:
+        break;
+      }
+    }
+    Token close = advance();
+
+    return arena.make<LazyFunctionStatement>(std::move(name),
+                                             std::move(parameters),
+                                             std::move(open), std::move(close));
+  }
+
+  std::vector<Token> parameterList(String kind) {
     consume(TokenType::LeftParenthesis, "Expect '(' after " + kind + " name.");
     std::vector<Token> parameters;
     if (!check(TokenType::RightParenthesis)) {
@@ -246,37 +323,34 @@ private:
       } while (match(TokenType::Comma));
     }
     consume(TokenType::RightParenthesis, "Expect ')' after parameters.");
-
-    consume(TokenType::LeftBrace, "Expect '{' before " + kind + " body.");
-    std::vector<std::shared_ptr<Statement>> body = block();
-
-    // Log(level, tag) << "body.size():" << body.size() ;
-    return std::make_shared<FunctionStatement>(std::move(name), std::move(parameters), body);
+    return parameters;
   }
 
-  std::vector<std::shared_ptr<Statement>> block() {
-    std::vector<std::shared_ptr<Statement>> statements;
+  std::vector<Statement *> block() {
+    std::vector<Statement *> statements;
 
     while (!check(TokenType::RightBrace) && !isAtEnd()) {
-      statements.push_back(declaration());
+      if (Statement *statement = declaration()) {
+        statements.push_back(statement);
+      }
     }
 
     consume(TokenType::RightBrace, "Expect '}' after block.");
     return statements;
   }
 
-  std::shared_ptr<Expression> assignment() {
-    std::shared_ptr<Expression> expr = orExpression();
+  Expression *assignment() {
+    Expression *expr = orExpression();
 
     if (match(TokenType::Equal)) {
       Token equals = previous();
-      std::shared_ptr<Expression> value = assignment();
+      Expression *value = assignment();
 
-      if (Variable *e = dynamic_cast<Variable *>(expr.get())) {
+      if (Variable *e = dynamic_cast<Variable *>(expr)) {
         Token name = e->name;
-        return std::make_shared<Assign>(std::move(name), value);
-      } else if (Get *get = dynamic_cast<Get *>(expr.get())) {
-        return std::make_shared<Set>(get->object, get->name, value);
+        return arena.make<Assign>(std::move(name), value);
+      } else if (Get *get = dynamic_cast<Get *>(expr)) {
+        return arena.make<Set>(get->object, get->name, value);
       }
 
       error(std::move(equals), "Invalid assignment target.");
@@ -285,93 +359,93 @@ private:
     return expr;
   }
 
-  std::shared_ptr<Expression> orExpression() {
-    std::shared_ptr<Expression> expr = andExpression();
+  Expression *orExpression() {
+    Expression *expr = andExpression();
 
     while (match(TokenType::Or)) {
       Token op = previous();
-      std::shared_ptr<Expression> right = andExpression();
-      expr = std::make_shared<Logical>(expr, std::move(op), right);
+      Expression *right = andExpression();
+      expr = arena.make<Logical>(expr, std::move(op), right);
     }
 
     return expr;
   }
 
-  std::shared_ptr<Expression> andExpression() {
-    std::shared_ptr<Expression> expr = equality();
+  Expression *andExpression() {
+    Expression *expr = equality();
 
     while (match(TokenType::And)) {
       Token op = previous();
-      std::shared_ptr<Expression> right = equality();
-      expr = std::make_shared<Logical>(expr, std::move(op), right);
+      Expression *right = equality();
+      expr = arena.make<Logical>(expr, std::move(op), right);
     }
 
     return expr;
   }
 
-  std::shared_ptr<Expression> equality() {
-    std::shared_ptr<Expression> expr = comparison();
+  Expression *equality() {
+    Expression *expr = comparison();
 
     // TODO use keywords?
     while (match(TokenType::BangEqual, TokenType::EqualEqual)) {
       Token op = previous();
-      std::shared_ptr<Expression> right = comparison();
-      expr = std::make_shared<Binary>(expr, std::move(op), right);
+      Expression *right = comparison();
+      expr = arena.make<Binary>(expr, std::move(op), right);
     }
 
     return expr;
   }
 
-  std::shared_ptr<Expression> comparison() {
-    std::shared_ptr<Expression> expr = term();
+  Expression *comparison() {
+    Expression *expr = term();
 
     while (match(TokenType::GreaterThan, TokenType::GreaterThanEqual,
                  TokenType::LessThan, TokenType::LessThanEqual)) {
       Token op = previous();
-      std::shared_ptr<Expression> right = term();
-      expr = std::make_shared<Binary>(expr, std::move(op), right);
+      Expression *right = term();
+      expr = arena.make<Binary>(expr, std::move(op), right);
     }
 
     return expr;
   }
 
-  std::shared_ptr<Expression> term() {
-    std::shared_ptr<Expression> expr = factor();
+  Expression *term() {
+    Expression *expr = factor();
 
     while (match(TokenType::Minus, TokenType::Plus)) {
       Token op = previous();
-      std::shared_ptr<Expression> right = factor();
-      expr = std::make_shared<Binary>(expr, std::move(op), right);
+      Expression *right = factor();
+      expr = arena.make<Binary>(expr, std::move(op), right);
     }
 
     return expr;
   }
 
-  std::shared_ptr<Expression> factor() {
-    std::shared_ptr<Expression> expr = unary();
+  Expression *factor() {
+    Expression *expr = unary();
 
     while (match(TokenType::Slash, TokenType::Star)) {
       Token op = previous();
-      std::shared_ptr<Expression> right = unary();
-      expr = std::make_shared<Binary>(expr, std::move(op), right);
+      Expression *right = unary();
+      expr = arena.make<Binary>(expr, std::move(op), right);
     }
 
     return expr;
   }
 
-  std::shared_ptr<Expression> unary() {
+  Expression *unary() {
     // TODO bang to not?
     if (match(TokenType::Bang, TokenType::Minus)) {
       Token op = previous();
-      std::shared_ptr<Expression> right = unary();
-      return std::make_shared<Unary>(std::move(op), right);
+      Expression *right = unary();
+      return arena.make<Unary>(std::move(op), right);
     }
 
     return call();
   }
 
-  std::shared_ptr<Expression> finishMethodCall(std::shared_ptr<Expression> callee, Token name) {
-    std::vector<std::shared_ptr<Expression>> arguments;
+  Expression *finishMethodCall(Expression *callee, Token name) {
+    std::vector<Expression *> arguments;
     if (!check(TokenType::RightParenthesis)) {
       do {
         if (arguments.size() >= 255) {
@@ -385,11 +459,11 @@ private:
         consume(TokenType::RightParenthesis, "Expect ')' after arguments.");
 
     // TODO
-    return std::make_shared<Dispatch>(callee, name, std::move(arguments));
+    return arena.make<Dispatch>(callee, name, std::move(arguments));
   }
 
-  std::shared_ptr<Expression> finishCall(std::shared_ptr<Expression> callee) {
-    std::vector<std::shared_ptr<Expression>> arguments;
+  Expression *finishCall(Expression *callee) {
+    std::vector<Expression *> arguments;
     if (!check(TokenType::RightParenthesis)) {
       do {
         if (arguments.size() >= 255) {
@@ -402,11 +476,11 @@ private:
     Token paren =
         consume(TokenType::RightParenthesis, "Expect ')' after arguments.");
 
-    return std::make_shared<Call>(callee, std::move(arguments));
+    return arena.make<Call>(callee, std::move(arguments));
   }
 
-  std::shared_ptr<Expression> call() {
-    std::shared_ptr<Expression> expr = primary();
+  Expression *call() {
+    Expression *expr = primary();
 
     while (true) {
       if (match(TokenType::LeftParenthesis)) {
@@ -418,7 +492,7 @@ private:
           std::cout << "Method Call" << std::endl;
           expr = finishMethodCall(expr, name);
         } else {
-          expr = std::make_shared<Get>(expr, std::move(name));
+          expr = arena.make<Get>(expr, std::move(name));
         }
         
       } else {
@@ -429,17 +503,17 @@ private:
     return expr;
   }
 
-  std::shared_ptr<Expression> primary() {
+  Expression *primary() {
     if (match(TokenType::False))
-      return std::make_shared<LiteralExpression>(false);
+      return arena.make<LiteralExpression>(false);
     if (match(TokenType::True))
-      return std::make_shared<LiteralExpression>(true);
+      return arena.make<LiteralExpression>(true);
     if (match(TokenType::Nil)) // TODD
-      return std::make_shared<LiteralExpression>();
+      return arena.make<LiteralExpression>();
 
     // TODO int and double?
     if (match(TokenType::Integer, TokenType::Double, TokenType::String)) {
-      return std::make_shared<LiteralExpression>(previous().literal);
+      return arena.make<LiteralExpression>(previous().literal());
     }
 
     if (match(TokenType::Super)) {
@@ -447,30 +521,30 @@ private:
       consume(TokenType::Dot, "Expect '.' after 'super'.");
       Token method =
           consume(TokenType::Identifier, "Expect superclass method name.");
-      return std::make_shared<Super>(std::move(keyword), std::move(method));
+      return arena.make<Super>(std::move(keyword), std::move(method));
     }
 
     if (match(TokenType::This))
-      return std::make_shared<This>(previous());
+      return arena.make<This>(previous());
 
     if (match(TokenType::Var)) {
-      return std::make_shared<Variable>(previous());
+      return arena.make<Variable>(previous());
     }
 
     if (match(TokenType::Identifier)) {
-      return std::make_shared<Variable>(previous());
+      return arena.make<Variable>(previous());
     }
 
     if (match(TokenType::LeftParenthesis)) {
       Log(level, tag) << "LeftParenthesis" ;
-      std::shared_ptr<Expression> expr = expression();
+      Expression *expr = expression();
       consume(TokenType::RightParenthesis, "Expect ')' after expression.");
-      return std::make_shared<Grouping>(expr);
+      return arena.make<Grouping>(expr);
     }
     if (match(TokenType::Identifier)) {
     //   TODO
-    //   std::shared_ptr<Expression> expr = call();
-    //   return std::make_shared<ExpressionStatement>(expr);
+    //   Expression *expr = call();
+    //   return arena.make<ExpressionStatement>(expr);
         return call(); //TODO
     }
     Log(level, tag) << "type:" << (int)peek().type ;
@@ -511,7 +585,7 @@ private:
 
   bool check(TokenType type) { return isAtEnd() ? false : peek().type == type; }
 
-  Token advance() {
+  const Token &advance() {
     if (!isAtEnd()) {
       ++current;
     }
@@ -520,13 +594,12 @@ private:
 
   bool isAtEnd() { return peek().type == TokenType::EndOfFile; }
 
-  Token peek() { return tokens.at(current); }
+  const Token &peek() { return tokens.at(current); }
 
-  Token previous() { return tokens.at(current - 1); }
+  const Token &previous() { return tokens.at(current - 1); }
 
   ParseError error(const Token &token, String message) {
-    // ::error(token, message);
-    return ParseError{message};
+    return ParseError{"line " + std::to_string(token.line) + ": " + message};
   }
 
   void synchronize() {
@@ -0,0 +1,117 @@
+#include "reloader.hpp"
+
+#include <unordered_map>
+#include <vector>
+
+#include "compile/parser.hpp"
+#include "compile/scanner.hpp"
+#include "compile/statements.hpp"
+#include "image.hpp"
+
+namespace kestrel {
+
+namespace {
+
+// A top-level function of a source, the text from its name to its closing
+// brace hashed;
+struct Definition {
+  uint64_t hash;
+  LazyFunctionStatement *statement;
+};
+
+} // namespace
+
+struct Reloader::Detail {
+  // Runs `visit` on the top-level functions of `source`, whose statements
+  // live in `arena`.
+  template <typename Visit>
+  void definitions(const std::string &source, Arena &arena, Visit visit) {
+    Scanner scanner(source);
+    std::vector<Token> tokens = scanner.scanTokens();
+    Parser parser(tokens, arena);
+    parser.setLazyFunctions(true);
+    for (Statement *statement : parser.parse()) {
+      auto *function = dynamic_cast<LazyFunctionStatement *>(statement);
+      if (function == nullptr) {
+        continue;
+      }
+      const Token &name = function->name();
+      const Token &close = function->close();
+      std::string text(name.text(), close.start + close.length - name.start);
+      visit(name.lexeme(), Definition{Image::contentHash(text), function});
+    }
+  }
+
+  int optimizationLevel;
+  std::unordered_map<std::string, uint64_t> hashes; // by function name;
+  size_t changed = 0;
+  size_t unchanged = 0;
+};
+
+Reloader::Reloader(int optimizationLevel) : detail(std::make_unique<Detail>()) {
+  detail->optimizationLevel = optimizationLevel;
+}
+
+Reloader::~Reloader() = default;
+
+void Reloader::track(const std::string &source) {
+  Arena arena;
+  detail->hashes.clear();
+  detail->definitions(source, arena,
+                      [&](const std::string &name, const Definition &d) {
+                        detail->hashes[name] = d.hash;
+                      });
+}
+
+Patch Reloader::diff(Module &module, const std::string &source) {
+  Arena arena;
+  // the last definition of a name is the one bound;
+  std::unordered_map<std::string, Definition> definitions;
+  std::vector<std::string> order;
+  detail->definitions(source, arena,
+                      [&](const std::string &name, const Definition &d) {
+                        if (definitions.count(name) == 0) {
+                          order.push_back(name);
+                        }
+                        definitions[name] = d;
+                      });
+
+  // compiled on the side, the running module only takes the new names and
+  // constants in when the patch is applied;
+  Patch patch;
+  patch.module = std::make_shared<Module>();
+  patch.module->imports_ = module.imports_;
+  detail->changed = detail->unchanged = 0;
+  for (const std::string &name : order) {
+    const Definition &definition = definitions.at(name);
+    auto it = detail->hashes.find(name);
+    if (it != detail->hashes.end() && it->second == definition.hash) {
+      detail->unchanged++;
+      continue;
+    }
+    // compiled now rather than on the first call, the stub keeps the new
+    // source alive;
+    std::shared_ptr<Function> function =
+        definition.statement->stub(detail->optimizationLevel);
+    function->compile(*patch.module);
+    patch.functions.emplace_back(name, std::move(function));
+    detail->changed++;
+  }
+  for (auto &tracked : detail->hashes) {
+    if (definitions.count(tracked.first) == 0) {
+      patch.removed.push_back(tracked.first);
+    }
+  }
+
+  detail->hashes.clear();
+  for (auto &definition : definitions) {
+    detail->hashes[definition.first] = definition.second.hash;
+  }
+  return patch;
+}
+
+size_t Reloader::changed() const { return detail->changed; }
+
+size_t Reloader::unchanged() const { return detail->unchanged; }
+
+} // namespace kestrel
@@ -1,9 +1,12 @@
 #pragma once
 
-#include <map>
+#include <algorithm>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "byte_class.hpp"
+#include "keywords.hpp"
 #include "token.hpp"
 
 namespace kestrel {
@@ -11,7 +14,16 @@ namespace kestrel {
 class Scanner {
 
 public:
-  Scanner(String source) : source{source} {}
+  // Takes the source over; tokens refer into it rather than copying.
+  Scanner(String source)
+      : buffer{std::make_shared<const String>(std::move(source))},
+        source{buffer->data()}, length{(int)buffer->size()} {}
+
+  // Scans [begin, end) of a buffer other tokens already refer to, counting
+  // lines from `line`.
+  Scanner(std::shared_ptr<const String> source, int begin, int end, int line)
+      : buffer{std::move(source)}, source{buffer->data()}, length{end},
+        start{begin}, current{begin}, line{line} {}
 
   std::vector<Token> scanTokens() {
     while (!isAtEnd()) {
@@ -21,7 +33,7 @@ public:
     }
 
     // tokens.push_back(TokenType::EndOfFile);
-    tokens.emplace_back(TokenType::EndOfFile, "", "", line);
+    tokens.emplace_back(TokenType::EndOfFile, buffer, current, 0, line);
     return tokens;
   }
 
@@ -86,12 +98,14 @@ private:
     case ' ':
     case '\r':
     case '\t':
-      // Ignore whitespace.
-      break;
-
-    case '\n':
-      ++line;
+    case '\n': {
+      // Ignore whitespace, counting the lines it spans.
+      --current;
+      int n = (int)byte_class::blankRun(source + current, source + length);
+      line += (int)std::count(source + current, source + current + n, '\n');
+      current += n;
       break;
+    }
 
     case '"':
       string();
@@ -112,36 +126,23 @@ private:
   }
 
   void identifier() {
-    while (isAlphaNumeric(peek())) {
-      advance();
-    }
-
-    String text = String{source.substr(start, current - start)};
-
-    TokenType type = TokenType::Identifier;
-    auto match = keywords.find(text);
-    if (match != keywords.end()) {
-      type = match->second;
-    }
-    addToken(type);
+    current += (int)byte_class::identifierRun(source + current,
+                                              source + length);
+    addToken(keywordType(source + start, current - start));
   }
 
   void number() {
-    while (isDigit(peek())) {
-      advance();
-    }
+    current += (int)byte_class::digitRun(source + current, source + length);
 
     // Look for a fractional part.
     if (peek() == '.' && isDigit(peekNext())) {
       // Consume the "."
       advance();
-      while (isDigit(peek())) {
-        advance();
-      }
-      addToken(TokenType::Double, source.substr(start, current - start));
+      current += (int)byte_class::digitRun(source + current, source + length);
+      addToken(TokenType::Double);
       return;
     }
-    addToken(TokenType::Integer, source.substr(start, current - start));
+    addToken(TokenType::Integer);
   }
 
   void string() {
@@ -159,10 +160,7 @@ private:
 
     // The closing ".
     advance();
-
-    // Trim the surrounding quotes.
-    String value{source.substr(start + 1, current - 2 - start)};
-    addToken(TokenType::String, value);
+    addToken(TokenType::String);
   }
 
   bool match(char expected) {
@@ -185,52 +183,33 @@ private:
   }
 
   char peekNext() {
-    if (current + 1 >= source.length()) {
+    if (current + 1 >= length) {
       return '\0';
     }
     return source[current + 1];
   }
 
-  bool isAlpha(char c) {
-    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
-  }
-
-  bool isAlphaNumeric(char c) { return isAlpha(c) || isDigit(c); }
+  bool isAlpha(char c) { return byte_class::isAlpha(c); }
 
-  bool isDigit(char c) { return c >= '0' && c <= '9'; }
+  bool isDigit(char c) { return byte_class::isDigit(c); }
 
-  bool isAtEnd() { return current >= source.length(); }
+  bool isAtEnd() { return current >= length; }
 
   char advance() { return source[current++]; }
 
-  void addToken(TokenType type, String value = "") {
-    String text{source.substr(start, current - start)};
-    tokens.emplace_back(type, std::move(text), std::move(value), line);
+  void addToken(TokenType type) {
+    tokens.emplace_back(type, buffer, start, current - start, line);
   }
   // };
 
 private:
-  static const std::map<String, TokenType> keywords;
-
-  String source;
+  std::shared_ptr<const String> buffer;
+  const char *source;
+  int length;
   std::vector<Token> tokens;
   int start = 0;
   int current = 0;
   int line = 1;
 };
-// move to somewher else?
-const std::map<String, TokenType> Scanner::keywords = {
-    {"and", TokenType::And},         {"class", TokenType::Class},
-    {"else", TokenType::Else},       {"false", TokenType::False},
-    {"final", TokenType::While},     {"for", TokenType::For},
-    {"get", TokenType::Get},         {"def", TokenType::Def},
-    {"if", TokenType::If},           {"import", TokenType::Import},
-    {"is", TokenType::Is},           {"nil", TokenType::Nil},
-    {"nothing", TokenType::Nothing}, {"or", TokenType::Or},
-    {"return", TokenType::Return},   {"set", TokenType::Set},
-    {"super", TokenType::Super},     {"this", TokenType::This},
-    {"true", TokenType::True},       {"let", TokenType::Var},
-    {"while", TokenType::While},     {"module", TokenType::While},
-};
 
 } // namespace kestrel
@@ -0,0 +1,364 @@
+#include "builder.hpp"
+
+#include "compile/statements.hpp"
+#include "compile/expression.hpp"
+
+namespace kestrel {
+namespace ssa {
+
+Builder::Builder(Graph &graph, const SymbolTable &table)
+    : graph_(graph), table_(table) {}
+
+bool Builder::build(const std::vector<Statement *> &statements) {
+  current_ = graph_.entry = graph_.newBlock();
+  sealed_.insert(current_);
+
+  // parameters arrive in the first slots;
+  for (int i = 0; i < table_.size(); i++) {
+    Node *param = graph_.append(current_, NodeKind::Param);
+    param->index = i;
+    write(i, current_, param);
+  }
+
+  for (auto &stmt : statements) {
+    statement(stmt);
+    if (!supported_) {
+      return false;
+    }
+  }
+  // code after a return leaves unreachable predecessors behind;
+  graph_.analyze();
+  removeTrivialPhis(graph_);
+  return true;
+}
+
+Block *Builder::startBlock(bool sealed) {
+  current_ = graph_.newBlock();
+  if (sealed) {
+    sealed_.insert(current_);
+  }
+  return current_;
+}
+
+Node *Builder::constant(const Value &value) {
+  Node *node = graph_.append(current_, NodeKind::Constant);
+  node->constant = value;
+  return node;
+}
+
+void Builder::write(int slot, Block *block, Node *value) {
+  defs_[block][slot] = value;
+}
+
+Node *Builder::read(int slot, Block *block) {
+  auto &defs = defs_[block];
+  auto it = defs.find(slot);
+  if (it != defs.end()) {
+    return it->second;
+  }
+  return readRecursive(slot, block);
+}
+
+Node *Builder::readRecursive(int slot, Block *block) {
+  Node *value = nullptr;
+  if (!sealed_.count(block)) {
+    // more predecessors may follow, complete the phi when sealing;
+    value = graph_.newNode(NodeKind::Phi);
+    value->block = block;
+    block->phis.push_back(value);
+    incomplete_[block][slot] = value;
+  } else if (block->predecessors.size() == 1) {
+    value = read(slot, block->predecessors[0]);
+  } else if (block->predecessors.empty()) {
+    // declared later or unreachable: frames start out nil;
+    Node *node = graph_.newNode(NodeKind::Constant);
+    node->block = block;
+    block->code.insert(block->code.begin(), node);
+    value = node;
+  } else {
+    value = graph_.newNode(NodeKind::Phi);
+    value->block = block;
+    block->phis.push_back(value);
+    write(slot, block, value); // breaks cycles through loops;
+    addPhiOperands(slot, value);
+  }
+  write(slot, block, value);
+  return value;
+}
+
+void Builder::addPhiOperands(int slot, Node *phi) {
+  for (Block *predecessor : phi->block->predecessors) {
+    phi->operands.push_back(read(slot, predecessor));
+  }
+}
+
+void Builder::seal(Block *block) {
+  for (auto &entry : incomplete_[block]) {
+    addPhiOperands(entry.first, entry.second);
+  }
+  incomplete_.erase(block);
+  sealed_.insert(block);
+}
+
+void Builder::statement(Statement *stmt) {
+  if (stmt == nullptr || !supported_) {
+    return;
+  }
+  if (auto *s = dynamic_cast<ExpressionStatement *>(stmt)) {
+    expression(s->expression);
+  } else if (auto *s = dynamic_cast<VariableStatement *>(stmt)) {
+    Node *value = s->initializer ? expression(s->initializer)
+                                 : constant(Value());
+    write(table_.addSymbol(s->name.lexeme()), current_, value);
+  } else if (auto *s = dynamic_cast<BlockStatement *>(stmt)) {
+    table_.enterScope();
+    for (auto &inner : s->statements) {
+      statement(inner);
+    }
+    table_.exitScope();
+  } else if (auto *s = dynamic_cast<IfStatement *>(stmt)) {
+    Block *thenBlock = graph_.newBlock();
+    Block *elseBlock = s->elseBranch ? graph_.newBlock() : nullptr;
+    Block *join = graph_.newBlock();
+    condition(s->condition, thenBlock, elseBlock ? elseBlock : join);
+
+    seal(thenBlock);
+    current_ = thenBlock;
+    statement(s->thenBranch);
+    if (current_->exit == Exit::None) {
+      graph_.jump(current_, join);
+    }
+    if (elseBlock) {
+      seal(elseBlock);
+      current_ = elseBlock;
+      statement(s->elseBranch);
+      if (current_->exit == Exit::None) {
+        graph_.jump(current_, join);
+      }
+    }
+    seal(join);
+    current_ = join;
+  } else if (auto *s = dynamic_cast<While *>(stmt)) {
+    Block *header = graph_.newBlock();
+    graph_.jump(current_, header);
+    current_ = header;
+    Block *body = graph_.newBlock();
+    Block *exit = graph_.newBlock();
+    condition(s->condition, body, exit);
+
+    seal(body);
+    current_ = body;
+    statement(s->body);
+    if (current_->exit == Exit::None) {
+      graph_.jump(current_, header);
+    }
+    seal(header);
+    seal(exit);
+    current_ = exit;
+  } else if (auto *s = dynamic_cast<ReturnStatement *>(stmt)) {
+    Node *value = s->value ? expression(s->value) : constant(Value());
+    graph_.ret(current_, value);
+    startBlock(true); // anything after the return is unreachable;
+  } else {
+    supported_ = false; // functions, classes and imports;
+  }
+}
+
+void Builder::condition(Expression *expr, Block *ifTrue, Block *ifFalse) {
+  if (expr != nullptr && supported_) {
+    if (expr->type() == ExpressionType::Grouping) {
+      condition(static_cast<Grouping *>(expr)->expression, ifTrue, ifFalse);
+      return;
+    }
+    if (expr->type() == ExpressionType::Unary &&
+        static_cast<Unary *>(expr)->op.type == TokenType::Bang) {
+      condition(static_cast<Unary *>(expr)->right, ifFalse, ifTrue);
+      return;
+    }
+    if (expr->type() == ExpressionType::Logical) {
+      // the right side runs only when the left one does not decide;
+      auto *logical = static_cast<Logical *>(expr);
+      Block *right = graph_.newBlock();
+      if (logical->op.type == TokenType::And) {
+        condition(logical->left, right, ifFalse);
+      } else {
+        condition(logical->left, ifTrue, right);
+      }
+      seal(right);
+      current_ = right;
+      condition(logical->right, ifTrue, ifFalse);
+      return;
+    }
+  }
+  Node *value = expression(expr);
+  if (supported_) {
+    graph_.branch(current_, value, ifTrue, ifFalse);
+  }
+}
+
+Node *Builder::expression(Expression *expr) {
+  if (expr == nullptr || !supported_) {
+    supported_ = false;
+    return nullptr;
+  }
+  switch (expr->type()) {
+  case ExpressionType::Literal:
+    return constant(static_cast<LiteralExpression *>(expr)->value);
+  case ExpressionType::Variable: {
+    auto *variable = static_cast<Variable *>(expr);
+    int slot = table_.findSymbol(variable->name.lexeme());
+    if (slot >= 0) {
+      return read(slot, current_);
+    }
+    Node *node = graph_.append(current_, NodeKind::LoadGlobal);
+    node->name = variable->name.lexeme();
+    return node;
+  }
+  case ExpressionType::Assign: {
+    auto *assign = static_cast<Assign *>(expr);
+    Node *value = expression(assign->value);
+    int slot = table_.findSymbol(assign->name.lexeme());
+    if (slot >= 0) {
+      write(slot, current_, value);
+    } else {
+      Node *store = graph_.append(current_, NodeKind::StoreGlobal, {value});
+      store->name = assign->name.lexeme();
+    }
+    return value;
+  }
+  case ExpressionType::Binary: {
+    auto *binary = static_cast<Binary *>(expr);
+    Node *left = expression(binary->left);
+    Node *right = expression(binary->right);
+    bool negated = false;
+    Opcode code = binary->opcode(negated);
+    if (code == Opcode::NoOP || !supported_) {
+      supported_ = false;
+      return nullptr;
+    }
+    Node *node = graph_.append(current_, NodeKind::Binary, {left, right});
+    node->opcode = code;
+    return negated ? graph_.append(current_, NodeKind::Not, {node}) : node;
+  }
+  case ExpressionType::Unary: {
+    auto *unary = static_cast<Unary *>(expr);
+    Node *right = expression(unary->right);
+    NodeKind kind =
+        unary->op.type == TokenType::Bang ? NodeKind::Not : NodeKind::Negate;
+    return graph_.append(current_, kind, {right});
+  }
+  case ExpressionType::Grouping:
+    return expression(static_cast<Grouping *>(expr)->expression);
+  case ExpressionType::Logical: {
+    // the value of the operand that decided, joined by a phi;
+    auto *logical = static_cast<Logical *>(expr);
+    Node *left = expression(logical->left);
+    if (!supported_) {
+      return nullptr;
+    }
+    Block *from = current_;
+    Block *right = graph_.newBlock();
+    Block *join = graph_.newBlock();
+    if (logical->op.type == TokenType::And) {
+      graph_.branch(from, left, right, join);
+    } else {
+      graph_.branch(from, left, join, right);
+    }
+    seal(right);
+    current_ = right;
+    Node *value = expression(logical->right);
+    if (!supported_) {
+      return nullptr;
+    }
+    graph_.jump(current_, join);
+    seal(join);
+    current_ = join;
+    Node *phi = graph_.newNode(NodeKind::Phi);
+    phi->block = join;
+    join->phis.push_back(phi);
+    for (Block *predecessor : join->predecessors) {
+      phi->operands.push_back(predecessor == from ? left : value);
+    }
+    return phi;
+  }
+  case ExpressionType::Call: {
+    auto *call = static_cast<Call *>(expr);
+    std::vector<Node *> operands = {expression(call->callee)};
+    for (auto &argument : call->arguments) {
+      operands.push_back(expression(argument));
+    }
+    return graph_.append(current_, NodeKind::Call, operands);
+  }
+  case ExpressionType::Dispatch: {
+    auto *dispatch = static_cast<Dispatch *>(expr);
+    std::vector<Node *> operands = {expression(dispatch->object)};
+    for (auto &argument : dispatch->arguments) {
+      operands.push_back(expression(argument));
+    }
+    Node *node = graph_.append(current_, NodeKind::Dispatch, operands);
+    node->name = dispatch->name.lexeme();
+    return node;
+  }
+  case ExpressionType::Get: {
+    auto *get = static_cast<Get *>(expr);
+    Node *object = expression(get->object);
+    Node *node = graph_.append(current_, NodeKind::GetItem, {object});
+    node->name = get->name.lexeme();
+    return node;
+  }
+  case ExpressionType::Set: {
+    auto *set = static_cast<Set *>(expr);
+    Node *object = expression(set->object);
+    Node *value = expression(set->value);
+    Node *node = graph_.append(current_, NodeKind::SetItem, {object, value});
+    node->name = set->name.lexeme();
+    return node;
+  }
+  default:
+    supported_ = false; // This and Super;
+    return nullptr;
+  }
+}
+
+void removeTrivialPhis(Graph &graph) {
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    std::unordered_map<Node *, Node *> replacements;
+    // an operand replaced earlier in this round stands for its replacement;
+    auto resolve = [&](Node *node) {
+      for (auto it = replacements.find(node); it != replacements.end();
+           it = replacements.find(node)) {
+        node = it->second;
+      }
+      return node;
+    };
+    for (auto &block : graph.blocks) {
+      for (Node *phi : block->phis) {
+        Node *same = nullptr;
+        bool trivial = true;
+        for (Node *operand : phi->operands) {
+          operand = resolve(operand);
+          if (operand == phi || operand == same) {
+            continue;
+          }
+          if (same != nullptr) {
+            trivial = false;
+            break;
+          }
+          same = operand;
+        }
+        if (trivial && same != nullptr) {
+          replacements[phi] = same;
+        }
+      }
+    }
+    if (!replacements.empty()) {
+      graph.replace(replacements);
+      changed = true;
+    }
+  }
+}
+
+} // namespace ssa
+} // namespace kestrel
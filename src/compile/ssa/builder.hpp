@@ -0,0 +1,59 @@
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "compile/symbol_table.hpp"
+#include "graph.hpp"
+#include "statement.hpp"
+
+namespace kestrel {
+
+struct Expression;
+
+namespace ssa {
+
+// Builds SSA form straight from the AST with Braun et al.'s on-the-fly
+// construction: each local slot's current definition is tracked per block
+// and phis are placed lazily when a read crosses a join. Slots are resolved
+// with a copy of the compiler's SymbolTable, as TypeInference does.
+class Builder {
+public:
+  Builder(Graph &graph, const SymbolTable &table);
+
+  // Returns false if the body uses something the IR does not model yet;
+  // the caller then compiles it straight from the AST.
+  bool build(const std::vector<Statement *> &statements);
+
+private:
+  void statement(Statement *statement);
+  Node *expression(Expression *expression);
+  // Ends the current block branching to `ifTrue` or `ifFalse`; `and`, `or`
+  // and `!` become more branches rather than values.
+  void condition(Expression *expression, Block *ifTrue, Block *ifFalse);
+
+  Node *constant(const Value &value);
+  void write(int slot, Block *block, Node *value);
+  Node *read(int slot, Block *block);
+  Node *readRecursive(int slot, Block *block);
+  void addPhiOperands(int slot, Node *phi);
+  void seal(Block *block);
+  Block *startBlock(bool sealed);
+
+  Graph &graph_;
+  SymbolTable table_;
+  Block *current_ = nullptr;
+  bool supported_ = true;
+
+  std::unordered_map<Block *, std::unordered_map<int, Node *>> defs_;
+  std::unordered_map<Block *, std::unordered_map<int, Node *>> incomplete_;
+  std::unordered_set<Block *> sealed_;
+};
+
+// Replaces phis whose operands are all the same value (or the phi itself).
+void removeTrivialPhis(Graph &graph);
+
+} // namespace ssa
+} // namespace kestrel
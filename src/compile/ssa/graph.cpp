@@ -0,0 +1,221 @@
+#include "graph.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <unordered_set>
+
+namespace kestrel {
+namespace ssa {
+
+std::vector<Block *> Block::successors() const {
+  switch (exit) {
+  case Exit::Jump:
+    return {targets[0]};
+  case Exit::Branch:
+    return {targets[0], targets[1]};
+  default:
+    return {};
+  }
+}
+
+Block *Graph::newBlock() {
+  blocks.push_back(std::make_unique<Block>());
+  blocks.back()->id = (int)blocks.size() - 1;
+  return blocks.back().get();
+}
+
+Node *Graph::newNode(NodeKind kind) {
+  nodes_.push_back(std::make_unique<Node>());
+  Node *node = nodes_.back().get();
+  node->kind = kind;
+  node->id = (int)nodes_.size() - 1;
+  return node;
+}
+
+Node *Graph::append(Block *block, NodeKind kind, std::vector<Node *> operands) {
+  Node *node = newNode(kind);
+  node->block = block;
+  node->operands = std::move(operands);
+  block->code.push_back(node);
+  return node;
+}
+
+void Graph::jump(Block *from, Block *to) {
+  from->exit = Exit::Jump;
+  from->targets[0] = to;
+  to->predecessors.push_back(from);
+}
+
+void Graph::branch(Block *from, Node *condition, Block *ifTrue,
+                   Block *ifFalse) {
+  from->exit = Exit::Branch;
+  from->value = condition;
+  from->targets[0] = ifTrue;
+  from->targets[1] = ifFalse;
+  ifTrue->predecessors.push_back(from);
+  ifFalse->predecessors.push_back(from);
+}
+
+void Graph::ret(Block *from, Node *value) {
+  from->exit = Exit::Return;
+  from->value = value;
+}
+
+void Graph::analyze() {
+  // depth-first postorder from the entry;
+  std::vector<Block *> postorder;
+  std::unordered_set<Block *> visited;
+  std::function<void(Block *)> visit = [&](Block *block) {
+    visited.insert(block);
+    for (Block *successor : block->successors()) {
+      if (!visited.count(successor)) {
+        visit(successor);
+      }
+    }
+    postorder.push_back(block);
+  };
+  visit(entry);
+
+  // unreachable blocks go away together with their outgoing edges;
+  for (auto &block : blocks) {
+    if (!visited.count(block.get())) {
+      for (Block *successor : block->successors()) {
+        removeEdge(block.get(), successor);
+      }
+      block->exit = Exit::None;
+    }
+  }
+  blocks.erase(std::remove_if(blocks.begin(), blocks.end(),
+                              [&](const std::unique_ptr<Block> &block) {
+                                return !visited.count(block.get());
+                              }),
+               blocks.end());
+
+  order.assign(postorder.rbegin(), postorder.rend());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i]->order = (int)i;
+    order[i]->idom = nullptr;
+  }
+
+  // Cooper, Harvey and Kennedy's iterative dominator algorithm;
+  auto intersect = [](Block *a, Block *b) {
+    while (a != b) {
+      while (a->order > b->order) {
+        a = a->idom;
+      }
+      while (b->order > a->order) {
+        b = b->idom;
+      }
+    }
+    return a;
+  };
+  entry->idom = entry;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t i = 1; i < order.size(); i++) {
+      Block *block = order[i];
+      Block *idom = nullptr;
+      for (Block *predecessor : block->predecessors) {
+        if (predecessor->idom == nullptr) {
+          continue;
+        }
+        idom = idom ? intersect(predecessor, idom) : predecessor;
+      }
+      if (idom != block->idom) {
+        block->idom = idom;
+        changed = true;
+      }
+    }
+  }
+  entry->idom = nullptr;
+}
+
+bool Graph::dominates(const Block *a, const Block *b) const {
+  for (; b != nullptr; b = b->idom) {
+    if (a == b) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Graph::replace(const std::unordered_map<Node *, Node *> &replacements) {
+  if (replacements.empty()) {
+    return;
+  }
+  auto resolve = [&](Node *node) {
+    for (auto it = replacements.find(node); it != replacements.end();
+         it = replacements.find(node)) {
+      node = it->second;
+    }
+    return node;
+  };
+  auto replaced = [&](Node *node) { return replacements.count(node) > 0; };
+  for (auto &block : blocks) {
+    block->phis.erase(
+        std::remove_if(block->phis.begin(), block->phis.end(), replaced),
+        block->phis.end());
+    block->code.erase(
+        std::remove_if(block->code.begin(), block->code.end(), replaced),
+        block->code.end());
+    for (Node *phi : block->phis) {
+      for (Node *&operand : phi->operands) {
+        operand = resolve(operand);
+      }
+    }
+    for (Node *node : block->code) {
+      for (Node *&operand : node->operands) {
+        operand = resolve(operand);
+      }
+    }
+    if (block->value) {
+      block->value = resolve(block->value);
+    }
+  }
+}
+
+void Graph::removeEdge(Block *block, Block *successor) {
+  auto &predecessors = successor->predecessors;
+  auto it = std::find(predecessors.begin(), predecessors.end(), block);
+  if (it == predecessors.end()) {
+    return;
+  }
+  size_t index = it - predecessors.begin();
+  predecessors.erase(it);
+  for (Node *phi : successor->phis) {
+    phi->operands.erase(phi->operands.begin() + index);
+  }
+}
+
+void Graph::splitCriticalEdges() {
+  size_t count = blocks.size();
+  for (size_t i = 0; i < count; i++) {
+    Block *block = blocks[i].get();
+    if (block->exit != Exit::Branch) {
+      continue;
+    }
+    for (int k = 0; k < 2; k++) {
+      Block *successor = block->targets[k];
+      if (successor->predecessors.size() < 2) {
+        continue;
+      }
+      // the second edge of a branch with equal targets is the second entry;
+      int skip = k == 1 && block->targets[0] == block->targets[1] ? 1 : 0;
+      for (Block *&predecessor : successor->predecessors) {
+        if (predecessor == block && skip-- == 0) {
+          Block *middle = newBlock();
+          middle->predecessors.push_back(block);
+          middle->exit = Exit::Jump;
+          middle->targets[0] = successor;
+          predecessor = middle;
+          block->targets[k] = middle;
+          break;
+        }
+      }
+    }
+  }
+}
+
+} // namespace ssa
+} // namespace kestrel
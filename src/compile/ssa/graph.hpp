@@ -0,0 +1,126 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "opcodes.hpp"
+#include "value.hpp"
+
+namespace kestrel {
+namespace ssa {
+
+struct Block;
+
+enum class NodeKind {
+  Constant,
+  Param,
+  Phi,
+  Binary,
+  Negate,
+  Not,
+  LoadGlobal,
+  StoreGlobal,
+  Call,
+  Dispatch,
+  GetItem,
+  SetItem,
+};
+
+// One SSA value. Operands are other nodes; a Phi has one operand per
+// predecessor of its block, in the same order.
+struct Node {
+  NodeKind kind = NodeKind::Constant;
+  Opcode opcode = Opcode::NoOP; // Binary;
+  int index = 0;                // Param slot;
+  std::string name;             // global, attribute or method name;
+  Value constant;
+  std::vector<Node *> operands;
+  Block *block = nullptr;
+  ValueType type = ValueType::Unknown;
+  int id = 0;
+
+  // No side effects and no reads of mutable state, so the node may be
+  // moved, duplicated or removed freely.
+  bool pure() const {
+    return kind == NodeKind::Constant || kind == NodeKind::Param ||
+           kind == NodeKind::Binary || kind == NodeKind::Negate ||
+           kind == NodeKind::Not;
+  }
+};
+
+enum class Exit { None, Jump, Branch, Return };
+
+struct Block {
+  int id = 0;
+  std::vector<Node *> phis;
+  std::vector<Node *> code;
+  std::vector<Block *> predecessors;
+
+  Exit exit = Exit::None;
+  Node *value = nullptr; // branch condition or returned value;
+  Block *targets[2] = {nullptr, nullptr}; // Jump: [0], Branch: true, false;
+
+  Block *idom = nullptr;
+  int order = -1; // position in reverse postorder, -1 if unreachable;
+
+  std::vector<Block *> successors() const;
+};
+
+// Control-flow graph of one function in SSA form.
+class Graph {
+public:
+  Block *newBlock();
+  Node *newNode(NodeKind kind);
+
+  // Creates a node at the end of `block`.
+  Node *append(Block *block, NodeKind kind, std::vector<Node *> operands = {});
+
+  void jump(Block *from, Block *to);
+  void branch(Block *from, Node *condition, Block *ifTrue, Block *ifFalse);
+  void ret(Block *from, Node *value);
+
+  // Reverse postorder, immediate dominators and `order`; unreachable blocks
+  // are dropped first.
+  void analyze();
+  bool dominates(const Block *a, const Block *b) const;
+
+  // Rewrites every use of a key to its value, following chains.
+  void replace(const std::unordered_map<Node *, Node *> &replacements);
+
+  // Removes `block` from the predecessors of `successor` along with the
+  // matching phi operands.
+  void removeEdge(Block *block, Block *successor);
+
+  // Inserts an empty block on every edge from a block with two successors
+  // to a block with several predecessors.
+  void splitCriticalEdges();
+
+  Block *entry = nullptr;
+  std::vector<Block *> order; // reverse postorder after analyze();
+  std::vector<std::unique_ptr<Block>> blocks;
+
+private:
+  std::vector<std::unique_ptr<Node>> nodes_;
+};
+
+// Sparse conditional constant propagation: folds nodes that are constant on
+// every executable path and drops branches that never go one way.
+void propagateConstants(Graph &graph);
+
+// Dominator-scoped value numbering of pure nodes.
+void eliminateCommonSubexpressions(Graph &graph);
+
+// Moves pure nodes whose operands are defined outside a loop into the
+// loop's preheader.
+void hoistLoopInvariants(Graph &graph);
+
+// Removes pure nodes and phis whose value is never used.
+void eliminateDeadCode(Graph &graph);
+
+// Static types for the lowering, joined over phis.
+void inferTypes(Graph &graph);
+
+} // namespace ssa
+} // namespace kestrel
@@ -0,0 +1,327 @@
+#include "lower.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <unordered_set>
+
+#include "compiler.hpp"
+#include "type_rules.hpp"
+
+namespace kestrel {
+namespace ssa {
+
+namespace {
+
+class Lowering {
+public:
+  Lowering(Graph &graph, Compiler &compiler, int firstSlot)
+      : graph_(graph), compiler_(compiler), slots_(firstSlot) {}
+
+  int run() {
+    graph_.splitCriticalEdges();
+    graph_.analyze();
+    countUses();
+    chooseTrees();
+    assignSlots();
+
+    for (size_t i = 0; i < graph_.order.size(); i++) {
+      Block *block = graph_.order[i];
+      Block *next = i + 1 < graph_.order.size() ? graph_.order[i + 1] : nullptr;
+      start_[block] = (int)compiler_.instructions().size();
+      for (Node *node : block->code) {
+        if (isRoot(node)) {
+          emitRoot(node);
+        }
+      }
+      emitExit(block, next);
+    }
+
+    int end = (int)compiler_.instructions().size();
+    for (auto &patch : patches_) {
+      int target = patch.second ? start_[patch.second] : end;
+      compiler_.patchBranch(patch.first, target);
+    }
+    return slots_;
+  }
+
+private:
+  void countUses() {
+    for (auto &block : graph_.blocks) {
+      for (Node *phi : block->phis) {
+        for (Node *operand : phi->operands) {
+          uses_[operand]++;
+          users_[operand] = phi;
+        }
+      }
+      for (Node *node : block->code) {
+        for (Node *operand : node->operands) {
+          uses_[operand]++;
+          users_[operand] = node;
+        }
+      }
+      if (block->value) {
+        uses_[block->value]++;
+        users_[block->value] = nullptr; // the terminator;
+        exitOf_[block->value] = block.get();
+      }
+    }
+  }
+
+  // True if `node` can be evaluated right where its only user reads it.
+  bool inlinable(Node *node) {
+    if (node->kind == NodeKind::Constant || node->kind == NodeKind::Param ||
+        node->kind == NodeKind::StoreGlobal || uses_[node] != 1) {
+      return false;
+    }
+    Node *user = users_[node];
+    if (user == nullptr) {
+      return exitOf_[node] == node->block;
+    }
+    return user->kind != NodeKind::Phi && user->block == node->block;
+  }
+
+  // Values inlined into their user are evaluated where the user is, which
+  // must not move them across another side effect.
+  void chooseTrees() {
+    for (auto &block : graph_.blocks) {
+      for (Node *node : block->code) {
+        if (inlinable(node)) {
+          inline_.insert(node);
+        }
+      }
+    }
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (auto &block : graph_.blocks) {
+        auto &code = block->code;
+        std::unordered_map<Node *, int> position;
+        for (int i = 0; i < (int)code.size(); i++) {
+          position[code[i]] = i;
+        }
+        for (int i = 0; i < (int)code.size(); i++) {
+          Node *node = code[i];
+          if (!inline_.count(node) || node->pure()) {
+            continue;
+          }
+          Node *root = rootOf(node);
+          int until = root ? position[root] : (int)code.size();
+          for (int k = i + 1; k < until; k++) {
+            if (!code[k]->pure() && rootOf(code[k]) != root) {
+              inline_.erase(node);
+              changed = true;
+              break;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // The node whose tree `node` is evaluated in, null for a terminator.
+  Node *rootOf(Node *node) {
+    while (inline_.count(node)) {
+      node = users_[node];
+      if (node == nullptr) {
+        return nullptr;
+      }
+    }
+    return node;
+  }
+
+  bool isRoot(Node *node) {
+    return node->kind != NodeKind::Constant &&
+           node->kind != NodeKind::Param && !inline_.count(node);
+  }
+
+  void assignSlots() {
+    for (Block *block : graph_.order) {
+      for (Node *phi : block->phis) {
+        slot_[phi] = slots_++;
+      }
+      for (Node *node : block->code) {
+        if (isRoot(node) && uses_[node] > 0) {
+          slot_[node] = slots_++;
+        }
+      }
+    }
+  }
+
+  void emitRoot(Node *node) {
+    emitTree(node);
+    if (node->kind == NodeKind::StoreGlobal) {
+      return; // pushes nothing;
+    }
+    auto it = slot_.find(node);
+    if (it != slot_.end()) {
+      compiler_.emitStore(it->second, node->type);
+    } else {
+      compiler_.emitCode(Opcode::Pop);
+    }
+  }
+
+  void emitValue(Node *node) {
+    if (node->kind == NodeKind::Constant) {
+      compiler_.emitConstant(node->constant);
+    } else if (node->kind == NodeKind::Param) {
+      compiler_.emitCode(Opcode::LoadLocal);
+      compiler_.emitIndex(node->index);
+    } else if (inline_.count(node)) {
+      emitTree(node);
+    } else {
+      if (node->type == ValueType::Integer) {
+        compiler_.emitCode(Opcode::LoadLocalInt);
+      } else if (node->type == ValueType::Double) {
+        compiler_.emitCode(Opcode::LoadLocalDouble);
+      } else {
+        compiler_.emitCode(Opcode::LoadLocal);
+      }
+      compiler_.emitIndex(slot_[node]);
+    }
+  }
+
+  void emitTree(Node *node) {
+    for (Node *operand : node->operands) {
+      emitValue(operand);
+    }
+    switch (node->kind) {
+    case NodeKind::Binary: {
+      Opcode typed = typedForm(node->opcode, node->operands[0]->type,
+                               node->operands[1]->type);
+      compiler_.emitCode(typed != Opcode::NoOP ? typed : node->opcode);
+      break;
+    }
+    case NodeKind::Negate:
+      compiler_.emitCode(Opcode::Negate);
+      break;
+    case NodeKind::Not:
+      compiler_.emitCode(Opcode::Not);
+      break;
+    case NodeKind::LoadGlobal:
+      compiler_.emitCode(Opcode::LoadGlobal);
+      compiler_.emitIndex(compiler_.nameIndex(node->name));
+      break;
+    case NodeKind::StoreGlobal:
+      compiler_.emitCode(Opcode::StoreGlobal);
+      compiler_.emitIndex(compiler_.nameIndex(node->name));
+      break;
+    case NodeKind::Call:
+      if (node->operands[0]->kind == NodeKind::LoadGlobal) {
+        compiler_.emitCall(node->operands.size() - 1,
+                           node->operands[0]->name, slots_);
+        break;
+      }
+      compiler_.emitCode(Opcode::Call);
+      compiler_.emitIndex(node->operands.size() - 1);
+      break;
+    case NodeKind::Dispatch:
+      compiler_.emitCode(Opcode::Dispatch);
+      compiler_.emitIndex(compiler_.nameIndex(node->name));
+      compiler_.emitIndex(node->operands.size() - 1);
+      break;
+    case NodeKind::GetItem:
+      compiler_.emitCode(Opcode::GetItem);
+      compiler_.emitIndex(compiler_.nameIndex(node->name));
+      break;
+    case NodeKind::SetItem:
+      compiler_.emitCode(Opcode::SetItem);
+      compiler_.emitIndex(compiler_.nameIndex(node->name));
+      break;
+    default:
+      break;
+    }
+  }
+
+  void emitBranch(Opcode opcode, Block *target) {
+    compiler_.emitCode(opcode);
+    patches_.push_back({compiler_.emitIndex(0), target});
+  }
+
+  void emitExit(Block *block, Block *next) {
+    switch (block->exit) {
+    case Exit::Jump: {
+      Block *target = block->targets[0];
+      if (!target->phis.empty()) {
+        // parallel copy: read every operand before writing any phi;
+        auto &predecessors = target->predecessors;
+        size_t index =
+            std::find(predecessors.begin(), predecessors.end(), block) -
+            predecessors.begin();
+        for (Node *phi : target->phis) {
+          emitValue(phi->operands[index]);
+        }
+        for (auto it = target->phis.rbegin(); it != target->phis.rend(); ++it) {
+          compiler_.emitStore(slot_[*it], (*it)->type);
+        }
+      }
+      if (target != next) {
+        emitBranch(Opcode::Branch, target);
+      }
+      break;
+    }
+    case Exit::Branch: {
+      // a comparison evaluated right here branches on its operands;
+      Node *condition = block->value;
+      bool negated = false;
+      if (condition->kind == NodeKind::Not && inline_.count(condition) &&
+          inline_.count(condition->operands[0])) {
+        condition = condition->operands[0];
+        negated = true;
+      }
+      bool fused = condition->kind == NodeKind::Binary &&
+                   inline_.count(condition) &&
+                   fusedBranch(condition->opcode, true) != Opcode::NoOP;
+      if (fused) {
+        emitValue(condition->operands[0]);
+        emitValue(condition->operands[1]);
+      } else {
+        emitValue(block->value);
+      }
+      // branches taken when the condition is true, and when false;
+      Opcode ifTrue = fused ? fusedBranch(condition->opcode, !negated)
+                            : Opcode::BranchTrue;
+      Opcode ifFalse = fused ? fusedBranch(condition->opcode, negated)
+                             : Opcode::BranchFalse;
+      if (block->targets[1] == next) {
+        emitBranch(ifTrue, block->targets[0]);
+      } else {
+        emitBranch(ifFalse, block->targets[1]);
+        if (block->targets[0] != next) {
+          emitBranch(Opcode::Branch, block->targets[0]);
+        }
+      }
+      break;
+    }
+    case Exit::Return:
+      emitValue(block->value);
+      compiler_.emitCode(Opcode::Return);
+      break;
+    case Exit::None:
+      if (next != nullptr) {
+        emitBranch(Opcode::Branch, nullptr); // falls off the end;
+      }
+      break;
+    }
+  }
+
+  Graph &graph_;
+  Compiler &compiler_;
+  int slots_;
+
+  std::unordered_map<Node *, int> uses_;
+  std::unordered_map<Node *, Node *> users_;
+  std::unordered_map<Node *, Block *> exitOf_;
+  std::unordered_set<Node *> inline_;
+  std::unordered_map<Node *, int> slot_;
+  std::unordered_map<Block *, int> start_;
+  std::vector<std::pair<int, Block *>> patches_;
+};
+
+} // namespace
+
+int lower(Graph &graph, Compiler &compiler, int firstSlot) {
+  return Lowering(graph, compiler, firstSlot).run();
+}
+
+} // namespace ssa
+} // namespace kestrel
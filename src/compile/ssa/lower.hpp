@@ -0,0 +1,19 @@
+#pragma once
+
+#include "graph.hpp"
+
+namespace kestrel {
+
+class Compiler;
+
+namespace ssa {
+
+// Lowers `graph` back to stack code appended to the compiler's
+// instructions. Values that are used once, right where they are computed,
+// stay on the operand stack; every other value and every phi gets its own
+// local slot counted from `firstSlot`. Returns the number of slots used,
+// including the first `firstSlot`.
+int lower(Graph &graph, Compiler &compiler, int firstSlot);
+
+} // namespace ssa
+} // namespace kestrel
@@ -0,0 +1,449 @@
+#include "graph.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <set>
+#include <sstream>
+#include <unordered_set>
+
+#include "arithmetic.hpp"
+#include "type_rules.hpp"
+
+namespace kestrel {
+namespace ssa {
+
+namespace {
+
+enum class Lattice { Top, Constant, Bottom };
+
+struct Cell {
+  Lattice state = Lattice::Top;
+  Value value;
+};
+
+// Every node and terminator that reads `node`.
+struct Uses {
+  std::unordered_map<Node *, std::vector<Node *>> nodes;
+  std::unordered_map<Node *, std::vector<Block *>> exits;
+
+  explicit Uses(Graph &graph) {
+    for (auto &block : graph.blocks) {
+      for (Node *phi : block->phis) {
+        for (Node *operand : phi->operands) {
+          nodes[operand].push_back(phi);
+        }
+      }
+      for (Node *node : block->code) {
+        for (Node *operand : node->operands) {
+          nodes[operand].push_back(node);
+        }
+      }
+      if (block->value) {
+        exits[block->value].push_back(block.get());
+      }
+    }
+  }
+};
+
+} // namespace
+
+void propagateConstants(Graph &graph) {
+  std::unordered_map<Node *, Cell> cells;
+  std::unordered_set<Block *> executable;
+  std::set<std::pair<Block *, Block *>> edges;
+  std::vector<std::pair<Block *, Block *>> flow = {{nullptr, graph.entry}};
+  std::vector<Node *> ssa;
+  Uses uses(graph);
+
+  auto evaluate = [&](Node *node) -> Cell {
+    Cell result;
+    switch (node->kind) {
+    case NodeKind::Constant:
+      result.state = Lattice::Constant;
+      result.value = node->constant;
+      return result;
+    case NodeKind::Phi: {
+      Block *block = node->block;
+      for (size_t i = 0; i < node->operands.size(); i++) {
+        if (!edges.count({block->predecessors[i], block})) {
+          continue;
+        }
+        Cell &cell = cells[node->operands[i]];
+        if (cell.state == Lattice::Top) {
+          continue;
+        }
+        if (cell.state == Lattice::Bottom ||
+            (result.state == Lattice::Constant &&
+             !(result.value == cell.value))) {
+          result.state = Lattice::Bottom;
+          return result;
+        }
+        result = cell;
+      }
+      return result;
+    }
+    case NodeKind::Binary:
+    case NodeKind::Negate:
+    case NodeKind::Not: {
+      for (Node *operand : node->operands) {
+        Lattice state = cells[operand].state;
+        if (state == Lattice::Bottom) {
+          result.state = Lattice::Bottom;
+          return result;
+        }
+        if (state == Lattice::Top) {
+          return result;
+        }
+      }
+      Value value;
+      if (node->kind == NodeKind::Binary) {
+        const Value &left = cells[node->operands[0]].value;
+        const Value &right = cells[node->operands[1]].value;
+        if (overflows(node->opcode, left, right)) {
+          result.state = Lattice::Bottom;
+          return result;
+        }
+        value = arithmetic(node->opcode, left, right);
+      } else {
+        Opcode opcode =
+            node->kind == NodeKind::Not ? Opcode::Not : Opcode::Negate;
+        value = unary(opcode, cells[node->operands[0]].value);
+      }
+      // nil marks an operand the operator rejects, leave it to the runtime;
+      result.state = value.type() == ValueType::Nil ? Lattice::Bottom
+                                                    : Lattice::Constant;
+      result.value = value;
+      return result;
+    }
+    default:
+      result.state = Lattice::Bottom;
+      return result;
+    }
+  };
+
+  auto visitExit = [&](Block *block) {
+    switch (block->exit) {
+    case Exit::Jump:
+      flow.push_back({block, block->targets[0]});
+      break;
+    case Exit::Branch: {
+      Cell &condition = cells[block->value];
+      if (condition.state == Lattice::Constant) {
+        int taken = condition.value.boolValue() ? 0 : 1;
+        flow.push_back({block, block->targets[taken]});
+      } else if (condition.state == Lattice::Bottom) {
+        flow.push_back({block, block->targets[0]});
+        flow.push_back({block, block->targets[1]});
+      }
+      break;
+    }
+    default:
+      break;
+    }
+  };
+
+  auto visit = [&](Node *node) {
+    Cell &cell = cells[node];
+    Cell next = evaluate(node);
+    if (next.state == cell.state) {
+      return; // the lattice only moves down;
+    }
+    cell = next;
+    for (Node *user : uses.nodes[node]) {
+      if (executable.count(user->block)) {
+        ssa.push_back(user);
+      }
+    }
+    for (Block *block : uses.exits[node]) {
+      if (executable.count(block)) {
+        visitExit(block);
+      }
+    }
+  };
+
+  while (!flow.empty() || !ssa.empty()) {
+    if (!flow.empty()) {
+      auto edge = flow.back();
+      flow.pop_back();
+      if (edge.first && !edges.insert(edge).second) {
+        continue;
+      }
+      Block *block = edge.second;
+      for (Node *phi : block->phis) {
+        visit(phi);
+      }
+      if (executable.insert(block).second) {
+        for (Node *node : block->code) {
+          visit(node);
+        }
+        visitExit(block);
+      }
+      continue;
+    }
+    Node *node = ssa.back();
+    ssa.pop_back();
+    visit(node);
+  }
+
+  // rewrite constant values and branches that only ever go one way;
+  std::unordered_map<Node *, Node *> replacements;
+  for (auto &block : graph.blocks) {
+    if (!executable.count(block.get())) {
+      continue;
+    }
+    for (Node *phi : block->phis) {
+      Cell &cell = cells[phi];
+      if (cell.state == Lattice::Constant) {
+        Node *node = graph.newNode(NodeKind::Constant);
+        node->constant = cell.value;
+        node->block = block.get();
+        block->code.insert(block->code.begin(), node);
+        replacements[phi] = node;
+      }
+    }
+    for (Node *node : block->code) {
+      Cell &cell = cells[node];
+      if (node->pure() && node->kind != NodeKind::Constant &&
+          cell.state == Lattice::Constant) {
+        node->kind = NodeKind::Constant;
+        node->constant = cell.value;
+        node->operands.clear();
+      }
+    }
+    if (block->exit == Exit::Branch &&
+        cells[block->value].state == Lattice::Constant) {
+      int taken = cells[block->value].value.boolValue() ? 0 : 1;
+      Block *target = block->targets[taken];
+      graph.removeEdge(block.get(), block->targets[1 - taken]);
+      block->exit = Exit::Jump;
+      block->targets[0] = target;
+      block->targets[1] = nullptr;
+      block->value = nullptr;
+    }
+  }
+  graph.replace(replacements);
+  graph.analyze();
+}
+
+// Key identifying the value a pure node computes.
+static std::string valueKey(const Node *node) {
+  std::ostringstream key;
+  key << (int)node->kind << ":" << (int)node->opcode << ":" << node->index;
+  for (const Node *operand : node->operands) {
+    // constants are rematerialized, equal ones count as the same value;
+    if (operand->kind == NodeKind::Constant) {
+      key << ",#" << (int)operand->constant.type() << ":"
+          << operand->constant.toString();
+    } else {
+      key << "," << operand->id;
+    }
+  }
+  return key.str();
+}
+
+void eliminateCommonSubexpressions(Graph &graph) {
+  std::unordered_map<Block *, std::vector<Block *>> children;
+  for (Block *block : graph.order) {
+    if (block->idom) {
+      children[block->idom].push_back(block);
+    }
+  }
+
+  std::unordered_map<Node *, Node *> replacements;
+  std::unordered_map<std::string, Node *> available;
+  auto resolve = [&](Node *node) {
+    for (auto it = replacements.find(node); it != replacements.end();
+         it = replacements.find(node)) {
+      node = it->second;
+    }
+    return node;
+  };
+
+  std::function<void(Block *)> visit = [&](Block *block) {
+    std::vector<std::string> added;
+    for (Node *node : block->code) {
+      // constants are rematerialized at every use anyway;
+      if (!node->pure() || node->kind == NodeKind::Constant ||
+          node->kind == NodeKind::Param) {
+        continue;
+      }
+      for (Node *&operand : node->operands) {
+        operand = resolve(operand);
+      }
+      std::string key = valueKey(node);
+      auto it = available.find(key);
+      if (it != available.end()) {
+        replacements[node] = it->second;
+      } else {
+        available[key] = node;
+        added.push_back(key);
+      }
+    }
+    for (Block *child : children[block]) {
+      visit(child);
+    }
+    for (const std::string &key : added) {
+      available.erase(key);
+    }
+  };
+  visit(graph.entry);
+  graph.replace(replacements);
+}
+
+void hoistLoopInvariants(Graph &graph) {
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (Block *header : graph.order) {
+      // a back edge comes from a block the header dominates;
+      std::unordered_set<Block *> loop = {header};
+      std::vector<Block *> work;
+      bool isLoop = false;
+      for (Block *predecessor : header->predecessors) {
+        if (graph.dominates(header, predecessor)) {
+          isLoop = true;
+          work.push_back(predecessor);
+        }
+      }
+      if (!isLoop) {
+        continue;
+      }
+      while (!work.empty()) {
+        Block *block = work.back();
+        work.pop_back();
+        if (loop.insert(block).second) {
+          for (Block *predecessor : block->predecessors) {
+            work.push_back(predecessor);
+          }
+        }
+      }
+
+      // the preheader is the one way in, and it leads only to the header;
+      Block *preheader = nullptr;
+      int outside = 0;
+      for (Block *predecessor : header->predecessors) {
+        if (!loop.count(predecessor)) {
+          preheader = predecessor;
+          outside++;
+        }
+      }
+      if (outside != 1 || preheader->exit != Exit::Jump) {
+        continue;
+      }
+
+      for (Block *block : graph.order) {
+        if (!loop.count(block)) {
+          continue;
+        }
+        auto &code = block->code;
+        for (auto it = code.begin(); it != code.end();) {
+          Node *node = *it;
+          bool invariant = node->pure() && node->kind != NodeKind::Constant;
+          for (Node *operand : node->operands) {
+            invariant = invariant && (operand->kind == NodeKind::Constant ||
+                                      !loop.count(operand->block));
+          }
+          if (!invariant) {
+            ++it;
+            continue;
+          }
+          node->block = preheader;
+          preheader->code.push_back(node);
+          it = code.erase(it);
+          changed = true;
+        }
+      }
+    }
+  }
+}
+
+void eliminateDeadCode(Graph &graph) {
+  std::unordered_set<Node *> live;
+  std::vector<Node *> work;
+  for (auto &block : graph.blocks) {
+    for (Node *node : block->code) {
+      if (!node->pure()) {
+        work.push_back(node);
+      }
+    }
+    if (block->value) {
+      work.push_back(block->value);
+    }
+  }
+  while (!work.empty()) {
+    Node *node = work.back();
+    work.pop_back();
+    if (live.insert(node).second) {
+      for (Node *operand : node->operands) {
+        work.push_back(operand);
+      }
+    }
+  }
+
+  auto dead = [&](Node *node) { return !live.count(node); };
+  for (auto &block : graph.blocks) {
+    block->phis.erase(
+        std::remove_if(block->phis.begin(), block->phis.end(), dead),
+        block->phis.end());
+    block->code.erase(
+        std::remove_if(block->code.begin(), block->code.end(), dead),
+        block->code.end());
+  }
+}
+
+static ValueType joinType(ValueType a, ValueType b) {
+  return a == b ? a : ValueType::Unknown;
+}
+
+void inferTypes(Graph &graph) {
+  // optimistic: phis start out without a type and only ever widen;
+  std::unordered_set<Node *> known;
+  auto typeOf = [&](Node *node) -> ValueType {
+    switch (node->kind) {
+    case NodeKind::Constant:
+      return node->constant.type();
+    case NodeKind::Phi: {
+      bool first = true;
+      ValueType type = ValueType::Unknown;
+      for (Node *operand : node->operands) {
+        if (!known.count(operand)) {
+          continue;
+        }
+        type = first ? operand->type : joinType(type, operand->type);
+        first = false;
+      }
+      return type;
+    }
+    case NodeKind::Binary:
+      return resultType(node->opcode, node->operands[0]->type,
+                        node->operands[1]->type);
+    case NodeKind::Negate: {
+      ValueType type = node->operands[0]->type;
+      return isNumberType(type) ? type : ValueType::Unknown;
+    }
+    case NodeKind::Not:
+      return ValueType::Boolean;
+    default:
+      return ValueType::Unknown;
+    }
+  };
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (Block *block : graph.order) {
+      for (auto *nodes : {&block->phis, &block->code}) {
+        for (Node *node : *nodes) {
+          ValueType type = typeOf(node);
+          if (known.insert(node).second || type != node->type) {
+            node->type = type;
+            changed = true;
+          }
+        }
+      }
+    }
+  }
+}
+
+} // namespace ssa
+} // namespace kestrel
@@ -7,6 +7,7 @@ namespace kestrel {
 void ExpressionStatement::evaluate(Compiler &compiler) {
   Log(level, tag) << "ExpressionStatement";
   expression->eval(compiler);
+  compiler.emitCode(Opcode::Pop); // discard the unused result;
 }
 
 void BlockStatement::evaluate(Compiler &compiler) {
@@ -19,22 +20,23 @@ void BlockStatement::evaluate(Compiler &compiler) {
 }
 
 void VariableStatement::evaluate(Compiler &compiler) {
-  Log(level, tag) << "VariableStatement " << name.lexeme;
+  Log(level, tag) << "VariableStatement " << name.lexeme();
   if (initializer) {
     initializer->eval(compiler);
   } else {
     compiler.emitCode(Opcode::LoadNil);
   }
 
-  int index = compiler.lookup(name.lexeme); // local? global?
+  int index = compiler.lookup(name.lexeme()); // local? global?
   if (index != -1) {
     // TODO already exist;
   }
   // TODO make global?
-  index = compiler.addLocal(name.lexeme);
+  index = compiler.addLocal(name.lexeme());
   // store local or global;
-  compiler.emitCode(Opcode::Store);
-  compiler.emitIndex(index);
+  ValueType type = initializer ? compiler.typeOf(initializer)
+                               : ValueType::Nil;
+  compiler.emitStore(index, type);
 }
 
 } // namespace kestrel
\ No newline at end of file
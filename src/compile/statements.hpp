@@ -13,36 +13,39 @@
 
 namespace kestrel {
 
+class Arena;
 class Compiler;
+class Function;
+class Module;
 
 static LogLevel level = LogLevel::Debug;
 static std::string tag = "stmt";
 
 
 struct BlockStatement : Statement {
-  BlockStatement(std::vector<std::shared_ptr<Statement>> statements)
+  BlockStatement(std::vector<Statement *> statements)
       : statements{std::move(statements)} {}
 
   void evaluate(Compiler &compiler) override;
   void print() override { Log(level, tag) << "Block"; }
 
-  const std::vector<std::shared_ptr<Statement>> statements;
+  const std::vector<Statement *> statements;
 };
 
 struct ExpressionStatement : Statement {
-  ExpressionStatement(std::shared_ptr<Expression> expression)
+  ExpressionStatement(Expression *expression)
       : expression{std::move(expression)} {}
 
   void evaluate(Compiler &compiler) override;
 
   void print() override { Log(level, tag) << "Expression" << expression; }
 
-  const std::shared_ptr<Expression> expression;
+  Expression *const expression;
 };
 
 struct FunctionStatement : Statement {
   FunctionStatement(Token name, std::vector<Token> params,
-                    std::vector<std::shared_ptr<Statement>> body)
+                    std::vector<Statement *> body)
       : name_{std::move(name)}, params_{std::move(params)}, body_{std::move(
                                                                 body)} {
     if (body_.size() == 0) {
@@ -54,44 +57,75 @@ struct FunctionStatement : Statement {
   void evaluate(Compiler &compiler) override;
   void print() override;
 
+  // Compiles the body against `module`'s constant and name tables; nodes the
+  // compiler rewrites go to `arena`.
+  std::shared_ptr<Function> compile(Module &module, int optimizationLevel,
+                                    Arena &arena);
+
 public:
   const Token &name() { return name_; }
   const std::vector<Token> &params() { return params_; }
-  const std::vector<std::shared_ptr<Statement>> &body() { return body_; }
+  const std::vector<Statement *> &body() { return body_; }
+
+private:
+  const Token name_;
+  const std::vector<Token> params_;
+  std::vector<Statement *> body_;
+};
+
+// A function declaration whose body was only pre-parsed. It compiles to a
+// stub Function that scans, parses and compiles the source between `open`
+// and `close` the first time it is called; until then the function costs
+// its name, its parameters and a reference to the source.
+struct LazyFunctionStatement : Statement {
+  LazyFunctionStatement(Token name, std::vector<Token> params, Token open,
+                        Token close)
+      : name_{std::move(name)}, params_{std::move(params)},
+        open_{std::move(open)}, close_{std::move(close)} {}
+
+  void evaluate(Compiler &compiler) override;
+  void print() override { Log(level, tag) << "LazyFunction " << name_.lexeme(); }
+
+  // A function whose body is compiled from the source on its first call.
+  std::shared_ptr<Function> stub(int optimizationLevel) const;
+
+  const Token &name() const { return name_; }
+  const Token &close() const { return close_; }
 
 private:
   const Token name_;
   const std::vector<Token> params_;
-  std::vector<std::shared_ptr<Statement>> body_;
+  const Token open_;  // {
+  const Token close_; // }
 };
 
 struct IfStatement : Statement {
-  IfStatement(std::shared_ptr<Expression> condition,
-              std::shared_ptr<Statement> thenBranch,
-              std::shared_ptr<Statement> elseBranch)
+  IfStatement(Expression *condition,
+              Statement *thenBranch,
+              Statement *elseBranch)
       : condition{std::move(condition)}, thenBranch{std::move(thenBranch)},
         elseBranch{std::move(elseBranch)} {}
 
   void evaluate(Compiler &compiler) override;
   void print() override { Log(level, tag) << "If "; }
 
-  const std::shared_ptr<Expression> condition;
-  const std::shared_ptr<Statement> thenBranch;
-  const std::shared_ptr<Statement> elseBranch;
+  Expression *const condition;
+  Statement *const thenBranch;
+  Statement *const elseBranch;
 };
 
 struct ReturnStatement : Statement {
-  ReturnStatement(std::shared_ptr<Expression> value)
+  ReturnStatement(Expression *value)
       : value{std::move(value)} {}
 
   void evaluate(Compiler &compiler) override;
   void print() override { Log(level, tag) << "Return"; }
 
-  const std::shared_ptr<Expression> value;
+  Expression *const value;
 };
 
 struct VariableStatement : Statement {
-  VariableStatement(Token name, std::shared_ptr<Expression> initializer)
+  VariableStatement(Token name, Expression *initializer)
       : name{std::move(name)}, initializer{std::move(initializer)} {}
 
 
@@ -100,21 +134,22 @@ struct VariableStatement : Statement {
   void evaluate(Compiler &compiler) override;
 
   void print() override {
-    Log(level, tag) << "Variable " << name.lexeme << " = " << initializer;
+    Log(level, tag) << "Variable " << name.lexeme() << " = " << initializer;
   }
 
   const Token name;
-  const std::shared_ptr<Expression> initializer;
+  Expression *const initializer;
 };
 
 struct While : Statement {
-  While(std::shared_ptr<Expression> condition, std::shared_ptr<Statement> body)
+  While(Expression *condition, Statement *body)
       : condition{std::move(condition)}, body{std::move(body)} {}
 
+  void evaluate(Compiler &compiler) override;
   void print() override { Log(level, tag) << "While"; }
 
-  const std::shared_ptr<Expression> condition;
-  const std::shared_ptr<Statement> body;
+  Expression *const condition;
+  Statement *const body;
 };
 
 struct Import : Statement {
@@ -128,17 +163,17 @@ struct Import : Statement {
 };
 
 struct ClassStatement : Statement {
-  ClassStatement(Token name, std::shared_ptr<Variable> superclass,
-                 std::vector<std::shared_ptr<FunctionStatement>> constructors,
-                 std::vector<std::shared_ptr<FunctionStatement>> methods,
-                 std::vector<std::shared_ptr<FunctionStatement>> getters,
-                 std::vector<std::shared_ptr<FunctionStatement>> setters)
+  ClassStatement(Token name, Variable *superclass,
+                 std::vector<FunctionStatement *> constructors,
+                 std::vector<FunctionStatement *> methods,
+                 std::vector<FunctionStatement *> getters,
+                 std::vector<FunctionStatement *> setters)
       : name{std::move(name)}, superclass{std::move(superclass)},
         constructors{std::move(constructors)}, methods{std::move(methods)},
         getters{std::move(getters)}, setters{std::move(setters)} {}
 
   void print() override {
-    Log(level, tag) << "Class " << name.lexeme
+    Log(level, tag) << "Class " << name.lexeme()
                     << " constructors:" << constructors.size()
                     << " methods:" << methods.size()
                     << " getters: " << getters.size()
@@ -146,11 +181,11 @@ struct ClassStatement : Statement {
   }
 
   const Token name;
-  const std::shared_ptr<Variable> superclass;
-  const std::vector<std::shared_ptr<FunctionStatement>> constructors;
-  const std::vector<std::shared_ptr<FunctionStatement>> methods;
-  const std::vector<std::shared_ptr<FunctionStatement>> getters;
-  const std::vector<std::shared_ptr<FunctionStatement>> setters;
+  Variable *const superclass;
+  const std::vector<FunctionStatement *> constructors;
+  const std::vector<FunctionStatement *> methods;
+  const std::vector<FunctionStatement *> getters;
+  const std::vector<FunctionStatement *> setters;
 };
 
 } // namespace kestrel
\ No newline at end of file
@@ -2,7 +2,10 @@
 #include "function.hpp"
 
 #include <memory>
+#include <stdexcept>
 
+#include "compile/parser.hpp"
+#include "compile/scanner.hpp"
 #include "compile/statements.hpp"
 #include "compiler.hpp"
 
@@ -14,36 +17,86 @@ void FunctionStatement::prepare(Compiler &compiler) {
 
 void FunctionStatement::evaluate(Compiler& compiler) {
     Log(level, tag) << "FunctionStatement" ;
-    
+
+    std::shared_ptr<Function> function = compiler.precompiled(this);
+    if (!function) {
+        function = compile(compiler.module(), compiler.optimizationLevel(),
+                           compiler.arena());
+    }
+
+    Value value(function);
+    // TODO global?
+    Log(level, tag) << "before make global" ;
+    compiler.makeGlobal(name_.lexeme(), value);
+}
+
+std::shared_ptr<Function> FunctionStatement::compile(
+    Module &module, int optimizationLevel, Arena &arena) {
     Compiler subCompiler;
-    subCompiler.setModule(compiler.module());
+    subCompiler.setModule(module);
+    subCompiler.setOptimizationLevel(optimizationLevel);
 
     for (int i = 0; i < params_.size(); i++) {
-        subCompiler.addLocal(params_[i].lexeme);
+        subCompiler.addLocal(params_[i].lexeme());
     }
 
-    Module m = subCompiler.compile(body_);
-
-    // TODO add nil?
-    m.instructions.appendByte((uint8_t)Opcode::Return);
-    // subCompiler.emitCode(Opcode::Return);
+    auto function = std::make_shared<Function>(
+        subCompiler.compileFunction(body_, arena));
 
     Log(level, tag) << "start function" ;
-    Log(level, tag) << "name:" << name_.lexeme ;
+    Log(level, tag) << "name:" << name_.lexeme() ;
     Log(level, tag) << "arty:" << params_.size() ;
     Log(level, tag) << "body.size:" << body_.size() ;
-    Log(level, tag) << "instructions.size:" << m.instructions.size();
+    Log(level, tag) << "instructions.size:"
+                    << function->instructions().size();
 
-    std::shared_ptr<Function> function;
-    function = std::make_shared<Function>(m.instructions);
     function->setArity(params_.size()); // TODO store names for kvargs?
-    function->setName(name_.lexeme);
-    function->setMaxSlots(subCompiler.maxSlots());
-    
-    Value value(function);
-    // TODO global?
-    Log(level, tag) << "before make global" ;
-    compiler.makeGlobal(name_.lexeme, value);
+    function->setName(name_.lexeme());
+    return function;
+}
+
+void LazyFunctionStatement::evaluate(Compiler &compiler) {
+    Log(level, tag) << "LazyFunctionStatement" ;
+
+    Value value(stub(compiler.optimizationLevel()));
+    compiler.makeGlobal(name_.lexeme(), value);
+}
+
+std::shared_ptr<Function> LazyFunctionStatement::stub(
+    int optimizationLevel) const {
+    auto function = std::make_shared<Function>();
+    function->setArity(params_.size());
+    function->setName(name_.lexeme());
+
+    // the tokens keep the source alive, the tree is not;
+    Token name = name_;
+    std::vector<Token> params = params_;
+    Token open = open_;
+    Token close = close_;
+    function->setLazyBody([name, params, open, close, optimizationLevel](
+                              Function &function, Module &module) {
+        Scanner scanner(open.buffer(), open.start + open.length, close.start,
+                        open.line);
+        std::vector<Token> tokens = scanner.scanTokens();
+        Arena arena;
+        Parser parser(tokens, arena);
+        parser.setLazyFunctions(true);
+        std::vector<Statement *> body = parser.parse();
+        // the body was only bracket-matched at load time, so a syntax error
+        // surfaces on the first call, as an error of that call;
+        if (!parser.errors().empty()) {
+            throw std::runtime_error(name.lexeme() + ": parse error at " +
+                                     parser.errors().front());
+        }
+        FunctionStatement statement(name, params, body);
+
+        std::shared_ptr<Function> compiled =
+            statement.compile(module, optimizationLevel, arena);
+        function.instructions() = std::move(compiled->instructions());
+        function.setMaxSlots(compiled->maxSlots());
+        function.setCompiledSize(compiled->compiledSize());
+    });
+    return function;
 }
 
 void FunctionStatement::print() {
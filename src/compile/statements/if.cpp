@@ -3,24 +3,30 @@
 
 namespace kestrel {
 void IfStatement::evaluate(Compiler& compiler) {
-    // condition first
-    condition->eval(compiler);
-    compiler.emitCode(Opcode::BranchFalse);
-    int index = compiler.emitIndex(0);
-
-    int current = (int) compiler.instructions().size();
+    // condition first, jumping to the else branch when false;
+    std::vector<int> toElse;
+    condition->branch(compiler, false, toElse);
 
     thenBranch->evaluate(compiler);
-    int offset = (int) compiler.instructions().size() - current;
-    compiler.instructions().writeShort(offset, index); // patch offset;
 
     Log(level, tag) << "then is:";
     thenBranch->print();
 
     if (elseBranch) {
+        // jump over the else branch;
+        compiler.emitCode(Opcode::Branch);
+        int end = compiler.emitIndex(0);
+        for (int jump : toElse) {
+            compiler.patchBranch(jump, (int) compiler.instructions().size());
+        }
+
         elseBranch->evaluate(compiler);
+        compiler.patchBranch(end, (int) compiler.instructions().size());
+    } else {
+        for (int jump : toElse) {
+            compiler.patchBranch(jump, (int) compiler.instructions().size());
+        }
     }
-    
 }
 
 }
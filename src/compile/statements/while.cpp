@@ -0,0 +1,22 @@
+#include "compile/statements.hpp"
+#include "compiler.hpp"
+
+namespace kestrel {
+void While::evaluate(Compiler& compiler) {
+    int start = (int) compiler.instructions().size();
+
+    std::vector<int> exits;
+    condition->branch(compiler, false, exits);
+
+    body->evaluate(compiler);
+
+    // jump back to the condition;
+    compiler.emitCode(Opcode::Branch);
+    compiler.patchBranch(compiler.emitIndex(0), start);
+
+    for (int exit : exits) {
+        compiler.patchBranch(exit, (int) compiler.instructions().size());
+    }
+}
+
+}
@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace kestrel {
@@ -11,38 +12,50 @@ struct Local {
   int level;
 };
 
+// Locals of one function body by lexical scope. A local's slot is its
+// position on the scope stack, so leaving a scope frees the slots of its
+// locals for the declarations that follow. Names map to the stack of slots
+// declared under them, innermost last, for constant time lookup.
 class SymbolTable {
 public:
   void enterScope() { level++; }
-  void exitScope() { level--; }
-  int findSymbol(const std::string &name) {
-    for (int i = (int)locals.size() - 1; i >= 0; i--) {
-      if (locals[i].name == name) {
-        return i;
+  void exitScope() {
+    while (!locals.empty() && locals.back().level == level) {
+      auto it = slots_.find(locals.back().name);
+      it->second.pop_back();
+      if (it->second.empty()) {
+        slots_.erase(it);
       }
+      locals.pop_back();
     }
-    return -1;
+    level--;
+  }
+  int findSymbol(const std::string &name) const {
+    auto it = slots_.find(name);
+    return it == slots_.end() ? -1 : it->second.back();
   }
   int addSymbol(const std::string &name) {
+    int slot = (int)locals.size();
     locals.push_back({name, level});
-    maxSlots_ = std::max(maxSlots_, (int)locals.size());
-    return locals.size() - 1;
+    slots_[name].push_back(slot);
+    maxSlots_ = std::max(maxSlots_, slot + 1);
+    return slot;
   }
-  bool checkSymbol(const std::string &name) {
-    for (int i = (int)locals.size() - 1; i >= 0; i--) {
-      if (locals[i].level == level && locals[i].name == name) {
-        return true;
-      }
-    }
-    return false;
+  bool checkSymbol(const std::string &name) const {
+    int slot = findSymbol(name);
+    return slot >= 0 && locals[slot].level == level;
   }
 
-  int maxSlots() { return maxSlots_; }
+  // Most locals live at once so far.
+  int maxSlots() const { return maxSlots_; }
+
+  int size() const { return (int)locals.size(); }
 
 private:
   std::vector<Local> locals;
+  std::unordered_map<std::string, std::vector<int>> slots_;
   int level = 0;
-  int maxSlots_;
+  int maxSlots_ = 0;
 };
 
 } // namespace kestrel
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <string>
 
 namespace kestrel {
@@ -111,45 +112,66 @@ struct Literal {
   std::string string;
 };
 
+// A token refers to its lexeme by offset and length into the source buffer
+// it was scanned from, which it shares with the scanner; nothing is copied
+// until lexeme() or literal() is asked for.
 class Token {
 public:
-  Token(TokenType type, String lexeme, String value, int line)
-      : type{type}, lexeme{std::move(lexeme)}, value{std::move(lexeme)},
-        line{line} {
-    // Literal literal;
+  Token(TokenType type, std::shared_ptr<const String> source, int start,
+        int length, int line)
+      : type{type}, line{line}, start{start}, length{length},
+        source{std::move(source)} {}
+
+  // A token made up by the compiler rather than scanned;
+  Token(TokenType type, const String &text, int line)
+      : Token(type, std::make_shared<const String>(text), 0, (int)text.size(),
+              line) {}
+
+  String lexeme() const { return String(text(), length); }
+
+  const char *text() const { return source->data() + start; }
+
+  // Source the token was scanned from;
+  const std::shared_ptr<const String> &buffer() const { return source; }
+
+  // Value of an Integer, Double or String token;
+  Literal literal() const {
+    Literal literal;
     switch (type) {
     case TokenType::Integer:
       literal.type = LiteralType::Integer;
-      literal.value.intValue = std::stoi(value);
+      literal.value.intValue = std::stoi(lexeme());
       break;
     case TokenType::Double:
       literal.type = LiteralType::Double;
-      literal.value.doubleValue = std::stod(value);
+      literal.value.doubleValue = std::stod(lexeme());
       break;
     case TokenType::String:
+      // trim the surrounding quotes;
       literal.type = LiteralType::kString;
-      literal.string = value;
+      literal.string.assign(text() + 1, length - 2);
       break;
     default:
       // we don't care about the rest;
       break;
     }
+    return literal;
   }
 
-  operator String() const { return lexeme; }
+  operator String() const { return lexeme(); }
 
   String toString() const {
     String literal_text;
 
     switch (type) {
     case (TokenType::Identifier):
-      literal_text = lexeme;
+      literal_text = lexeme();
       break;
     case (TokenType::String):
-      literal_text = value;
+      literal_text = literal().string;
       break;
     case (TokenType::Double): // TODO int? double:
-      literal_text = std::to_string(literal.value.doubleValue);
+      literal_text = std::to_string(literal().value.doubleValue);
       break;
     case (TokenType::True):
       literal_text = "true";
@@ -161,15 +183,17 @@ public:
       literal_text = "nil";
     }
 
-    return std::to_string((int)type) + " " + lexeme + " " + literal_text;
+    return std::to_string((int)type) + " " + lexeme() + " " + literal_text;
   }
 
   // private:
   const TokenType type; // TODO use getter/setter;
-  const String lexeme;
-  const String value;
   const int line;
-  Literal literal;
+  const int start;
+  const int length;
+
+private:
+  std::shared_ptr<const String> source;
 };
 
 } // namespace kestrel
\ No newline at end of file
@@ -0,0 +1,214 @@
+#include "type_inference.hpp"
+
+#include "statements.hpp"
+#include "type_rules.hpp"
+
+namespace kestrel {
+
+static ValueType joinType(ValueType a, ValueType b) {
+  return a == b ? a : ValueType::Unknown;
+}
+
+void TypeInference::run(
+    const std::vector<Statement *> &statements) {
+  State state;
+  // parameters are already declared and dynamic;
+  state.slots.assign(table_.size(), ValueType::Unknown);
+  for (auto &stmt : statements) {
+    statement(stmt, state);
+  }
+}
+
+ValueType TypeInference::typeOf(const Expression *expression) const {
+  auto it = types_.find(expression);
+  return it == types_.end() ? ValueType::Unknown : it->second;
+}
+
+void TypeInference::record(Expression *expression, ValueType type,
+                           const State &state) {
+  if (!state.reachable) {
+    return; // dead code keeps the generic instructions;
+  }
+  auto it = types_.find(expression);
+  if (it == types_.end()) {
+    types_[expression] = type;
+  } else {
+    it->second = joinType(it->second, type);
+  }
+}
+
+ValueType &TypeInference::slot(State &state, int index) {
+  if (index >= (int)state.slots.size()) {
+    state.slots.resize(index + 1, ValueType::Nil); // frames start out nil;
+  }
+  return state.slots[index];
+}
+
+TypeInference::State TypeInference::join(const State &a, const State &b) {
+  if (!a.reachable) {
+    return b;
+  }
+  if (!b.reachable) {
+    return a;
+  }
+  State result = a.slots.size() >= b.slots.size() ? a : b;
+  const State &other = a.slots.size() >= b.slots.size() ? b : a;
+  for (size_t i = 0; i < other.slots.size(); i++) {
+    result.slots[i] = joinType(result.slots[i], other.slots[i]);
+  }
+  return result;
+}
+
+void TypeInference::statement(Statement *stmt, State &state) {
+  if (stmt == nullptr) {
+    return;
+  }
+  if (auto *s = dynamic_cast<ExpressionStatement *>(stmt)) {
+    expression(s->expression, state);
+  } else if (auto *s = dynamic_cast<VariableStatement *>(stmt)) {
+    ValueType type = ValueType::Nil;
+    if (s->initializer) {
+      type = expression(s->initializer, state);
+    }
+    slot(state, table_.addSymbol(s->name.lexeme())) = type;
+  } else if (auto *s = dynamic_cast<BlockStatement *>(stmt)) {
+    table_.enterScope();
+    for (auto &inner : s->statements) {
+      statement(inner, state);
+    }
+    table_.exitScope();
+  } else if (auto *s = dynamic_cast<IfStatement *>(stmt)) {
+    expression(s->condition, state);
+    State thenState = state;
+    statement(s->thenBranch, thenState);
+    State elseState = state;
+    statement(s->elseBranch, elseState);
+    state = join(thenState, elseState);
+  } else if (auto *s = dynamic_cast<While *>(stmt)) {
+    // Iterate the body until the state at the loop head is stable; each
+    // pass replays the declarations from the same symbol table.
+    SymbolTable entry = table_;
+    State head = state;
+    while (true) {
+      table_ = entry;
+      State body = head;
+      expression(s->condition, body);
+      statement(s->body, body);
+      State merged = join(head, body);
+      if (merged.slots == head.slots && merged.reachable == head.reachable) {
+        break;
+      }
+      head = merged;
+    }
+    // the exit edge leaves from the condition;
+    SymbolTable after = table_;
+    table_ = entry;
+    expression(s->condition, head);
+    table_ = after;
+    state = head;
+  } else if (auto *s = dynamic_cast<ReturnStatement *>(stmt)) {
+    if (s->value) {
+      expression(s->value, state);
+    }
+    state.reachable = false;
+  }
+  // functions are inferred when their own body is compiled;
+}
+
+ValueType TypeInference::expression(Expression *expr, State &state) {
+  if (expr == nullptr) {
+    return ValueType::Unknown;
+  }
+  ValueType type = ValueType::Unknown;
+
+  switch (expr->type()) {
+  case ExpressionType::Literal: {
+    type = static_cast<LiteralExpression *>(expr)->value.type();
+    break;
+  }
+  case ExpressionType::Variable: {
+    auto *variable = static_cast<Variable *>(expr);
+    int index = table_.findSymbol(variable->name.lexeme());
+    if (index >= 0) {
+      type = slot(state, index);
+    }
+    break;
+  }
+  case ExpressionType::Assign: {
+    auto *assign = static_cast<Assign *>(expr);
+    type = expression(assign->value, state);
+    int index = table_.findSymbol(assign->name.lexeme());
+    if (index >= 0) {
+      slot(state, index) = type;
+    }
+    break;
+  }
+  case ExpressionType::Binary: {
+    auto *binary = static_cast<Binary *>(expr);
+    ValueType left = expression(binary->left, state);
+    ValueType right = expression(binary->right, state);
+    bool negated = false;
+    Opcode code = binary->opcode(negated);
+    type = negated ? ValueType::Boolean : resultType(code, left, right);
+    break;
+  }
+  case ExpressionType::Unary: {
+    auto *unary = static_cast<Unary *>(expr);
+    ValueType right = expression(unary->right, state);
+    if (unary->op.type == TokenType::Bang) {
+      type = ValueType::Boolean;
+    } else if (isNumberType(right)) {
+      type = right;
+    }
+    break;
+  }
+  case ExpressionType::Grouping: {
+    type = expression(static_cast<Grouping *>(expr)->expression, state);
+    break;
+  }
+  case ExpressionType::Logical: {
+    auto *logical = static_cast<Logical *>(expr);
+    ValueType left = expression(logical->left, state);
+    State skipped = state; // the right side may not run;
+    ValueType right = expression(logical->right, state);
+    state = join(state, skipped);
+    if (left == ValueType::Boolean && right == ValueType::Boolean) {
+      type = ValueType::Boolean;
+    }
+    break;
+  }
+  case ExpressionType::Call: {
+    auto *call = static_cast<Call *>(expr);
+    expression(call->callee, state);
+    for (auto &argument : call->arguments) {
+      expression(argument, state);
+    }
+    break;
+  }
+  case ExpressionType::Dispatch: {
+    auto *dispatch = static_cast<Dispatch *>(expr);
+    expression(dispatch->object, state);
+    for (auto &argument : dispatch->arguments) {
+      expression(argument, state);
+    }
+    break;
+  }
+  case ExpressionType::Get: {
+    expression(static_cast<Get *>(expr)->object, state);
+    break;
+  }
+  case ExpressionType::Set: {
+    auto *set = static_cast<Set *>(expr);
+    expression(set->object, state);
+    expression(set->value, state);
+    break;
+  }
+  default:
+    break;
+  }
+
+  record(expr, type, state);
+  return type;
+}
+
+} // namespace kestrel
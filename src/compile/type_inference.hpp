@@ -0,0 +1,45 @@
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "expression.hpp"
+#include "statement.hpp"
+#include "symbol_table.hpp"
+#include "value.hpp"
+
+namespace kestrel {
+
+// Flow-sensitive type inference over one function body (or the module
+// initializer). Local slots are resolved with a copy of the compiler's
+// SymbolTable replaying the same scope and declaration calls, so a slot
+// here is the slot the compiler assigns. Each expression gets the join of
+// the types it had on every path that reaches it; Unknown means dynamic.
+class TypeInference {
+public:
+  TypeInference() = default;
+  TypeInference(const SymbolTable &table) : table_(table) {}
+
+  void run(const std::vector<Statement *> &statements);
+
+  ValueType typeOf(const Expression *expression) const;
+
+private:
+  struct State {
+    bool reachable = true;
+    std::vector<ValueType> slots;
+  };
+
+  void statement(Statement *statement, State &state);
+  ValueType expression(Expression *expression, State &state);
+
+  void record(Expression *expression, ValueType type, const State &state);
+  ValueType &slot(State &state, int index);
+  static State join(const State &a, const State &b);
+
+  SymbolTable table_;
+  std::unordered_map<const Expression *, ValueType> types_;
+};
+
+} // namespace kestrel
@@ -0,0 +1,358 @@
+#include "runtime/escape_analysis.hpp"
+
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "instruction_list.hpp"
+#include "opcodes.hpp"
+#include "peephole.hpp"
+
+namespace kestrel {
+
+namespace {
+
+struct Candidate {
+  int load = -1;  // LoadGlobal;
+  int call = -1;  // Call 0;
+  int store = -1; // Store s;
+  bool escapes = false;
+  std::string global;
+};
+
+struct Entry {
+  int candidate = -1;
+  int producer = -1; // LoadLocal that pushed the object;
+
+  bool operator==(const Entry& other) const {
+    return candidate == other.candidate && producer == other.producer;
+  }
+};
+
+const int kConflict = -2;
+
+struct State {
+  bool reached = false;
+  std::vector<Entry> stack;
+  std::vector<int> slots; // candidate held by each local, -1 for none;
+};
+
+bool isStore(Opcode code) {
+  return code == Opcode::Store || code == Opcode::StoreInt ||
+         code == Opcode::StoreDouble || code == Opcode::StoreBoolean;
+}
+
+} // namespace
+
+ScalarReplacement::Result ScalarReplacement::run(Function& function) {
+  Result result;
+  InstructionList list = InstructionList::decode(function.instructions());
+  std::vector<Instruction>& code = list.code;
+  int count = (int)code.size(); // includes the end marker;
+  // nothing below retargets a branch, and instructions are only inserted
+  // once the analysis is done;
+  std::unordered_set<int> targets = list.targets();
+  std::unordered_map<int, int> indices = list.indices();
+
+  // undo the peephole's load/store forwarding: `Duplicate; Store s` reads
+  // as `Store s; LoadLocal s`, so every use of the slot is a LoadLocal;
+  for (int i = 0; i + 1 < count; i++) {
+    Instruction &dup = code[i];
+    Instruction &store = code[i + 1];
+    if (dup.opcode == Opcode::Duplicate && isStore(store.opcode) &&
+        !targets.count(store.id)) {
+      dup.opcode = store.opcode;
+      dup.operands[0] = store.operands[0];
+      store.opcode = store.opcode == Opcode::StoreInt    ? Opcode::LoadLocalInt
+                     : store.opcode == Opcode::StoreDouble ? Opcode::LoadLocalDouble
+                                                           : Opcode::LoadLocal;
+    }
+  }
+
+  // allocation sites of plain classes;
+  std::vector<Candidate> candidates;
+  std::vector<int> candidateAt(count, -1); // instruction -> candidate;
+  for (int i = 0; i + 2 < count; i++) {
+    Instruction& load = code[i];
+    Instruction& call = code[i + 1];
+    Instruction& store = code[i + 2];
+    if (load.opcode != Opcode::LoadGlobal || call.opcode != Opcode::Call ||
+        call.operands[0] != 0 || store.opcode != Opcode::Store ||
+        targets.count(call.id) || targets.count(store.id)) {
+      continue;
+    }
+    const std::string& name = module_.getName(load.operands[0]);
+    if (!module_.hasGlobal(name)) {
+      continue;
+    }
+    Value& value = module_.getGlobal(name);
+    if (value.type() != ValueType::Class || !value.metaClass()->isPlain()) {
+      continue;
+    }
+    Candidate candidate;
+    candidate.load = i;
+    candidate.call = i + 1;
+    candidate.store = i + 2;
+    candidate.global = name;
+    candidateAt[i + 1] = (int)candidates.size();
+    candidateAt[i + 2] = (int)candidates.size();
+    candidates.push_back(candidate);
+  }
+  if (candidates.empty()) {
+    return result;
+  }
+
+  std::vector<int> producerOf(count, -1); // GetItem/SetItem -> LoadLocal;
+  std::vector<int> consumerOf(count, -1); // LoadLocal -> GetItem/SetItem;
+  std::vector<int> candidateOf(count, -1); // LoadLocal -> candidate;
+  auto escape = [&](const Entry& entry) {
+    if (entry.candidate >= 0) {
+      candidates[entry.candidate].escapes = true;
+    }
+  };
+  auto use = [&](const Entry& entry, int consumer) {
+    if (entry.candidate < 0) {
+      return;
+    }
+    int producer = entry.producer;
+    if (producer < 0 ||
+        (producerOf[consumer] >= 0 && producerOf[consumer] != producer) ||
+        (consumerOf[producer] >= 0 && consumerOf[producer] != consumer)) {
+      escape(entry);
+      return;
+    }
+    producerOf[consumer] = producer;
+    consumerOf[producer] = consumer;
+    candidateOf[producer] = entry.candidate;
+  };
+
+  int slotCount = std::max(function.maxSlots(), function.arity());
+  // Slots share values that never live at the same time, so paths may
+  // join with different candidates in one slot. That only matters if the
+  // slot is read before the next store; such a read escapes them all.
+  std::vector<std::vector<int>> merged(slotCount);
+  auto readSlot = [&](const State& state, int index) {
+    int held = state.slots[index];
+    if (held >= 0) {
+      candidates[held].escapes = true;
+    } else if (held == kConflict) {
+      for (int c : merged[index]) {
+        candidates[c].escapes = true;
+      }
+    }
+  };
+  std::vector<State> states(count);
+  bool ok = true;
+  auto join = [&](State& into, const State& from) {
+    if (!into.reached) {
+      into = from;
+      into.reached = true;
+      return true;
+    }
+    if (into.stack.size() != from.stack.size()) {
+      ok = false;
+      return false;
+    }
+    bool changed = false;
+    for (size_t i = 0; i < into.stack.size(); i++) {
+      if (!(into.stack[i] == from.stack[i]) && into.stack[i].candidate != -1) {
+        escape(into.stack[i]);
+        escape(from.stack[i]);
+        into.stack[i] = Entry();
+        changed = true;
+      } else if (!(into.stack[i] == from.stack[i])) {
+        escape(from.stack[i]);
+      }
+    }
+    for (size_t i = 0; i < into.slots.size(); i++) {
+      if (into.slots[i] != from.slots[i] && into.slots[i] != kConflict) {
+        if (into.slots[i] >= 0) {
+          merged[i].push_back(into.slots[i]);
+        }
+        if (from.slots[i] >= 0) {
+          merged[i].push_back(from.slots[i]);
+        }
+        into.slots[i] = kConflict;
+        changed = true;
+      } else if (into.slots[i] == kConflict && from.slots[i] >= 0) {
+        merged[i].push_back(from.slots[i]);
+      }
+    }
+    return changed;
+  };
+
+  State entry;
+  entry.slots.assign(slotCount, -1);
+  join(states[0], entry);
+  std::vector<int> worklist = {0};
+  while (!worklist.empty() && ok) {
+    int i = worklist.back();
+    worklist.pop_back();
+    Instruction& instruction = code[i];
+    if (instruction.removed) {
+      continue; // end marker;
+    }
+    State state = states[i];
+    std::vector<Entry>& stack = state.stack;
+
+    int pops = instruction.pops();
+    if ((int)stack.size() < pops) {
+      ok = false;
+      break;
+    }
+    std::vector<Entry> consumed(stack.end() - pops, stack.end());
+    stack.resize(stack.size() - pops);
+
+    Opcode op = instruction.opcode;
+    if (op == Opcode::GetItem) {
+      use(consumed[0], i);
+      stack.push_back(Entry());
+    } else if (op == Opcode::SetItem) {
+      use(consumed[0], i);
+      escape(consumed[1]);
+      stack.push_back(Entry());
+    } else if (op == Opcode::Store && candidateAt[i] >= 0 &&
+               consumed[0].candidate == candidateAt[i]) {
+      state.slots[instruction.operands[0]] = candidateAt[i];
+    } else {
+      for (const Entry& e : consumed) {
+        escape(e);
+      }
+      if (op == Opcode::Call && candidateAt[i] >= 0) {
+        stack.push_back(Entry{candidateAt[i], -1});
+      } else if (op == Opcode::LoadLocal) {
+        int index = instruction.operands[0];
+        if (index < 0 || index >= slotCount) {
+          ok = false;
+          break;
+        }
+        Entry pushed;
+        if (state.slots[index] >= 0) {
+          pushed = Entry{state.slots[index], i};
+        } else {
+          readSlot(state, index);
+        }
+        stack.push_back(pushed);
+      } else if ((op == Opcode::LoadLocalInt ||
+                  op == Opcode::LoadLocalDouble) &&
+                 instruction.operands[0] < slotCount) {
+        readSlot(state, instruction.operands[0]);
+        stack.push_back(Entry());
+      } else {
+        if (isStore(op) && instruction.operands[0] < slotCount) {
+          state.slots[instruction.operands[0]] = -1;
+        }
+        for (int n = 0; n < instruction.pushes(); n++) {
+          stack.push_back(Entry());
+        }
+      }
+    }
+
+    std::vector<int> successors;
+    if (instruction.isBranch()) {
+      auto target = indices.find(instruction.target);
+      successors.push_back(target == indices.end() ? -1 : target->second);
+    }
+    if (op != Opcode::Branch && op != Opcode::Return && i + 1 < count) {
+      successors.push_back(i + 1);
+    }
+    for (int next : successors) {
+      if (next >= 0 && join(states[next], state)) {
+        worklist.push_back(next);
+      }
+    }
+  }
+  if (!ok) {
+    return result;
+  }
+
+  // every pushed object must have been consumed by an attribute access;
+  for (int i = 0; i < count; i++) {
+    if (code[i].opcode == Opcode::LoadLocal && states[i].reached) {
+      int held = states[i].slots[code[i].operands[0]];
+      if (held >= 0 && consumerOf[i] < 0) {
+        candidates[held].escapes = true;
+      }
+    }
+  }
+
+  // rewrite: attributes become locals past the existing frame;
+  int nextSlot = slotCount;
+  std::vector<std::pair<int, int>> stores; // insert Store slot after id;
+  for (int c = 0; c < (int)candidates.size(); c++) {
+    Candidate& candidate = candidates[c];
+    if (candidate.escapes) {
+      continue;
+    }
+    std::map<int, int> fields; // name index -> slot;
+    for (int i = 0; i < count; i++) {
+      int producer = producerOf[i];
+      if (producer < 0 || candidateOf[producer] != c) {
+        continue;
+      }
+      int name = code[i].operands[0];
+      if (fields.count(name) == 0) {
+        fields[name] = nextSlot++;
+      }
+      code[producer].removed = true;
+      if (code[i].opcode == Opcode::GetItem) {
+        code[i].opcode = Opcode::LoadLocal;
+        code[i].operands[0] = fields[name];
+      } else {
+        code[i].opcode = Opcode::Duplicate;
+        stores.push_back({code[i].id, fields[name]});
+      }
+    }
+
+    // the allocation resets the attributes to nil;
+    code[candidate.store].removed = true;
+    if (fields.empty()) {
+      code[candidate.load].removed = true;
+      code[candidate.call].removed = true;
+    } else {
+      auto it = fields.begin();
+      code[candidate.load].opcode = Opcode::LoadNil;
+      code[candidate.call].opcode = Opcode::Store;
+      code[candidate.call].operands[0] = it->second;
+      int after = code[candidate.call].id;
+      for (++it; it != fields.end(); ++it) {
+        stores.push_back({after, -1});
+        stores.push_back({after, it->second});
+      }
+    }
+    result.eliminated++;
+    result.dependencies.push_back(candidate.global);
+  }
+  if (result.eliminated == 0) {
+    return result;
+  }
+
+  // -1 inserts LoadNil, anything else a Store; pairs after the same id keep
+  // their order. Inserting back to front leaves the positions still to
+  // visit where they were;
+  std::map<int, std::vector<int>> after; // position -> requests;
+  for (auto& request : stores) {
+    after[indices[request.first]].push_back(request.second);
+  }
+  for (auto it = after.rbegin(); it != after.rend(); ++it) {
+    int index = it->first + 1;
+    for (int slot : it->second) {
+      if (slot < 0) {
+        list.insert(index++, Opcode::LoadNil);
+      } else {
+        list.insert(index++, Opcode::Store, slot);
+      }
+    }
+  }
+
+  InstructionArray instructions = list.encode();
+  Peephole().run(instructions); // the rewrite leaves Duplicate; Store; Pop;
+  result.function = std::make_shared<Function>(std::move(instructions));
+  result.function->setName(function.name());
+  result.function->setArity(function.arity());
+  result.function->setMaxSlots(nextSlot);
+  return result;
+}
+
+} // namespace kestrel
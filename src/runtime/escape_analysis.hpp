@@ -0,0 +1,36 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "function.hpp"
+#include "module.hpp"
+
+namespace kestrel {
+
+// Escape analysis and scalar replacement over a script function's bytecode.
+//
+// An allocation is `LoadGlobal C; Call 0; Store s` where C is bound to a
+// plain Class. Its object does not escape if the only uses of slot s are
+// as the object operand of GetItem/SetItem; storing it anywhere else,
+// passing it to a call or dispatch, returning it or merging it with another
+// value makes it escape. Non-escaping objects lose their allocation and
+// each of their attributes becomes a fresh local slot.
+class ScalarReplacement {
+public:
+  struct Result {
+    std::shared_ptr<Function> function; // nullptr if nothing was replaced;
+    int eliminated = 0;
+    std::vector<std::string> dependencies; // globals the result relies on;
+  };
+
+  ScalarReplacement(Module& module) : module_(module) {}
+
+  Result run(Function& function);
+
+private:
+  Module& module_;
+};
+
+}
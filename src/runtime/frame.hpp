@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <string>
 #include <iostream>
 
@@ -16,6 +17,10 @@ struct Frame {
   std::vector<Value> locals;
 
   Function* function;
+  // keeps `function` alive when it is optimized or specialized code the
+  // called function has since dropped, see Function::deoptimize;
+  std::shared_ptr<Function> code;
+  Module* module = nullptr; // the function's names and constants;
 
   void print() {
     // std::cout << "pc:" << pc << std::endl;
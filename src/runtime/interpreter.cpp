@@ -2,43 +2,70 @@
 
 #include <ctype.h>
 #include <iostream>
+#include <stdexcept>
 #include <vector>
 #include <stack>
 
 #include "log.hpp"
 #include "value.hpp"
+#include "feedback.hpp"
 #include "function.hpp"
 #include "opcodes.hpp"
 
+#include "arithmetic.hpp"
+#include "runtime/escape_analysis.hpp"
+#include "runtime/module_loader.hpp"
+#include "runtime/specializer.hpp"
 #include "runtime/stack.hpp"
 #include "core/core.hpp"
 
 namespace kestrel {
 
-void Interpreter::run(Module& module, Function& function) {
+// Recording feedback for a frozen function would write to pages it shares
+// with other processes;
+static FeedbackVector* feedbackOf(Function* function) {
+  static FeedbackVector none;
+  return function->frozen() ? &none : &function->feedback();
+}
+
+void Interpreter::run(Module& entry, Function& function) {
   LogLevel level = LogLevel::Debug;
   std::string tag = "interp";
 
   Stack<Value> stack;
   Stack<Frame> frames; // TODO move to coroutine?
-  std::vector<Value> locals_i;
-  locals_i.reserve(256); // TODO
-  
   frames.push(Frame(function));
+  frames.top().locals.resize(function.maxSlots());
+  frames.top().module = &entry;
 
-  std::vector<Value>* locals = &locals_i;
+  std::vector<Value>* locals = &frames.top().locals;
   Frame* frame = &frames.top();
-  InstructionArray* instructions = &frame->function->instructions();
+  BytecodeView code = frame->function->instructions().view();
+  FeedbackVector* feedback = feedbackOf(frame->function);
+  Module* module = frame->module;
   int pc = (frame->pc);
 
 #define RELOAD() \
   frame = &frames.top(); \
-  instructions = &frame->function->instructions(); \
+  code = frame->function->instructions().view(); \
+  feedback = feedbackOf(frame->function); \
+  module = frame->module; \
   pc = (frame->pc); \
   locals = &frame->locals;
 
-  while (pc < instructions->size()) {
-    Opcode opcode = (Opcode)instructions->readByte(pc++);
+  while (pc < code.size()) {
+    int start = pc; // feedback slots are keyed by the opcode offset;
+    Opcode opcode = (Opcode)code.readByte(pc++);
+    int width = 1; // of the operands, unless a prefix widens them;
+    if (opcode == Opcode::Wide || opcode == Opcode::ExtraWide) {
+      width = opcode == Opcode::Wide ? 2 : 4;
+      opcode = (Opcode)code.readByte(pc++);
+    }
+    auto operand = [&] {
+      int value = code.readOperand(pc, width);
+      pc += width;
+      return value;
+    };
     Log(level, tag) << "opcode:" << (int)opcode;
 
     switch (opcode) {
@@ -46,69 +73,166 @@ void Interpreter::run(Module& module, Function& function) {
       Log(level, tag) << "Nop";
       continue;
     }
+    case Opcode::Branch: {
+      int offset = operand();
+      pc += offset;
+      continue;
+    }
+    case Opcode::BranchTrue: {
+      int offset = operand();
+      if (stack.top().boolValue()) {
+        pc += offset;
+      }
+      stack.pop(1);
+      continue;
+    }
     case Opcode::BranchFalse: {
-      int offset = instructions->readShort(pc);
+      int offset = operand();
       // std::cout << "offset:" << offset << std::endl;
-      pc += 2;
       if (stack.top().boolValue() == false) {
         pc += offset;
       }
       stack.pop();
       continue;
     }
+    case Opcode::BranchIfLess:
+    case Opcode::BranchIfNotLess:
+    case Opcode::BranchIfGreater:
+    case Opcode::BranchIfNotGreater:
+    case Opcode::BranchIfEqual:
+    case Opcode::BranchIfNotEqual: {
+      int offset = operand();
+      Value& left = stack[-2];
+      Value& right = stack[-1];
+      if (FeedbackSlot* slot = feedback->slotAt(start)) {
+        slot->recordOperands(left, right);
+      }
+      bool when;
+      Opcode compared = fusedCompare(opcode, when);
+      if (compare(compared, left, right) == when) {
+        pc += offset;
+      }
+      stack.pop(2);
+      continue;
+    }
     case Opcode::Add:
     case Opcode::Subtract:
+    case Opcode::Multiply:
+    case Opcode::Divide:
     case Opcode::Equals: 
     case Opcode::LessThan:
     case Opcode::GreaterThan: {
       Value& left = stack[-2];
       Value& right = stack[-1];
-
-      Value result;
-      switch (opcode) {
-        case Opcode::Add: {
-          result = Value(left.intValue() + right.intValue());
-          break;
-        }
-        case Opcode::Subtract: {
-          result = Value(left.intValue() - right.intValue());
-          break;
-        }
-        case Opcode::Equals: {
-          result = Value(left.intValue() == right.intValue());
-          break;
-        }
-        case Opcode::LessThan: {
-          result = Value(left.intValue() < right.intValue());
-          break;
-        }
-        case Opcode::GreaterThan: {
-          result = Value(left.intValue() > right.intValue());
-          break;
-        }
+      if (FeedbackSlot* slot = feedback->slotAt(start)) {
+        slot->recordOperands(left, right);
       }
-      
+
+      Value result = arithmetic(opcode, left, right);
       stack.pop(2);
       stack.push(std::move(result));
       continue;
     }
+    // Typed forms produced by the specializer, operand tags are known.
+    case Opcode::AddInt:
+    case Opcode::SubtractInt:
+    case Opcode::MultiplyInt:
+    case Opcode::EqualsInt:
+    case Opcode::LessThanInt:
+    case Opcode::GreaterThanInt: {
+      int left = stack[-2].intValue();
+      int right = stack[-1].intValue();
+      Value& result = stack[-2];
+      switch (opcode) {
+        case Opcode::AddInt: result.set(left + right); break;
+        case Opcode::SubtractInt: result.set(left - right); break;
+        case Opcode::MultiplyInt: result.set(left * right); break;
+        case Opcode::EqualsInt: result.set(left == right); break;
+        case Opcode::LessThanInt: result.set(left < right); break;
+        default: result.set(left > right); break;
+      }
+      stack.pop(1);
+      continue;
+    }
+    case Opcode::AddDouble:
+    case Opcode::SubtractDouble:
+    case Opcode::MultiplyDouble:
+    case Opcode::DivideDouble:
+    case Opcode::EqualsDouble:
+    case Opcode::LessThanDouble:
+    case Opcode::GreaterThanDouble: {
+      double left = stack[-2].doubleValue();
+      double right = stack[-1].doubleValue();
+      Value& result = stack[-2];
+      switch (opcode) {
+        case Opcode::AddDouble: result.set(left + right); break;
+        case Opcode::SubtractDouble: result.set(left - right); break;
+        case Opcode::MultiplyDouble: result.set(left * right); break;
+        case Opcode::DivideDouble: result.set(left / right); break;
+        case Opcode::EqualsDouble: result.set(left == right); break;
+        case Opcode::LessThanDouble: result.set(left < right); break;
+        default: result.set(left > right); break;
+      }
+      stack.pop(1);
+      continue;
+    }
+    case Opcode::AddString: {
+      std::string result = stack[-2].stringValue() + stack[-1].stringValue();
+      stack[-2].set(result);
+      stack.pop(1);
+      continue;
+    }
+    case Opcode::Pop: {
+      stack.pop(1);
+      continue;
+    }
+    case Opcode::Duplicate: {
+      Value top = stack.top();
+      stack.push(top);
+      continue;
+    }
+    case Opcode::Negate: {
+      Value& value = stack.top();
+      if (value.type() == ValueType::Integer) {
+        value.set(-value.intValue());
+      } else if (value.type() == ValueType::Double) {
+        value.set(-value.doubleValue());
+      } else {
+        value = Value(); // TODO raise a type error;
+      }
+      continue;
+    }
+    case Opcode::Not: {
+      Value& value = stack.top();
+      value.set(!value.boolValue());
+      continue;
+    }
     case Opcode::LoadInteger: {
-      int value = instructions->readShort(pc);
-      pc += 2;
+      int value = operand();
       stack.push({value});
       continue;
     }
+    case Opcode::LoadNil: {
+      stack.push(Value::nil());
+      continue;
+    }
     case Opcode::LoadConstant: {
-      int index = instructions->readShort(pc);
-      pc += 2;
-      Value& value = module.constants[index];
+      int index = operand();
+      const Value& value = module->getConstant(index);
       // std::cout << "loading:" << value << std::endl;
       stack.push(value);
       continue;
     }
+    case Opcode::LoadLocal0:
+    case Opcode::LoadLocal1:
+    case Opcode::LoadLocal2:
+    case Opcode::LoadLocal3: {
+      int localIndex = (int)opcode - (int)Opcode::LoadLocal0;
+      stack.push(locals->at(localIndex));
+      continue;
+    }
     case Opcode::LoadLocal: {
-      int localIndex = instructions->readShort(pc);
-      pc += 2;
+      int localIndex = operand();
       std::cout << "localIndex:" << localIndex << std::endl;
       Value& value = locals->at(localIndex);
       std::cout << "loading local :" << value << std::endl;
@@ -116,24 +240,60 @@ void Interpreter::run(Module& module, Function& function) {
       stack.inspect();
       continue;
     }
+    case Opcode::LoadLocalInt: {
+      int index = operand();
+      stack.push(Value((*locals)[index].intValue()));
+      continue;
+    }
+    case Opcode::LoadLocalDouble: {
+      int index = operand();
+      stack.push(Value((*locals)[index].doubleValue()));
+      continue;
+    }
+    // The slot keeps its storage, only the payload and tag are written.
+    case Opcode::StoreInt: {
+      int index = operand();
+      (*locals)[index].set(stack.top().intValue());
+      stack.pop(1);
+      continue;
+    }
+    case Opcode::StoreDouble: {
+      int index = operand();
+      (*locals)[index].set(stack.top().doubleValue());
+      stack.pop(1);
+      continue;
+    }
+    case Opcode::StoreBoolean: {
+      int index = operand();
+      (*locals)[index].set(stack.top().boolValue());
+      stack.pop(1);
+      continue;
+    }
+    case Opcode::StoreGlobal: {
+      int index = operand();
+      module->setGlobal(module->getName(index), stack.top());
+      stack.pop(1);
+      continue;
+    }
     // case Opcode::Load=
     case Opcode::Store: {
-      int index = instructions->readShort(pc);
-      pc += 2;
+      int index = operand();
       (*locals)[index] = stack.pop();
       // std::cout << "storing " << (*locals)[index] << " at index:" << index << std::endl;
       continue;
     }
     case Opcode::LoadGlobal: {
       std::cout << "LoadGlobal" << std::endl;
-      int index = instructions->readShort(pc);
-      pc += 2;
-      std::string& name = module.names[index];
+      int index = operand();
+      const std::string& name = module->getName(index);
       std::cout << "name:" << name << std::endl;
 
-      if (module.hasGlobal(name)) {
-        Value& val = module.getGlobal(name);
+      if (module->hasGlobal(name)) {
+        Value& val = module->getGlobal(name);
         std::cout << "LoadGlobal:" << name << " val:" << val << std::endl;
+        if (FeedbackSlot* slot = feedback->slotAt(start)) {
+          slot->recordValue(val);
+        }
         stack.push(val);
       } else {
         std::cout << "Cannot find global:" << name << std::endl;
@@ -142,28 +302,53 @@ void Interpreter::run(Module& module, Function& function) {
       continue;
     }
     case Opcode::GetItem: {
-      int index = instructions->readShort(pc);
-      pc += 2;
-      std::string& name = module.names[index];
-      Value& tos = stack.top();
-      core::Object* object;
-      // Value& attr = object->getAttribute(name);
-      
-      // core::Object* item = object->getItem(name);
-      // if (item == nullptr) {
-        
-      // }
-      
+      int index = operand();
+      const std::string& name = module->getName(index);
+      if (Module* imported = stack.top().moduleValue()) {
+        // the first access loads the module and runs its initializer; a
+        // module that fails to load fails the access;
+        if (loader && loader->prepare(*imported)) {
+          run(*imported, imported->initializer_);
+        }
+        Value attr = imported->hasGlobal(name) ? imported->getGlobal(name)
+                                               : Value();
+        stack.pop(1);
+        stack.push(attr);
+        continue;
+      }
+      core::Object* object = stack.top().objectValue();
+      Value attr = object ? object->getAttribute(name) : Value();
+      stack.pop(1);
+      stack.push(attr);
+      continue;
+    }
+    case Opcode::SetItem: {
+      int index = operand();
+      const std::string& name = module->getName(index);
+      Value value = stack[-1];
+      if (core::Object* object = stack[-2].objectValue()) {
+        object->setAttribute(name, value);
+      }
+      stack.pop(2);
+      stack.push(value);
+      continue;
+    }
+    case Opcode::Import: {
+      int index = operand();
+      const std::string& name = module->getName(index);
+      if (loader == nullptr) {
+        throw std::runtime_error("Cannot import without a module loader: " +
+                                 name);
+      }
+      module->setGlobal(name, Value(loader->import(name)));
       continue;
     }
     case Opcode::Dispatch: {
-      int index = instructions->readShort(pc);
-      pc += 2;
-      int arity = instructions->readShort(pc);
-      pc += 2;
+      int index = operand();
+      int arity = operand();
 
-      std::string name = module.names[index];
-      std::cout << "Dispatch:" << module.names[index] << " : " << arity << std::endl;
+      std::string name = module->getName(index);
+      std::cout << "Dispatch:" << name << " : " << arity << std::endl;
       stack.inspect();
       
       std::vector<Value> args;
@@ -177,6 +362,10 @@ void Interpreter::run(Module& module, Function& function) {
 
       Value& value = stack[first - 1];
       std::cout << "metaClass:" << value.metaClass() << std::endl;
+      if (FeedbackSlot* slot = feedback->slotAt(start)) {
+        slot->recordValue(value);
+        slot->recordTarget(value.metaClass());
+      }
 
       MethodParameter params = {args};
       Value res = value.metaClass()->dispatch(value, name, params);
@@ -190,8 +379,7 @@ void Interpreter::run(Module& module, Function& function) {
       continue;
     }
     case Opcode::Call: {
-      int arity = instructions->readShort(pc);
-      pc += 2;
+      int arity = operand();
 
       // std::cout << "Call:" << arity << std::endl;
       
@@ -200,9 +388,16 @@ void Interpreter::run(Module& module, Function& function) {
       // std::cout << "val:" << val << std::endl;
       // // std::cout << "type:"
       std::shared_ptr<Function> function = val.functionValue();
+      if (FeedbackSlot* slot = feedback->slotAt(start)) {
+        slot->recordValue(val);
+        if (val.type() == ValueType::Class) {
+          slot->recordTarget(val.metaClass());
+        } else {
+          slot->recordTarget(function.get());
+        }
+      }
       if (val.type() == ValueType::Class) {
         // TODO move to a function;
-        std::cout << "class:" << val.metaClass() << std::endl;
 
         std::vector<Value> args;
         for (int i = 0; i < arity; i++) {
@@ -213,7 +408,7 @@ void Interpreter::run(Module& module, Function& function) {
         MethodParameter mp = {args};
         // mp.args = args;
         Value object = val.metaClass()->construct(val, mp);
-        // TODO pop class and args;
+        stack.pop(arity + 1); // pop class and args;
         stack.push(object);
         continue;
       }
@@ -221,8 +416,48 @@ void Interpreter::run(Module& module, Function& function) {
       if (val.functionValue()->type() == FunctionType::Native) {
         // std::cout << "Native:" << std::endl;
 
+        // first call: replace non-escaping allocations, the result holds
+        // until one of the classes it relied on is rebound;
+        // a function of an imported module runs against that module;
+        Module& home = function->module() ? *function->module() : *module;
+        // the frame owns the code it runs, deoptimizing drops only the
+        // function's reference to it;
+        std::shared_ptr<Function> callee = function;
+        function->compile(home);
+        if (optimize && !function->frozen()) {
+          if (!function->optimizationAttempted()) {
+            ScalarReplacement::Result result =
+                ScalarReplacement(home).run(*function);
+            function->setOptimized(result.function, result.eliminated);
+            for (const std::string& name : result.dependencies) {
+              home.addDependent(name, function);
+            }
+          }
+          if (function->optimized()) {
+            callee = function->optimized();
+          }
+        }
+
+        // pick the clone specialized for the argument types, if any;
+        if (specialize && !function->frozen()) {
+          SpecializationTable& table = function->specializations();
+          TypeSignature signature = signatureOf(stack, first, arity);
+          if (std::shared_ptr<Function> clone = table.lookup(signature)) {
+            callee = std::move(clone);
+          } else if (table.shouldSpecialize(signature)) {
+            auto clone = Specializer(home).specialize(*callee, signature);
+            if (clone) {
+              table.add(signature, clone);
+              callee = std::move(clone);
+            }
+          }
+        }
+        Function* target = callee.get();
+
         frames.top().pc = pc;
-        frames.push(Frame(*val.functionValue())); // TODO
+        frames.push(Frame(*target));
+        frames.top().code = std::move(callee);
+        frames.top().module = &home;
 
         std::vector<Value>& args = frames.top().locals; 
         // std::cout << "before call" << std::endl;
@@ -234,7 +469,7 @@ void Interpreter::run(Module& module, Function& function) {
           // std::cout << "arg:" << arg << std::endl;
           args.push_back(stack[first + i]);
         }
-        args.resize(function->maxSlots()); // make room for the locals;
+        args.resize(target->maxSlots()); // make room for the locals;
         stack.pop(arity + 1); // pop callee and args;
 
         // std::cout << "after pop" << std::endl;
@@ -244,14 +479,23 @@ void Interpreter::run(Module& module, Function& function) {
       } else {
         std::vector<Value> args; 
         for (int i = 0; i < arity; i++) {
-          args.push_back(stack[0 - arity - i]);
+          args.push_back(stack[first + i]);
         }
         stack.inspect();
-        function->foreignFunction()(args);
+        Value result = function->foreignFunction()(args);
         stack.pop(arity + 1);
+        stack.push(std::move(result));
       }
       continue;
     }
+    case Opcode::CheckCallee: {
+      int arity = operand();
+      int index = operand();
+      // false once the global the call reads has been rebound;
+      bool same = stack[-(arity + 1)] == module->getConstant(index);
+      stack.push(Value(same));
+      continue;
+    }
     case Opcode::Return: {
       // std::cout << stack.size() << std::endl;
       frames.pop(1);
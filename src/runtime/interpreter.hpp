@@ -11,10 +11,21 @@
 namespace kestrel {
 
 class InterpreterImpl;
+class ModuleLoader;
 class Interpreter {
 public:
     void run(Module& module, Function& function);
 
+    // Clone hot script functions per argument-type signature.
+    bool specialize = true;
+
+    // Scalar-replace objects that never leave the function allocating them.
+    bool optimize = true;
+
+    // Resolves `import`, nullptr if the script may not import. An import
+    // that can't be resolved throws std::runtime_error out of run().
+    ModuleLoader* loader = nullptr;
+
     // int framePointer = 0;
     // Array<Frame> frames;
     // Frame& currentFrame = frames.back();
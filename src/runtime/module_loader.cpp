@@ -0,0 +1,392 @@
+#include "runtime/module_loader.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include "code_unit.hpp"
+#include "compile/byte_class.hpp"
+#include "function.hpp"
+#include "image.hpp"
+
+namespace kestrel {
+
+namespace {
+
+// Compiled modules by source hash and optimization level, for every loader
+// of the process;
+struct SharedCache {
+  std::mutex mutex;
+  std::map<std::pair<uint64_t, int>, std::shared_ptr<const CodeUnit>> units;
+};
+
+SharedCache &sharedCache() {
+  static SharedCache cache;
+  return cache;
+}
+
+bool readFile(const std::string &path, std::string &text) {
+  std::ifstream input(path, std::ios::binary);
+  if (!input.is_open()) {
+    return false;
+  }
+  std::ostringstream buffer;
+  buffer << input.rdbuf();
+  text = buffer.str();
+  return true;
+}
+
+} // namespace
+
+struct ModuleLoader::Detail {
+  explicit Detail(const HostRegistry &hosts) : hosts(hosts) {}
+
+  struct Entry {
+    std::unique_ptr<Module> module; // never moves, values point at it;
+    std::string path;
+    bool loaded = false;
+    std::shared_ptr<const CodeUnit> unit; // compiled by preload();
+  };
+
+  // The code of `source`, from the shared cache, the cache directory or
+  // compiled now.
+  std::shared_ptr<const CodeUnit> unit(const std::string &source,
+                                       const std::string &path) {
+    uint64_t hash = Image::contentHash(source);
+    std::pair<uint64_t, int> key(hash, optimizationLevel);
+    SharedCache &cache = sharedCache();
+    {
+      std::lock_guard<std::mutex> lock(cache.mutex);
+      auto it = cache.units.find(key);
+      if (it != cache.units.end()) {
+        return it->second;
+      }
+    }
+
+    std::shared_ptr<const CodeUnit> unit;
+    std::string cached;
+    if (!cacheDirectory.empty()) {
+      char name[32];
+      std::snprintf(name, sizeof(name), "%016llx-O%d.ksimage",
+                    (unsigned long long)hash, optimizationLevel);
+      cached = cacheDirectory + "/" + name;
+      try {
+        Image mapped = Image::map(cached);
+        if (mapped.sourceHash() == hash &&
+            mapped.optimizationLevel() == optimizationLevel) {
+          unit = CodeUnit::build(mapped.load());
+        }
+      } catch (std::runtime_error &) {
+        // not cached yet, or written by another version;
+      }
+    }
+    if (!unit) {
+      if (!compile) {
+        throw std::runtime_error("import: no compiler for " + path);
+      }
+      Module compiled = compile(source);
+      if (!cached.empty()) {
+        try {
+          Image::write(compiled, hash, optimizationLevel, cached);
+          // run from the mapping, shared with later processes;
+          unit = CodeUnit::build(Image::map(cached).load());
+        } catch (std::runtime_error &) {
+          // a read-only cache still runs, from memory;
+        }
+      }
+      if (!unit) {
+        unit = CodeUnit::build(std::move(compiled));
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    // another loader may have compiled it meanwhile, keep the first;
+    return cache.units.emplace(key, unit).first->second;
+  }
+
+  const HostRegistry &hosts;
+  std::vector<std::string> searchPath;
+  std::string cacheDirectory;
+  SourceCompiler compile;
+  int optimizationLevel = 0;
+  std::unordered_map<std::string, Entry> entries;
+  std::unordered_map<const Module *, Entry *> byModule;
+  size_t loaded = 0;
+};
+
+ModuleLoader::ModuleLoader(const HostRegistry &hosts)
+    : detail(std::make_unique<Detail>(hosts)) {}
+
+ModuleLoader::~ModuleLoader() = default;
+
+void ModuleLoader::addSearchPath(const std::string &directory) {
+  detail->searchPath.push_back(directory);
+}
+
+void ModuleLoader::setCacheDirectory(const std::string &directory) {
+  detail->cacheDirectory = directory;
+}
+
+void ModuleLoader::setCompiler(SourceCompiler compile, int optimizationLevel) {
+  detail->compile = std::move(compile);
+  detail->optimizationLevel = optimizationLevel;
+}
+
+std::string ModuleLoader::resolve(const std::string &name) const {
+  std::vector<std::string> directories = detail->searchPath;
+  if (directories.empty()) {
+    directories.push_back(".");
+  }
+  for (const std::string &directory : directories) {
+    std::string path = directory + "/" + name + ".ks";
+    if (std::ifstream(path).good()) {
+      return path;
+    }
+  }
+  throw std::runtime_error("import: no module named " + name);
+}
+
+Module *ModuleLoader::import(const std::string &name) {
+  auto it = detail->entries.find(name);
+  if (it != detail->entries.end()) {
+    return it->second.module.get();
+  }
+  std::string path = resolve(name);
+  Detail::Entry &entry = detail->entries[name];
+  entry.module = std::make_unique<Module>();
+  entry.path = path;
+  detail->byModule[entry.module.get()] = &entry;
+  return entry.module.get();
+}
+
+const std::string *ModuleLoader::nameOf(const Module *module) const {
+  for (auto &entry : detail->entries) {
+    if (entry.second.module.get() == module) {
+      return &entry.first;
+    }
+  }
+  return nullptr;
+}
+
+Module &ModuleLoader::define(const std::string &name) {
+  Detail::Entry &entry = detail->entries[name];
+  if (!entry.module) {
+    entry.module = std::make_unique<Module>();
+    entry.loaded = true;
+    detail->byModule[entry.module.get()] = &entry;
+  }
+  return *entry.module;
+}
+
+bool ModuleLoader::prepare(Module &module) {
+  auto it = detail->byModule.find(&module);
+  if (it == detail->byModule.end() || it->second->loaded) {
+    return false;
+  }
+  Detail::Entry &entry = *it->second;
+  if (!entry.unit) {
+    std::string source;
+    if (!readFile(entry.path, source)) {
+      throw std::runtime_error("import: can't read " + entry.path);
+    }
+    entry.unit = detail->unit(source, entry.path);
+  }
+  module = entry.unit->instantiate();
+
+  // its functions index into its own names and constants, whoever calls
+  // them;
+  module.setHome(&module);
+  module.initializer_.setModule(&module);
+  for (auto &host : detail->hosts.values()) {
+    module.setGlobal(host.first, Value(host.second));
+  }
+  // set before the initializer runs, so a cyclic import finds it loaded;
+  entry.loaded = true;
+  detail->loaded++;
+  return true;
+}
+
+std::vector<Module *> ModuleLoader::preload(const std::string &source,
+                                            int jobs) {
+  // modules of the graph by name; workers add to it as they scan;
+  struct Node {
+    std::string path;
+    std::vector<std::string> imports;
+    std::shared_ptr<const CodeUnit> unit;
+  };
+  std::unordered_map<std::string, Node> nodes;
+  std::deque<std::string> pending;
+  std::mutex mutex;
+  std::condition_variable changed;
+  size_t busy = 0;
+  std::exception_ptr error;
+
+  // called with the lock held;
+  auto discover = [&](const std::vector<std::string> &names) {
+    for (const std::string &name : names) {
+      if (detail->entries.count(name) == 0 &&
+          nodes.emplace(name, Node()).second) {
+        pending.push_back(name);
+      }
+    }
+    changed.notify_all();
+  };
+
+  auto work = [&]() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+      changed.wait(lock, [&] {
+        return !pending.empty() || busy == 0 || error;
+      });
+      if (pending.empty() || error) {
+        return; // nothing queued and nobody left to queue more;
+      }
+      std::string name = std::move(pending.front());
+      pending.pop_front();
+      busy++;
+      lock.unlock();
+
+      Node node;
+      std::exception_ptr failed;
+      try {
+        node.path = resolve(name);
+        std::string text;
+        if (!readFile(node.path, text)) {
+          throw std::runtime_error("import: can't read " + node.path);
+        }
+        node.imports = importsOf(text);
+        {
+          // the imports go to the queue before compiling, so other
+          // workers start on them meanwhile;
+          std::lock_guard<std::mutex> queue(mutex);
+          discover(node.imports);
+        }
+        node.unit = detail->unit(text, node.path);
+      } catch (...) {
+        failed = std::current_exception();
+      }
+
+      lock.lock();
+      busy--;
+      if (failed && !error) {
+        error = failed;
+      }
+      nodes[name] = std::move(node);
+      changed.notify_all();
+    }
+  };
+
+  std::vector<std::string> roots = importsOf(source);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    discover(roots);
+  }
+  std::vector<std::thread> workers;
+  for (int i = 1; i < std::max(jobs, 1); i++) {
+    workers.emplace_back(work);
+  }
+  work(); // the calling thread is a worker too;
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+
+  for (auto &node : nodes) {
+    Module *module = import(node.first);
+    detail->byModule[module]->unit = node.second.unit;
+  }
+
+  // dependencies first; a cycle is cut where it is entered again;
+  std::vector<Module *> order;
+  std::unordered_set<std::string> visited;
+  std::function<void(const std::string &)> visit =
+      [&](const std::string &name) {
+        if (!visited.insert(name).second) {
+          return;
+        }
+        auto it = nodes.find(name);
+        if (it == nodes.end()) {
+          return; // imported before, it is not preloaded;
+        }
+        for (const std::string &dependency : it->second.imports) {
+          visit(dependency);
+        }
+        order.push_back(detail->entries[name].module.get());
+      };
+  for (const std::string &root : roots) {
+    visit(root);
+  }
+  return order;
+}
+
+std::vector<std::string> ModuleLoader::importsOf(const std::string &source) {
+  using namespace byte_class;
+  std::vector<std::string> imports;
+  const char *p = source.data();
+  const char *end = p + source.size();
+  // whole words only, so `reimport` or `imports` is not `import`;
+  auto word = [&](const char *&q) {
+    size_t n = identifierRun(q, end);
+    std::string text(q, n);
+    q += n;
+    return text;
+  };
+  auto skipBlanks = [&](const char *&q) { q += blankRun(q, end); };
+  while (p < end) {
+    char c = *p;
+    if (c == '/' && p + 1 < end && p[1] == '/') {
+      const char *line = static_cast<const char *>(
+          std::memchr(p, '\n', (size_t)(end - p)));
+      p = line ? line + 1 : end;
+    } else if (c == '"') {
+      const char *close = static_cast<const char *>(
+          std::memchr(p + 1, '"', (size_t)(end - p - 1)));
+      p = close ? close + 1 : end;
+    } else if (isAlpha(c)) {
+      if (word(p) != "import") {
+        continue;
+      }
+      const char *q = p;
+      skipBlanks(q);
+      if (q < end && isAlpha(*q)) {
+        std::string name = word(q);
+        skipBlanks(q);
+        if (q < end && *q == ';') {
+          imports.push_back(std::move(name));
+          p = q + 1;
+        }
+      }
+    } else if (isDigit(c)) {
+      p += identifierRun(p, end); // not a word: 2import;
+    } else {
+      p++;
+    }
+  }
+  return imports;
+}
+
+size_t ModuleLoader::importedModules() const { return detail->entries.size(); }
+
+size_t ModuleLoader::loadedModules() const { return detail->loaded; }
+
+size_t ModuleLoader::cachedModules() {
+  SharedCache &cache = sharedCache();
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  return cache.units.size();
+}
+
+} // namespace kestrel
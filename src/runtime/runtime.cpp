@@ -1,24 +1,118 @@
 #include "runtime/runtime.hpp"
 #include "runtime/interpreter.hpp"
+#include "runtime/module_loader.hpp"
+
+#include <mutex>
 
 namespace kestrel {
 
 struct Runtime::Detail {
-    std::unordered_map<std::string, Module> globals;
+    Detail() : modules(hosts) {
+        interpreter.loader = &modules;
+    }
+
+    void run(Module& module, Function& function) {
+        // a stub run directly, not through a call;
+        function.compile(module);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            depth++;
+        }
+        try {
+            interpreter.run(module, function);
+        } catch (...) {
+            leave();
+            throw;
+        }
+        leave();
+    }
+
+    void leave() {
+        std::lock_guard<std::mutex> guard(lock);
+        if (--depth == 0) {
+            applyPending();
+        }
+    }
+
+    void apply(Module& module, const Patch& patch) {
+        if (patch.module) {
+            std::vector<std::shared_ptr<Function>> functions;
+            for (auto& function : patch.functions) {
+                functions.push_back(function.second);
+            }
+            module.merge(*patch.module, functions);
+        }
+        for (auto& function : patch.functions) {
+            // setGlobal invalidates the code depending on the old binding;
+            module.setGlobal(function.first, Value(function.second));
+        }
+        for (auto& name : patch.removed) {
+            module.removeGlobal(name);
+        }
+    }
+
+    void applyPending() {
+        std::vector<std::pair<Module*, Patch>> patches = std::move(pending);
+        pending.clear();
+        for (auto& patch : patches) {
+            apply(*patch.first, patch.second);
+        }
+    }
+
     Interpreter interpreter;
+    HostRegistry hosts;
+    ModuleLoader modules;
+    // A reload from another thread applies at once only while no run is in
+    // progress, and a run can't start while one applies; both hold `lock`
+    // for that, and pending patches are applied under it too.
+    std::mutex lock;
+    int depth = 0; // runs in progress, reloads wait for none;
+    std::vector<std::pair<Module*, Patch>> pending;
 };
 
 Runtime::Runtime() : detail(std::make_unique<Detail>()) {};
 Runtime::~Runtime() = default;
 
 Module& Runtime::defineModule(const std::string& name) {
-    detail->globals.emplace(std::make_pair(name, Module()));
-    return detail->globals[name];
+    return detail->modules.define(name);
 };
 
+ModuleLoader& Runtime::modules() {
+    return detail->modules;
+}
+
+void Runtime::preload(const std::string& source, int jobs) {
+    for (Module* module : detail->modules.preload(source, jobs)) {
+        if (detail->modules.prepare(*module)) {
+            detail->run(*module, module->initializer_);
+        }
+    }
+}
+
 Value Runtime::run(Module& module, Function& function) {
-    detail->interpreter.run(module, function);
+    detail->run(module, function);
     return Value::nil(); // TODO
 }
 
+void Runtime::reload(Module& module, Patch patch) {
+    std::lock_guard<std::mutex> guard(detail->lock);
+    if (detail->depth > 0) {
+        detail->pending.emplace_back(&module, std::move(patch));
+        return;
+    }
+    detail->apply(module, patch);
+}
+
+HostRegistry& Runtime::hosts() {
+    return detail->hosts;
+}
+
+void Runtime::snapshot(Module& module, uint64_t sourceHash, const std::string& path) {
+    Snapshot::write(module, detail->hosts, sourceHash, path, &detail->modules);
+}
+
+Module Runtime::restore(const std::string& path, uint64_t sourceHash) {
+    return Snapshot::restore(path, detail->hosts, sourceHash, &detail->modules);
+}
+
 }
\ No newline at end of file
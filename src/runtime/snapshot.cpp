@@ -0,0 +1,432 @@
+#include "runtime/snapshot.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <unordered_set>
+#include <vector>
+
+#include "function.hpp"
+#include "heap.hpp"
+#include "image.hpp"
+#include "runtime/module_loader.hpp"
+
+namespace kestrel {
+
+namespace {
+
+const char kMagic[8] = {'K', 'S', 'S', 'N', 'A', 'P', '\0', '\0'};
+
+// How a value is stored; functions and objects by index into their tables,
+// host values by registered name, imported modules by module name.
+enum class Tag : uint8_t {
+  Nil = 0,
+  Boolean,
+  Integer,
+  Double,
+  String,
+  Function,
+  HostFunction,
+  Class,
+  Object,
+  Module,
+};
+
+class Encoder {
+public:
+  void u8(uint8_t v) { out.push_back((char)v); }
+  void u32(uint32_t v) { raw(&v, sizeof(v)); }
+  void u64(uint64_t v) { raw(&v, sizeof(v)); }
+  void f64(double v) { raw(&v, sizeof(v)); }
+  void string(const std::string &s) {
+    u32((uint32_t)s.size());
+    out += s;
+  }
+  void raw(const void *data, size_t size) {
+    out.append(static_cast<const char *>(data), size);
+  }
+
+  std::string out;
+};
+
+class Decoder {
+public:
+  Decoder(const char *p, const char *end) : p_(p), end_(end) {}
+
+  uint8_t u8() { return (uint8_t)*take(1); }
+  uint32_t u32() { return read<uint32_t>(); }
+  uint64_t u64() { return read<uint64_t>(); }
+  double f64() { return read<double>(); }
+  std::string string() {
+    uint32_t length = u32();
+    return std::string(take(length), length);
+  }
+  const char *take(size_t size) {
+    if ((size_t)(end_ - p_) < size) {
+      throw std::runtime_error("snapshot: truncated");
+    }
+    const char *at = p_;
+    p_ += size;
+    return at;
+  }
+
+private:
+  template <typename T> T read() {
+    T value;
+    std::memcpy(&value, take(sizeof(T)), sizeof(T));
+    return value;
+  }
+
+  const char *p_;
+  const char *end_;
+};
+
+class Writer {
+public:
+  Writer(Function &initializer, const HostRegistry &hosts,
+         const ModuleLoader *modules)
+      : hosts_(hosts), modules_(modules) {
+    functions_.push_back(&initializer);
+  }
+
+  void value(Encoder &out, const Value &value) {
+    switch (value.type()) {
+    case ValueType::Nil:
+      out.u8((uint8_t)Tag::Nil);
+      break;
+    case ValueType::Boolean:
+      out.u8((uint8_t)Tag::Boolean);
+      out.u8(value.boolValue() ? 1 : 0);
+      break;
+    case ValueType::Integer:
+      out.u8((uint8_t)Tag::Integer);
+      out.u64((uint64_t)(int64_t)value.intValue());
+      break;
+    case ValueType::Double:
+      out.u8((uint8_t)Tag::Double);
+      out.f64(value.doubleValue());
+      break;
+    case ValueType::String:
+      out.u8((uint8_t)Tag::String);
+      out.string(value.stringValue());
+      break;
+    case ValueType::Function: {
+      Function *function = value.functionValue().get();
+      if (function->type() != FunctionType::Native) {
+        out.u8((uint8_t)Tag::HostFunction);
+        out.string(hostName(value));
+      } else {
+        out.u8((uint8_t)Tag::Function);
+        out.u32(index(function, functionIndex_, functions_));
+      }
+      break;
+    }
+    case ValueType::Class:
+      out.u8((uint8_t)Tag::Class);
+      out.string(hostName(value));
+      break;
+    case ValueType::Object:
+      out.u8((uint8_t)Tag::Object);
+      out.u32(index(value.objectValue(), objectIndex_, objects_));
+      break;
+    case ValueType::Module: {
+      const std::string *name =
+          modules_ ? modules_->nameOf(value.moduleValue()) : nullptr;
+      if (name == nullptr) {
+        throw std::runtime_error("snapshot: can't store an unnamed module");
+      }
+      out.u8((uint8_t)Tag::Module);
+      out.string(*name);
+      break;
+    }
+    default:
+      throw std::runtime_error("snapshot: can't store " + value.toString());
+    }
+  }
+
+  // Objects found so far; encoding one may find more.
+  std::vector<Object *> objects_;
+  std::vector<Function *> functions_;
+
+private:
+  template <typename T>
+  static uint32_t index(T *p, std::unordered_map<T *, uint32_t> &indexes,
+                        std::vector<T *> &table) {
+    auto it = indexes.find(p);
+    if (it != indexes.end()) {
+      return it->second;
+    }
+    uint32_t i = (uint32_t)table.size();
+    table.push_back(p);
+    indexes.emplace(p, i);
+    return i;
+  }
+
+  const std::string &hostName(const Value &value) {
+    const std::string *name = hosts_.nameOf(value);
+    if (name == nullptr) {
+      throw std::runtime_error("snapshot: unregistered host value " +
+                               value.toString());
+    }
+    return *name;
+  }
+
+  const HostRegistry &hosts_;
+  const ModuleLoader *modules_;
+  std::unordered_map<Object *, uint32_t> objectIndex_;
+  std::unordered_map<Function *, uint32_t> functionIndex_;
+};
+
+// Compiles the lazy functions reachable from the module, before anything
+// is written: compiling adds constants, names and globals;
+void compileStubs(Module &module) {
+  for (bool compiled = true; compiled;) {
+    compiled = false;
+    std::vector<std::shared_ptr<Function>> stubs;
+    std::unordered_set<Object *> seen;
+    std::vector<Value> pending;
+    for (auto &global : module.globals_) {
+      pending.push_back(global.second);
+    }
+    for (Value &constant : module.constants) {
+      pending.push_back(constant);
+    }
+    while (!pending.empty()) {
+      Value value = pending.back();
+      pending.pop_back();
+      if (value.type() == ValueType::Function &&
+          !value.functionValue()->isCompiled()) {
+        stubs.push_back(value.functionValue());
+      } else if (value.type() == ValueType::Object &&
+                 seen.insert(value.objectValue()).second) {
+        for (auto &attribute : value.objectValue()->attributes()) {
+          pending.push_back(attribute.second);
+        }
+      }
+    }
+    for (auto &stub : stubs) {
+      if (!stub->isCompiled()) {
+        stub->compile(module);
+        compiled = true;
+      }
+    }
+  }
+}
+
+} // namespace
+
+void HostRegistry::add(const std::string &name, const Value &value) {
+  values_[name] = value;
+  if (value.type() == ValueType::Function) {
+    names_[value.functionValue().get()] = name;
+  } else if (value.type() == ValueType::Class) {
+    names_[value.metaClass()] = name;
+  }
+}
+
+const std::string *HostRegistry::nameOf(const Value &value) const {
+  const void *key = nullptr;
+  if (value.type() == ValueType::Function) {
+    key = value.functionValue().get();
+  } else if (value.type() == ValueType::Class) {
+    key = value.metaClass();
+  }
+  auto it = names_.find(key);
+  return it != names_.end() ? &it->second : nullptr;
+}
+
+const Value *HostRegistry::find(const std::string &name) const {
+  auto it = values_.find(name);
+  return it != values_.end() ? &it->second : nullptr;
+}
+
+void Snapshot::write(Module &module, const HostRegistry &hosts,
+                     uint64_t sourceHash, const std::string &path,
+                     const ModuleLoader *modules) {
+  module.materialize();
+  compileStubs(module);
+
+  Writer writer(module.initializer_, hosts, modules);
+  Encoder roots;
+  roots.u32((uint32_t)module.names.size());
+  for (auto &name : module.names) {
+    roots.string(name);
+  }
+  roots.u32((uint32_t)module.constants.size());
+  for (Value &constant : module.constants) {
+    writer.value(roots, constant);
+  }
+  roots.u32((uint32_t)module.globals_.size());
+  for (auto &global : module.globals_) {
+    roots.string(global.first);
+    writer.value(roots, global.second);
+  }
+
+  // the table grows while it is walked;
+  Encoder objects;
+  for (size_t i = 0; i < writer.objects_.size(); i++) {
+    Object *object = writer.objects_[i];
+    Class *cls = object->getClass();
+    if (cls != nullptr) {
+      writer.value(objects, Value(cls));
+    } else {
+      writer.value(objects, Value());
+    }
+    objects.u32((uint32_t)object->attributes().size());
+    for (auto &attribute : object->attributes()) {
+      objects.string(attribute.first);
+      writer.value(objects, attribute.second);
+    }
+  }
+
+  Encoder out;
+  out.raw(kMagic, sizeof(kMagic));
+  out.u32(kVersion);
+  out.u64(sourceHash);
+  out.u32((uint32_t)writer.functions_.size());
+  for (Function *function : writer.functions_) {
+    BytecodeView code = function->instructions().view();
+    out.string(function->name());
+    out.u32((uint32_t)function->arity());
+    out.u32((uint32_t)function->maxSlots());
+    out.u64(function->compiledSize());
+    out.u32((uint32_t)code.size());
+    out.raw(code.data(), code.size());
+  }
+  out.u32((uint32_t)writer.objects_.size());
+  out.out += objects.out;
+  out.out += roots.out;
+
+  try {
+    Image::replaceFile(path, out.out);
+  } catch (std::runtime_error &error) {
+    throw std::runtime_error(std::string("snapshot: ") + error.what());
+  }
+}
+
+Module Snapshot::restore(const std::string &path, const HostRegistry &hosts,
+                         uint64_t sourceHash, ModuleLoader *modules) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("snapshot: can't open " + path);
+  }
+  // the code of the functions stays in this buffer;
+  auto buffer = std::make_shared<const std::string>(
+      (std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  const std::string &bytes = *buffer;
+  Decoder in(bytes.data(), bytes.data() + bytes.size());
+  if (std::memcmp(in.take(sizeof(kMagic)), kMagic, sizeof(kMagic)) != 0) {
+    throw std::runtime_error("snapshot: " + path + " is not a snapshot");
+  }
+  if (in.u32() != kVersion) {
+    throw std::runtime_error("snapshot: " + path + " has another version");
+  }
+  if (in.u64() != sourceHash) {
+    throw std::runtime_error("snapshot: " + path + " is stale");
+  }
+
+  std::vector<std::shared_ptr<Function>> functions(in.u32());
+  if (functions.empty()) {
+    throw std::runtime_error("snapshot: no initializer");
+  }
+  for (auto &function : functions) {
+    std::string name = in.string();
+    uint32_t arity = in.u32();
+    uint32_t maxSlots = in.u32();
+    uint64_t compiledSize = in.u64();
+    uint32_t size = in.u32();
+    const uint8_t *code = reinterpret_cast<const uint8_t *>(in.take(size));
+    InstructionArray instructions(code, size, buffer);
+    function = std::make_shared<Function>(std::move(instructions));
+    function->setName(name);
+    function->setArity(arity);
+    function->setMaxSlots((int)maxSlots);
+    function->setCompiledSize(compiledSize);
+  }
+
+  // objects are allocated up front, attributes may refer to any of them;
+  std::vector<Object *> objects(in.u32());
+  if (objects.size() > bytes.size()) {
+    throw std::runtime_error("snapshot: bad object count");
+  }
+  for (auto &object : objects) {
+    object = Heap::current().allocate();
+  }
+
+  auto host = [&](const std::string &name) {
+    const Value *value = hosts.find(name);
+    if (value == nullptr) {
+      throw std::runtime_error("snapshot: unregistered host value " + name);
+    }
+    return *value;
+  };
+  auto value = [&]() -> Value {
+    switch ((Tag)in.u8()) {
+    case Tag::Nil:
+      return Value();
+    case Tag::Boolean:
+      return Value(in.u8() != 0);
+    case Tag::Integer:
+      return Value((int)(int64_t)in.u64());
+    case Tag::Double:
+      return Value(in.f64());
+    case Tag::String:
+      return Value(in.string());
+    case Tag::Function: {
+      uint32_t i = in.u32();
+      if (i == 0 || i >= functions.size()) {
+        throw std::runtime_error("snapshot: bad function index");
+      }
+      return Value(functions[i]);
+    }
+    case Tag::HostFunction:
+    case Tag::Class:
+      return host(in.string());
+    case Tag::Object: {
+      uint32_t i = in.u32();
+      if (i >= objects.size()) {
+        throw std::runtime_error("snapshot: bad object index");
+      }
+      return Value(objects[i]);
+    }
+    case Tag::Module: {
+      std::string name = in.string();
+      if (modules == nullptr) {
+        throw std::runtime_error("snapshot: can't import " + name);
+      }
+      return Value(modules->import(name));
+    }
+    default:
+      throw std::runtime_error("snapshot: bad value tag");
+    }
+  };
+
+  for (Object *object : objects) {
+    Value cls = value();
+    if (cls.type() == ValueType::Class) {
+      object->setClass(cls.metaClass());
+    }
+    for (uint32_t n = in.u32(); n > 0; n--) {
+      std::string name = in.string();
+      object->setAttribute(name, value());
+    }
+  }
+
+  Module module;
+  // nothing else refers to the initializer;
+  module.initializer_ = std::move(*functions[0]);
+  for (uint32_t n = in.u32(); n > 0; n--) {
+    module.names.push_back(in.string());
+  }
+  for (uint32_t n = in.u32(); n > 0; n--) {
+    module.constants.push_back(value());
+  }
+  for (uint32_t n = in.u32(); n > 0; n--) {
+    std::string name = in.string();
+    module.setGlobal(name, value());
+  }
+  return module;
+}
+
+} // namespace kestrel
@@ -0,0 +1,288 @@
+#include "runtime/specializer.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include "opcodes.hpp"
+#include "type_rules.hpp"
+
+namespace kestrel {
+
+namespace {
+
+struct State {
+  bool reached = false;
+  std::vector<ValueType> locals;
+  std::vector<ValueType> stack;
+};
+
+// Merges `from` into `into`, types that disagree become Unknown.
+bool join(State& into, const State& from, bool& ok) {
+  if (!into.reached) {
+    into = from;
+    into.reached = true;
+    return true;
+  }
+  if (into.stack.size() != from.stack.size()) {
+    ok = false;
+    return false;
+  }
+  bool changed = false;
+  auto merge = [&](std::vector<ValueType>& a, const std::vector<ValueType>& b) {
+    for (size_t i = 0; i < a.size(); i++) {
+      if (a[i] != b[i] && a[i] != ValueType::Unknown) {
+        a[i] = ValueType::Unknown;
+        changed = true;
+      }
+    }
+  };
+  merge(into.locals, from.locals);
+  merge(into.stack, from.stack);
+  return changed;
+}
+
+} // namespace
+
+std::shared_ptr<Function> Specializer::specialize(Function& function,
+                                                  TypeSignature signature) {
+  InstructionArray& instructions = function.instructions();
+  BytecodeView view = instructions.view();
+  int size = (int)instructions.size();
+  std::vector<ValueType> params = signatureTypes(signature);
+  if ((int)params.size() != function.arity()) {
+    return nullptr;
+  }
+
+  std::vector<State> states(size);
+  State entry;
+  entry.locals.assign(std::max(function.maxSlots(), function.arity()),
+                      ValueType::Nil);
+  for (size_t i = 0; i < params.size(); i++) {
+    entry.locals[i] = params[i];
+  }
+  bool ok = true;
+  join(states[0], entry, ok);
+
+  std::vector<int> worklist = {0};
+  while (!worklist.empty() && ok) {
+    int pc = worklist.back();
+    worklist.pop_back();
+
+    State state = states[pc];
+    DecodedInstruction decoded = decodeAt(view, pc);
+    Opcode code = decoded.opcode;
+    int next = pc + decoded.length;
+    int target = -1;
+    bool fallsThrough = true;
+    auto& stack = state.stack;
+    auto pop = [&](int n) {
+      if ((int)stack.size() < n) {
+        ok = false;
+        return;
+      }
+      stack.resize(stack.size() - n);
+    };
+
+    switch (code) {
+    case Opcode::NoOP:
+      break;
+    case Opcode::Add:
+    case Opcode::Subtract:
+    case Opcode::Multiply:
+    case Opcode::Divide:
+    case Opcode::Equals:
+    case Opcode::LessThan:
+    case Opcode::GreaterThan: {
+      if (stack.size() < 2) {
+        ok = false;
+        break;
+      }
+      ValueType result = resultType(code, stack[stack.size() - 2], stack.back());
+      pop(2);
+      stack.push_back(result);
+      break;
+    }
+    case Opcode::AddInt:
+    case Opcode::SubtractInt:
+    case Opcode::MultiplyInt:
+    case Opcode::EqualsInt:
+    case Opcode::LessThanInt:
+    case Opcode::GreaterThanInt:
+    case Opcode::AddDouble:
+    case Opcode::SubtractDouble:
+    case Opcode::MultiplyDouble:
+    case Opcode::DivideDouble:
+    case Opcode::EqualsDouble:
+    case Opcode::LessThanDouble:
+    case Opcode::GreaterThanDouble:
+    case Opcode::AddString:
+      pop(2);
+      stack.push_back(typedResult(code));
+      break;
+    case Opcode::Negate:
+      if (stack.empty()) {
+        ok = false;
+      } else if (!isNumberType(stack.back())) {
+        stack.back() = ValueType::Unknown;
+      }
+      break;
+    case Opcode::Not:
+      pop(1);
+      stack.push_back(ValueType::Boolean);
+      break;
+    case Opcode::Branch:
+      target = next + decoded.operands[0];
+      fallsThrough = false;
+      break;
+    case Opcode::BranchTrue:
+    case Opcode::BranchFalse:
+      target = next + decoded.operands[0];
+      pop(1);
+      break;
+    case Opcode::BranchIfLess:
+    case Opcode::BranchIfNotLess:
+    case Opcode::BranchIfGreater:
+    case Opcode::BranchIfNotGreater:
+    case Opcode::BranchIfEqual:
+    case Opcode::BranchIfNotEqual:
+      target = next + decoded.operands[0];
+      pop(2);
+      break;
+    case Opcode::Duplicate:
+      if (stack.empty()) {
+        ok = false;
+        break;
+      }
+      stack.push_back(stack.back());
+      break;
+    case Opcode::LoadBoolean:
+      stack.push_back(ValueType::Boolean);
+      break;
+    case Opcode::LoadInteger:
+      stack.push_back(ValueType::Integer);
+      break;
+    case Opcode::LoadConstant:
+      stack.push_back(module_.getConstant(decoded.operands[0]).type());
+      break;
+    case Opcode::LoadNil:
+      stack.push_back(ValueType::Nil);
+      break;
+    case Opcode::LoadName:
+    case Opcode::LoadGlobal:
+    case Opcode::LoadGlobalFromPool:
+      stack.push_back(ValueType::Unknown);
+      break;
+    case Opcode::LoadLocalInt:
+      stack.push_back(ValueType::Integer);
+      break;
+    case Opcode::LoadLocalDouble:
+      stack.push_back(ValueType::Double);
+      break;
+    case Opcode::StoreInt:
+    case Opcode::StoreDouble:
+    case Opcode::StoreBoolean: {
+      int index = decoded.operands[0];
+      if (index < 0 || index >= (int)state.locals.size()) {
+        ok = false;
+        break;
+      }
+      state.locals[index] = code == Opcode::StoreInt      ? ValueType::Integer
+                            : code == Opcode::StoreDouble ? ValueType::Double
+                                                          : ValueType::Boolean;
+      pop(1);
+      break;
+    }
+    case Opcode::StoreGlobal:
+      pop(1);
+      break;
+    case Opcode::GetItem:
+      pop(1);
+      stack.push_back(ValueType::Unknown);
+      break;
+    case Opcode::SetItem:
+      pop(2);
+      stack.push_back(ValueType::Unknown);
+      break;
+    case Opcode::LoadLocal: {
+      int index = decoded.operands[0];
+      if (index < 0 || index >= (int)state.locals.size()) {
+        ok = false;
+        break;
+      }
+      stack.push_back(state.locals[index]);
+      break;
+    }
+    case Opcode::Store: {
+      int index = decoded.operands[0];
+      if (stack.empty() || index < 0 || index >= (int)state.locals.size()) {
+        ok = false;
+        break;
+      }
+      state.locals[index] = stack.back();
+      pop(1);
+      break;
+    }
+    case Opcode::Pop:
+      pop(1);
+      break;
+    case Opcode::Call:
+      pop(decoded.operands[0] + 1);
+      stack.push_back(ValueType::Unknown);
+      break;
+    case Opcode::Dispatch:
+      pop(decoded.operands[1] + 1);
+      stack.push_back(ValueType::Unknown);
+      break;
+    case Opcode::CheckCallee:
+      stack.push_back(ValueType::Boolean);
+      break;
+    case Opcode::Return:
+      fallsThrough = false;
+      break;
+    default:
+      ok = false; // not understood, keep the generic function;
+      break;
+    }
+    if (!ok) {
+      break;
+    }
+
+    if (fallsThrough && next < size && join(states[next], state, ok)) {
+      worklist.push_back(next);
+    }
+    if (target >= 0 && target < size && join(states[target], state, ok)) {
+      worklist.push_back(target);
+    }
+  }
+  if (!ok) {
+    return nullptr;
+  }
+
+  InstructionArray specialized = instructions;
+  int rewritten = 0;
+  for (int pc = 0; pc < size;) {
+    DecodedInstruction decoded = decodeAt(view, pc);
+    Opcode code = decoded.opcode;
+    const State& state = states[pc];
+    if (state.reached && state.stack.size() >= 2) {
+      Opcode typed = typedForm(code, state.stack[state.stack.size() - 2],
+                               state.stack.back());
+      if (typed != Opcode::NoOP) {
+        specialized.writeByte(static_cast<uint8_t>(typed), pc);
+        rewritten++;
+      }
+    }
+    pc += decoded.length;
+  }
+  if (rewritten == 0) {
+    return nullptr;
+  }
+
+  auto clone = std::make_shared<Function>(std::move(specialized));
+  clone->setName(signatureToString(function.name(), signature));
+  clone->setArity(function.arity());
+  clone->setMaxSlots(function.maxSlots());
+  return clone;
+}
+
+} // namespace kestrel
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <memory>
+
+#include "function.hpp"
+#include "module.hpp"
+#include "specialization.hpp"
+
+namespace kestrel {
+
+// Clones a script function for one argument-type signature. The clone's
+// bytecode is the original with arithmetic and compare sites rewritten to
+// their typed forms wherever the operand types follow from the signature,
+// literals and local stores on every path.
+class Specializer {
+public:
+  Specializer(Module& module) : module_(module) {}
+
+  // Returns nullptr if the bytecode uses something the analysis does not
+  // understand or nothing could be specialized.
+  std::shared_ptr<Function> specialize(Function& function,
+                                       TypeSignature signature);
+
+private:
+  Module& module_;
+};
+
+}
@@ -9,7 +9,7 @@ private:
   std::vector<T> data;
 
 public:
-  void push(T& value) { data.push_back(value); }
+  void push(const T& value) { data.push_back(value); }
   void push(T&& value) { data.push_back(value); }
 
   int size() {
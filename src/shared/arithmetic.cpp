@@ -0,0 +1,123 @@
+#include "arithmetic.hpp"
+
+#include <climits>
+
+namespace kestrel {
+
+Value arithmetic(Opcode opcode, const Value& left, const Value& right) {
+  ValueType lt = left.type();
+  ValueType rt = right.type();
+  bool ints = lt == ValueType::Integer && rt == ValueType::Integer;
+  bool numbers = left.isNumber() && right.isNumber();
+
+  switch (opcode) {
+    case Opcode::Add: {
+      if (lt == ValueType::String && rt == ValueType::String) {
+        return Value(left.stringValue() + right.stringValue());
+      }
+      if (ints) {
+        return Value(left.intValue() + right.intValue());
+      }
+      if (numbers) {
+        return Value(left.doubleValue() + right.doubleValue());
+      }
+      break;
+    }
+    case Opcode::Subtract: {
+      if (ints) {
+        return Value(left.intValue() - right.intValue());
+      }
+      if (numbers) {
+        return Value(left.doubleValue() - right.doubleValue());
+      }
+      break;
+    }
+    case Opcode::Multiply: {
+      if (ints) {
+        return Value(left.intValue() * right.intValue());
+      }
+      if (numbers) {
+        return Value(left.doubleValue() * right.doubleValue());
+      }
+      break;
+    }
+    case Opcode::Divide: {
+      if (ints && right.intValue() != 0) {
+        return Value(left.intValue() / right.intValue());
+      }
+      if (numbers) {
+        return Value(left.doubleValue() / right.doubleValue());
+      }
+      break;
+    }
+    case Opcode::Equals:
+    case Opcode::LessThan:
+    case Opcode::GreaterThan:
+      return Value(compare(opcode, left, right));
+    default:
+      break;
+  }
+  return Value(); // TODO raise a type error;
+}
+
+bool compare(Opcode opcode, const Value& left, const Value& right) {
+  if (left.type() == ValueType::Integer && right.type() == ValueType::Integer) {
+    int l = left.intValue();
+    int r = right.intValue();
+    return opcode == Opcode::LessThan ? l < r
+           : opcode == Opcode::GreaterThan ? l > r
+                                           : l == r;
+  }
+  switch (opcode) {
+    case Opcode::Equals:
+      if (left.isNumber() && right.isNumber()) {
+        return left.doubleValue() == right.doubleValue();
+      }
+      return left == right;
+    case Opcode::LessThan:
+      return left.doubleValue() < right.doubleValue();
+    default:
+      return left.doubleValue() > right.doubleValue();
+  }
+}
+
+Value unary(Opcode opcode, const Value& value) {
+  if (opcode == Opcode::Not) {
+    return Value(!value.boolValue());
+  }
+  if (value.type() == ValueType::Integer) {
+    return Value(-value.intValue());
+  }
+  if (value.type() == ValueType::Double) {
+    return Value(-value.doubleValue());
+  }
+  return Value(); // TODO raise a type error;
+}
+
+bool overflows(Opcode code, const Value& left, const Value& right) {
+  if (left.type() != ValueType::Integer ||
+      right.type() != ValueType::Integer) {
+    return false;
+  }
+  long long l = left.intValue();
+  long long r = right.intValue();
+  long long result = 0;
+  switch (code) {
+  case Opcode::Add:
+    result = l + r;
+    break;
+  case Opcode::Subtract:
+    result = l - r;
+    break;
+  case Opcode::Multiply:
+    result = l * r;
+    break;
+  case Opcode::Divide:
+    return l == INT_MIN && r == -1;
+  default:
+    return false;
+  }
+  return result < INT_MIN || result > INT_MAX;
+}
+
+} // namespace kestrel
@@ -0,0 +1,213 @@
+#include "code_unit.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "module.hpp"
+
+namespace kestrel {
+
+std::shared_ptr<const CodeUnit> CodeUnit::build(Module &&module) {
+  // an instance becomes a unit of its own;
+  module.materialize();
+  // compiling a lazy body may declare more functions, look again until none
+  // is left;
+  for (bool compiled = true; compiled;) {
+    compiled = false;
+    std::vector<std::shared_ptr<Function>> stubs;
+    for (auto &global : module.globals_) {
+      if (global.second.type() == ValueType::Function &&
+          !global.second.functionValue()->isCompiled()) {
+        stubs.push_back(global.second.functionValue());
+      }
+    }
+    for (Value &constant : module.constants) {
+      if (constant.type() == ValueType::Function &&
+          !constant.functionValue()->isCompiled()) {
+        stubs.push_back(constant.functionValue());
+      }
+    }
+    for (auto &stub : stubs) {
+      if (!stub->isCompiled()) {
+        stub->compile(module);
+        compiled = true;
+      }
+    }
+  }
+
+  std::shared_ptr<CodeUnit> unit(new CodeUnit());
+  unit->functions_.push_back(
+      std::make_shared<Function>(std::move(module.initializer_)));
+  std::unordered_map<Function *, int> indexes;
+  auto indexOf = [&](const std::shared_ptr<Function> &function) {
+    auto it = indexes.find(function.get());
+    if (it != indexes.end()) {
+      return it->second;
+    }
+    if (function->type() != FunctionType::Native) {
+      throw std::runtime_error("code unit: can't share foreign function " +
+                               function->name());
+    }
+    int index = (int)unit->functions_.size();
+    unit->functions_.push_back(function);
+    indexes.emplace(function.get(), index);
+    return index;
+  };
+
+  for (Value &constant : module.constants) {
+    int index = (int)unit->constants_.size();
+    if (constant.type() == ValueType::Function) {
+      unit->constantFunctions_.push_back(indexOf(constant.functionValue()));
+      unit->constants_.push_back(Value());
+    } else {
+      unit->constantFunctions_.push_back(-1);
+      unit->constantIndex_.emplace(constant.hash(), index);
+      unit->constants_.push_back(std::move(constant));
+    }
+  }
+
+  unit->names_ = std::move(module.names);
+  for (size_t i = 0; i < unit->names_.size(); i++) {
+    // emplace keeps the first index of a name pushed twice;
+    unit->nameIndex_.emplace(unit->names_[i], (int)i);
+  }
+
+  // sorted, so the same module always makes the same unit;
+  std::vector<std::string> globals;
+  for (auto &global : module.globals_) {
+    if (global.second.type() != ValueType::Function) {
+      throw std::runtime_error("code unit: global " + global.first +
+                               " is not a function");
+    }
+    globals.push_back(global.first);
+  }
+  std::sort(globals.begin(), globals.end());
+  for (auto &name : globals) {
+    unit->globalIndex_.emplace(name, (int)unit->globals_.size());
+    unit->globals_.emplace_back(
+        name, indexOf(module.globals_[name].functionValue()));
+  }
+  return unit;
+}
+
+Module CodeUnit::instantiate() const {
+  Module module;
+  module.unit_ = shared_from_this();
+  module.unitConstants_ = constants_.size();
+  module.unitNames_ = names_.size();
+  module.boundGlobals_.assign(globals_.size(), false);
+  module.pendingGlobals_ = globals_.size();
+  module.initializer_ = std::move(*makeFunction(0, nullptr));
+  return module;
+}
+
+int CodeUnit::nameIndex(const std::string &name) const {
+  auto it = nameIndex_.find(name);
+  return it != nameIndex_.end() ? it->second : -1;
+}
+
+int CodeUnit::constantIndex(const Value &value) const {
+  // lowest index wins, as with Module::putConstant;
+  int found = -1;
+  auto range = constantIndex_.equal_range(value.hash());
+  for (auto it = range.first; it != range.second; ++it) {
+    if ((found < 0 || it->second < found) && constants_[it->second] == value) {
+      found = it->second;
+    }
+  }
+  return found;
+}
+
+int CodeUnit::globalIndex(const std::string &name) const {
+  auto it = globalIndex_.find(name);
+  return it != globalIndex_.end() ? it->second : -1;
+}
+
+std::shared_ptr<Function> CodeUnit::makeFunction(int index,
+                                                 Module *home) const {
+  Function &prototype = *functions_[index];
+  BytecodeView code = prototype.instructions().view();
+  auto function = std::make_shared<Function>(
+      InstructionArray(code.data(), code.size(), shared_from_this()));
+  function->setName(prototype.name());
+  function->setArity(prototype.arity());
+  function->setMaxSlots(prototype.maxSlots());
+  function->setCompiledSize(prototype.compiledSize());
+  function->setModule(home);
+  return function;
+}
+
+size_t CodeUnit::codeSize() const {
+  size_t size = 0;
+  for (auto &function : functions_) {
+    size += function->instructions().size();
+  }
+  for (auto &name : names_) {
+    size += name.size();
+  }
+  return size + constants_.size() * sizeof(Value);
+}
+
+void Module::bindGlobal(const std::string &name, bool make) {
+  int slot = unit_->globalIndex(name);
+  if (slot < 0 || boundGlobals_[slot]) {
+    return;
+  }
+  boundGlobals_[slot] = true;
+  pendingGlobals_--;
+  if (make) {
+    globals_[name] = Value(function(unit_->globals()[slot].second));
+  }
+}
+
+std::shared_ptr<Function> Module::function(int index) {
+  std::shared_ptr<Function> &function = functions_[index];
+  if (!function) {
+    function = unit_->makeFunction(index, home_);
+  }
+  return function;
+}
+
+const Value &Module::functionConstant(int index) {
+  auto it = functionConstants_.find(index);
+  if (it == functionConstants_.end()) {
+    it = functionConstants_
+             .emplace(index, Value(function(unit_->functionAt(index))))
+             .first;
+  }
+  return it->second;
+}
+
+void Module::materialize() {
+  if (unit_ == nullptr) {
+    return;
+  }
+  const std::vector<std::pair<std::string, int>> &globals = unit_->globals();
+  for (size_t slot = 0; pendingGlobals_ > 0 && slot < globals.size();
+       slot++) {
+    bindGlobal(globals[slot].first, true);
+  }
+
+  std::vector<Value> allConstants;
+  allConstants.reserve(constantCount());
+  for (size_t i = 0; i < constantCount(); i++) {
+    allConstants.push_back(getConstant((int)i));
+  }
+  std::vector<std::string> allNames = unit_->names();
+  allNames.insert(allNames.end(), names.begin(), names.end());
+  constants = std::move(allConstants);
+  names = std::move(allNames);
+
+  unit_.reset();
+  unitConstants_ = unitNames_ = 0;
+  boundGlobals_.clear();
+  functions_.clear();
+  functionConstants_.clear();
+  // reindexed from the whole tables on the next lookup;
+  constantIndex_.clear();
+  indexedConstants_ = 0;
+  nameIndex_.clear();
+  indexedNames_ = 0;
+}
+
+} // namespace kestrel
@@ -19,19 +19,21 @@ static Value startsWith(Value& self, MethodParameter& params) {
 
 static Value toUpperCase(Value& self, MethodParameter& params) {
     std::string str = self.stringValue();
-    std::transform(str.begin(), str.end(), str.begin(), ::toupper);
+    for (char& c : str) {
+        c = ::toupper(c);
+    }
     return str;
 };
 
-static Class* integer = nullptr;
 Class* integerClass() {
-    static std::once_flag flag;
-    std::call_once(flag, [](){ 
-        integer = new Class();
-        integer->registerMethod("length", length);
-        integer->registerMethod("startsWith",startsWith);
-        integer->registerMethod("toUpperCase", toUpperCase);
-    });
+    // a local static is initialized once, whichever thread gets here first;
+    static Class* integer = [] {
+        Class* cls = new Class();
+        cls->registerMethod("length", length);
+        cls->registerMethod("startsWith",startsWith);
+        cls->registerMethod("toUpperCase", toUpperCase);
+        return cls;
+    }();
     return integer;
 }
 
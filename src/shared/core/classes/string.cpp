@@ -1,4 +1,5 @@
 #include "core/classes.hpp"
+
 #include <string>
 #include "value.hpp"
 
@@ -19,19 +20,21 @@ static Value startsWith(Value& self, MethodParameter& params) {
 
 static Value toUpperCase(Value& self, MethodParameter& params) {
     std::string str = self.stringValue();
-    std::transform(str.begin(), str.end(), str.begin(), ::toupper);
+    for (char& c : str) {
+        c = ::toupper(c);
+    }
     return str;
 };
 
-static Class* string = nullptr;
 Class* stringClass() {
-    static std::once_flag flag;
-    std::call_once(flag, [](){ 
-        string = new Class();
-        string->registerMethod("length", length);
-        string->registerMethod("startsWith",startsWith);
-        string->registerMethod("toUpperCase", toUpperCase);
-    });
+    // a local static is initialized once, whichever thread gets here first;
+    static Class* string = [] {
+        Class* cls = new Class();
+        cls->registerMethod("length", length);
+        cls->registerMethod("startsWith",startsWith);
+        cls->registerMethod("toUpperCase", toUpperCase);
+        return cls;
+    }();
     return string;
 }
 
@@ -0,0 +1,172 @@
+#include "feedback.hpp"
+
+#include <sstream>
+
+#include "instruction_array.hpp"
+#include "opcodes.hpp"
+
+namespace kestrel {
+
+static int bitCount(TypeSet types) {
+  int count = 0;
+  while (types) {
+    types &= types - 1;
+    count++;
+  }
+  return count;
+}
+
+static bool siteKind(Opcode code, FeedbackKind &kind) {
+  switch (code) {
+  case Opcode::Add:
+  case Opcode::Subtract:
+  case Opcode::Multiply:
+  case Opcode::Divide:
+    kind = FeedbackKind::Arithmetic;
+    return true;
+  case Opcode::Equals:
+  case Opcode::LessThan:
+  case Opcode::GreaterThan:
+  case Opcode::BranchIfLess:
+  case Opcode::BranchIfNotLess:
+  case Opcode::BranchIfGreater:
+  case Opcode::BranchIfNotGreater:
+  case Opcode::BranchIfEqual:
+  case Opcode::BranchIfNotEqual:
+    kind = FeedbackKind::Compare;
+    return true;
+  case Opcode::Dispatch:
+    kind = FeedbackKind::Dispatch;
+    return true;
+  case Opcode::Call:
+    kind = FeedbackKind::Call;
+    return true;
+  case Opcode::LoadGlobal:
+    kind = FeedbackKind::LoadGlobal;
+    return true;
+  default:
+    return false;
+  }
+}
+
+std::string toString(FeedbackKind kind) {
+  switch (kind) {
+  case FeedbackKind::Arithmetic:
+    return "arith";
+  case FeedbackKind::Compare:
+    return "compare";
+  case FeedbackKind::Dispatch:
+    return "dispatch";
+  case FeedbackKind::Call:
+    return "call";
+  case FeedbackKind::LoadGlobal:
+    return "global";
+  }
+  return "unknown";
+}
+
+std::string toString(FeedbackState state) {
+  switch (state) {
+  case FeedbackState::Uninitialized:
+    return "uninitialized";
+  case FeedbackState::Monomorphic:
+    return "monomorphic";
+  case FeedbackState::Polymorphic:
+    return "polymorphic";
+  case FeedbackState::Megamorphic:
+    return "megamorphic";
+  }
+  return "unknown";
+}
+
+std::string typeSetToString(TypeSet types) {
+  static const char *names[] = {"nil",     "bool",   "int",    "double",
+                                "string",  "func",   "closure", "object",
+                                "module",  "class",  "unknown"};
+  std::string result;
+  for (int i = 0; i <= (int)ValueType::Unknown; i++) {
+    if (types & typeBit((ValueType)i)) {
+      if (!result.empty()) {
+        result += "|";
+      }
+      result += names[i];
+    }
+  }
+  return result.empty() ? "-" : result;
+}
+
+FeedbackState FeedbackSlot::state() const {
+  if (count == 0) {
+    return FeedbackState::Uninitialized;
+  }
+  if (megamorphic) {
+    return FeedbackState::Megamorphic;
+  }
+  if (targetCount > 1 || bitCount(left) > 1 || bitCount(right) > 1) {
+    return FeedbackState::Polymorphic;
+  }
+  return FeedbackState::Monomorphic;
+}
+
+std::string FeedbackSlot::toString() const {
+  std::ostringstream oss;
+  oss << kestrel::toString(kind) << " " << kestrel::toString(state())
+      << " count:" << count;
+  switch (kind) {
+  case FeedbackKind::Arithmetic:
+  case FeedbackKind::Compare:
+    oss << " (" << typeSetToString(left) << ", " << typeSetToString(right)
+        << ")";
+    break;
+  default:
+    oss << " " << typeSetToString(left);
+    break;
+  }
+  if (targetCount > 0) {
+    oss << " targets:" << targetCount;
+  }
+  return oss.str();
+}
+
+void FeedbackVector::build(InstructionArray &instructions) {
+  slots_.clear();
+  index_.assign(instructions.size(), -1);
+
+  BytecodeView view = instructions.view();
+  int pc = 0;
+  int size = (int)instructions.size();
+  while (pc < size) {
+    DecodedInstruction decoded = decodeAt(view, pc);
+    Opcode code = decoded.opcode;
+    FeedbackKind kind;
+    if (siteKind(code, kind)) {
+      FeedbackSlot slot;
+      slot.kind = kind;
+      slot.pc = pc;
+      index_[pc] = (int)slots_.size();
+      slots_.push_back(slot);
+    }
+    pc += decoded.length;
+  }
+  built_ = true;
+}
+
+void FeedbackVector::reset() {
+  built_ = false;
+  slots_.clear();
+  index_.clear();
+}
+
+std::vector<FeedbackSlot *> FeedbackVector::polymorphicSites() {
+  std::vector<FeedbackSlot *> result;
+  for (FeedbackSlot &slot : slots_) {
+    FeedbackState state = slot.state();
+    if (state == FeedbackState::Polymorphic ||
+        state == FeedbackState::Megamorphic) {
+      result.push_back(&slot);
+    }
+  }
+  return result;
+}
+
+} // namespace kestrel
@@ -8,9 +8,19 @@ public:
     bool isInitializer;
     int arity = 0;
     int localSize = 0;
+    size_t compiledSize = 0;
     FunctionType type = Native;
     ForeignFunction foreignFunction_;
     std::string name;
+    FeedbackVector feedback;
+    SpecializationTable specializations;
+    std::shared_ptr<Function> optimized;
+    bool optimizationAttempted = false;
+    int eliminatedAllocations = 0;
+    LazyBody lazyBody;
+    bool compiled = true;
+    bool frozen = false;
+    Module* module = nullptr;
 };
 
 Function::Function() : detail(std::make_unique<Detail>()) {}
@@ -20,9 +30,9 @@ Function::Function(ForeignFunction f) : detail(std::make_unique<Detail>()) {
     detail->foreignFunction_ = f;
 }
 
-Function::Function(InstructionArray& instructions) : detail(std::make_unique<Detail>()) {
+Function::Function(InstructionArray instructions) : detail(std::make_unique<Detail>()) {
     detail->type = Native;
-    detail->instructions = instructions;
+    detail->instructions = std::move(instructions);
 }
 
 Function::~Function() = default;
@@ -72,6 +82,14 @@ void Function::setMaxSlots(int size) {
     detail->localSize = size;
 }
 
+size_t Function::compiledSize() const {
+    return detail->compiledSize;
+}
+
+void Function::setCompiledSize(size_t size) {
+    detail->compiledSize = size;
+}
+
 void Function::setName(const std::string& name) {
     detail->name = name;
 }
@@ -84,4 +102,83 @@ InstructionArray& Function::instructions() {
     return detail->instructions;
 }
 
+Module* Function::module() const {
+    return detail->module;
+}
+
+void Function::setModule(Module* module) {
+    detail->module = module;
+}
+
+void Function::freeze() {
+    detail->frozen = true;
+}
+
+bool Function::frozen() const {
+    return detail->frozen;
+}
+
+void Function::setLazyBody(LazyBody body) {
+    detail->lazyBody = std::move(body);
+    detail->compiled = false;
+}
+
+bool Function::isCompiled() const {
+    return detail->compiled;
+}
+
+void Function::compile(Module& module) {
+    if (!detail->lazyBody) {
+        return;
+    }
+    // taken out first, so the body runs once; the stub counts as compiled
+    // only when it has its code, a recursive call must not be inlined;
+    LazyBody body = std::move(detail->lazyBody);
+    detail->lazyBody = nullptr;
+    try {
+        body(*this, module);
+    } catch (...) {
+        // a body that does not parse stays a stub, failing every call;
+        detail->lazyBody = std::move(body);
+        throw;
+    }
+    detail->compiled = true;
+}
+
+FeedbackVector& Function::feedback() {
+    if (!detail->feedback.built()) {
+        detail->feedback.build(detail->instructions);
+    }
+    return detail->feedback;
+}
+
+SpecializationTable& Function::specializations() {
+    return detail->specializations;
+}
+
+const std::shared_ptr<Function>& Function::optimized() const {
+    return detail->optimized;
+}
+
+void Function::setOptimized(std::shared_ptr<Function> code, int eliminatedAllocations) {
+    detail->optimizationAttempted = true;
+    detail->optimized = std::move(code);
+    detail->eliminatedAllocations = eliminatedAllocations;
+}
+
+bool Function::optimizationAttempted() const {
+    return detail->optimizationAttempted;
+}
+
+int Function::eliminatedAllocations() const {
+    return detail->eliminatedAllocations;
+}
+
+void Function::deoptimize() {
+    detail->optimized = nullptr;
+    detail->specializations.clear();
+    detail->optimizationAttempted = false;
+    detail->eliminatedAllocations = 0;
+}
+
 }  // namespace kestrel
\ No newline at end of file
@@ -0,0 +1,263 @@
+#include "heap.hpp"
+
+#include <cstdlib>
+#include <new>
+#include <unordered_set>
+
+#include "module.hpp"
+#include "value.hpp"
+
+namespace kestrel {
+
+namespace {
+
+const size_t kCellSize =
+    (sizeof(Object) + alignof(Object) - 1) / alignof(Object) * alignof(Object);
+const size_t kCells = Heap::kBlockSize / kCellSize;
+const size_t kWords = (kCells + 63) / 64;
+
+bool test(const std::vector<uint64_t> &bits, size_t i) {
+  return (bits[i / 64] >> (i % 64)) & 1;
+}
+
+void set(std::vector<uint64_t> &bits, size_t i) {
+  bits[i / 64] |= uint64_t(1) << (i % 64);
+}
+
+void clear(std::vector<uint64_t> &bits, size_t i) {
+  bits[i / 64] &= ~(uint64_t(1) << (i % 64));
+}
+
+} // namespace
+
+struct Heap::Block {
+  Block() : used(kWords, 0) {
+    void *p = nullptr;
+    if (posix_memalign(&p, kBlockSize, kBlockSize) != 0) {
+      throw std::bad_alloc();
+    }
+    memory = static_cast<char *>(p);
+  }
+  ~Block() { std::free(memory); }
+
+  Object *cell(size_t i) const {
+    return reinterpret_cast<Object *>(memory + i * kCellSize);
+  }
+
+  size_t indexOf(const Object *object) const {
+    return (size_t)(reinterpret_cast<const char *>(object) - memory) /
+           kCellSize;
+  }
+
+  char *memory = nullptr;
+  std::vector<uint64_t> used; // side bitmap of cells in use;
+  size_t next = 0;            // cells past this were never handed out;
+  bool frozen = false;
+};
+
+Heap &Heap::current() {
+  static Heap heap;
+  return heap;
+}
+
+Heap::Heap() = default;
+
+Heap::~Heap() {
+  for (auto &block : blocks_) {
+    for (size_t i = 0; i < block->next; i++) {
+      if (test(block->used, i)) {
+        block->cell(i)->~Object();
+      }
+    }
+  }
+}
+
+Object *Heap::allocate() {
+  Object *cell = nullptr;
+  if (!free_.empty()) {
+    cell = free_.back();
+    free_.pop_back();
+  } else {
+    Block *block = blocks_.empty() ? nullptr : blocks_.back().get();
+    if (block == nullptr || block->frozen || block->next == kCells) {
+      blocks_.push_back(std::make_unique<Block>());
+      block = blocks_.back().get();
+      blockIndex_[reinterpret_cast<uintptr_t>(block->memory)] = block;
+    }
+    cell = block->cell(block->next++);
+  }
+  Block *block = blockOf(cell);
+  set(block->used, block->indexOf(cell));
+  live_++;
+  return new (cell) Object();
+}
+
+Heap::Block *Heap::blockOf(const Object *object) const {
+  uintptr_t address = reinterpret_cast<uintptr_t>(object) & ~(kBlockSize - 1);
+  auto it = blockIndex_.find(address);
+  return it != blockIndex_.end() ? it->second : nullptr;
+}
+
+bool Heap::isFrozen(const Object *object) const {
+  Block *block = blockOf(object);
+  return block != nullptr && block->frozen;
+}
+
+void Heap::freeze(Module &module) {
+  // values reachable from the module and the modules it imports, each
+  // visited once, and the lazy functions among them compiled against their
+  // own module; their bodies may add globals and constants, which only
+  // then need another walk;
+  std::vector<Value *> values;
+  std::vector<Module *> modules;
+  for (bool grew = true; grew;) {
+    values.clear();
+    modules.clear();
+    std::vector<std::shared_ptr<Function>> stubs;
+    std::unordered_set<Object *> seen;
+    std::unordered_set<Module *> entered;
+    auto enter = [&](Module *reached) {
+      if (reached == nullptr || !entered.insert(reached).second) {
+        return;
+      }
+      // every function is frozen, not only those an instance made so far;
+      reached->materialize();
+      modules.push_back(reached);
+      for (auto &global : reached->globals_) {
+        values.push_back(&global.second);
+      }
+      for (Value &constant : reached->constants) {
+        values.push_back(&constant);
+      }
+    };
+    enter(&module);
+    for (size_t i = 0; i < values.size(); i++) {
+      Value &value = *values[i];
+      if (value.type() == ValueType::Function &&
+          !value.functionValue()->isCompiled()) {
+        stubs.push_back(value.functionValue());
+      } else if (value.type() == ValueType::Module) {
+        enter(value.moduleValue());
+      } else if (value.type() == ValueType::Object &&
+                 seen.insert(value.objectValue()).second) {
+        Object *object = value.objectValue();
+        for (auto &attribute : object->attributes()) {
+          values.push_back(&object->getAttribute(attribute.first));
+        }
+      }
+    }
+    size_t sizes = 0;
+    for (Module *reached : modules) {
+      sizes += reached->globals_.size() + reached->constants.size();
+    }
+    for (auto &stub : stubs) {
+      stub->compile(stub->module() ? *stub->module() : module);
+    }
+    size_t after = 0;
+    for (Module *reached : modules) {
+      after += reached->globals_.size() + reached->constants.size();
+    }
+    grew = after != sizes;
+  }
+
+  for (Module *reached : modules) {
+    reached->initializer_.freeze();
+  }
+  for (Value *value : values) {
+    if (value->type() != ValueType::Function ||
+        value->functionValue()->type() != FunctionType::Native ||
+        value->borrowsFunction()) {
+      continue; // a borrowed one was frozen and pinned when it was borrowed;
+    }
+    std::shared_ptr<Function> &function = value->functionValue();
+    function->freeze();
+    pinned_.push_back(function);
+    value->borrowFunction();
+  }
+
+  for (auto &block : blocks_) {
+    block->frozen = true;
+  }
+  // cells freed in frozen blocks stay unused;
+  free_.clear();
+}
+
+size_t Heap::collect(Module &module) {
+  std::unordered_map<Block *, std::vector<uint64_t>> marks;
+  std::unordered_set<Object *> external; // not allocated here;
+  std::unordered_set<Module *> modules;  // imported ones are roots too;
+  std::vector<Object *> pending;
+  std::vector<Module *> pendingModules;
+  auto reach = [&](const Value &value) {
+    if (value.type() == ValueType::Module) {
+      Module *reached = value.moduleValue();
+      if (reached != nullptr && modules.insert(reached).second) {
+        pendingModules.push_back(reached);
+      }
+      return;
+    }
+    if (value.type() != ValueType::Object || value.objectValue() == nullptr) {
+      return;
+    }
+    Object *object = value.objectValue();
+    Block *block = blockOf(object);
+    if (block == nullptr) {
+      if (external.insert(object).second) {
+        pending.push_back(object);
+      }
+      return;
+    }
+    std::vector<uint64_t> &bits = marks[block];
+    if (bits.empty()) {
+      bits.assign(kWords, 0);
+    }
+    size_t i = block->indexOf(object);
+    if (!test(bits, i)) {
+      set(bits, i);
+      pending.push_back(object);
+    }
+  };
+
+  modules.insert(&module);
+  pendingModules.push_back(&module);
+  while (!pending.empty() || !pendingModules.empty()) {
+    if (!pendingModules.empty()) {
+      Module *reached = pendingModules.back();
+      pendingModules.pop_back();
+      for (auto &global : reached->globals_) {
+        reach(global.second);
+      }
+      for (Value &constant : reached->constants) {
+        reach(constant);
+      }
+      continue;
+    }
+    Object *object = pending.back();
+    pending.pop_back();
+    for (auto &attribute : object->attributes()) {
+      reach(attribute.second);
+    }
+  }
+
+  size_t freed = 0;
+  for (auto &block : blocks_) {
+    if (block->frozen) {
+      continue;
+    }
+    auto it = marks.find(block.get());
+    for (size_t i = 0; i < block->next; i++) {
+      if (!test(block->used, i) ||
+          (it != marks.end() && test(it->second, i))) {
+        continue;
+      }
+      block->cell(i)->~Object();
+      clear(block->used, i);
+      free_.push_back(block->cell(i));
+      freed++;
+    }
+  }
+  live_ -= freed;
+  return freed;
+}
+
+} // namespace kestrel
@@ -0,0 +1,499 @@
+#include "image.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "function.hpp"
+#include "value.hpp"
+
+namespace kestrel {
+
+namespace {
+
+const char kMagic[8] = {'K', 'S', 'I', 'M', 'A', 'G', 'E', '\0'};
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t optimizationLevel;
+  uint64_t sourceHash;
+  uint64_t size; // of the whole image;
+  uint32_t functionCount;
+  uint32_t constantCount;
+  uint32_t nameCount;
+  uint32_t globalCount;
+  // section offsets from the start of the image;
+  uint64_t functions;
+  uint64_t constants;
+  uint64_t names;
+  uint64_t globals;
+  uint64_t strings;
+  uint64_t code;
+};
+
+struct StringRecord {
+  uint32_t offset; // into the string bytes;
+  uint32_t length;
+};
+
+struct FunctionRecord {
+  StringRecord name;
+  uint32_t arity;
+  int32_t maxSlots;
+  uint64_t compiledSize;
+  uint64_t code; // into the bytecode;
+  uint64_t codeSize;
+};
+
+struct ConstantRecord {
+  uint32_t type;   // ValueType;
+  uint32_t length; // of a string;
+  uint64_t bits;   // the value, a string offset or a function record index;
+};
+
+struct GlobalRecord {
+  StringRecord name;
+  uint32_t function;
+  uint32_t unused;
+};
+
+size_t align8(size_t n) { return (n + 7) & ~(size_t)7; }
+
+// The mapped file, or the image built in memory; borrowed instruction
+// arrays hold on to it.
+struct Mapping {
+  Mapping(void *data, size_t size) : data(data), size(size) {}
+  explicit Mapping(std::string bytes)
+      : buffer(std::move(bytes)), data(&buffer[0]), size(buffer.size()) {}
+  ~Mapping() {
+    if (buffer.empty()) {
+      munmap(data, size);
+    }
+  }
+
+  std::string buffer;
+  void *const data;
+  const size_t size;
+};
+
+class Writer {
+public:
+  StringRecord string(const std::string &text) {
+    auto it = offsets_.find(text);
+    if (it == offsets_.end()) {
+      it = offsets_.emplace(text, (uint32_t)strings.size()).first;
+      strings += text;
+    }
+    return StringRecord{it->second, (uint32_t)text.size()};
+  }
+
+  std::string strings;
+
+private:
+  std::unordered_map<std::string, uint32_t> offsets_;
+};
+
+template <typename T>
+void append(std::string &out, const std::vector<T> &records) {
+  out.append(reinterpret_cast<const char *>(records.data()),
+             records.size() * sizeof(T));
+  out.resize(align8(out.size()), '\0');
+}
+
+} // namespace
+
+uint64_t Image::contentHash(const std::string &text) {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (unsigned char c : text) {
+    hash = (hash ^ c) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+namespace {
+
+std::string encode(Module &module, uint64_t sourceHash,
+                   int optimizationLevel) {
+  module.materialize();
+  // compiling a lazy body may declare more functions, look again until none
+  // is left;
+  for (bool compiled = true; compiled;) {
+    compiled = false;
+    std::vector<std::shared_ptr<Function>> stubs;
+    for (auto &global : module.globals_) {
+      if (global.second.type() == ValueType::Function &&
+          !global.second.functionValue()->isCompiled()) {
+        stubs.push_back(global.second.functionValue());
+      }
+    }
+    for (auto &stub : stubs) {
+      stub->compile(module);
+      compiled = true;
+    }
+  }
+
+  std::vector<Function *> functions = {&module.initializer_};
+  std::unordered_map<Function *, uint32_t> indexes;
+  auto indexOf = [&](const std::shared_ptr<Function> &function) {
+    auto it = indexes.find(function.get());
+    if (it != indexes.end()) {
+      return it->second;
+    }
+    if (function->type() != FunctionType::Native) {
+      throw std::runtime_error("image: can't store foreign function " +
+                               function->name());
+    }
+    uint32_t index = (uint32_t)functions.size();
+    functions.push_back(function.get());
+    indexes.emplace(function.get(), index);
+    return index;
+  };
+
+  // sorted, so the same module always makes the same image;
+  std::vector<std::string> names;
+  for (auto &global : module.globals_) {
+    if (global.second.type() == ValueType::Function) {
+      names.push_back(global.first);
+    }
+  }
+  std::sort(names.begin(), names.end());
+
+  Writer writer;
+  std::vector<GlobalRecord> globals;
+  for (auto &name : names) {
+    uint32_t function = indexOf(module.globals_[name].functionValue());
+    globals.push_back(GlobalRecord{writer.string(name), function, 0});
+  }
+
+  std::vector<ConstantRecord> constants;
+  for (Value &value : module.constants) {
+    ConstantRecord record = {static_cast<uint32_t>(value.type()), 0, 0};
+    switch (value.type()) {
+    case ValueType::Nil:
+      break;
+    case ValueType::Boolean:
+      record.bits = value.boolValue() ? 1 : 0;
+      break;
+    case ValueType::Integer:
+      record.bits = (uint64_t)(int64_t)value.intValue();
+      break;
+    case ValueType::Double: {
+      double d = value.doubleValue();
+      std::memcpy(&record.bits, &d, sizeof(d));
+      break;
+    }
+    case ValueType::String: {
+      StringRecord s = writer.string(value.stringValue());
+      record.bits = s.offset;
+      record.length = s.length;
+      break;
+    }
+    case ValueType::Function:
+      record.bits = indexOf(value.functionValue());
+      break;
+    default:
+      throw std::runtime_error("image: can't store constant " +
+                               value.toString());
+    }
+    constants.push_back(record);
+  }
+
+  std::vector<StringRecord> nameRecords;
+  for (auto &name : module.names) {
+    nameRecords.push_back(writer.string(name));
+  }
+
+  std::string code;
+  std::vector<FunctionRecord> functionRecords;
+  for (Function *function : functions) {
+    BytecodeView view = function->instructions().view();
+    FunctionRecord record = {};
+    record.name = writer.string(function->name());
+    record.arity = (uint32_t)function->arity();
+    record.maxSlots = function->maxSlots();
+    record.compiledSize = function->compiledSize();
+    record.code = code.size();
+    record.codeSize = view.size();
+    functionRecords.push_back(record);
+    code.append(reinterpret_cast<const char *>(view.data()), view.size());
+    code.resize(align8(code.size()), '\0');
+  }
+
+  Header header = {};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = Image::kVersion;
+  header.optimizationLevel = (uint32_t)optimizationLevel;
+  header.sourceHash = sourceHash;
+  header.functionCount = (uint32_t)functionRecords.size();
+  header.constantCount = (uint32_t)constants.size();
+  header.nameCount = (uint32_t)nameRecords.size();
+  header.globalCount = (uint32_t)globals.size();
+
+  std::string out(align8(sizeof(Header)), '\0');
+  header.functions = out.size();
+  append(out, functionRecords);
+  header.constants = out.size();
+  append(out, constants);
+  header.names = out.size();
+  append(out, nameRecords);
+  header.globals = out.size();
+  append(out, globals);
+  header.strings = out.size();
+  out += writer.strings;
+  out.resize(align8(out.size()), '\0');
+  header.code = out.size();
+  out += code;
+  header.size = out.size();
+  std::memcpy(&out[0], &header, sizeof(header));
+  return out;
+}
+
+} // namespace
+
+void Image::write(Module &module, uint64_t sourceHash, int optimizationLevel,
+                  const std::string &path) {
+  std::string out = encode(module, sourceHash, optimizationLevel);
+  try {
+    replaceFile(path, out);
+  } catch (std::runtime_error &error) {
+    throw std::runtime_error(std::string("image: ") + error.what());
+  }
+}
+
+void Image::replaceFile(const std::string &path, const std::string &bytes) {
+  std::string temporary = path + ".XXXXXX";
+  int fd = mkstemp(&temporary[0]);
+  if (fd < 0) {
+    throw std::runtime_error("can't write " + path);
+  }
+  // mkstemp creates the file private to its owner;
+  bool written = fchmod(fd, 0644) == 0;
+  for (size_t done = 0; written && done < bytes.size();) {
+    ssize_t n = ::write(fd, bytes.data() + done, bytes.size() - done);
+    written = n > 0;
+    done += written ? (size_t)n : 0;
+  }
+  written = close(fd) == 0 && written;
+  if (!written || std::rename(temporary.c_str(), path.c_str()) != 0) {
+    std::remove(temporary.c_str());
+    throw std::runtime_error("can't write " + path);
+  }
+}
+
+struct Image::Detail {
+  std::shared_ptr<Mapping> mapping;
+
+  const uint8_t *bytes() const {
+    return static_cast<const uint8_t *>(mapping->data);
+  }
+
+  const Header &header() const {
+    return *reinterpret_cast<const Header *>(bytes());
+  }
+
+  template <typename T> const T *section(uint64_t offset) const {
+    return reinterpret_cast<const T *>(bytes() + offset);
+  }
+
+  std::string string(const StringRecord &record) const {
+    return std::string(section<char>(header().strings) + record.offset,
+                       record.length);
+  }
+};
+
+Image::Image() : detail(std::make_unique<Detail>()) {}
+
+Image::Image(Image &&other) noexcept = default;
+
+Image &Image::operator=(Image &&other) noexcept = default;
+
+Image::~Image() = default;
+
+Image Image::map(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("image: can't open " + path);
+  }
+  struct stat status;
+  if (fstat(fd, &status) != 0 || (size_t)status.st_size < sizeof(Header)) {
+    close(fd);
+    throw std::runtime_error("image: " + path + " is too short");
+  }
+  size_t size = (size_t)status.st_size;
+  void *data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    throw std::runtime_error("image: can't map " + path);
+  }
+
+  Image image;
+  image.detail->mapping = std::make_shared<Mapping>(data, size);
+  const Header &header = image.detail->header();
+  auto fail = [&](const std::string &why) {
+    throw std::runtime_error("image: " + path + ": " + why);
+  };
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+    fail("not an image");
+  }
+  if (header.version != kVersion) {
+    fail("version " + std::to_string(header.version) + ", expected " +
+         std::to_string(kVersion));
+  }
+  if (header.size != size) {
+    fail("truncated");
+  }
+
+  // everything the loader follows must stay inside the file;
+  auto fits = [&](uint64_t offset, uint64_t count, size_t unit) {
+    return offset <= size && count <= (size - offset) / unit;
+  };
+  if (!fits(header.functions, header.functionCount, sizeof(FunctionRecord)) ||
+      !fits(header.constants, header.constantCount, sizeof(ConstantRecord)) ||
+      !fits(header.names, header.nameCount, sizeof(StringRecord)) ||
+      !fits(header.globals, header.globalCount, sizeof(GlobalRecord)) ||
+      !fits(header.strings, 0, 1) || !fits(header.code, 0, 1) ||
+      header.strings > header.code || header.functionCount == 0) {
+    fail("bad section table");
+  }
+  uint64_t strings = header.code - header.strings;
+  uint64_t code = size - header.code;
+  auto string = [&](const StringRecord &s) {
+    return s.offset <= strings && s.length <= strings - s.offset;
+  };
+  auto functions = image.detail->section<FunctionRecord>(header.functions);
+  for (uint32_t i = 0; i < header.functionCount; i++) {
+    const FunctionRecord &f = functions[i];
+    if (!string(f.name) || f.code > code || f.codeSize > code - f.code) {
+      fail("bad function record");
+    }
+  }
+  auto constants = image.detail->section<ConstantRecord>(header.constants);
+  for (uint32_t i = 0; i < header.constantCount; i++) {
+    const ConstantRecord &c = constants[i];
+    bool valid = true;
+    switch (static_cast<ValueType>(c.type)) {
+    case ValueType::Nil:
+    case ValueType::Boolean:
+    case ValueType::Integer:
+    case ValueType::Double:
+      break;
+    case ValueType::String:
+      valid = c.bits <= UINT32_MAX && string(StringRecord{(uint32_t)c.bits,
+                                                          c.length});
+      break;
+    case ValueType::Function:
+      valid = c.bits > 0 && c.bits < header.functionCount;
+      break;
+    default:
+      valid = false;
+    }
+    if (!valid) {
+      fail("bad constant record");
+    }
+  }
+  auto names = image.detail->section<StringRecord>(header.names);
+  for (uint32_t i = 0; i < header.nameCount; i++) {
+    if (!string(names[i])) {
+      fail("bad name record");
+    }
+  }
+  auto globals = image.detail->section<GlobalRecord>(header.globals);
+  for (uint32_t i = 0; i < header.globalCount; i++) {
+    if (!string(globals[i].name) || globals[i].function == 0 ||
+        globals[i].function >= header.functionCount) {
+      fail("bad global record");
+    }
+  }
+  return image;
+}
+
+Image Image::build(Module &module, uint64_t sourceHash,
+                   int optimizationLevel) {
+  Image image;
+  image.detail->mapping = std::make_shared<Mapping>(
+      encode(module, sourceHash, optimizationLevel));
+  return image;
+}
+
+uint64_t Image::sourceHash() const { return detail->header().sourceHash; }
+
+int Image::optimizationLevel() const {
+  return (int)detail->header().optimizationLevel;
+}
+
+size_t Image::size() const { return detail->mapping->size; }
+
+Module Image::load() const {
+  const Header &header = detail->header();
+  const uint8_t *code = detail->bytes() + header.code;
+
+  std::vector<std::shared_ptr<Function>> functions;
+  auto records = detail->section<FunctionRecord>(header.functions);
+  for (uint32_t i = 0; i < header.functionCount; i++) {
+    const FunctionRecord &record = records[i];
+    InstructionArray instructions(code + record.code, record.codeSize,
+                                  detail->mapping);
+    auto function = std::make_shared<Function>(std::move(instructions));
+    function->setName(detail->string(record.name));
+    function->setArity(record.arity);
+    function->setMaxSlots(record.maxSlots);
+    function->setCompiledSize(record.compiledSize);
+    functions.push_back(std::move(function));
+  }
+
+  Module module;
+  // nothing else refers to the initializer;
+  module.initializer_ = std::move(*functions[0]);
+
+  auto constants = detail->section<ConstantRecord>(header.constants);
+  for (uint32_t i = 0; i < header.constantCount; i++) {
+    const ConstantRecord &record = constants[i];
+    switch (static_cast<ValueType>(record.type)) {
+    case ValueType::Boolean:
+      module.constants.push_back(Value(record.bits != 0));
+      break;
+    case ValueType::Integer:
+      module.constants.push_back(Value((int)(int64_t)record.bits));
+      break;
+    case ValueType::Double: {
+      double d;
+      std::memcpy(&d, &record.bits, sizeof(d));
+      module.constants.push_back(Value(d));
+      break;
+    }
+    case ValueType::String:
+      module.constants.push_back(Value(detail->string(
+          StringRecord{(uint32_t)record.bits, record.length})));
+      break;
+    case ValueType::Function:
+      module.constants.push_back(Value(functions[record.bits]));
+      break;
+    default:
+      module.constants.push_back(Value());
+      break;
+    }
+  }
+
+  auto names = detail->section<StringRecord>(header.names);
+  for (uint32_t i = 0; i < header.nameCount; i++) {
+    module.names.push_back(detail->string(names[i]));
+  }
+
+  auto globals = detail->section<GlobalRecord>(header.globals);
+  for (uint32_t i = 0; i < header.globalCount; i++) {
+    module.setGlobal(detail->string(globals[i].name),
+                     Value(functions[globals[i].function]));
+  }
+  return module;
+}
+
+} // namespace kestrel
@@ -1,18 +1,52 @@
 
 #include "instruction_array.hpp"
 
+#include <algorithm>
+#include <atomic>
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "bytecode operands are read with memcpy and assume a little-endian host"
+#endif
+
 namespace kestrel {
 
+static std::atomic<size_t> copied{0};
+
 class InstructionArrayDetail {
 public:
   std::vector<uint8_t> elements;
+  // borrowed bytes, used instead of `elements` until the first change;
+  const uint8_t* code = nullptr;
+  size_t size = 0;
+  std::shared_ptr<const void> owner;
+
+  std::vector<uint8_t>& own() {
+    if (code != nullptr) {
+      copied += size;
+      elements.assign(code, code + size);
+      code = nullptr;
+      size = 0;
+      owner.reset();
+    }
+    return elements;
+  }
 };
 
 InstructionArray::InstructionArray()
     : detail(std::make_unique<InstructionArrayDetail>()) {}
 
+InstructionArray::InstructionArray(const uint8_t* code, size_t size,
+                                   std::shared_ptr<const void> owner)
+    : detail(std::make_unique<InstructionArrayDetail>()) {
+  detail->code = code;
+  detail->size = size;
+  detail->owner = std::move(owner);
+}
+
 InstructionArray::InstructionArray(const InstructionArray& other)
-    : detail(std::make_unique<InstructionArrayDetail>(*other.detail)) {}
+    : detail(std::make_unique<InstructionArrayDetail>(*other.detail)) {
+  copied += other.detail->elements.size();
+}
 
 InstructionArray::InstructionArray(InstructionArray&& other) noexcept
     : detail(std::move(other.detail)) {}
@@ -20,6 +54,7 @@ InstructionArray::InstructionArray(InstructionArray&& other) noexcept
 InstructionArray& InstructionArray::operator=(const InstructionArray& other) {
   if (this != &other) {
     *detail = *other.detail;
+    copied += other.detail->elements.size();
   }
   return *this;
 }
@@ -33,11 +68,28 @@ InstructionArray& InstructionArray::operator=(InstructionArray&& other) noexcept
 
 InstructionArray::~InstructionArray() = default;
 
-void InstructionArray::writeByte(uint8_t value, size_t index) {
-  if (index >= detail->elements.size()) {
-    detail->elements.resize(index * 1.5 + 8);
+// Writes past the end grow the array to exactly index + 1 bytes; capacity
+// doubles so a sequence of writes stays amortized O(1).
+static void ensureSize(std::vector<uint8_t>& elements, size_t size) {
+  if (size <= elements.size()) {
+    return;
+  }
+  if (size > elements.capacity()) {
+    elements.reserve(std::max(size, elements.capacity() * 2));
   }
-  detail->elements[index] = value;
+  elements.resize(size);
+}
+
+template <typename T>
+static void write(std::vector<uint8_t>& elements, T value, size_t index) {
+  ensureSize(elements, index + sizeof(T));
+  std::memcpy(elements.data() + index, &value, sizeof(T));
+}
+
+void InstructionArray::writeByte(uint8_t value, size_t index) {
+  std::vector<uint8_t>& elements = detail->own();
+  ensureSize(elements, index + 1);
+  elements[index] = value;
 }
 
 void InstructionArray::writeBoolean(bool value, size_t index) {
@@ -45,79 +97,91 @@ void InstructionArray::writeBoolean(bool value, size_t index) {
 }
 
 void InstructionArray::writeShort(int16_t value, size_t index) {
-  writeByte(value & 0xff, index);
-  writeByte(value >> 8, index + 1);
+  write(detail->own(), value, index);
 }
 
 void InstructionArray::writeInt(int32_t value, size_t index) {
-  writeShort(value & 0xffff, index);
-  writeShort(value >> 16, index + 2);
+  write(detail->own(), value, index);
 }
 
 void InstructionArray::writeLong(int64_t value, size_t index) {
-  writeInt(static_cast<int32_t>(value & 0xffffffff), index);
-  writeInt(static_cast<int32_t>(value >> 32), index + 4);
+  write(detail->own(), value, index);
 }
 
 size_t InstructionArray::appendByte(uint8_t value) {
-  detail->elements.push_back(value);
-  return detail->elements.size() - 1;
+  std::vector<uint8_t>& elements = detail->own();
+  elements.push_back(value);
+  return elements.size() - 1;
 }
 
 size_t InstructionArray::appendBoolean(bool value) {
-  detail->elements.push_back(value ? 1 : 0);
-  return detail->elements.size() - 1;
+  std::vector<uint8_t>& elements = detail->own();
+  elements.push_back(value ? 1 : 0);
+  return elements.size() - 1;
 }
 
 size_t InstructionArray::appendShort(int16_t value) {
-  size_t index = detail->elements.size();
-  detail->elements.resize(index + 2);
+  size_t index = size();
   writeShort(value, index);
   return index;
 }
 
 size_t InstructionArray::appendInt(int32_t value) {
-  size_t index = detail->elements.size();
-  detail->elements.resize(index + 4);
+  size_t index = size();
   writeInt(value, index);
   return index;
 }
 
 size_t InstructionArray::appendLong(int64_t value) {
-  size_t index = detail->elements.size();
-  detail->elements.resize(index + 8);
+  size_t index = size();
   writeLong(value, index);
   return index;
 }
 
+size_t InstructionArray::appendOperand(int value, int width) {
+  if (width == 1) {
+    return appendByte(static_cast<uint8_t>(static_cast<int8_t>(value)));
+  }
+  return width == 2 ? appendShort(static_cast<int16_t>(value))
+                    : appendInt(value);
+}
+
 uint8_t InstructionArray::readByte(size_t index) const {
-  return detail->elements[index];
+  return view().readByte(index);
 }
 
 bool InstructionArray::readBoolean(size_t index) const {
-  return readByte(index) != 0;
+  return view().readBoolean(index);
 }
 
 int16_t InstructionArray::readShort(size_t index) const {
-  int16_t result = (static_cast<uint8_t>(detail->elements[index + 1]) << 8) |
-                    static_cast<uint8_t>(detail->elements[index]);
-  return result;
+  return view().readShort(index);
 }
 
 int32_t InstructionArray::readInt(size_t index) const {
-  int32_t result = (static_cast<uint8_t>(detail->elements[index + 3]) << 24) |
-                   (static_cast<uint8_t>(detail->elements[index + 2]) << 16) |
-                   (static_cast<uint8_t>(detail->elements[index + 1]) << 8) |
-                   static_cast<uint8_t>(detail->elements[index]);
-  return result;
+  return view().readInt(index);
 }
 
 int64_t InstructionArray::readLong(size_t index) const {
-  int64_t result = (static_cast<int64_t>(readInt(index + 4)) << 32) | readInt(index);
-  return result;
+  return view().readLong(index);
 }
 
 size_t InstructionArray::size() const {
-  return detail->elements.size();
+  return detail->code != nullptr ? detail->size : detail->elements.size();
+}
+
+bool InstructionArray::borrowed() const {
+  return detail->code != nullptr;
+}
+
+size_t InstructionArray::copiedBytes() {
+  return copied;
+}
+
+BytecodeView InstructionArray::view() const {
+  if (detail->code != nullptr) {
+    return BytecodeView(detail->code, detail->size);
+  }
+  return BytecodeView(detail->elements.data(), detail->elements.size());
 }
 }
\ No newline at end of file
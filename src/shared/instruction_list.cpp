@@ -0,0 +1,270 @@
+#include "instruction_list.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace kestrel {
+
+int Instruction::pops() const {
+  switch (opcode) {
+  case Opcode::Call:
+    return operands[0] + 1;
+  case Opcode::Dispatch:
+    return operands[1] + 1;
+  case Opcode::Add:
+  case Opcode::Subtract:
+  case Opcode::Multiply:
+  case Opcode::Divide:
+  case Opcode::Equals:
+  case Opcode::LessThan:
+  case Opcode::GreaterThan:
+  case Opcode::AddInt:
+  case Opcode::SubtractInt:
+  case Opcode::MultiplyInt:
+  case Opcode::EqualsInt:
+  case Opcode::LessThanInt:
+  case Opcode::GreaterThanInt:
+  case Opcode::AddDouble:
+  case Opcode::SubtractDouble:
+  case Opcode::MultiplyDouble:
+  case Opcode::DivideDouble:
+  case Opcode::EqualsDouble:
+  case Opcode::LessThanDouble:
+  case Opcode::GreaterThanDouble:
+  case Opcode::AddString:
+  case Opcode::SetItem:
+  case Opcode::BranchIfLess:
+  case Opcode::BranchIfNotLess:
+  case Opcode::BranchIfGreater:
+  case Opcode::BranchIfNotGreater:
+  case Opcode::BranchIfEqual:
+  case Opcode::BranchIfNotEqual:
+    return 2;
+  case Opcode::BranchTrue:
+  case Opcode::BranchFalse:
+  case Opcode::Duplicate:
+  case Opcode::Store:
+  case Opcode::StoreInt:
+  case Opcode::StoreDouble:
+  case Opcode::StoreBoolean:
+  case Opcode::StoreGlobal:
+  case Opcode::Pop:
+  case Opcode::Return:
+  case Opcode::Negate:
+  case Opcode::Not:
+  case Opcode::GetItem:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+int Instruction::pushes() const {
+  switch (opcode) {
+  case Opcode::NoOP:
+  case Opcode::Branch:
+  case Opcode::BranchTrue:
+  case Opcode::BranchFalse:
+  case Opcode::BranchIfLess:
+  case Opcode::BranchIfNotLess:
+  case Opcode::BranchIfGreater:
+  case Opcode::BranchIfNotGreater:
+  case Opcode::BranchIfEqual:
+  case Opcode::BranchIfNotEqual:
+  case Opcode::Store:
+  case Opcode::StoreInt:
+  case Opcode::StoreDouble:
+  case Opcode::StoreBoolean:
+  case Opcode::StoreGlobal:
+  case Opcode::Pop:
+  case Opcode::Return:
+  case Opcode::Import:
+  case Opcode::Move:
+    return 0;
+  case Opcode::Duplicate:
+    return 2;
+  default:
+    return 1;
+  }
+}
+
+InstructionList InstructionList::decode(const InstructionArray &instructions) {
+  InstructionList list;
+  std::unordered_map<int, int> idAt; // pc -> id;
+  std::vector<int> ends;             // pc after each instruction;
+  BytecodeView view = instructions.view();
+  int size = (int)instructions.size();
+
+  int pc = 0;
+  while (pc < size) {
+    DecodedInstruction decoded = decodeAt(view, pc);
+    Instruction instruction;
+    instruction.opcode = decoded.opcode;
+    instruction.operands[0] = decoded.operands[0];
+    instruction.operands[1] = decoded.operands[1];
+    instruction.pc = pc;
+    instruction.id = list.nextId_++;
+    idAt[pc] = instruction.id;
+    list.code.push_back(instruction);
+    pc += decoded.length;
+    ends.push_back(pc);
+  }
+
+  // branches falling off the end target an implicit end marker;
+  Instruction end;
+  end.id = list.nextId_++;
+  end.pc = pc;
+  end.removed = true;
+  idAt[pc] = end.id;
+
+  for (size_t i = 0; i < list.code.size(); i++) {
+    Instruction &instruction = list.code[i];
+    if (instruction.isBranch()) {
+      int target = ends[i] + instruction.operands[0];
+      auto it = idAt.find(target);
+      instruction.target = it == idAt.end() ? end.id : it->second;
+    }
+  }
+  list.code.push_back(end);
+  return list;
+}
+
+// LoadLocal of slots 0 to 3 has a form without an operand;
+static bool isShortForm(const Instruction &instruction) {
+  return instruction.opcode == Opcode::LoadLocal &&
+         instruction.operands[0] >= 0 && instruction.operands[0] <= 3;
+}
+
+// Bytes of an instruction whose operands are `width` bytes wide.
+static int lengthOf(const Instruction &instruction, int width) {
+  if (isShortForm(instruction)) {
+    return 1;
+  }
+  int count = operandCount(instruction.opcode);
+  if (count == 0) {
+    return 1;
+  }
+  return (width > 1 ? 2 : 1) + count * width;
+}
+
+InstructionArray InstructionList::encode() const {
+  // the narrowest width of every operand; a branch starts at one byte and
+  // widens until its offset fits, which may move and widen others;
+  std::vector<int> widths(code.size(), 1);
+  for (size_t i = 0; i < code.size(); i++) {
+    const Instruction &instruction = code[i];
+    if (instruction.removed || instruction.isBranch()) {
+      continue;
+    }
+    for (int k = 0; k < operandCount(instruction.opcode); k++) {
+      widths[i] = std::max(widths[i], operandWidth(instruction.operands[k]));
+    }
+  }
+
+  // new offsets, removed instructions take the next kept one's;
+  std::unordered_map<int, int> pcOf;
+  int pc = 0;
+  for (bool widened = true; widened;) {
+    widened = false;
+    pc = 0;
+    for (size_t i = 0; i < code.size(); i++) {
+      pcOf[code[i].id] = pc;
+      if (!code[i].removed) {
+        pc += lengthOf(code[i], widths[i]);
+      }
+    }
+    for (size_t i = 0; i < code.size(); i++) {
+      const Instruction &instruction = code[i];
+      if (instruction.removed || !instruction.isBranch()) {
+        continue;
+      }
+      auto it = pcOf.find(instruction.target);
+      int target = it == pcOf.end() ? pc : it->second;
+      int next = pcOf[instruction.id] + lengthOf(instruction, widths[i]);
+      int width = operandWidth(target - next);
+      if (width > widths[i]) {
+        widths[i] = width;
+        widened = true;
+      }
+    }
+  }
+
+  InstructionArray result;
+  for (size_t i = 0; i < code.size(); i++) {
+    const Instruction &instruction = code[i];
+    if (instruction.removed) {
+      continue;
+    }
+    if (isShortForm(instruction)) {
+      result.appendByte(static_cast<uint8_t>(
+          (int)Opcode::LoadLocal0 + instruction.operands[0]));
+      continue;
+    }
+    int width = widths[i];
+    int count = operandCount(instruction.opcode);
+    if (count > 0 && width > 1) {
+      result.appendByte(static_cast<uint8_t>(width == 2 ? Opcode::Wide
+                                                        : Opcode::ExtraWide));
+    }
+    result.appendByte(static_cast<uint8_t>(instruction.opcode));
+    int operands[2] = {instruction.operands[0], instruction.operands[1]};
+    if (instruction.isBranch()) {
+      auto it = pcOf.find(instruction.target);
+      int target = it == pcOf.end() ? pc : it->second;
+      operands[0] = target - (int)(result.size() + width);
+    }
+    for (int k = 0; k < count; k++) {
+      result.appendOperand(operands[k], width);
+    }
+  }
+  return result;
+}
+
+int InstructionList::insert(int index, Opcode opcode, int operand) {
+  Instruction instruction;
+  instruction.opcode = opcode;
+  instruction.operands[0] = operand;
+  instruction.id = nextId_++;
+  code.insert(code.begin() + index, instruction);
+  return instruction.id;
+}
+
+int InstructionList::indexOf(int id) const {
+  for (int i = 0; i < (int)code.size(); i++) {
+    if (code[i].id == id) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool InstructionList::isTarget(int id) const {
+  for (const Instruction &instruction : code) {
+    if (!instruction.removed && instruction.isBranch() &&
+        instruction.target == id) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::unordered_map<int, int> InstructionList::indices() const {
+  std::unordered_map<int, int> result;
+  result.reserve(code.size());
+  for (int i = 0; i < (int)code.size(); i++) {
+    result[code[i].id] = i;
+  }
+  return result;
+}
+
+std::unordered_set<int> InstructionList::targets() const {
+  std::unordered_set<int> result;
+  for (const Instruction &instruction : code) {
+    if (!instruction.removed && instruction.isBranch()) {
+      result.insert(instruction.target);
+    }
+  }
+  return result;
+}
+
+} // namespace kestrel
@@ -42,3 +42,80 @@
 // };
 
 // } // namespace kestrel
+
+#include "module.hpp"
+
+#include <algorithm>
+
+#include "instruction_list.hpp"
+#include "opcodes.hpp"
+
+namespace kestrel {
+
+// Rewrites the name and constant operands of `function` through the maps
+// from another module's table indices to this one's.
+static void renumber(Function &function, const std::vector<int> &names,
+                     const std::vector<int> &constants) {
+  // a renumbered index may need a wider operand, lay the code out again;
+  InstructionList list = InstructionList::decode(function.instructions());
+  for (Instruction &instruction : list.code) {
+    if (instruction.removed) {
+      continue;
+    }
+    int operand = nameOperand(instruction.opcode);
+    if (operand >= 0) {
+      instruction.operands[operand] = names[instruction.operands[operand]];
+    }
+    operand = constantOperand(instruction.opcode);
+    if (operand >= 0) {
+      instruction.operands[operand] =
+          constants[instruction.operands[operand]];
+    }
+  }
+  function.instructions() = list.encode();
+}
+
+void Module::merge(Module &from,
+                   const std::vector<std::shared_ptr<Function>> &functions) {
+  std::vector<int> names(from.names.size());
+  for (size_t k = 0; k < from.names.size(); k++) {
+    names[k] = nameIndex(from.names[k]);
+  }
+  std::vector<int> constants(from.constants.size());
+  for (size_t k = 0; k < from.constants.size(); k++) {
+    constants[k] = putConstant(from.constants[k]);
+  }
+
+  // nested functions reach the module as globals or, once inlined, as
+  // constants; each is renumbered once;
+  std::unordered_set<Function *> seen;
+  auto visit = [&](const std::shared_ptr<Function> &function) {
+    if (function && seen.insert(function.get()).second) {
+      renumber(*function, names, constants);
+    }
+  };
+  for (auto &function : functions) {
+    visit(function);
+  }
+  for (Value &value : from.constants) {
+    if (value.type() == ValueType::Function) {
+      visit(value.functionValue());
+    }
+  }
+  for (auto &global : from.globals_) {
+    if (global.second.type() == ValueType::Function) {
+      visit(global.second.functionValue());
+    }
+  }
+  // sorted, as the map's iteration order is not the insertion order;
+  std::vector<std::string> globals;
+  for (auto &global : from.globals_) {
+    globals.push_back(global.first);
+  }
+  std::sort(globals.begin(), globals.end());
+  for (auto &name : globals) {
+    setGlobal(name, from.globals_[name]);
+  }
+}
+
+} // namespace kestrel
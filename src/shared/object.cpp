@@ -1,4 +1,4 @@
-#include "object.hpp"
+#include "core/object.hpp"
 #include "value.hpp"
 
 namespace kestrel {
@@ -11,5 +11,9 @@ Value& Object::getAttribute(const std::string& name) {
     return Value::nil();
 }
 
+void Object::setAttribute(const std::string& name, const Value& value) {
+    attrs[name] = value;
+}
+
 }
 }
\ No newline at end of file
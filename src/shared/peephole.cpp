@@ -0,0 +1,236 @@
+#include "peephole.hpp"
+
+#include <unordered_set>
+#include <vector>
+
+namespace kestrel {
+
+static bool isStore(Opcode code) {
+  return code == Opcode::Store || code == Opcode::StoreInt ||
+         code == Opcode::StoreDouble || code == Opcode::StoreBoolean;
+}
+
+static bool isLoadLocal(Opcode code) {
+  return code == Opcode::LoadLocal || code == Opcode::LoadLocalInt ||
+         code == Opcode::LoadLocalDouble;
+}
+
+// Pushes one value and has no other effect.
+static bool isPureLoad(Opcode code) {
+  switch (code) {
+  case Opcode::LoadNil:
+  case Opcode::LoadBoolean:
+  case Opcode::LoadInteger:
+  case Opcode::LoadConstant:
+  case Opcode::LoadLocal:
+  case Opcode::LoadLocalInt:
+  case Opcode::LoadLocalDouble:
+    return true;
+  default:
+    return false;
+  }
+}
+
+Peephole::Report Peephole::run(InstructionArray &instructions) {
+  Report report;
+  report.before = instructions.size();
+  list_ = InstructionList::decode(instructions);
+  indices_ = list_.indices();
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    changed |= removeNoOPs();
+    changed |= threadJumps();
+    changed |= invertBranches();
+    changed |= forward();
+    changed |= removeDeadCode();
+  }
+
+  instructions = list_.encode();
+  report.after = instructions.size();
+  return report;
+}
+
+// Index of the next kept instruction after `index`, the end marker if none.
+int Peephole::next(int index) const {
+  int size = (int)list_.code.size();
+  for (int i = index + 1; i < size; i++) {
+    if (!list_.code[i].removed) {
+      return i;
+    }
+  }
+  return size - 1;
+}
+
+// Index of the instruction a branch to `id` lands on: removed instructions
+// forward to the next kept one.
+int Peephole::resolve(int id) const {
+  auto found = indices_.find(id);
+  int index = found == indices_.end() ? -1 : found->second;
+  if (index < 0 || !list_.code[index].removed) {
+    return index;
+  }
+  return next(index);
+}
+
+bool Peephole::removeNoOPs() {
+  bool changed = false;
+  for (Instruction &instruction : list_.code) {
+    if (!instruction.removed && instruction.opcode == Opcode::NoOP) {
+      instruction.removed = true;
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+bool Peephole::threadJumps() {
+  bool changed = false;
+  std::vector<Instruction> &code = list_.code;
+  int end = (int)code.size() - 1;
+  for (int i = 0; i < end; i++) {
+    Instruction &branch = code[i];
+    if (branch.removed || !branch.isBranch()) {
+      continue;
+    }
+    // follow chains of unconditional branches, stopping on cycles;
+    int target = resolve(branch.target);
+    for (int hops = 0; hops < end && target < end &&
+                       code[target].opcode == Opcode::Branch && target != i;
+         hops++) {
+      int further = resolve(code[target].target);
+      if (further == target) {
+        break;
+      }
+      branch.target = code[further].id;
+      target = further;
+      changed = true;
+    }
+    if (target == next(i)) {
+      if (branch.opcode == Opcode::Branch) {
+        branch.removed = true;
+        changed = true;
+      } else if (branch.pops() == 1) {
+        // a conditional branch to the next instruction only pops; a fused
+        // compare-and-branch pops two and stays;
+        branch.opcode = Opcode::Pop;
+        branch.target = -1;
+        changed = true;
+      }
+    }
+  }
+  return changed;
+}
+
+// `BranchTrue over; Branch target; over:` -> `BranchFalse target; over:`,
+// and likewise for the fused compare-and-branch forms;
+bool Peephole::invertBranches() {
+  bool changed = false;
+  std::vector<Instruction> &code = list_.code;
+  int end = (int)code.size() - 1;
+  // a retargeted branch adds its new target; the old one may stay in the
+  // set, which only passes up a rewrite;
+  std::unordered_set<int> targets = list_.targets();
+  for (int i = 0; i < end; i++) {
+    Instruction &branch = code[i];
+    Opcode inverted = invertedBranch(branch.opcode);
+    if (branch.removed || inverted == Opcode::NoOP) {
+      continue;
+    }
+    int j = next(i);
+    if (j >= end || code[j].opcode != Opcode::Branch ||
+        resolve(branch.target) != next(j) || targets.count(code[j].id)) {
+      continue;
+    }
+    branch.opcode = inverted;
+    branch.target = code[j].target;
+    targets.insert(branch.target);
+    code[j].removed = true;
+    changed = true;
+  }
+  return changed;
+}
+
+bool Peephole::forward() {
+  bool changed = false;
+  std::vector<Instruction> &code = list_.code;
+  int end = (int)code.size() - 1;
+  // no rewrite below adds or retargets a branch, so collect targets once;
+  std::unordered_set<int> targets = list_.targets();
+  for (int i = 0; i < end; i++) {
+    Instruction &first = code[i];
+    if (first.removed) {
+      continue;
+    }
+    int j = next(i);
+    if (j >= end || targets.count(code[j].id)) {
+      continue;
+    }
+    Instruction &second = code[j];
+
+    // a value loaded only to be discarded;
+    if (isPureLoad(first.opcode) && second.opcode == Opcode::Pop) {
+      first.removed = true;
+      second.removed = true;
+      changed = true;
+      continue;
+    }
+
+    // Duplicate; Store s; Pop -> Store s;
+    if (first.opcode == Opcode::Duplicate && isStore(second.opcode)) {
+      int k = next(j);
+      if (k < end && code[k].opcode == Opcode::Pop &&
+          !targets.count(code[k].id)) {
+        first.removed = true;
+        code[k].removed = true;
+        changed = true;
+        continue;
+      }
+    }
+
+    // Store s; LoadLocal s -> Duplicate; Store s;
+    if (isStore(first.opcode) && isLoadLocal(second.opcode) &&
+        first.operands[0] == second.operands[0]) {
+      second.opcode = first.opcode;
+      first.opcode = Opcode::Duplicate;
+      first.operands[0] = 0;
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+bool Peephole::removeDeadCode() {
+  std::vector<Instruction> &code = list_.code;
+  int end = (int)code.size() - 1;
+  std::vector<bool> reached(code.size(), false);
+  std::vector<int> worklist = {next(-1)};
+  while (!worklist.empty()) {
+    int i = worklist.back();
+    worklist.pop_back();
+    if (i >= end || reached[i]) {
+      continue;
+    }
+    reached[i] = true;
+    const Instruction &instruction = code[i];
+    if (instruction.isBranch()) {
+      worklist.push_back(resolve(instruction.target));
+    }
+    if (instruction.opcode != Opcode::Branch &&
+        instruction.opcode != Opcode::Return) {
+      worklist.push_back(next(i));
+    }
+  }
+
+  bool changed = false;
+  for (int i = 0; i < end; i++) {
+    if (!code[i].removed && !reached[i]) {
+      code[i].removed = true;
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+} // namespace kestrel
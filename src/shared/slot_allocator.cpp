@@ -0,0 +1,170 @@
+#include "slot_allocator.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace kestrel {
+
+static bool isStore(Opcode code) {
+  return code == Opcode::Store || code == Opcode::StoreInt ||
+         code == Opcode::StoreDouble || code == Opcode::StoreBoolean;
+}
+
+static bool isLoadLocal(Opcode code) {
+  return code == Opcode::LoadLocal || code == Opcode::LoadLocalInt ||
+         code == Opcode::LoadLocalDouble;
+}
+
+int SlotAllocator::run(InstructionArray &instructions) {
+  InstructionList list = InstructionList::decode(instructions);
+  std::vector<Instruction> &code = list.code;
+  int size = (int)code.size(); // includes the end marker;
+
+  int slots = pinned_;
+  std::vector<int> order; // slots by first appearance;
+  std::vector<bool> seen;
+  for (const Instruction &instruction : code) {
+    if (instruction.removed) {
+      continue;
+    }
+    if (isStore(instruction.opcode) || isLoadLocal(instruction.opcode)) {
+      int slot = instruction.operands[0];
+      slots = std::max(slots, slot + 1);
+      if (slot >= (int)seen.size()) {
+        seen.resize(slot + 1, false);
+      }
+      if (!seen[slot]) {
+        seen[slot] = true;
+        order.push_back(slot);
+      }
+    }
+  }
+
+  std::unordered_map<int, int> indices = list.indices();
+  std::vector<std::vector<int>> successors(size);
+  for (int i = 0; i < size; i++) {
+    const Instruction &instruction = code[i];
+    if (instruction.removed) {
+      continue;
+    }
+    if (instruction.isBranch()) {
+      auto target = indices.find(instruction.target);
+      if (target != indices.end()) {
+        successors[i].push_back(target->second);
+      }
+    }
+    if (instruction.opcode != Opcode::Branch &&
+        instruction.opcode != Opcode::Return && i + 1 < size) {
+      successors[i].push_back(i + 1);
+    }
+  }
+
+  // too big to analyze cheaply, keep the compiler's numbering;
+  if ((long long)size * slots > kMaxCells) {
+    return slots;
+  }
+
+  // live[i]: slots live on entry to instruction i, one bit per slot;
+  int words = (slots + 63) / 64;
+  std::vector<std::vector<uint64_t>> live(size,
+                                          std::vector<uint64_t>(words, 0));
+  auto liveOut = [&](int i) {
+    std::vector<uint64_t> out(words, 0);
+    for (int successor : successors[i]) {
+      for (int w = 0; w < words; w++) {
+        out[w] |= live[successor][w];
+      }
+    }
+    return out;
+  };
+  auto test = [](const std::vector<uint64_t> &bits, int slot) {
+    return (bits[slot / 64] >> (slot % 64)) & 1;
+  };
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int i = size - 1; i >= 0; i--) {
+      const Instruction &instruction = code[i];
+      if (instruction.removed) {
+        continue;
+      }
+      std::vector<uint64_t> in = liveOut(i);
+      int slot = instruction.operands[0];
+      if (isStore(instruction.opcode)) {
+        in[slot / 64] &= ~(1ull << (slot % 64));
+      } else if (isLoadLocal(instruction.opcode)) {
+        in[slot / 64] |= 1ull << (slot % 64);
+      }
+      if (in != live[i]) {
+        live[i] = std::move(in);
+        changed = true;
+      }
+    }
+  }
+
+  std::vector<std::vector<bool>> interferes(slots,
+                                            std::vector<bool>(slots, false));
+  for (int i = 0; i < size; i++) {
+    const Instruction &instruction = code[i];
+    if (instruction.removed || !isStore(instruction.opcode)) {
+      continue;
+    }
+    int slot = instruction.operands[0];
+    std::vector<uint64_t> out = liveOut(i);
+    for (int s = 0; s < slots; s++) {
+      if (test(out, s) && s != slot) {
+        interferes[slot][s] = interferes[s][slot] = true;
+      }
+    }
+  }
+
+  // pinned slots keep their number and are live wherever anything is;
+  std::vector<bool> pinned(slots, false);
+  for (int s = 0; s < slots; s++) {
+    pinned[s] = s < pinned_ || test(live[0], s);
+  }
+  std::vector<int> color(slots, -1);
+  for (int s = 0; s < slots; s++) {
+    if (pinned[s]) {
+      color[s] = s;
+    }
+  }
+  int frame = pinned_;
+  for (int s = 0; s < slots; s++) {
+    if (pinned[s]) {
+      frame = std::max(frame, s + 1);
+    }
+  }
+  for (int slot : order) {
+    if (color[slot] >= 0) {
+      continue;
+    }
+    // a slot read before written relies on starting out nil, keep it alone;
+    std::vector<bool> taken(slots, false);
+    for (int s = 0; s < slots; s++) {
+      bool blocked = interferes[slot][s] || (pinned[s] && s >= pinned_);
+      if (color[s] >= 0 && blocked) {
+        taken[color[s]] = true;
+      }
+    }
+    int c = 0;
+    while (taken[c]) {
+      c++;
+    }
+    color[slot] = c;
+    frame = std::max(frame, c + 1);
+  }
+
+  for (Instruction &instruction : code) {
+    if (!instruction.removed && (isStore(instruction.opcode) ||
+                                 isLoadLocal(instruction.opcode))) {
+      instruction.operands[0] = color[instruction.operands[0]];
+    }
+  }
+  instructions = list.encode();
+  return frame;
+}
+
+} // namespace kestrel
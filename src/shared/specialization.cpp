@@ -0,0 +1,88 @@
+#include "specialization.hpp"
+
+#include <iomanip>
+#include <sstream>
+
+#include "feedback.hpp"
+#include "function.hpp"
+
+namespace kestrel {
+
+std::vector<ValueType> signatureTypes(TypeSignature signature) {
+  std::vector<ValueType> types;
+  int arity = signature >> 28;
+  for (int i = 0; i < arity; i++) {
+    types.push_back(static_cast<ValueType>((signature >> (4 * i)) & 0xf));
+  }
+  return types;
+}
+
+std::string signatureToString(const std::string &name,
+                              TypeSignature signature) {
+  std::string result = name + "(";
+  std::vector<ValueType> types = signatureTypes(signature);
+  for (size_t i = 0; i < types.size(); i++) {
+    if (i > 0) {
+      result += ",";
+    }
+    result += typeSetToString(typeBit(types[i]));
+  }
+  return result + ")";
+}
+
+bool SpecializationTable::shouldSpecialize(TypeSignature signature) {
+  if (signature == kNoSignature || clones_.size() >= (size_t)kMaxClones) {
+    return false;
+  }
+  for (auto &count : counts_) {
+    if (count.first == signature) {
+      return ++count.second == kHotCalls;
+    }
+  }
+  counts_.push_back({signature, 1});
+  return kHotCalls == 1;
+}
+
+void SpecializationTable::add(TypeSignature signature,
+                              std::shared_ptr<Function> function) {
+  Specialization s;
+  s.signature = signature;
+  s.function = std::move(function);
+  clones_.push_back(std::move(s));
+  lastSignature_ = kNoSignature;
+}
+
+void SpecializationTable::clear() {
+  clones_.clear();
+  lastSignature_ = kNoSignature;
+  counts_.clear();
+}
+
+uint64_t SpecializationTable::specializedCalls() const {
+  uint64_t total = 0;
+  for (const Specialization &s : clones_) {
+    total += s.hits;
+  }
+  return total;
+}
+
+double SpecializationTable::hitRate() const {
+  uint64_t hits = specializedCalls();
+  uint64_t total = hits + generic_;
+  return total == 0 ? 0.0 : (double)hits / (double)total;
+}
+
+std::string SpecializationTable::report(const std::string &name) const {
+  std::ostringstream oss;
+  oss << name << ": clones " << clones_.size() << "/" << kMaxClones
+      << ", specialized " << specializedCalls() << ", generic " << generic_
+      << ", hit rate " << std::fixed << std::setprecision(1)
+      << hitRate() * 100 << "%";
+  for (const Specialization &s : clones_) {
+    oss << "\n  " << signatureToString(name, s.signature) << " hits "
+        << s.hits;
+  }
+  return oss.str();
+}
+
+} // namespace kestrel
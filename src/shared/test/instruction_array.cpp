@@ -2,6 +2,105 @@
 #include <cassert>
 
 #include "instruction_array.hpp"
+#include "instruction_list.hpp"
+#include "opcodes.hpp"
+
+using kestrel::Opcode;
+
+static int failures = 0;
+
+// Release builds compile the asserts out, these run in any build.
+static void check(bool ok, const char* what) {
+    if (!ok) {
+        std::cout << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+// Emits `opcode` the way the compiler does, every operand 32 bits wide.
+static int emit(kestrel::InstructionArray& code, Opcode opcode, int a = 0,
+                int b = 0) {
+    int count = kestrel::operandCount(opcode);
+    if (count > 0) {
+        code.appendByte(static_cast<uint8_t>(Opcode::ExtraWide));
+    }
+    code.appendByte(static_cast<uint8_t>(opcode));
+    int at = (int) code.size();
+    if (count > 0) {
+        code.appendInt(a);
+    }
+    if (count > 1) {
+        code.appendInt(b);
+    }
+    return at;
+}
+
+// Compacts wide code and checks every operand and branch target survives.
+static void checkEncoding() {
+    kestrel::InstructionArray wide;
+    emit(wide, Opcode::LoadLocal, 2);
+    emit(wide, Opcode::LoadInteger, 100000);
+    emit(wide, Opcode::LoadInteger, -128);
+    emit(wide, Opcode::LoadConstant, 300);
+    emit(wide, Opcode::Dispatch, 5, 2);
+    int exit = emit(wide, Opcode::BranchFalse);
+    // a body no 16-bit offset reaches;
+    int bodyStart = (int) wide.size();
+    for (int i = 0; i < 20000; i++) {
+        emit(wide, Opcode::LoadLocal, 7);
+        emit(wide, Opcode::Pop);
+    }
+    int back = emit(wide, Opcode::Branch);
+    wide.writeInt(-(back + 4), back);
+    wide.writeInt((int) wide.size() - bodyStart, exit);
+    emit(wide, Opcode::Return);
+
+    kestrel::InstructionArray compact =
+        kestrel::InstructionList::decode(wide).encode();
+    check(compact.size() < wide.size() / 2, "compact size");
+    kestrel::BytecodeView view = compact.view();
+    check(view.readByte(0) == (uint8_t) Opcode::LoadLocal2, "short form");
+
+    kestrel::InstructionList before = kestrel::InstructionList::decode(wide);
+    kestrel::InstructionList after = kestrel::InstructionList::decode(compact);
+    check(before.code.size() == after.code.size(), "instruction count");
+    for (size_t i = 0; i < before.code.size() && i < after.code.size(); i++) {
+        const kestrel::Instruction& x = before.code[i];
+        const kestrel::Instruction& y = after.code[i];
+        bool same = x.opcode == y.opcode && x.target == y.target &&
+                    (x.isBranch() || (x.operands[0] == y.operands[0] &&
+                                      x.operands[1] == y.operands[1]));
+        check(same, "round trip");
+    }
+
+    // widths: 100000 and the long branches need 32 bits, 300 needs 16;
+    int pc = 0;
+    int widths[4] = {0, 0, 0, 0};
+    while (pc < (int) view.size()) {
+        kestrel::DecodedInstruction decoded = kestrel::decodeAt(view, pc);
+        widths[decoded.width - 1]++;
+        if (decoded.opcode == Opcode::LoadInteger) {
+            check(decoded.operands[0] == 100000 ? decoded.width == 4
+                                                 : decoded.width == 1,
+                  "literal width");
+        }
+        if (decoded.opcode == Opcode::LoadConstant) {
+            check(decoded.width == 2 && decoded.operands[0] == 300,
+                  "constant width");
+        }
+        if (decoded.opcode == Opcode::Branch) {
+            check(pc + decoded.length + decoded.operands[0] == 0,
+                  "backward branch");
+        }
+        if (decoded.opcode == Opcode::BranchFalse) {
+            int target = pc + decoded.length + decoded.operands[0];
+            check(target == (int) view.size() - 1, "forward branch");
+        }
+        pc += decoded.length;
+    }
+    check(pc == (int) view.size(), "decode reaches the end");
+    check(widths[3] == 3 && widths[1] == 1, "prefixed instructions");
+}
 
 int main(int argc, char** argv) {
     kestrel::InstructionArray arr;
@@ -15,4 +114,18 @@ int main(int argc, char** argv) {
     assert(arr.readByte(0) == 0x12);
     assert(arr.readShort(1)== 0x3456);
     assert(arr.readInt(3) == 0x78CDEF);
-}
\ No newline at end of file
+
+    // Borrowed bytes are read in place and copied on the first write
+    const uint8_t code[] = {1, 2, 3};
+    kestrel::InstructionArray borrowed(code, sizeof(code), nullptr);
+    kestrel::InstructionArray copy = borrowed;
+    assert(copy.borrowed() && copy.view().data() == code);
+    copy.writeByte(9, 0);
+    assert(!copy.borrowed() && copy.readByte(0) == 9 && copy.size() == 3);
+    assert(code[0] == 1 && borrowed.readByte(0) == 1);
+    borrowed.appendByte(4);
+    assert(!borrowed.borrowed() && borrowed.size() == 4);
+
+    checkEncoding();
+    return failures == 0 ? 0 : 1;
+}
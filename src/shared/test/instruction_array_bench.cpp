@@ -0,0 +1,50 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "instruction_array.hpp"
+
+// Decodes a synthetic stream of one-operand instructions repeatedly, once
+// through the out-of-line InstructionArray accessors and once through a
+// BytecodeView, and prints the time per instruction for each.
+
+using Clock = std::chrono::steady_clock;
+
+template <typename Reader>
+static double run(const Reader& reader, size_t size, int rounds,
+                  int64_t& checksum) {
+  auto start = Clock::now();
+  for (int round = 0; round < rounds; round++) {
+    size_t pc = 0;
+    while (pc < size) {
+      checksum += reader.readByte(pc++);
+      checksum += reader.readShort(pc);
+      pc += 2;
+    }
+  }
+  std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+  return elapsed.count() / (double(rounds) * (size / 3));
+}
+
+int main(int argc, char** argv) {
+  int instructions = argc > 1 ? std::atoi(argv[1]) : 1 << 16;
+  int rounds = argc > 2 ? std::atoi(argv[2]) : 200;
+
+  auto start = Clock::now();
+  kestrel::InstructionArray arr;
+  for (int i = 0; i < instructions; i++) {
+    arr.writeByte(static_cast<uint8_t>(i % 40), arr.size());
+    arr.writeShort(static_cast<int16_t>(i), arr.size());
+  }
+  std::chrono::duration<double, std::milli> encode = Clock::now() - start;
+
+  int64_t checksum = 0;
+  double array = run(arr, arr.size(), rounds, checksum);
+  double view = run(arr.view(), arr.size(), rounds, checksum);
+
+  std::printf("encode  %8.3f ms for %d instructions\n", encode.count(),
+              instructions);
+  std::printf("array   %8.3f ns/instruction\n", array);
+  std::printf("view    %8.3f ns/instruction\n", view);
+  std::printf("checksum %lld\n", (long long)checksum);
+}
@@ -17,6 +17,7 @@ public:
     int intValue;
     double doubleValue;
     Class* classPointer;
+    Module* modulePointer;
   };
   // TODO use a pointer?
 
@@ -83,6 +84,11 @@ Value::Value(Object* self) : detail(std::make_shared<Detail>()) {
   detail->type = ValueType::Object;
 }
 
+Value::Value(Module* module) : detail(std::make_shared<Detail>()) {
+  detail->holder_.modulePointer = module;
+  detail->type = ValueType::Module;
+}
+
 Value::~Value() = default;
 
 bool Value::isNumber() const {
@@ -158,6 +164,20 @@ std::shared_ptr<Function> &Value::functionValue() const {
   }
 }
 
+Object *Value::objectValue() const {
+  if (detail->type == ValueType::Object) {
+    return detail->holder_.object;
+  }
+  return nullptr;
+}
+
+Module *Value::moduleValue() const {
+  if (detail->type == ValueType::Module) {
+    return detail->holder_.modulePointer;
+  }
+  return nullptr;
+}
+
 void Value::set(bool value) {
   detail->type = ValueType::Boolean;
   detail->holder_.booleanValue = value;
@@ -227,6 +247,9 @@ std::string Value::toString() const {
   case ValueType::Function:
     oss << "<function>";
     break;
+  case ValueType::Module:
+    oss << "<module>";
+    break;
   default:
     oss << "<undefined>";
     break;
@@ -271,11 +294,50 @@ bool Value::operator==(const Value &other) const {
   case ValueType::Function:
     return detail->holder_.functionPointer ==
            other.detail->holder_.functionPointer;
+  case ValueType::Module:
+    return detail->holder_.modulePointer == other.detail->holder_.modulePointer;
   default:
     return true;
   }
 }
 
+void Value::borrowFunction() {
+  std::shared_ptr<Function> &function = detail->holder_.functionPointer;
+  // an aliasing pointer without a control block, copies of it count nothing;
+  function = std::shared_ptr<Function>(std::shared_ptr<Function>(),
+                                       function.get());
+}
+
+bool Value::borrowsFunction() const {
+  const std::shared_ptr<Function> &function = detail->holder_.functionPointer;
+  // an owning pointer always has a control block, a borrowed one none;
+  return detail->type == ValueType::Function && function != nullptr &&
+         function.use_count() == 0;
+}
+
+size_t Value::hash() const {
+  size_t seed = static_cast<size_t>(detail->type) * 0x9e3779b97f4a7c15ull;
+  switch (detail->type) {
+  case ValueType::Boolean:
+    return seed ^ std::hash<bool>()(detail->holder_.booleanValue);
+  case ValueType::Integer:
+    return seed ^ std::hash<int>()(detail->holder_.intValue);
+  case ValueType::Double: {
+    // 0.0 == -0.0, so both must land in the same bucket;
+    double d = detail->holder_.doubleValue;
+    return seed ^ std::hash<double>()(d == 0.0 ? 0.0 : d);
+  }
+  case ValueType::String:
+    return seed ^ std::hash<std::string>()(detail->holder_.stringValue);
+  case ValueType::Function:
+    return seed ^ std::hash<Function *>()(detail->holder_.functionPointer.get());
+  case ValueType::Module:
+    return seed ^ std::hash<Module *>()(detail->holder_.modulePointer);
+  default:
+    return seed;
+  }
+}
+
 std::ostream &operator<<(std::ostream &os, const Value &value) {
   switch (value.type()) {
   case ValueType::Boolean:
@@ -293,6 +355,9 @@ std::ostream &operator<<(std::ostream &os, const Value &value) {
   case ValueType::Function:
     os << "<function>" << value.functionValue()->name();
     break;
+  case ValueType::Module:
+    os << "<module>";
+    break;
   case ValueType::Class:  {
     os << "Class"; 
     break;
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "compile/parser.hpp"
+#include "compile/scanner.hpp"
+#include "compiler.hpp"
+
+// Scaffolding the benches share: a millisecond clock, compiling a source
+// in one call and the synthetic function library most of them load.
+
+namespace kestrel {
+
+using Clock = std::chrono::steady_clock;
+
+inline double millis(Clock::time_point since) {
+  std::chrono::duration<double, std::milli> elapsed = Clock::now() - since;
+  return elapsed.count();
+}
+
+// Scans, parses and compiles `source` with the settings of `compiler`,
+// deferring function bodies to their first call if `lazy`.
+inline Module compileSource(const std::string &source, Compiler &compiler,
+                            bool lazy = false) {
+  Scanner scanner(source);
+  std::vector<Token> tokens = scanner.scanTokens();
+  Arena arena;
+  Parser parser(tokens, arena);
+  parser.setLazyFunctions(lazy);
+  auto statements = parser.parse();
+  return compiler.compile(statements, arena);
+}
+
+inline Module compileSource(const std::string &source) {
+  Compiler compiler;
+  return compileSource(source, compiler);
+}
+
+// Appends functions f<first> .. f<first + count - 1> of one argument `a`,
+// each adding `statements` terms `a * (f + s) - minus` to a running total
+// and returning it; `minus` is an expression of the script, the term's
+// index s if empty.
+inline void writeFunctions(std::ostream &out, int first, int count,
+                           int statements, const std::string &minus = "") {
+  for (int f = first; f < first + count; f++) {
+    out << "def f" << f << "(a) {\n  let total = a;\n";
+    for (int s = 0; s < statements; s++) {
+      out << "  total = total + a * " << f + s << " - ";
+      if (minus.empty()) {
+        out << s;
+      } else {
+        out << minus;
+      }
+      out << ";\n";
+    }
+    out << "  return total;\n}\n";
+  }
+}
+
+} // namespace kestrel
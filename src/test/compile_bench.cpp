@@ -0,0 +1,84 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <sys/resource.h>
+
+#include "bench.hpp"
+#include "compile/parser.hpp"
+#include "compile/scanner.hpp"
+#include "compiler.hpp"
+
+// Compiles a synthetic script of `literals` assignments whose right hand
+// sides cycle through `distinct` integer, double and string constants and
+// whose targets cycle through as many global names, then prints the time of
+// each phase, the size of the resulting pools, the memory the tree took and
+// the peak resident size of the process.
+
+using namespace kestrel;
+int main(int argc, char **argv) {
+  int literals = argc > 1 ? std::atoi(argv[1]) : 100000;
+  int distinct = argc > 2 ? std::atoi(argv[2]) : 8000;
+  int level = argc > 3 ? std::atoi(argv[3]) : 0;
+
+  std::ostringstream script;
+  for (int i = 0; i < literals; i++) {
+    int k = i % distinct;
+    script << "g" << k << " = ";
+    switch (i % 3) {
+    case 0:
+      script << k;
+      break;
+    case 1:
+      script << k << ".5";
+      break;
+    default:
+      script << "\"s" << k << "\"";
+      break;
+    }
+    script << ";\n";
+  }
+  std::string source = script.str();
+
+  static Writer quiet = [](std::string &) {};
+  setWriter(quiet);
+
+  auto start = Clock::now();
+  Scanner scanner(source);
+  std::vector<Token> tokens = scanner.scanTokens();
+  double scan = millis(start);
+
+  start = Clock::now();
+  Arena arena;
+  Parser parser(tokens, arena);
+  auto statements = parser.parse();
+  double parse = millis(start);
+
+  // the compiler echoes every statement it compiles;
+  std::ostringstream sink;
+  std::streambuf *out = std::cout.rdbuf(sink.rdbuf());
+  start = Clock::now();
+  Compiler compiler;
+  compiler.setOptimizationLevel(level);
+  Module module_ = compiler.compile(statements, arena);
+  double compile = millis(start);
+  std::cout.rdbuf(out);
+  size_t treeBytes = arena.reserved();
+  statements.clear();
+  arena.clear();
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  std::printf("source    %8zu bytes, %d literals, -O%d\n", source.size(),
+              literals, level);
+  std::printf("scan      %8.3f ms\n", scan);
+  std::printf("parse     %8.3f ms\n", parse);
+  std::printf("compile   %8.3f ms\n", compile);
+  std::printf("constants %8zu\n", module_.constants.size());
+  std::printf("names     %8zu\n", module_.names.size());
+  std::printf("tree      %8.2f MB\n", treeBytes / (1024.0 * 1024));
+  std::printf("peak rss  %8.2f MB\n", usage.ru_maxrss / 1024.0);
+}
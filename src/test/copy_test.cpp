@@ -0,0 +1,125 @@
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include "bench.hpp"
+#include "code_unit.hpp"
+#include "compile/parser.hpp"
+#include "compile/scanner.hpp"
+#include "compiler.hpp"
+#include "image.hpp"
+#include "runtime/runtime.hpp"
+#include "testing.hpp"
+
+// Counts the bytecode bytes copied from one InstructionArray into another
+// while compiling a script at every optimization level, eagerly, in
+// parallel and lazily, and into a running module, and while loading it
+// from an in-memory image, a mapped image, a shared code unit and an
+// import. Each code buffer is built once and moved or borrowed from there,
+// so all of them must copy nothing; compiled into a running module, the
+// module's tables are not copied either.
+//
+//   copy_test [directory]
+
+using namespace kestrel;
+
+static const char *source = "base = 3;\n"
+                            "def square(a) { return a * a; }\n"
+                            "def f(a) {\n"
+                            "  let total = 0;\n"
+                            "  let i = 0;\n"
+                            "  while (i < a) {\n"
+                            "    total = total + square(i) - base;\n"
+                            "    i = i + 1;\n"
+                            "  }\n"
+                            "  return total;\n"
+                            "}\n"
+                            "def g(a) { return f(a) + f(a + 1); }\n"
+                            "result = g(base);\n";
+
+static Module compileSource(const std::string &text, int level, int jobs,
+                            bool lazy) {
+  Compiler compiler;
+  compiler.setOptimizationLevel(level);
+  compiler.setJobs(jobs);
+  Module module = compileSource(text, compiler, lazy);
+  for (auto &global : module.globals_) {
+    if (global.second.type() == ValueType::Function) {
+      global.second.functionValue()->compile(module);
+    }
+  }
+  return module;
+}
+
+// Runs `step` and reports the bytes it copied.
+template <typename Step> static void count(const std::string &name, Step step) {
+  size_t before = InstructionArray::copiedBytes();
+  step();
+  size_t copied = InstructionArray::copiedBytes() - before;
+  std::printf("%-24s %6zu bytes copied\n", name.c_str(), copied);
+  if (copied != 0) {
+    failures()++;
+  }
+}
+
+int main(int argc, char **argv) {
+  std::string directory = argc > 1 ? argv[1] : "/tmp";
+
+  Quiet quiet;
+
+  for (int level = 0; level <= 2; level++) {
+    std::string suffix = " -O" + std::to_string(level);
+    count("compile" + suffix, [&] { compileSource(source, level, 1, false); });
+    count("compile -j2" + suffix,
+          [&] { compileSource(source, level, 2, false); });
+    count("compile lazily" + suffix,
+          [&] { compileSource(source, level, 1, true); });
+  }
+
+  Module running = compileSource(source, 1, 1, false);
+  count("compile into a module", [&] {
+    Compiler compiler;
+    compiler.setModule(running);
+    Module request = compileSource("result = g(base) + 1;\n", compiler);
+    if (request.constantCount() != 0 || request.nameCount() != 0 ||
+        !request.globals_.empty()) {
+      failures()++;
+    }
+  });
+
+  // the count sees a copy when there is one;
+  Module compiled = compileSource(source, 1, 1, false);
+  size_t before = InstructionArray::copiedBytes();
+  InstructionArray copy = compiled.initializer_.instructions();
+  if (InstructionArray::copiedBytes() - before != copy.size()) {
+    failures()++;
+  }
+
+  Image built = Image::build(compiled, 1, 1);
+  count("load built image", [&] { built.load(); });
+
+  std::string path = directory + "/copy_test.ksimage";
+  Image::write(compiled, 1, 1, path);
+  Image mapped = Image::map(path);
+  count("load mapped image", [&] { mapped.load(); });
+
+  std::shared_ptr<const CodeUnit> unit =
+      CodeUnit::build(compileSource(source, 1, 1, false));
+  count("instantiate unit", [&] { unit->instantiate().materialize(); });
+
+  std::ofstream(directory + "/copy_test.ks") << source;
+  count("import", [&] {
+    Runtime runtime;
+    runtime.modules().addSearchPath(directory);
+    runtime.modules().setCompiler(
+        [](const std::string &text) {
+          return compileSource(text, 1, 1, false);
+        },
+        1);
+    runtime.modules().prepare(*runtime.modules().import("copy_test"));
+  });
+  std::remove((directory + "/copy_test.ks").c_str());
+  std::remove(path.c_str());
+
+  return verdict("COPIED");
+}
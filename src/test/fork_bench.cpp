@@ -0,0 +1,157 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench.hpp"
+#include "compile/parser.hpp"
+#include "compile/scanner.hpp"
+#include "compiler.hpp"
+#include "heap.hpp"
+#include "runtime/runtime.hpp"
+#include "testing.hpp"
+
+// Prefork server model: the parent runs an initializer that builds a table
+// of `entries` records, optionally freezes the heap, then forks `workers`
+// that each serve `requests` requests walking the table, collecting after
+// each one. Every worker then reports how much of its memory is still
+// shared with the others and how much it had to copy.
+//
+//   fork_bench [entries] [workers] [requests] [frozen]
+
+using namespace kestrel;
+
+// Kilobytes of this process shared with another process, and private to it.
+static void residency(long &shared, long &priv) {
+  std::ifstream rollup("/proc/self/smaps_rollup");
+  std::string line;
+  shared = priv = 0;
+  while (std::getline(rollup, line)) {
+    long kb = 0;
+    if (std::sscanf(line.c_str(), "Shared_Clean: %ld kB", &kb) == 1 ||
+        std::sscanf(line.c_str(), "Shared_Dirty: %ld kB", &kb) == 1) {
+      shared += kb;
+    } else if (std::sscanf(line.c_str(), "Private_Clean: %ld kB", &kb) == 1 ||
+               std::sscanf(line.c_str(), "Private_Dirty: %ld kB", &kb) == 1) {
+      priv += kb;
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  int entries = argc > 1 ? std::atoi(argv[1]) : 20000;
+  int workers = argc > 2 ? std::atoi(argv[2]) : 4;
+  int requests = argc > 3 ? std::atoi(argv[3]) : 20;
+  bool frozen = argc > 4 ? std::atoi(argv[4]) != 0 : true;
+
+  std::ostringstream script;
+  script << "def build(n) {\n"
+            "  let head = Record();\n"
+            "  head.value = 0;\n"
+            "  let i = 1;\n"
+            "  while (i < n) {\n"
+            "    let node = Record();\n"
+            "    node.value = i;\n"
+            "    node.name = \"entry\";\n"
+            "    node.next = head;\n"
+            "    head = node;\n"
+            "    i = i + 1;\n"
+            "  }\n"
+            "  return head;\n"
+            "}\n"
+            "def handle(k) {\n"
+            "  let node = table;\n"
+            "  let total = 0;\n"
+            "  let i = 1;\n"
+         << "  while (i < " << entries << ") {\n"
+         << "    total = total + node.value * k;\n"
+            "    node = node.next;\n"
+            "    i = i + 1;\n"
+            "  }\n"
+            "  let reply = Record();\n"
+            "  reply.value = total;\n"
+            "  return reply;\n"
+            "}\n"
+         << "table = build(" << entries << ");\n"
+         << "request = 0;\n"
+            "reply = nil;\n";
+
+  static Writer quiet = [](std::string &) {};
+  setWriter(quiet);
+  // the compiler and the interpreter trace to cout;
+  std::ostringstream sink;
+  std::streambuf *out = std::cout.rdbuf(sink.rdbuf());
+
+  Class *record = recordClass();
+
+  Runtime runtime;
+  Compiler compiler;
+  Module module_ = compileSource(script.str(), compiler);
+  module_.setGlobal("Record", Value(record));
+  runtime.run(module_, module_.initializer_);
+
+  // the code serving one request, compiled against the initialized module;
+  Compiler serving;
+  serving.setModule(module_);
+  Function serve = compileSource("reply = handle(request);\n", serving)
+                       .initializer_;
+  if (frozen) {
+    Heap::current().freeze(module_);
+    serve.freeze();
+  }
+  std::cout.rdbuf(out);
+
+  long shared, priv;
+  residency(shared, priv);
+  std::printf("entries   %8d, %s heap\n", entries,
+              frozen ? "frozen" : "unfrozen");
+  std::printf("objects   %8zu in %zu blocks\n", Heap::current().liveObjects(),
+              Heap::current().blockCount());
+  std::printf("parent    %8ld kB\n", shared + priv);
+  std::fflush(stdout);
+
+  // each worker reports in on `ready` once it served its requests, then
+  // waits for `go` to close, so none of them exits before all measured;
+  int ready[2], go[2];
+  if (pipe(ready) != 0 || pipe(go) != 0) {
+    return 1;
+  }
+  for (int i = 0; i < workers; i++) {
+    if (fork() == 0) {
+      close(go[1]);
+      // drop the trace rather than buffer it, it would dwarf the heap;
+      std::cout.rdbuf(nullptr);
+      size_t freed = 0;
+      for (int r = 0; r < requests; r++) {
+        module_.setGlobal("request", Value(r));
+        runtime.run(module_, serve);
+        freed += Heap::current().collect(module_);
+      }
+      char c = 0;
+      if (write(ready[1], &c, 1) != 1 || read(go[0], &c, 1) != 0) {
+        _exit(1);
+      }
+      residency(shared, priv);
+      std::printf("worker %d  %d requests, freed %zu, shared %ld kB, "
+                  "private %ld kB\n",
+                  i, requests, freed, shared, priv);
+      std::fflush(stdout);
+      _exit(0);
+    }
+  }
+  for (int i = 0; i < workers; i++) {
+    char c;
+    if (read(ready[0], &c, 1) != 1) {
+      return 1;
+    }
+  }
+  close(go[1]);
+  for (int i = 0; i < workers; i++) {
+    wait(nullptr);
+  }
+}
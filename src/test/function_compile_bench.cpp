@@ -0,0 +1,117 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "bench.hpp"
+#include "compile/parser.hpp"
+#include "compile/scanner.hpp"
+#include "compiler.hpp"
+
+// Compiles a synthetic script of `functions` top-level functions, each a
+// loop over a few dozen statements with its own constants and globals, with
+// 1, 2 and 4 jobs. Prints the compile time of each and checks that the
+// bytecode, constants and names come out the same on every run with jobs.
+
+using namespace kestrel;
+
+static std::string generate(int functions, int statements) {
+  std::ostringstream script;
+  for (int f = 0; f < functions; f++) {
+    script << "def f" << f << "(a, b) {\n";
+    script << "  let i = 0;\n  let total = 0;\n";
+    script << "  while (i < a) {\n";
+    for (int s = 0; s < statements; s++) {
+      script << "    total = total + (i * " << (f * statements + s) % 997
+             << " + b) / " << s + 2 << ".5;\n";
+      if (s % 8 == 0) {
+        script << "    g" << (f + s) % 64 << " = \"f" << f << "s" << s
+               << "\";\n";
+      }
+    }
+    script << "    i = i + 1;\n  }\n  return total;\n}\n";
+  }
+  for (int f = 0; f < functions; f++) {
+    script << "r" << f << " = f" << f << "(3, " << f << ");\n";
+  }
+  return script.str();
+}
+
+// Bytecode of the module and of every function global, and both tables.
+static std::string fingerprint(Module &module) {
+  std::ostringstream out;
+  auto dump = [&](InstructionArray &code) {
+    for (size_t i = 0; i < code.size(); i++) {
+      out << (int)code.readByte(i) << ",";
+    }
+    out << "\n";
+  };
+  dump(module.initializer_.instructions());
+  for (auto &constant : module.constants) {
+    out << constant << ";";
+  }
+  out << "\n";
+  for (auto &name : module.names) {
+    out << name << ";";
+  }
+  out << "\n";
+  int functions = 0;
+  while (module.hasGlobal("f" + std::to_string(functions))) {
+    Value &f = module.getGlobal("f" + std::to_string(functions++));
+    dump(f.functionValue()->instructions());
+  }
+  return out.str();
+}
+
+static double compile(const std::string &source, int level, int jobs,
+                      std::string &print) {
+  Scanner scanner(source);
+  std::vector<Token> tokens = scanner.scanTokens();
+  Arena arena;
+  Parser parser(tokens, arena);
+  auto statements = parser.parse();
+
+  // the compiler echoes every statement it compiles;
+  std::ostringstream sink;
+  std::streambuf *out = std::cout.rdbuf(sink.rdbuf());
+  auto start = Clock::now();
+  Compiler compiler;
+  compiler.setOptimizationLevel(level);
+  compiler.setJobs(jobs);
+  Module module_ = compiler.compile(statements, arena);
+  double elapsed = millis(start);
+  std::cout.rdbuf(out);
+  print = fingerprint(module_);
+  return elapsed;
+}
+
+int main(int argc, char **argv) {
+  int functions = argc > 1 ? std::atoi(argv[1]) : 400;
+  int statements = argc > 2 ? std::atoi(argv[2]) : 40;
+  int level = argc > 3 ? std::atoi(argv[3]) : 1;
+
+  std::string source = generate(functions, statements);
+
+  static Writer quiet = [](std::string &) {};
+  setWriter(quiet);
+
+  std::printf("source    %8zu bytes, %d functions, -O%d\n", source.size(),
+              functions, level);
+  bool same = true;
+  std::string reference;
+  for (int jobs : {1, 2, 4}) {
+    std::string first, second;
+    double ms = compile(source, level, jobs, first);
+    compile(source, level, jobs, second);
+    if (first != second || (jobs > 2 && first != reference)) {
+      same = false;
+    }
+    if (jobs == 2) {
+      reference = first;
+    }
+    std::printf("jobs %d   %8.3f ms\n", jobs, ms);
+  }
+  std::printf("deterministic %s\n", same ? "yes" : "NO");
+  return same ? 0 : 1;
+}
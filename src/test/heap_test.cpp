@@ -0,0 +1,158 @@
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench.hpp"
+#include "heap.hpp"
+#include "runtime/runtime.hpp"
+#include "testing.hpp"
+
+// Collects the garbage of an initializer, freezes the heap and checks what
+// the freeze promises: lazy functions reachable from the module are
+// compiled and frozen, frozen objects are neither moved nor freed, values
+// of the module borrow their functions, and objects allocated afterwards
+// are collected as before. Modules the script imports are walked as well.
+//
+//   heap_test [directory]
+
+using namespace kestrel;
+
+static const char *source = "import store;\n"
+                            "def square(n) { return n * n; }\n"
+                            "def make(v) {\n"
+                            "  let r = Record();\n"
+                            "  r.value = v;\n"
+                            "  return r;\n"
+                            "}\n"
+                            "def churn(n) {\n"
+                            "  let i = 0;\n"
+                            "  while (i < n) {\n"
+                            "    let a = make(i);\n"
+                            "    let b = make(i);\n"
+                            "    a.next = b;\n"
+                            "    b.next = a;\n"
+                            "    i = i + 1;\n"
+                            "  }\n"
+                            "}\n"
+                            "def handle(k) {\n"
+                            "  return make(square(k) + table.value);\n"
+                            "}\n"
+                            "table = make(3);\n"
+                            "table.next = make(4);\n"
+                            "table.fn = square;\n"
+                            "churn(50);\n"
+                            "stored = store.kept.value;\n";
+
+// kept is only reachable through the import, lookup is never called;
+static const char *storeSource = "def make(v) {\n"
+                                 "  let r = Record();\n"
+                                 "  r.value = v;\n"
+                                 "  return r;\n"
+                                 "}\n"
+                                 "def lookup() { return kept.value; }\n"
+                                 "kept = make(7);\n";
+
+int main(int argc, char **argv) {
+  std::string parent = argc > 1 ? argv[1] : "/tmp";
+  std::string pattern = parent + "/heap_test.XXXXXX";
+  if (!mkdtemp(&pattern[0])) {
+    std::perror("heap_test");
+    return 1;
+  }
+  std::string directory = pattern;
+  std::string storePath = directory + "/store.ks";
+  std::ofstream(storePath) << storeSource;
+
+  Quiet quiet;
+
+  Class *record = recordClass();
+
+  Heap &heap = Heap::current();
+  Runtime runtime;
+  runtime.hosts().add("Record", Value(record));
+  runtime.modules().addSearchPath(directory);
+  runtime.modules().setCompiler(
+      [](const std::string &text) {
+        Compiler compiler;
+        return compileSource(text, compiler, true);
+      },
+      1);
+  Compiler compiler;
+  compiler.setOptimizationLevel(1);
+  Module module_ = compileSource(source, compiler, true);
+  module_.setGlobal("Record", Value(record));
+  runtime.run(module_, module_.initializer_);
+  Module &store = *module_.getGlobal("store").moduleValue();
+  Object *kept = store.getGlobal("kept").objectValue();
+
+  // churn left 50 unreachable pairs, each a cycle;
+  size_t live = heap.liveObjects();
+  size_t freed = heap.collect(module_);
+  check("cycles collected", freed == 100);
+  check("live count follows", heap.liveObjects() == live - freed);
+  Object *table = module_.getGlobal("table").objectValue();
+  check("reachable objects kept",
+        table->getAttribute("value") == Value(3) &&
+            table->getAttribute("next").objectValue()->getAttribute(
+                "value") == Value(4));
+  check("imported objects kept", module_.getGlobal("stored") == Value(7) &&
+                                     kept->getAttribute("value") == Value(7));
+
+  Function &handle = *module_.getGlobal("handle").functionValue();
+  check("handle lazy before freeze", !handle.isCompiled());
+  heap.freeze(module_);
+  check("lazy function compiled", handle.isCompiled());
+  Function &square = *module_.getGlobal("square").functionValue();
+  check("functions frozen", handle.frozen() && square.frozen());
+  check("objects frozen", heap.isFrozen(table));
+  Function &lookup = *store.getGlobal("lookup").functionValue();
+  check("imported functions frozen",
+        lookup.isCompiled() && lookup.frozen());
+  check("imported objects frozen", heap.isFrozen(kept));
+  check("globals borrow functions",
+        module_.getGlobal("square").borrowsFunction());
+  check("attributes borrow functions",
+        table->getAttribute("fn").borrowsFunction());
+
+  // requests allocate into new blocks and only the last reply is kept;
+  Compiler serving;
+  serving.setModule(module_);
+  Function serve =
+      compileSource("reply = handle(5);\n", serving).initializer_;
+  for (int i = 0; i < 10; i++) {
+    runtime.run(module_, serve);
+  }
+  Object *reply = module_.getGlobal("reply").objectValue();
+  check("frozen code runs", reply->getAttribute("value") == Value(28));
+  check("new objects not frozen", !heap.isFrozen(reply));
+  check("replies collected", heap.collect(module_) == 9);
+  check("last reply kept", reply->getAttribute("value") == Value(28));
+
+  // unreachable frozen objects stay, untouched;
+  live = heap.liveObjects();
+  module_.setGlobal("table", Value());
+  check("frozen objects never freed", heap.collect(module_) == 0 &&
+                                          heap.liveObjects() == live);
+  check("frozen objects untouched", table->getAttribute("value") == Value(3));
+
+  // a body that fails to compile fails the freeze;
+  Compiler lazily;
+  Module broken = compileSource("def bad() { let = 1; }\n", lazily, true);
+  Heap scratch;
+  bool raised = false;
+  try {
+    scratch.freeze(broken);
+  } catch (std::runtime_error &) {
+    raised = true;
+  }
+  check("compile error raised", raised);
+
+  std::remove(storePath.c_str());
+  rmdir(directory.c_str());
+
+  return verdict();
+}
@@ -0,0 +1,130 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench.hpp"
+#include "compile/parser.hpp"
+#include "compile/scanner.hpp"
+#include "compiler.hpp"
+#include "image.hpp"
+#include "runtime/runtime.hpp"
+
+// Compiles a synthetic script of `functions` functions, all called, writes
+// it as an image and compares compiling with loading the image. Then forks
+// `workers` processes that each map the image and run it, and prints how
+// much of the mapping each of them shares with the others.
+
+using namespace kestrel;
+// Kilobytes of the mapping of `path` resident in this process, and how many
+// of them are shared with another process.
+static void residency(const std::string &path, long &rss, long &shared) {
+  std::ifstream smaps("/proc/self/smaps");
+  std::string line;
+  bool inside = false;
+  rss = shared = 0;
+  while (std::getline(smaps, line)) {
+    if (line.find('-') < line.find(' ') && line.find(' ') != line.npos &&
+        std::isxdigit((unsigned char)line[0])) {
+      inside = line.size() >= path.size() &&
+               line.compare(line.size() - path.size(), path.size(), path) == 0;
+    } else if (inside) {
+      long kb = 0;
+      if (std::sscanf(line.c_str(), "Rss: %ld kB", &kb) == 1) {
+        rss += kb;
+      } else if (std::sscanf(line.c_str(), "Shared_Clean: %ld kB", &kb) == 1 ||
+                 std::sscanf(line.c_str(), "Shared_Dirty: %ld kB", &kb) == 1) {
+        // a freshly written file is still dirty in the page cache;
+        shared += kb;
+      }
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  int functions = argc > 1 ? std::atoi(argv[1]) : 1000;
+  int workers = argc > 2 ? std::atoi(argv[2]) : 4;
+  std::string path = argc > 3 ? argv[3] : "/tmp/image_bench.img";
+
+  std::ostringstream script;
+  writeFunctions(script, 0, functions, 30);
+  for (int f = 0; f < functions; f++) {
+    script << "r" << f << " = f" << f << "(" << f << ");\n";
+  }
+  std::string source = script.str();
+
+  static Writer quiet = [](std::string &) {};
+  setWriter(quiet);
+
+  // the compiler echoes every statement it compiles;
+  std::ostringstream sink;
+  std::streambuf *out = std::cout.rdbuf(sink.rdbuf());
+  auto start = Clock::now();
+  Scanner scanner(source);
+  std::vector<Token> tokens = scanner.scanTokens();
+  Arena arena;
+  Parser parser(tokens, arena);
+  auto statements = parser.parse();
+  Compiler compiler;
+  Module compiled = compiler.compile(statements, arena);
+  double compile = millis(start);
+  std::cout.rdbuf(out);
+
+  Image::write(compiled, Image::contentHash(source),
+               compiler.optimizationLevel(), path);
+
+  start = Clock::now();
+  Image image = Image::map(path);
+  Module loaded = image.load();
+  double load = millis(start);
+
+  std::printf("source    %8zu bytes, %d functions\n", source.size(),
+              functions);
+  std::printf("image     %8zu bytes\n", image.size());
+  std::printf("compile   %8.3f ms\n", compile);
+  std::printf("load      %8.3f ms\n", load);
+  std::fflush(stdout);
+
+  // each worker reports in on `ready` once it ran, then waits for `go` to
+  // close, so all of them have the image mapped when they measure;
+  int ready[2], go[2];
+  if (pipe(ready) != 0 || pipe(go) != 0) {
+    return 1;
+  }
+  for (int i = 0; i < workers; i++) {
+    if (fork() == 0) {
+      close(go[1]);
+      Image mapped = Image::map(path);
+      Module module_ = mapped.load();
+      std::cout.rdbuf(sink.rdbuf()); // the interpreter traces to cout;
+      Runtime runtime;
+      runtime.run(module_, module_.initializer_);
+      char c = 0;
+      if (write(ready[1], &c, 1) != 1 || read(go[0], &c, 1) != 0) {
+        _exit(1);
+      }
+      long rss, shared;
+      residency(path, rss, shared);
+      std::printf("worker %d  image rss %ld kB, shared %ld kB\n", i, rss,
+                  shared);
+      std::fflush(stdout);
+      _exit(0);
+    }
+  }
+  for (int i = 0; i < workers; i++) {
+    char c;
+    if (read(ready[0], &c, 1) != 1) {
+      return 1;
+    }
+  }
+  close(go[1]);
+  for (int i = 0; i < workers; i++) {
+    wait(nullptr);
+  }
+  std::remove(path.c_str());
+}
@@ -0,0 +1,167 @@
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench.hpp"
+#include "image.hpp"
+#include "runtime/runtime.hpp"
+#include "testing.hpp"
+
+// Writes a lazily compiled script as an image, maps it and checks the
+// loaded module computes what the compiled one does, that a mapping
+// outlives the file being replaced, that concurrent writers of one path
+// leave a well formed image and no temporary file behind, and that files
+// that are not images of this version are rejected.
+//
+//   image_test [directory]
+
+using namespace kestrel;
+
+static const char *source = "base = 3;\n"
+                            "def square(a) { return a * a; }\n"
+                            "def f(a) {\n"
+                            "  let total = 0;\n"
+                            "  let i = 0;\n"
+                            "  while (i < a) {\n"
+                            "    total = total + square(i) - base;\n"
+                            "    i = i + 1;\n"
+                            "  }\n"
+                            "  return total;\n"
+                            "}\n"
+                            "def unused(a) { return f(a) * 2; }\n"
+                            "name = \"image\";\n"
+                            "result = f(10);\n";
+
+// Runs the initializer of the image at `path` and returns `result`.
+static Value runImage(const std::string &path) {
+  Image image = Image::map(path);
+  Module module_ = image.load();
+  Runtime runtime;
+  runtime.run(module_, module_.initializer_);
+  return module_.getGlobal("result");
+}
+
+// Whether mapping `path` throws std::runtime_error.
+static bool rejects(const std::string &path) {
+  try {
+    Image::map(path);
+  } catch (std::runtime_error &) {
+    return true;
+  }
+  return false;
+}
+
+// Names of the files in `directory`.
+static std::vector<std::string> files(const std::string &directory) {
+  std::vector<std::string> names;
+  DIR *dir = opendir(directory.c_str());
+  while (dirent *entry = readdir(dir)) {
+    std::string name = entry->d_name;
+    if (name != "." && name != "..") {
+      names.push_back(name);
+    }
+  }
+  closedir(dir);
+  return names;
+}
+
+int main(int argc, char **argv) {
+  std::string parent = argc > 1 ? argv[1] : "/tmp";
+  std::string pattern = parent + "/image_test.XXXXXX";
+  if (!mkdtemp(&pattern[0])) {
+    std::perror("image_test");
+    return 1;
+  }
+  std::string directory = pattern;
+  std::string path = directory + "/script.img";
+  uint64_t sourceHash = Image::contentHash(source);
+
+  Quiet quiet;
+
+  Compiler compiler;
+  compiler.setOptimizationLevel(2);
+  Module compiled = compileSource(source, compiler, true);
+  Image::write(compiled, sourceHash, compiler.optimizationLevel(), path);
+
+  Compiler eager;
+  eager.setOptimizationLevel(2);
+  Module expected = compileSource(source, eager);
+  Runtime runtime;
+  runtime.run(expected, expected.initializer_);
+
+  Image image = Image::map(path);
+  check("source hash", image.sourceHash() == sourceHash);
+  check("optimization level", image.optimizationLevel() == 2);
+  Module loaded = image.load();
+  runtime.run(loaded, loaded.initializer_);
+  check("same result",
+        loaded.getGlobal("result") == expected.getGlobal("result"));
+  check("strings", loaded.getGlobal("name").type() == ValueType::String &&
+                       loaded.getGlobal("name").stringValue() == "image");
+  check("lazy functions stored",
+        loaded.getGlobal("unused").functionValue()->isCompiled());
+
+  Image built = Image::build(compiled, sourceHash, 2);
+  Module inMemory = built.load();
+  runtime.run(inMemory, inMemory.initializer_);
+  check("in memory image",
+        inMemory.getGlobal("result") == expected.getGlobal("result"));
+
+  // the old mapping keeps its pages once the file is replaced;
+  Image before = Image::map(path);
+  Image::write(compiled, sourceHash + 1, 2, path);
+  Module stale = before.load();
+  runtime.run(stale, stale.initializer_);
+  check("mapping outlives replace",
+        stale.getGlobal("result") == expected.getGlobal("result"));
+  check("replaced", Image::map(path).sourceHash() == sourceHash + 1);
+
+  std::vector<std::thread> writers;
+  for (int w = 0; w < 4; w++) {
+    writers.emplace_back([&] {
+      for (int i = 0; i < 20; i++) {
+        Image::write(compiled, sourceHash, 2, path);
+      }
+    });
+  }
+  for (auto &writer : writers) {
+    writer.join();
+  }
+  check("concurrent writers", runImage(path) == expected.getGlobal("result"));
+  check("no temporary files", files(directory).size() == 1);
+
+  bool raised = false;
+  try {
+    Image::write(compiled, sourceHash, 2, directory + "/missing/script.img");
+  } catch (std::runtime_error &) {
+    raised = true;
+  }
+  check("unwritable path raises", raised);
+
+  std::string bytes;
+  {
+    std::ifstream in(path, std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(in),
+                 std::istreambuf_iterator<char>());
+  }
+  std::string truncated = directory + "/truncated.img";
+  Image::replaceFile(truncated, bytes.substr(0, bytes.size() / 2));
+  check("truncated image rejected", rejects(truncated));
+  std::string garbage = directory + "/garbage.img";
+  Image::replaceFile(garbage, std::string(bytes.size(), 'x'));
+  check("garbage rejected", rejects(garbage));
+  check("missing image rejected", rejects(directory + "/none.img"));
+
+  for (auto &name : files(directory)) {
+    std::remove((directory + "/" + name).c_str());
+  }
+  rmdir(directory.c_str());
+  return verdict();
+}
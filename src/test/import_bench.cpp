@@ -0,0 +1,97 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <sys/stat.h>
+
+#include "bench.hpp"
+#include "compile/parser.hpp"
+#include "compile/scanner.hpp"
+#include "compiler.hpp"
+#include "runtime/runtime.hpp"
+
+// Writes `modules` modules of `functions` functions each, then runs a script
+// importing all of them that calls into the first `used` only. Compares
+// compiling every module up front with the loader, which compiles a module
+// on its first use, and with a second runtime of the same process, which
+// finds the used modules compiled already.
+//
+//   import_bench [modules] [functions] [used] [directory]
+
+using namespace kestrel;
+static std::string moduleSource(int m, int functions) {
+  std::ostringstream source;
+  source << "base = " << m << ";\n";
+  writeFunctions(source, 0, functions, 10, "base");
+  return source.str();
+}
+
+int main(int argc, char **argv) {
+  int modules = argc > 1 ? std::atoi(argv[1]) : 200;
+  int functions = argc > 2 ? std::atoi(argv[2]) : 20;
+  int used = argc > 3 ? std::atoi(argv[3]) : 5;
+  std::string directory = argc > 4 ? argv[4] : "/tmp/import_bench";
+  mkdir(directory.c_str(), 0755);
+
+  std::ostringstream script;
+  for (int m = 0; m < modules; m++) {
+    std::ofstream(directory + "/m" + std::to_string(m) + ".ks")
+        << moduleSource(m, functions);
+    script << "import m" << m << ";\n";
+  }
+  for (int m = 0; m < used; m++) {
+    script << "r" << m << " = m" << m << ".f0(" << m << ");\n";
+  }
+  std::string source = script.str();
+
+  static Writer quiet = [](std::string &) {};
+  setWriter(quiet);
+  // the compiler and the interpreter trace to cout;
+  std::ostringstream sink;
+  std::streambuf *out = std::cout.rdbuf(sink.rdbuf());
+
+  // what loading every import up front would cost;
+  auto start = Clock::now();
+  for (int m = 0; m < modules; m++) {
+    compileSource(moduleSource(m, functions));
+  }
+  double eager = millis(start);
+
+  auto runScript = [&](Runtime &runtime) {
+    runtime.modules().addSearchPath(directory);
+    runtime.modules().setCompiler(
+        [](const std::string &text) { return compileSource(text); }, 1);
+    Module main = compileSource(source);
+    runtime.run(main, main.initializer_);
+    return main;
+  };
+
+  start = Clock::now();
+  Runtime first;
+  Module main = runScript(first);
+  double cold = millis(start);
+
+  start = Clock::now();
+  Runtime second;
+  runScript(second);
+  double warm = millis(start);
+  std::cout.rdbuf(out);
+
+  bool ok = used == 0 || main.getGlobal("r0").type() == ValueType::Integer;
+  std::printf("modules   %8d imported, %d used, %d functions each\n",
+              modules, used, functions);
+  std::printf("eager     %8.3f ms\n", eager);
+  std::printf("lazy      %8.3f ms, %zu loaded\n", cold,
+              first.modules().loadedModules());
+  std::printf("shared    %8.3f ms, %zu compiled in the process\n", warm,
+              ModuleLoader::cachedModules());
+  std::printf("result    %s\n", ok ? "ok" : "WRONG");
+
+  for (int m = 0; m < modules; m++) {
+    std::remove((directory + "/m" + std::to_string(m) + ".ks").c_str());
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,75 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <sys/resource.h>
+
+#include "bench.hpp"
+#include "compile/parser.hpp"
+#include "compile/scanner.hpp"
+#include "compiler.hpp"
+#include "runtime/runtime.hpp"
+
+// Loads a synthetic library of `functions` functions of which the script
+// calls only the first `used`, with function bodies compiled up front or,
+// with `lazy` set, on their first call. Prints the time to load and run it,
+// how many bodies got compiled and the peak resident size of the process;
+// run once per mode, as the peak only grows.
+
+using namespace kestrel;
+int main(int argc, char **argv) {
+  int functions = argc > 1 ? std::atoi(argv[1]) : 2000;
+  int used = argc > 2 ? std::atoi(argv[2]) : 20;
+  bool lazy = argc > 3 ? std::atoi(argv[3]) != 0 : true;
+
+  std::ostringstream script;
+  writeFunctions(script, 0, functions, 30);
+  for (int f = 0; f < used; f++) {
+    script << "r" << f << " = f" << f << "(" << f << ");\n";
+  }
+  std::string source = script.str();
+
+  static Writer quiet = [](std::string &) {};
+  setWriter(quiet);
+
+  // the compiler echoes every statement it compiles;
+  std::ostringstream sink;
+  std::streambuf *out = std::cout.rdbuf(sink.rdbuf());
+  auto start = Clock::now();
+  Scanner scanner(source);
+  std::vector<Token> tokens = scanner.scanTokens();
+  Arena arena;
+  Parser parser(tokens, arena);
+  parser.setLazyFunctions(lazy);
+  auto statements = parser.parse();
+  Compiler compiler;
+  Module module_ = compiler.compile(statements, arena);
+  statements.clear();
+  arena.clear();
+  tokens.clear();
+  double load = millis(start);
+
+  start = Clock::now();
+  Runtime runtime;
+  runtime.run(module_, module_.initializer_);
+  double run = millis(start);
+  std::cout.rdbuf(out);
+
+  int compiled = 0;
+  for (int f = 0; f < functions; f++) {
+    Value &value = module_.getGlobal("f" + std::to_string(f));
+    compiled += value.functionValue()->isCompiled() ? 1 : 0;
+  }
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  std::printf("source    %8zu bytes, %d functions, %d called, %s\n",
+              source.size(), functions, used, lazy ? "lazy" : "eager");
+  std::printf("load      %8.3f ms\n", load);
+  std::printf("run       %8.3f ms\n", run);
+  std::printf("compiled  %8d functions\n", compiled);
+  std::printf("peak rss  %8.2f MB\n", usage.ru_maxrss / 1024.0);
+}
@@ -0,0 +1,74 @@
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+#include "compile/parser.hpp"
+#include "compile/scanner.hpp"
+#include "compiler.hpp"
+#include "runtime/runtime.hpp"
+#include "testing.hpp"
+
+// Checks that syntax errors in function bodies are reported rather than
+// compiled: eagerly they are parse errors of the script, lazily the body is
+// only bracket-matched at load time and every call of the stub raises.
+//
+//   lazy_test
+
+using namespace kestrel;
+
+static const char *source = "def good(a) { return a + 1; }\n"
+                            "def bad() { let = 3; return 1; }\n"
+                            "before = good(1);\n"
+                            "after = bad();\n";
+
+static size_t parseErrors(const std::string &text, bool lazy) {
+  Scanner scanner(text);
+  std::vector<Token> tokens = scanner.scanTokens();
+  Arena arena;
+  Parser parser(tokens, arena);
+  parser.setLazyFunctions(lazy);
+  parser.parse();
+  return parser.errors().size();
+}
+
+int main() {
+  Quiet quiet;
+
+  check("eager body error", parseErrors(source, false) == 1);
+  check("lazy body error deferred", parseErrors(source, true) == 0);
+  check("eager empty body", parseErrors("def f() {}\n", false) == 1);
+  check("lazy empty body", parseErrors("def f() {}\n", true) == 1);
+
+  Scanner scanner(source);
+  std::vector<Token> tokens = scanner.scanTokens();
+  Arena arena;
+  Parser parser(tokens, arena);
+  parser.setLazyFunctions(true);
+  auto statements = parser.parse();
+  Compiler compiler;
+  compiler.setOptimizationLevel(1);
+  Module module = compiler.compile(statements, arena);
+
+  Runtime runtime;
+  bool raised = false;
+  try {
+    runtime.run(module, module.initializer_);
+  } catch (std::runtime_error &error) {
+    raised = std::string(error.what()).find("bad") == 0;
+  }
+  check("call of failing stub raises", raised);
+  check("code before the call ran", module.globals_["before"] == Value(2));
+
+  // the stub keeps its body and fails again instead of running no code;
+  Function &bad = *module.globals_["bad"].functionValue();
+  check("stub stays uncompiled", !bad.isCompiled());
+  raised = false;
+  try {
+    runtime.run(module, bad);
+  } catch (std::runtime_error &) {
+    raised = true;
+  }
+  check("second call raises", raised);
+
+  return verdict();
+}
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 
 #include <fstream>
@@ -9,8 +10,11 @@
 #include "compile/parser.hpp"
 #include "compile/scanner.hpp"
 #include "compiler.hpp"
+#include "heap.hpp"
+#include "image.hpp"
 
 #include "runtime/runtime.hpp"
+#include "tools/disassembler.hpp"
 
 using namespace kestrel;
 
@@ -39,30 +43,81 @@ int main(int argc, char **argv) {
   setWriter(writer);
 
   std::string path = std::string(argv[1]);
-  std::string source = readFileIntoString(path);
-  Scanner scanner(source);
-  std::vector<Token> tokens = scanner.scanTokens();
-  for (Token &token : tokens) {
-    Log(level, tag) << token.toString() ;
-  }
-
-
-  Parser parser(tokens);
-  auto statements = parser.parse();
-  for (auto statement : statements) {
-    statement->print();
+  Compiler compiler;
+  bool dump = false;
+  bool lazy = false;
+  bool emitOnly = false;
+  bool preload = false;
+  std::string imagePath;
+  std::string snapshotPath;
+  std::string moduleCache;
+  std::vector<std::string> modulePath;
+  for (int i = 2; i < argc; i++) {
+    std::string option = argv[i];
+    if (option == "--dump") {
+      dump = true;
+    } else if (option == "--lazy") {
+      lazy = true;
+    } else if ((option == "--image" || option == "--emit-image") &&
+               i + 1 < argc) {
+      // --image runs from the image when it is fresh and rewrites it when
+      // not, --emit-image only writes it;
+      emitOnly = option == "--emit-image";
+      imagePath = argv[++i];
+    } else if (option == "--snapshot" && i + 1 < argc) {
+      // restores the heap from a fresh snapshot instead of running the
+      // script, or runs it and saves its heap;
+      snapshotPath = argv[++i];
+    } else if (option == "--preload") {
+      // compiles all imports up front, on the -j threads, and initializes
+      // them before the script runs;
+      preload = true;
+    } else if (option == "--module-cache" && i + 1 < argc) {
+      // compiled imports are kept there as images;
+      moduleCache = argv[++i];
+    } else if (option.size() > 2 && option.compare(0, 2, "-I") == 0) {
+      modulePath.push_back(option.substr(2));
+    } else if (option.size() == 3 && option.compare(0, 2, "-O") == 0) {
+      compiler.setOptimizationLevel(option[2] - '0');
+    } else if (option.compare(0, 2, "-j") == 0) {
+      compiler.setJobs(std::atoi(option.c_str() + 2));
+    }
   }
 
-  // return 0;
+  std::string source = readFileIntoString(path);
+  uint64_t sourceHash = Image::contentHash(source);
 
-  Compiler compiler;
-  Module module_ = compiler.compile(statements);
+  // host functions and classes; snapshots refer to them by name;
+  Runtime runtime;
 
-  for (int i = 0; i < module_.instructions.size(); i++) {
-    // std::cout << ":" << (int)module_.instructions.readByte(i) << std::endl;
+  // imports are looked up next to the script first;
+  size_t slash = path.find_last_of('/');
+  runtime.modules().addSearchPath(slash == std::string::npos
+                                      ? "."
+                                      : path.substr(0, slash));
+  for (auto &directory : modulePath) {
+    runtime.modules().addSearchPath(directory);
   }
-
-  // return 0;
+  if (!moduleCache.empty()) {
+    runtime.modules().setCacheDirectory(moduleCache);
+  }
+  runtime.modules().setCompiler(
+      [&](const std::string &text) {
+        Scanner scanner(text);
+        std::vector<Token> tokens = scanner.scanTokens();
+        Arena arena;
+        Parser parser(tokens, arena);
+        parser.setLazyFunctions(lazy);
+        auto statements = parser.parse();
+        if (!parser.errors().empty()) {
+          throw std::runtime_error("parse error at " +
+                                   parser.errors().front());
+        }
+        Compiler imported;
+        imported.setOptimizationLevel(compiler.optimizationLevel());
+        return imported.compile(statements, arena);
+      },
+      compiler.optimizationLevel());
 
   ForeignFunction same = [](std::vector<Value> &args) {
     return Value(args[0] == args[1]);
@@ -95,12 +150,12 @@ int main(int argc, char **argv) {
   Value p(print);
   p.functionValue()->setName("print");
   
-  module_.setGlobal("print", p);
+  runtime.hosts().add("print", p);
 
 
   // module_.setGlobal("a", Value(same));
-  module_.setGlobal("enableLog", Value(enableLog));
-  module_.setGlobal("assert", assertF);
+  runtime.hosts().add("enableLog", Value(enableLog));
+  runtime.hosts().add("assert", Value(assertF));
 
   // Value& v = module_.getGlobal("print");
   // // std::cout << "v:" << v << std::endl;
@@ -114,11 +169,9 @@ int main(int argc, char **argv) {
     return Value(100);
   };
 
-  Runtime runtime;
-
   Class* calculator = new Class();
   calculator->constructor([&](Value& cls, MethodParameter& p) {
-    core::Object* object = new core::Object(); // TODO construct from Class? default contructor;
+    core::Object* object = Heap::current().allocate(); // TODO construct from Class? default contructor;
     object->setClass(calculator);
     return Value(object);
   });
@@ -140,7 +193,99 @@ int main(int argc, char **argv) {
     return p.args[0].doubleValue() / p.args[1].doubleValue();
   });
   
-  module_.setGlobal("Calculator", Value(calculator));
-  runtime.run(module_, module_.initializer_);
-  
+  runtime.hosts().add("Calculator", Value(calculator));
+
+  // attribute bag without methods, allocations of it can be scalar-replaced;
+  Class* record = new Class();
+  record->setPlain(true);
+  record->constructor([&](Value& cls, MethodParameter& p) {
+    core::Object* object = Heap::current().allocate();
+    object->setClass(record);
+    return Value(object);
+  });
+  runtime.hosts().add("Record", Value(record));
+
+  Module module_;
+  bool restored = false;
+  if (!snapshotPath.empty()) {
+    try {
+      module_ = runtime.restore(snapshotPath, sourceHash);
+      restored = true;
+    } catch (std::runtime_error &error) {
+      Log(level, tag) << error.what();
+    }
+  }
+
+  if (!restored) {
+    bool loaded = false;
+    if (!imagePath.empty() && !emitOnly) {
+      try {
+        Image image = Image::map(imagePath);
+        if (image.sourceHash() == sourceHash &&
+            image.optimizationLevel() == compiler.optimizationLevel()) {
+          module_ = image.load();
+          loaded = true;
+        }
+      } catch (std::runtime_error &error) {
+        Log(level, tag) << error.what();
+      }
+    }
+
+    if (!loaded) {
+      Scanner scanner(source);
+      std::vector<Token> tokens = scanner.scanTokens();
+      for (Token &token : tokens) {
+        Log(level, tag) << token.toString() ;
+      }
+
+      Arena arena;
+      Parser parser(tokens, arena);
+      parser.setLazyFunctions(lazy);
+      auto statements = parser.parse();
+      if (!parser.errors().empty()) {
+        for (auto &error : parser.errors()) {
+          std::cerr << path << ": parse error at " << error << std::endl;
+        }
+        return EXIT_FAILURE;
+      }
+      for (auto statement : statements) {
+        statement->print();
+      }
+
+      module_ = compiler.compile(statements, arena);
+      // the tree is not needed once compiled;
+      statements.clear();
+      arena.clear();
+
+      if (!imagePath.empty()) {
+        Image::write(module_, sourceHash, compiler.optimizationLevel(),
+                     imagePath);
+      }
+    }
+    if (emitOnly) {
+      return 0;
+    }
+
+    for (auto &host : runtime.hosts().values()) {
+      module_.setGlobal(host.first, Value(host.second));
+    }
+    if (preload) {
+      runtime.preload(source, std::max(compiler.jobs(), 1));
+    }
+    try {
+      runtime.run(module_, module_.initializer_);
+    } catch (std::runtime_error &error) {
+      std::cerr << error.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+    // the initialized heap, for the next run to start from;
+    if (!snapshotPath.empty()) {
+      runtime.snapshot(module_, sourceHash, snapshotPath);
+    }
+  }
+
+  // dump bytecode together with the feedback collected while running;
+  if (dump) {
+    Disassembler(std::cout).run(module_);
+  }
 };
@@ -0,0 +1,82 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench.hpp"
+#include "compile/parser.hpp"
+#include "compile/scanner.hpp"
+#include "compiler.hpp"
+#include "runtime/runtime.hpp"
+
+// Writes an application of `modules` modules of `functions` functions each,
+// where module i imports modules 2i + 1 and 2i + 2, and times preloading
+// all of it from a script importing module 0 with 1, 2, 4, ... threads up
+// to the number of cores. Each run is a fresh process, so none of them
+// finds the others' modules compiled.
+//
+//   preload_bench [modules] [functions] [directory]
+
+using namespace kestrel;
+int main(int argc, char **argv) {
+  int modules = argc > 1 ? std::atoi(argv[1]) : 200;
+  int functions = argc > 2 ? std::atoi(argv[2]) : 20;
+  std::string directory = argc > 3 ? argv[3] : "/tmp/preload_bench";
+  mkdir(directory.c_str(), 0755);
+
+  for (int m = 0; m < modules; m++) {
+    std::ofstream file(directory + "/m" + std::to_string(m) + ".ks");
+    for (int child = 2 * m + 1; child <= 2 * m + 2 && child < modules;
+         child++) {
+      file << "import m" << child << ";\n";
+    }
+    file << "base = " << m << ";\n";
+    writeFunctions(file, 0, functions, 10, "base");
+  }
+  std::string source = "import m0;\nresult = m0.f0(1);\n";
+
+  static Writer quiet = [](std::string &) {};
+  setWriter(quiet);
+  int cores = (int)std::thread::hardware_concurrency();
+  std::printf("modules   %8d, %d functions each, %d cores\n", modules,
+              functions, cores);
+  std::fflush(stdout);
+
+  for (int jobs = 1;; jobs *= 2) {
+    if (fork() == 0) {
+      // the compiler echoes every statement it compiles, from every
+      // thread, so drop it rather than buffer it;
+      std::cout.rdbuf(nullptr);
+      Runtime runtime;
+      runtime.modules().addSearchPath(directory);
+      runtime.modules().setCompiler(
+          [](const std::string &text) { return compileSource(text); }, 1);
+      auto start = Clock::now();
+      runtime.preload(source, jobs);
+      double preload = millis(start);
+      std::printf("jobs %3d  %8.3f ms, %zu loaded\n", jobs, preload,
+                  runtime.modules().loadedModules());
+      std::fflush(stdout);
+      _exit(runtime.modules().loadedModules() == (size_t)modules ? 0 : 1);
+    }
+    int status = 0;
+    wait(&status);
+    if (status != 0) {
+      std::printf("jobs %3d  FAILED\n", jobs);
+      return 1;
+    }
+    if (jobs >= cores && jobs >= 4) {
+      break;
+    }
+  }
+
+  for (int m = 0; m < modules; m++) {
+    std::remove((directory + "/m" + std::to_string(m) + ".ks").c_str());
+  }
+}
@@ -0,0 +1,109 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "bench.hpp"
+#include "compile/parser.hpp"
+#include "compile/scanner.hpp"
+#include "compiler.hpp"
+#include "reloader.hpp"
+#include "runtime/runtime.hpp"
+
+// Compiles a script of `functions` functions and a counter global, runs a
+// request that bumps the counter, then edits `changed` functions and
+// compares reloading them with compiling the whole new script. A reload
+// asked for while a request runs must wait for it to return. Checks that
+// the diff left the module alone, the counter survived and the edited
+// functions answer differently.
+//
+//   reload_bench [functions] [changed]
+
+using namespace kestrel;
+static std::string script(int functions, int changed, int version) {
+  std::ostringstream source;
+  source << "counter = 0;\n";
+  // each version subtracts its number in the changed functions;
+  writeFunctions(source, 0, changed, 10, std::to_string(version));
+  writeFunctions(source, changed, functions - changed, 10, "0");
+  return source.str();
+}
+
+int main(int argc, char **argv) {
+  int functions = argc > 1 ? std::atoi(argv[1]) : 2000;
+  int changed = argc > 2 ? std::atoi(argv[2]) : 1;
+
+  static Writer quiet = [](std::string &) {};
+  setWriter(quiet);
+  // the compiler and the interpreter trace to cout;
+  std::ostringstream sink;
+  std::streambuf *out = std::cout.rdbuf(sink.rdbuf());
+
+  std::string before = script(functions, changed, 0);
+  std::string after = script(functions, changed, 1);
+
+  Runtime runtime;
+  Compiler compiler;
+  Module module_ = compileSource(before, compiler);
+  Reloader reloader(compiler.optimizationLevel());
+  reloader.track(before);
+
+  // reloads from inside the request, which must not take effect before
+  // the request returns;
+  bool reloadNow = false;
+  Patch patch;
+  ForeignFunction hook = [&](std::vector<Value> &args) {
+    if (reloadNow) {
+      runtime.reload(module_, std::move(patch));
+      reloadNow = false;
+    }
+    return Value();
+  };
+  module_.setGlobal("hook", Value(hook));
+  runtime.run(module_, module_.initializer_);
+
+  Compiler serving;
+  serving.setModule(module_);
+  Function serve = compileSource("counter = counter + 1;\n"
+                                 "hook();\n"
+                                 "reply = f0(2);\n",
+                                 serving)
+                       .initializer_;
+  runtime.run(module_, serve);
+  int old = module_.getGlobal("reply").intValue();
+
+  size_t constants = module_.constantCount();
+  size_t names = module_.nameCount();
+  auto start = Clock::now();
+  patch = reloader.diff(module_, after);
+  double diff = millis(start);
+  // the diff compiles on the side, the module is untouched until applied;
+  bool untouched = module_.constantCount() == constants &&
+                   module_.nameCount() == names;
+
+  // asked for mid-request, applied when it returns;
+  reloadNow = true;
+  runtime.run(module_, serve);
+  bool deferred = module_.getGlobal("reply").intValue() == old;
+  runtime.run(module_, serve);
+  int updated = module_.getGlobal("reply").intValue();
+
+  start = Clock::now();
+  Compiler full;
+  compileSource(after, full);
+  double recompile = millis(start);
+  std::cout.rdbuf(out);
+
+  int counter = module_.getGlobal("counter").intValue();
+  bool ok = untouched && deferred && counter == 3 &&
+            (changed == 0 || updated != old);
+  std::printf("functions %8d, %d changed\n", functions, changed);
+  std::printf("reload    %8.3f ms, %zu recompiled, %zu kept\n", diff,
+              reloader.changed(), reloader.unchanged());
+  std::printf("recompile %8.3f ms\n", recompile);
+  std::printf("state     counter %d, reply %d -> %d\n", counter, old,
+              updated);
+  std::printf("result    %s\n", ok ? "ok" : "WRONG");
+  return ok ? 0 : 1;
+}
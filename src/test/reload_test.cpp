@@ -0,0 +1,161 @@
+#include <atomic>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "bench.hpp"
+#include "reloader.hpp"
+#include "runtime/runtime.hpp"
+#include "testing.hpp"
+
+// Reloads edited versions of a script into a running module and checks
+// the diff finds the new, changed and dropped functions without touching
+// the module, that a reload asked for mid-request, from the request itself
+// or from another thread, applies once the request returns, that hot code
+// which inlined a replaced function picks up the new one, and that the
+// other globals keep their values.
+//
+//   reload_test
+
+using namespace kestrel;
+
+static const char *header = "counter = 0;\n"
+                            "base = 10;\n"
+                            "def helper(a) { return a + 1; }\n";
+
+// at -O2 sum inlines answer, which is defined before it, behind a guard;
+static const char *footer = "def sum(n) {\n"
+                            "  let total = 0;\n"
+                            "  let i = 0;\n"
+                            "  while (i < n) {\n"
+                            "    total = total + answer(i);\n"
+                            "    i = i + 1;\n"
+                            "  }\n"
+                            "  return total;\n"
+                            "}\n";
+
+// The script with `answer` scaling by `factor`; the first version also has
+// `gone`, the later ones `added` instead.
+static std::string version(int factor) {
+  std::ostringstream source;
+  source << header << "def answer(a) { return helper(a) * " << factor
+         << " + base; }\n"
+         << footer;
+  if (factor == 2) {
+    source << "def gone() { return 0; }\n";
+  } else {
+    source << "def added(a) { return a - 1; }\n";
+  }
+  return source.str();
+}
+
+// sum(n) of the version scaling by `factor`.
+static int expectedSum(int n, int factor) {
+  return factor * n * (n + 1) / 2 + 10 * n;
+}
+
+int main() {
+  Quiet quiet;
+
+  Runtime runtime;
+  Compiler compiler;
+  compiler.setOptimizationLevel(2);
+  Module module_ = compileSource(version(2), compiler);
+  Reloader reloader(2);
+  reloader.track(version(2));
+
+  // the request reloads `patch` itself, or waits for another thread to
+  // reload while it runs;
+  Patch patch;
+  bool reloadNow = false;
+  bool waitForReload = false;
+  std::atomic<bool> running(false), reloaded(false);
+  ForeignFunction hook = [&](std::vector<Value> &) {
+    if (reloadNow) {
+      runtime.reload(module_, std::move(patch));
+      reloadNow = false;
+    }
+    if (waitForReload) {
+      running = true;
+      while (!reloaded) {
+        std::this_thread::yield();
+      }
+      waitForReload = false;
+    }
+    return Value();
+  };
+  module_.setGlobal("hook", Value(hook));
+  runtime.run(module_, module_.initializer_);
+
+  Compiler serving;
+  serving.setModule(module_);
+  Function serve = compileSource("counter = counter + 1;\n"
+                                 "hook();\n"
+                                 "reply = sum(10);\n",
+                                 serving)
+                       .initializer_;
+  // warm, so feedback and specialized clones all saw the old answer;
+  for (int i = 0; i < 50; i++) {
+    runtime.run(module_, serve);
+  }
+  check("before reload",
+        module_.getGlobal("reply") == Value(expectedSum(10, 2)));
+
+  size_t constants = module_.constantCount();
+  size_t names = module_.nameCount();
+  Function *answer = module_.getGlobal("answer").functionValue().get();
+  patch = reloader.diff(module_, version(3));
+  check("changed and added found", reloader.changed() == 2);
+  check("unchanged kept", reloader.unchanged() == 2);
+  check("dropped found",
+        patch.removed.size() == 1 && patch.removed[0] == "gone");
+  check("module untouched by diff",
+        module_.constantCount() == constants && module_.nameCount() == names &&
+            module_.getGlobal("answer").functionValue().get() == answer);
+
+  // asked for by the request itself;
+  reloadNow = true;
+  runtime.run(module_, serve);
+  check("deferred within request",
+        module_.getGlobal("reply") == Value(expectedSum(10, 2)));
+  check("applied after request",
+        module_.getGlobal("answer").functionValue().get() != answer);
+  runtime.run(module_, serve);
+  check("inlined copy replaced",
+        module_.getGlobal("reply") == Value(expectedSum(10, 3)));
+  check("dropped removed", !module_.hasGlobal("gone"));
+  check("added bound", module_.hasGlobal("added"));
+
+  // asked for by another thread while a request runs;
+  waitForReload = true;
+  std::thread other([&] {
+    while (!running) {
+      std::this_thread::yield();
+    }
+    runtime.reload(module_, reloader.diff(module_, version(4)));
+    reloaded = true;
+  });
+  runtime.run(module_, serve);
+  other.join();
+  check("deferred for other thread",
+        module_.getGlobal("reply") == Value(expectedSum(10, 3)));
+  runtime.run(module_, serve);
+  check("applied for other thread",
+        module_.getGlobal("reply") == Value(expectedSum(10, 4)));
+
+  // and while nothing runs, at once;
+  answer = module_.getGlobal("answer").functionValue().get();
+  std::thread idle(
+      [&] { runtime.reload(module_, reloader.diff(module_, version(5))); });
+  idle.join();
+  check("applied at once",
+        module_.getGlobal("answer").functionValue().get() != answer);
+  runtime.run(module_, serve);
+  check("new code at rest",
+        module_.getGlobal("reply") == Value(expectedSum(10, 5)));
+  check("globals kept", module_.getGlobal("counter") == Value(55) &&
+                            module_.getGlobal("base") == Value(10));
+
+  return verdict();
+}
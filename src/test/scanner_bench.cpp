@@ -0,0 +1,50 @@
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+
+#include "bench.hpp"
+#include "compile/scanner.hpp"
+
+// Scans a generated source of roughly `megabytes` MB mixing declarations,
+// arithmetic, string literals, comments and indentation, and prints the
+// scanner's throughput.
+
+using namespace kestrel;
+
+static std::string generate(size_t bytes) {
+  std::ostringstream out;
+  for (int i = 0; (size_t)out.tellp() < bytes; i++) {
+    out << "def function_" << i << "(alpha, beta_" << i << ") {\n"
+        << "  // accumulates the running total for round " << i << "\n"
+        << "  let total = alpha * " << i << " + beta_" << i << " / 3.25;\n"
+        << "  if (total >= " << i * 7 << " and alpha != nil) {\n"
+        << "    print(\"total for round " << i << " exceeded\");\n"
+        << "  }\n"
+        << "  return total;\n"
+        << "}\n\n";
+  }
+  return out.str();
+}
+
+int main(int argc, char **argv) {
+  double megabytes = argc > 1 ? std::atof(argv[1]) : 16;
+  int rounds = argc > 2 ? std::atoi(argv[2]) : 10;
+
+  std::string source = generate((size_t)(megabytes * 1024 * 1024));
+
+  size_t tokens = 0;
+  auto start = Clock::now();
+  for (int round = 0; round < rounds; round++) {
+    Scanner scanner(source);
+    tokens += scanner.scanTokens().size();
+  }
+  std::chrono::duration<double> elapsed = Clock::now() - start;
+
+  double total = (double)source.size() * rounds / (1024 * 1024);
+  std::printf("source   %8.2f MB, %d rounds\n",
+              source.size() / (1024.0 * 1024), rounds);
+  std::printf("tokens   %8zu per round\n", tokens / rounds);
+  std::printf("scan     %8.2f MB/s\n", total / elapsed.count());
+  std::printf("         %8.2f Mtokens/s\n", tokens / elapsed.count() / 1e6);
+}
@@ -0,0 +1,123 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "bench.hpp"
+#include "compile/parser.hpp"
+#include "compile/scanner.hpp"
+#include "compiler.hpp"
+#include "heap.hpp"
+#include "image.hpp"
+#include "runtime/runtime.hpp"
+#include "testing.hpp"
+
+// Runs an initializer that builds a linked table of `entries` records in a
+// global, snapshots the heap, restores it and compares the time of the cold
+// initialization with the restore, and the snapshot size. The restored table
+// is walked to check it holds the same values and the same cycle.
+
+using namespace kestrel;
+// Sum of `value` along the `next` chain of `head`, and whether the tail
+// points back at the head.
+static long walk(Module &module, bool &cyclic) {
+  Object *head = module.getGlobal("table").objectValue();
+  long sum = 0;
+  Object *node = head;
+  for (;;) {
+    sum += node->getAttribute("value").intValue();
+    Value &next = node->getAttribute("next");
+    if (next.type() != ValueType::Object) {
+      cyclic = false;
+      return sum;
+    }
+    if (next.objectValue() == head) {
+      cyclic = true;
+      return sum;
+    }
+    node = next.objectValue();
+  }
+}
+
+int main(int argc, char **argv) {
+  int entries = argc > 1 ? std::atoi(argv[1]) : 2000;
+  std::string path = argc > 2 ? argv[2] : "/tmp/snapshot_bench.snap";
+
+  std::ostringstream script;
+  script << "def square(n) {\n  return n * n;\n}\n"
+            "def build(n) {\n"
+            "  let head = Record();\n"
+            "  head.value = 0;\n"
+            "  let tail = head;\n"
+            "  let i = 1;\n"
+            "  while (i < n) {\n"
+            "    let node = Record();\n"
+            "    node.value = square(i) - i;\n"
+            "    node.name = \"entry\";\n"
+            "    node.next = head;\n"
+            "    head = node;\n"
+            "    i = i + 1;\n"
+            "  }\n"
+            "  tail.next = head;\n"
+            "  return head;\n"
+            "}\n"
+         << "table = build(" << entries << ");\n"
+         << "lookup = square;\n";
+  std::string source = script.str();
+  uint64_t sourceHash = Image::contentHash(source);
+
+  static Writer quiet = [](std::string &) {};
+  setWriter(quiet);
+  std::ostringstream sink;
+  std::streambuf *out = std::cout.rdbuf(sink.rdbuf());
+
+  Class *record = recordClass();
+
+  // cold: compile and run the initializer;
+  auto start = Clock::now();
+  Runtime cold;
+  cold.hosts().add("Record", Value(record));
+  Scanner scanner(source);
+  std::vector<Token> tokens = scanner.scanTokens();
+  Arena arena;
+  Parser parser(tokens, arena);
+  auto statements = parser.parse();
+  Compiler compiler;
+  Module initialized = compiler.compile(statements, arena);
+  initialized.setGlobal("Record", Value(record));
+  cold.run(initialized, initialized.initializer_);
+  double init = millis(start);
+
+  start = Clock::now();
+  cold.snapshot(initialized, sourceHash, path);
+  double save = millis(start);
+
+  start = Clock::now();
+  Runtime warm;
+  warm.hosts().add("Record", Value(record));
+  Module restored = warm.restore(path, sourceHash);
+  double restore = millis(start);
+  std::cout.rdbuf(out);
+
+  std::FILE *file = std::fopen(path.c_str(), "rb");
+  std::fseek(file, 0, SEEK_END);
+  long size = std::ftell(file);
+  std::fclose(file);
+  std::remove(path.c_str());
+
+  bool coldCycle = false, warmCycle = false;
+  long coldSum = walk(initialized, coldCycle);
+  long warmSum = walk(restored, warmCycle);
+  bool same = coldSum == warmSum && coldCycle && warmCycle &&
+              restored.getGlobal("lookup").functionValue() ==
+                  restored.getGlobal("square").functionValue();
+
+  std::printf("entries   %8d\n", entries);
+  std::printf("snapshot  %8ld bytes\n", size);
+  std::printf("cold init %8.3f ms\n", init);
+  std::printf("save      %8.3f ms\n", save);
+  std::printf("restore   %8.3f ms\n", restore);
+  std::printf("same heap %s\n", same ? "yes" : "NO");
+  return same ? 0 : 1;
+}
@@ -0,0 +1,130 @@
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include "bench.hpp"
+#include "heap.hpp"
+#include "image.hpp"
+#include "runtime/runtime.hpp"
+#include "testing.hpp"
+
+// Snapshots a module whose initializer built shared and cyclic records,
+// restores it and checks the restored heap holds the same values and the
+// same references, that a function left lazy runs from the snapshot, and
+// that unusable snapshots are rejected rather than restored.
+//
+//   snapshot_test [directory]
+
+using namespace kestrel;
+
+static const char *source = "def square(n) { return n * n; }\n"
+                            "def make(v) {\n"
+                            "  let r = Record();\n"
+                            "  r.value = v;\n"
+                            "  return r;\n"
+                            "}\n"
+                            "def probe() {\n"
+                            "  return lookup(7) + pair.left.value;\n"
+                            "}\n"
+                            "shared = make(5);\n"
+                            "pair = make(1);\n"
+                            "pair.left = shared;\n"
+                            "pair.right = shared;\n"
+                            "loop = make(2);\n"
+                            "loop.next = loop;\n"
+                            "name = \"kestrel\";\n"
+                            "ratio = 2.5;\n"
+                            "count = 42;\n"
+                            "lookup = square;\n";
+
+// Whether restoring `path` throws std::runtime_error.
+static bool rejects(Runtime &runtime, const std::string &path,
+                    uint64_t sourceHash) {
+  try {
+    runtime.restore(path, sourceHash);
+  } catch (std::runtime_error &) {
+    return true;
+  }
+  return false;
+}
+
+int main(int argc, char **argv) {
+  std::string directory = argc > 1 ? argv[1] : "/tmp";
+  std::string path = directory + "/snapshot_test.snap";
+  uint64_t sourceHash = Image::contentHash(source);
+
+  Quiet quiet;
+
+  Class *record = recordClass();
+
+  // probe and square are never called, so they are still lazy when saved;
+  Compiler compiler;
+  compiler.setOptimizationLevel(1);
+  Module initialized = compileSource(source, compiler, true);
+  initialized.setGlobal("Record", Value(record));
+  Runtime cold;
+  cold.hosts().add("Record", Value(record));
+  cold.run(initialized, initialized.initializer_);
+  check("saved while lazy",
+        !initialized.getGlobal("probe").functionValue()->isCompiled());
+  cold.snapshot(initialized, sourceHash, path);
+
+  Runtime warm;
+  warm.hosts().add("Record", Value(record));
+  Module restored = warm.restore(path, sourceHash);
+
+  check("integer", restored.getGlobal("count") == Value(42));
+  check("double", restored.getGlobal("ratio") == Value(2.5));
+  check("string", restored.getGlobal("name").type() == ValueType::String &&
+                      restored.getGlobal("name").stringValue() == "kestrel");
+
+  Object *pair = restored.getGlobal("pair").objectValue();
+  Object *shared = restored.getGlobal("shared").objectValue();
+  check("new objects", shared != initialized.getGlobal("shared").objectValue());
+  check("attributes", pair->getAttribute("value") == Value(1) &&
+                          shared->getAttribute("value") == Value(5));
+  check("shared reference",
+        pair->getAttribute("left").objectValue() == shared &&
+            pair->getAttribute("right").objectValue() == shared);
+  Object *loop = restored.getGlobal("loop").objectValue();
+  check("cycle", loop->getAttribute("next").objectValue() == loop);
+  check("function identity", restored.getGlobal("lookup").functionValue() ==
+                                 restored.getGlobal("square").functionValue());
+
+  // a request against the restored module, as a server would send it;
+  Compiler requests;
+  requests.setModule(restored);
+  Function request =
+      compileSource("probed = probe();\n", requests).initializer_;
+  warm.run(restored, request);
+  check("lazy function runs", restored.getGlobal("probed") == Value(54));
+
+  check("other source rejected", rejects(warm, path, sourceHash + 1));
+  check("missing file rejected", rejects(warm, path + ".missing", sourceHash));
+
+  std::string truncated = path + ".truncated";
+  {
+    std::ifstream in(path, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)),
+                      std::istreambuf_iterator<char>());
+    std::ofstream(truncated, std::ios::binary)
+        .write(bytes.data(), bytes.size() / 2);
+  }
+  check("truncated file rejected", rejects(warm, truncated, sourceHash));
+
+  Runtime bare;
+  check("unregistered host rejected", rejects(bare, path, sourceHash));
+  bool raised = false;
+  try {
+    bare.snapshot(initialized, sourceHash, path + ".bare");
+  } catch (std::runtime_error &) {
+    raised = true;
+  }
+  check("unregistered host not saved", raised);
+  check("nothing left behind", !std::ifstream(path + ".bare").good());
+
+  std::remove(path.c_str());
+  std::remove(truncated.c_str());
+  return verdict();
+}
@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <malloc.h>
+
+#include "bench.hpp"
+#include "code_unit.hpp"
+#include "compile/parser.hpp"
+#include "compile/scanner.hpp"
+#include "compiler.hpp"
+#include "image.hpp"
+#include "runtime/runtime.hpp"
+
+// Runs `tenants` tenants of a script of `functions` functions, each in a
+// Runtime of its own that calls three of them, and prints the heap each
+// additional tenant costs: loading its own module from a shared image, as
+// the module loader did, and instantiating one shared CodeUnit. Then runs
+// the tenants again from the unit on `threads` threads at once.
+//
+//   tenant_bench [tenants] [functions] [threads]
+
+using namespace kestrel;
+static size_t heapInUse() { return mallinfo2().uordblks; }
+
+static std::string script(int functions) {
+  std::ostringstream source;
+  source << "base = 7;\nlabel = \"tenant\";\n";
+  writeFunctions(source, 0, functions, 10, "base");
+  // the request, with the id the embedder binds first;
+  source << "reply = f0(id) + f1(id) + f2(id);\n";
+  return source.str();
+}
+
+// f<f>(a), as the script computes it;
+static int expected(int f, int a) { return a + a * (10 * f + 45) - 70; }
+
+struct Tenant {
+  explicit Tenant(Module module) : module(std::move(module)) {}
+
+  Runtime runtime;
+  Module module;
+};
+
+// Runs the tenant's module, which serves one request; true if the reply
+// is right.
+static bool serve(Tenant &tenant, int id) {
+  Module &module = tenant.module;
+  module.setGlobal("id", Value(id));
+  tenant.runtime.run(module, module.initializer_);
+  return module.getGlobal("reply").intValue() ==
+         expected(0, id) + expected(1, id) + expected(2, id);
+}
+
+int main(int argc, char **argv) {
+  int tenants = argc > 1 ? std::atoi(argv[1]) : 200;
+  int functions = argc > 2 ? std::atoi(argv[2]) : 500;
+  int threads = argc > 3 ? std::atoi(argv[3]) : 4;
+
+  static Writer quiet = [](std::string &) {};
+  setWriter(quiet);
+  // the compiler and the interpreter trace to cout, from every thread;
+  std::streambuf *out = std::cout.rdbuf(nullptr);
+
+  std::string source = script(functions);
+  Module compiled = compileSource(source);
+  Image image = Image::build(compiled, Image::contentHash(source), 1);
+  std::shared_ptr<const CodeUnit> unit =
+      CodeUnit::build(compileSource(source));
+
+  std::vector<int> failures(std::max(threads, 1), 0);
+  auto measure = [&](const char *label, Module (*load)(const Image &,
+                                                        const CodeUnit &)) {
+    std::vector<std::unique_ptr<Tenant>> running;
+    size_t before = heapInUse();
+    auto start = Clock::now();
+    for (int t = 0; t < tenants; t++) {
+      running.emplace_back(new Tenant(load(image, *unit)));
+      if (!serve(*running.back(), t)) {
+        failures[0]++;
+      }
+    }
+    double elapsed = millis(start);
+    size_t bytes = heapInUse() - before;
+    std::printf("%-10s %8.3f ms, %8zu bytes a tenant\n", label, elapsed,
+                bytes / tenants);
+    return bytes / tenants;
+  };
+  std::cout.rdbuf(out);
+  std::printf("tenants   %8d, %d functions, unit of %zu bytes\n", tenants,
+              functions, unit->codeSize());
+  std::cout.rdbuf(nullptr);
+  size_t loaded = measure("image", [](const Image &image, const CodeUnit &) {
+    return image.load();
+  });
+  size_t shared = measure("unit", [](const Image &, const CodeUnit &unit) {
+    return unit.instantiate();
+  });
+
+  // every thread instantiates the same unit at once;
+  std::vector<std::thread> workers;
+  auto start = Clock::now();
+  for (int w = 0; w < threads; w++) {
+    workers.emplace_back([&, w] {
+      for (int t = w; t < tenants; t += threads) {
+        Tenant tenant(unit->instantiate());
+        if (!serve(tenant, t)) {
+          failures[w]++;
+        }
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  double parallel = millis(start);
+  std::cout.rdbuf(out);
+
+  int failed = 0;
+  for (int f : failures) {
+    failed += f;
+  }
+  bool ok = failed == 0 && shared < loaded;
+  std::printf("threads   %8.3f ms, %d threads\n", parallel, threads);
+  std::printf("result    %s\n", ok ? "ok" : "WRONG");
+  return ok ? 0 : 1;
+}
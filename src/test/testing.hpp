@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "class.hpp"
+#include "heap.hpp"
+#include "log.hpp"
+#include "value.hpp"
+
+// Scaffolding the tests share: checks printed one per line with a verdict
+// at the end, silencing the trace, and the plain class scripts allocate
+// their records from.
+
+namespace kestrel {
+
+// Checks that failed so far.
+inline int &failures() {
+  static int count = 0;
+  return count;
+}
+
+inline void check(const std::string &name, bool passed) {
+  std::printf("%-36s %s\n", name.c_str(), passed ? "ok" : "FAILED");
+  if (!passed) {
+    failures()++;
+  }
+}
+
+// Prints the verdict, `failed` if a check failed, and returns the exit
+// status of the test.
+inline int verdict(const char *failed = "FAILED") {
+  std::printf("result    %s\n", failures() == 0 ? "ok" : failed);
+  return failures() == 0 ? 0 : 1;
+}
+
+// Drops the log and what the compiler and the interpreter trace to cout
+// while it lives.
+class Quiet {
+public:
+  Quiet() : out_(std::cout.rdbuf(sink_.rdbuf())) {
+    static Writer quiet = [](std::string &) {};
+    setWriter(quiet);
+  }
+  ~Quiet() { std::cout.rdbuf(out_); }
+
+private:
+  std::ostringstream sink_;
+  std::streambuf *out_;
+};
+
+// `Record()` of the scripts: a plain object on the current heap.
+inline Class *recordClass() {
+  static Class *record = [] {
+    Class *cls = new Class();
+    cls->setPlain(true);
+    cls->constructor([cls](Value &, MethodParameter &) {
+      Object *object = Heap::current().allocate();
+      object->setClass(cls);
+      return Value(object);
+    });
+    return cls;
+  }();
+  return record;
+}
+
+} // namespace kestrel
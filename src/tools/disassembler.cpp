@@ -0,0 +1,129 @@
+#include "tools/disassembler.hpp"
+
+#include <iomanip>
+#include <string>
+
+#include "feedback.hpp"
+#include "function.hpp"
+#include "opcodes.hpp"
+
+namespace kestrel {
+
+void Disassembler::run(Module& module_) {
+  module_.materialize();
+  run(module_, module_.initializer_);
+  for (auto& entry : module_.globals_) {
+    Value& value = entry.second;
+    if (value.type() != ValueType::Function) {
+      continue;
+    }
+    Function& function = *value.functionValue();
+    if (function.type() != FunctionType::Native) {
+      continue;
+    }
+    run(module_, function);
+
+    if (Function* optimized = function.optimized().get()) {
+      out << function.name() << ": eliminated "
+          << function.eliminatedAllocations() << " allocation(s)" << std::endl;
+      run(module_, *optimized);
+    }
+
+    SpecializationTable& table = function.specializations();
+    if (table.genericCalls() + table.specializedCalls() > 0) {
+      out << table.report(function.name()) << std::endl;
+    }
+    for (Specialization& s : table.clones()) {
+      run(module_, *s.function);
+    }
+  }
+}
+
+void Disassembler::run(Module& module_, Function& function) {
+  InstructionArray& instructions = function.instructions();
+  FeedbackVector& feedback = function.feedback();
+
+  std::string name = function.name().empty() ? "<init>" : function.name();
+  if (!function.isCompiled()) {
+    out << "== " << name << " arity:" << function.arity() << " not compiled"
+        << std::endl;
+    return;
+  }
+  out << "== " << name << " arity:" << function.arity()
+      << " slots:" << function.maxSlots()
+      << " size:" << instructions.size();
+  if (function.compiledSize() > 0) {
+    out << " (compiled " << function.compiledSize() << ")";
+  }
+  out << " feedback:" << feedback.size() << std::endl;
+
+  BytecodeView view = instructions.view();
+  int pc = 0;
+  int size = (int)instructions.size();
+  while (pc < size) {
+    DecodedInstruction decoded = decodeAt(view, pc);
+    Opcode code = decoded.opcode;
+    // wide operands show as LoadConstant.16, short forms as LoadLocal 0;
+    std::string mnemonic = toString(code);
+    if (decoded.width > 1) {
+      mnemonic += "." + std::to_string(decoded.width * 8);
+    }
+    out << std::setw(6) << pc << "  " << std::left << std::setw(18)
+        << mnemonic << std::right;
+
+    const int *operands = decoded.operands;
+    switch (code) {
+    case Opcode::Branch:
+    case Opcode::BranchTrue:
+    case Opcode::BranchFalse:
+    case Opcode::BranchIfLess:
+    case Opcode::BranchIfNotLess:
+    case Opcode::BranchIfGreater:
+    case Opcode::BranchIfNotGreater:
+    case Opcode::BranchIfEqual:
+    case Opcode::BranchIfNotEqual: {
+      int offset = operands[0];
+      out << offset << " -> " << pc + decoded.length + offset;
+      break;
+    }
+    case Opcode::LoadConstant: {
+      int index = operands[0];
+      out << index << " (" << module_.getConstant(index) << ")";
+      break;
+    }
+    case Opcode::LoadName:
+    case Opcode::LoadGlobal:
+    case Opcode::GetItem:
+    case Opcode::SetItem:
+    case Opcode::Import: {
+      int index = operands[0];
+      out << index << " (" << module_.getName(index) << ")";
+      break;
+    }
+    case Opcode::Dispatch: {
+      out << module_.getName(operands[0]) << " " << operands[1];
+      break;
+    }
+    case Opcode::CheckCallee: {
+      int index = operands[1];
+      out << operands[0] << " " << index << " ("
+          << module_.getConstant(index) << ")";
+      break;
+    }
+    default: {
+      if (operandCount(code) == 1) {
+        out << operands[0];
+      }
+      break;
+    }
+    }
+
+    if (FeedbackSlot* slot = feedback.slotAt(pc)) {
+      out << "    ; " << slot->toString();
+    }
+    out << std::endl;
+    pc += decoded.length;
+  }
+}
+
+} // namespace kestrel
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <ostream>
 #include <string>
 #include "module.hpp"
 
@@ -7,7 +8,16 @@ namespace kestrel {
 
 class Disassembler {
 public:
+    Disassembler(std::ostream& out) : out(out) {}
+
+    // Dumps the initializer and every script function bound in the module
+    // globals, annotating each site with its collected type feedback.
     void run(Module& module_);
+
+    void run(Module& module_, Function& function);
+
+private:
+    std::ostream& out;
 };
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,26 @@
+# Runs SCRIPT through the test driver with OPTIONS (space separated) and
+# compares the values it prints with the file EXPECTED, one per line.
+#
+#   cmake -DDRIVER=... -DSCRIPT=... -DOPTIONS=... -DEXPECTED=... -P compare.cmake
+
+separate_arguments(OPTIONS)
+execute_process(
+  COMMAND ${DRIVER} ${SCRIPT} ${OPTIONS}
+  OUTPUT_VARIABLE output
+  ERROR_VARIABLE output
+  RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "${SCRIPT} exited with ${result}:\n${output}")
+endif()
+
+string(REGEX MATCHALL "(^|\n)printing : [^\n]*" printed "${output}")
+set(got "")
+foreach(line IN LISTS printed)
+  string(REGEX REPLACE "^\n" "" line "${line}")
+  string(APPEND got "${line}\n")
+endforeach()
+
+file(READ ${EXPECTED} expected)
+if(NOT got STREQUAL expected)
+  message(FATAL_ERROR "${SCRIPT} printed\n${got}expected\n${expected}")
+endif()